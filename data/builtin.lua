@@ -424,7 +424,10 @@ end
 
 function make_registration()
 	local t = {}
-	local registerfunc = function(func) table.insert(t, func) end
+	local registerfunc = function(func)
+		table.insert(t, func)
+		minetest.callback_origins[func] = minetest.get_current_modname()
+	end
 	return t, registerfunc
 end
 
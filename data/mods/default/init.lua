@@ -113,9 +113,15 @@
 -- minetest.chat_send_player(name, text)
 -- minetest.get_player_privs(name) -> set of privs
 -- minetest.get_inventory(location) -> InvRef
+-- minetest.get_current_modname() -> name of the mod being loaded or nil
 -- minetest.get_modpath(modname) -> eg. "/home/user/.minetest/usermods/modname"
 -- ^ location = eg. {type="player", name="celeron55"}
 --                  {type="node", pos={x=, y=, z=}}
+-- minetest.get_content_id(name) -> integer
+-- ^ Content ids are valid after the node has been registered and stay the
+--   same until the server is restarted. Comparing them is faster than
+--   comparing names.
+-- minetest.get_name_from_content_id(content id) -> name
 --
 -- stackstring_take_item(stackstring) -> stackstring, item
 -- stackstring_put_item(stackstring, item) -> stackstring, success
@@ -147,11 +153,19 @@
 -- EnvRef is basically ServerEnvironment and ServerMap combined.
 -- EnvRef methods:
 -- - add_node(pos, node)
+-- - set_nodes({{pos=pos, node=node}, ...}) -> number of nodes set
+--   ^ Like add_node for many nodes, but lighting is updated and clients
+--     are sent the changed blocks once for all of them
+--   ^ Nodes in unloaded areas are skipped
 -- - remove_node(pos)
 -- - get_node(pos)
 --   ^ Returns {name="ignore", ...} for unloaded area
 -- - get_node_or_nil(pos)
 --   ^ Returns nil for unloaded area
+-- - get_node_raw(x, y, z) -> content id, param1, param2
+--   ^ Like get_node, without tables or names
+-- - set_node_raw(x, y, z, content id, param1, param2)
+--   ^ Like add_node, without tables or names
 -- - get_node_light(pos, timeofday) -> 0...15 or nil
 --   ^ timeofday: nil = current time, 0 = night, 0.5 = day
 -- - add_entity(pos, name): Returns ObjectRef or nil if failed
@@ -161,6 +175,24 @@
 -- - get_meta(pos) -- Get a NodeMetaRef at that position
 -- - get_player_by_name(name) -- Get an ObjectRef to a player
 -- - get_objects_inside_radius(pos, radius)
+-- - get_voxel_manip() -> VoxelManip
+--
+-- VoxelManip: bulk access to an area of the map
+-- - read_from_map(p1, p2) -> minp, maxp
+--   ^ Reads the loaded MapBlocks containing p1...p2 (at most 512 blocks)
+--   ^ minp, maxp = the area that was read, extended to whole MapBlocks
+-- - get_emerged_area() -> minp, maxp
+-- - get_data() -> {content id, ...}
+--   ^ Index of (x,y,z) is 1 + (z-minp.z)*ny*nx + (y-minp.y)*nx + (x-minp.x)
+--     where nx, ny = maxp.x-minp.x+1, maxp.y-minp.y+1
+--   ^ Unloaded nodes read as the content id of "ignore"
+-- - set_data({content id, ...})
+--   ^ Unloaded nodes and non-numbers are left as they are
+-- - get_param2_data() -> {param2, ...}
+-- - set_param2_data({param2, ...})
+-- - write_to_map(): Writes the data back to the map, updates lighting
+--   once and sends the changed MapBlocks to clients
+--   ^ Node metadata is not touched
 --
 -- NodeMetaRef (this stuff is subject to change in a future version)
 -- - get_type()
@@ -247,6 +279,10 @@
 -- - Callbacks:
 --   - on_activate(self, staticdata)
 --   - on_step(self, dtime)
+--     ^ Entities without on_step are not stepped while they rest; setting
+--       their position, velocity, acceleration or yaw, punching them and
+--       changing the nodes around them wakes them up. on_step is looked
+--       up when the entity is activated.
 --   - on_punch(self, hitter)
 --   - on_rightclick(self, clicker)
 --   - get_staticdata(self)
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define ACTIVEOBJECT_HEADER
 
 #include "irrlichttypes.h"
+#include "debug.h"
 #include <string>
 
 #define ACTIVEOBJECT_TYPE_INVALID 0
@@ -31,12 +32,16 @@ struct ActiveObjectMessage
 	ActiveObjectMessage(u16 id_, bool reliable_=true, std::string data_=""):
 		id(id_),
 		reliable(reliable_),
-		datastring(data_)
+		datastring(data_),
+		generation(0)
 	{}
 
 	u16 id;
 	bool reliable;
 	std::string datastring;
+	// Generation of the id when the message was queued, set by
+	// ServerEnvironment
+	u16 generation;
 };
 
 /*
@@ -66,5 +71,164 @@ class ActiveObject
 	u16 m_id; // 0 is invalid, "no id"
 };
 
+/*
+	Container of active objects by id.
+
+	The objects are kept in a dense array that can be iterated by index
+	with getAt(), and each id has a slot that tells where its object is
+	in it. Removing an object moves the last one in its place, so the
+	order of iteration changes; indexes are only stable while nothing is
+	removed. Objects inserted while iterating are appended to the end.
+
+	Removed ids are reused in the order they were freed. Each slot has
+	a generation that is incremented when its object is removed, so that
+	something holding an id over a longer time can check with the
+	generation whether it still refers to the same object.
+*/
+template<typename T>
+class ActiveObjectMap
+{
+public:
+	ActiveObjectMap():
+		m_next_unused_id(1)
+	{
+		// Id 0 is invalid
+		m_slots.push_back(Slot());
+	}
+
+	u32 size()
+	{
+		return m_objects.size();
+	}
+
+	T * getAt(u32 i)
+	{
+		return m_objects[i].object;
+	}
+
+	u16 getIdAt(u32 i)
+	{
+		return m_objects[i].id;
+	}
+
+	T * get(u16 id)
+	{
+		if(id >= m_slots.size())
+			return NULL;
+		return m_slots[id].object;
+	}
+
+	// Returns NULL if the object of the id has been removed since
+	// the generation was got
+	T * get(u16 id, u16 generation)
+	{
+		if(getGeneration(id) != generation)
+			return NULL;
+		return get(id);
+	}
+
+	u16 getGeneration(u16 id)
+	{
+		if(id >= m_slots.size())
+			return 0;
+		return m_slots[id].generation;
+	}
+
+	bool isFree(u16 id)
+	{
+		if(id == 0)
+			return false;
+		return (get(id) == NULL);
+	}
+
+	/*
+		Returns a free id or 0 if there are none. The id is not
+		reserved; insert() has to be called before getting another one.
+	*/
+	u16 getFreeId()
+	{
+		// Reuse removed ids first to keep the slots dense
+		while(m_free_ids.size() > 0)
+		{
+			core::list<u16>::Iterator i = m_free_ids.begin();
+			u16 id = *i;
+			m_free_ids.erase(i);
+			// It might have been inserted with a supplied id
+			if(isFree(id))
+				return id;
+		}
+		while(m_next_unused_id != 0)
+		{
+			u16 id = m_next_unused_id;
+			// Wraps to 0 after 65535
+			m_next_unused_id++;
+			if(isFree(id))
+				return id;
+		}
+		return 0;
+	}
+
+	// Returns false if the id is not free
+	bool insert(u16 id, T *object)
+	{
+		assert(object);
+		if(isFree(id) == false)
+			return false;
+		while(id >= m_slots.size())
+			m_slots.push_back(Slot());
+		Slot &slot = m_slots[id];
+		slot.object = object;
+		slot.index = m_objects.size();
+		Entry e;
+		e.id = id;
+		e.object = object;
+		m_objects.push_back(e);
+		return true;
+	}
+
+	void remove(u16 id)
+	{
+		if(isFree(id))
+			return;
+		Slot &slot = m_slots[id];
+		// Move the last object in place of the removed one
+		u32 last = m_objects.size() - 1;
+		if(slot.index != last)
+		{
+			m_objects[slot.index] = m_objects[last];
+			m_slots[m_objects[slot.index].id].index = slot.index;
+		}
+		m_objects.erase(last);
+		slot.object = NULL;
+		slot.generation++;
+		m_free_ids.push_back(id);
+	}
+
+private:
+	struct Slot
+	{
+		Slot():
+			object(NULL),
+			generation(0),
+			index(0)
+		{}
+		T *object;
+		u16 generation;
+		// Index in m_objects
+		u32 index;
+	};
+	struct Entry
+	{
+		u16 id;
+		T *object;
+	};
+
+	core::array<Slot> m_slots;
+	core::array<Entry> m_objects;
+	core::list<u16> m_free_ids;
+	// Next id that has never been handed out; 0 when all have been
+	u16 m_next_unused_id;
+};
+
 #endif
 
@@ -0,0 +1,348 @@
+/*
+Minetest-c55
+Copyright (C) 2010 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark.h"
+#include "test.h"
+#include "debug.h"
+#include "map.h"
+#include "main.h"
+#include "utility.h"
+#include "serialization.h"
+#include <sstream>
+#include "porting.h"
+#include "content_mapnode.h"
+#include "nodedef.h"
+#include "mapsector.h"
+#include "mapblock.h"
+#include "settings.h"
+#include "log.h"
+#include "script.h"
+#include "scriptapi.h"
+#include "serverobject.h"
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+#ifndef SERVER
+#include "gamedef.h"
+#include "tile.h"
+#endif
+
+/*
+	Compares the block compression codecs on the node data of all
+	blocks in a map.sqlite
+*/
+void run_compression_benchmark(const std::string &dbpath)
+{
+	sqlite3 *db = NULL;
+	if(sqlite3_open_v2(dbpath.c_str(), &db, SQLITE_OPEN_READONLY, NULL)
+			!= SQLITE_OK)
+	{
+		errorstream<<"Could not open "<<dbpath<<std::endl;
+		sqlite3_close(db);
+		return;
+	}
+	sqlite3_stmt *stmt = NULL;
+	if(sqlite3_prepare(db, "SELECT `data` FROM `blocks`", -1, &stmt, NULL)
+			!= SQLITE_OK)
+	{
+		errorstream<<"Could not read blocks: "<<sqlite3_errmsg(db)<<std::endl;
+		sqlite3_close(db);
+		return;
+	}
+
+	/*
+		Collect the uncompressed node data of each block
+	*/
+	core::list<SharedBuffer<u8> > payloads;
+	u64 total = 0;
+	while(sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		const char *data = (const char*)sqlite3_column_blob(stmt, 0);
+		int len = sqlite3_column_bytes(stmt, 0);
+		if(len < 2)
+			continue;
+		u8 version = data[0];
+		// Only versions with a flags byte followed by node data
+		if(!ser_ver_supported(version) || version < 11)
+			continue;
+		try{
+			std::istringstream is(std::string(data + 2, len - 2),
+					std::ios_base::binary);
+			std::ostringstream os(std::ios_base::binary);
+			decompress(is, os, version);
+			std::string s = os.str();
+			payloads.push_back(SharedBuffer<u8>((u8*)s.c_str(), s.size()));
+			total += s.size();
+		}
+		catch(SerializationError &e)
+		{
+			continue;
+		}
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+
+	dstream<<"Compression benchmark: "<<payloads.size()<<" blocks, "
+			<<total<<" bytes of node data"<<std::endl;
+	if(total == 0)
+		return;
+
+	struct Codec{
+		const char *name;
+		CompressionCodec codec;
+		int level;
+	};
+	Codec codecs[] = {
+		{"zlib -1", COMPRESSION_ZLIB, -1},
+		{"zlib 1", COMPRESSION_ZLIB, 1},
+		{"zlib 9", COMPRESSION_ZLIB, 9},
+		{"lz", COMPRESSION_LZ, -1},
+		{"none", COMPRESSION_NONE, -1},
+	};
+	for(u32 c=0; c<sizeof(codecs)/sizeof(codecs[0]); c++)
+	{
+		setCompressionParams(codecs[c].codec, codecs[c].level);
+
+		core::list<std::string> compressed;
+		u64 compressed_total = 0;
+		u32 t0 = porting::getTimeMs();
+		for(core::list<SharedBuffer<u8> >::Iterator
+				i = payloads.begin(); i != payloads.end(); i++)
+		{
+			std::ostringstream os(std::ios_base::binary);
+			compress(*i, os, SER_FMT_VER_HIGHEST);
+			compressed.push_back(os.str());
+			compressed_total += os.str().size();
+		}
+		u32 t1 = porting::getTimeMs();
+		for(core::list<std::string>::Iterator
+				i = compressed.begin(); i != compressed.end(); i++)
+		{
+			std::istringstream is(*i, std::ios_base::binary);
+			std::ostringstream os(std::ios_base::binary);
+			decompress(is, os, SER_FMT_VER_HIGHEST);
+		}
+		u32 t2 = porting::getTimeMs();
+
+		float mb = (float)total / 1000000.0;
+		dstream<<codecs[c].name<<": ratio "
+				<<((float)total / compressed_total)
+				<<", compress "<<(mb * 1000.0 / MYMAX(t1 - t0, 1))<<" MB/s"
+				<<", decompress "<<(mb * 1000.0 / MYMAX(t2 - t1, 1))<<" MB/s"
+				<<std::endl;
+	}
+	setCompressionParams(COMPRESSION_ZLIB, -1);
+}
+
+/*
+	Stands in for a LuaEntitySAO; the script only needs its id
+*/
+class BenchmarkObject : public ServerActiveObject
+{
+public:
+	BenchmarkObject(u16 id):
+		ServerActiveObject(NULL, v3f(0,0,0))
+	{
+		setId(id);
+	}
+	u8 getType() const
+	{ return ACTIVEOBJECT_TYPE_INVALID; }
+};
+
+/*
+	Adds Lua entities with an on_step callback to a scripting state
+	without a server and steps all of them like the environment does
+*/
+void run_luaentity_benchmark(u32 count)
+{
+	const u32 steps = 100;
+	const char *mod =
+		"minetest.register_entity(\":benchmark:entity\", {\n"
+		"	timer = 0,\n"
+		"	on_step = function(self, dtime)\n"
+		"		self.timer = self.timer + dtime\n"
+		"	end,\n"
+		"})\n";
+
+	if(count == 0 || count >= 65535)
+	{
+		errorstream<<"Entity count must be 1...65534"<<std::endl;
+		return;
+	}
+
+	lua_State *L = script_init();
+	if(L == NULL)
+	{
+		errorstream<<"Could not create a Lua state"<<std::endl;
+		return;
+	}
+	scriptapi_export(L, NULL);
+	if(luaL_dostring(L, mod))
+	{
+		errorstream<<"Could not register the entity: "
+				<<lua_tostring(L, -1)<<std::endl;
+		script_deinit(L);
+		return;
+	}
+
+	core::array<BenchmarkObject*> objects;
+	for(u32 i=0; i<count; i++)
+	{
+		BenchmarkObject *obj = new BenchmarkObject(i + 1);
+		scriptapi_add_object_reference(L, obj);
+		scriptapi_luaentity_add(L, obj->getId(), "benchmark:entity", "");
+		objects.push_back(obj);
+	}
+
+	u32 t0 = porting::getTimeMs();
+	for(u32 step=0; step<steps; step++)
+	{
+		for(u32 i=0; i<objects.size(); i++)
+			scriptapi_luaentity_step(L, objects[i]->getId(), 0.05);
+	}
+	u32 t1 = porting::getTimeMs();
+
+	float ms = (float)MYMAX(t1 - t0, 1) / steps;
+	dstream<<"Lua entity benchmark: "<<count<<" entities, "
+			<<ms<<" ms per step, "
+			<<(ms * 1000.0 / count)<<" us per entity"<<std::endl;
+
+	for(u32 i=0; i<objects.size(); i++)
+	{
+		scriptapi_luaentity_rm(L, objects[i]->getId());
+		scriptapi_rm_object_reference(L, objects[i]);
+		delete objects[i];
+	}
+	script_deinit(L);
+}
+
+#ifndef SERVER
+
+/*
+	Makes the meshes of all blocks in a map.sqlite with and without
+	greedy meshing
+*/
+static void meshgen_benchmark(IGameDef *gamedef, const std::string &dbpath)
+{
+	sqlite3 *db = NULL;
+	if(sqlite3_open_v2(dbpath.c_str(), &db, SQLITE_OPEN_READONLY, NULL)
+			!= SQLITE_OK)
+	{
+		errorstream<<"Could not open "<<dbpath<<std::endl;
+		sqlite3_close(db);
+		return;
+	}
+	sqlite3_stmt *stmt = NULL;
+	if(sqlite3_prepare(db, "SELECT `pos`, `data` FROM `blocks`", -1, &stmt,
+			NULL) != SQLITE_OK)
+	{
+		errorstream<<"Could not read blocks: "<<sqlite3_errmsg(db)<<std::endl;
+		sqlite3_close(db);
+		return;
+	}
+
+	/*
+		Load all blocks. The map holds them so that meshes see their
+		neighbors, and deletes them when this returns.
+	*/
+	TestMap map(gamedef);
+	core::list<MapBlock*> blocks;
+	while(sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		v3s16 p = ServerMap::getIntegerAsBlock(sqlite3_column_int64(stmt, 0));
+		const char *data = (const char*)sqlite3_column_blob(stmt, 1);
+		int len = sqlite3_column_bytes(stmt, 1);
+		if(len < 1)
+			continue;
+		std::istringstream is(std::string(data, len), std::ios_base::binary);
+		u8 version = SER_FMT_VER_INVALID;
+		is.read((char*)&version, 1);
+		MapBlock *block = new MapBlock(&map, p, gamedef);
+		try{
+			block->deSerialize(is, version);
+			block->deSerializeDiskExtra(is, version);
+		}
+		catch(SerializationError &e)
+		{
+			delete block;
+			continue;
+		}
+		map.insertBlock(block);
+		blocks.push_back(block);
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+
+	dstream<<"Meshgen benchmark: "<<blocks.size()<<" blocks"<<std::endl;
+	if(blocks.size() == 0)
+		return;
+
+	bool greedy_was = g_settings->getBool("greedy_meshing");
+	for(u32 greedy=0; greedy<2; greedy++)
+	{
+		g_settings->setBool("greedy_meshing", greedy != 0);
+
+		u64 vertices = 0;
+		u64 buffers = 0;
+		u32 meshes = 0;
+		u32 t0 = porting::getTimeMs();
+		for(core::list<MapBlock*>::Iterator
+				i = blocks.begin(); i != blocks.end(); i++)
+		{
+			MeshMakeData data;
+			data.fill(1000, *i);
+			MapBlockMesh *mesh = makeMapBlockMesh(&data, gamedef);
+			if(mesh == NULL)
+				continue;
+			meshes++;
+			for(u32 j=0; j<mesh->getMeshBufferCount(); j++)
+				vertices += mesh->getMeshBuffer(j)->getVertexCount();
+			buffers += mesh->getMeshBufferCount();
+			mesh->drop();
+		}
+		u32 t1 = porting::getTimeMs();
+
+		dstream<<(greedy ? "greedy" : "rows")<<": "
+				<<meshes<<" meshes, "
+				<<((float)vertices / blocks.size())<<" vertices/block, "
+				<<((float)buffers / blocks.size())<<" meshbuffers/block, "
+				<<((float)(t1 - t0) / blocks.size())<<" ms/block"
+				<<std::endl;
+	}
+	g_settings->setBool("greedy_meshing", greedy_was);
+}
+
+void run_meshgen_benchmark(IrrlichtDevice *device, const std::string &dbpath)
+{
+	IWritableTextureSource *tsrc = createTextureSource(device);
+	IWritableNodeDefManager *ndef = createNodeDefManager();
+	content_mapnode_init(ndef);
+	TestGameDef gamedef(ndef, tsrc);
+	if(g_settings->getBool("enable_texture_atlas"))
+		tsrc->buildMainAtlas(&gamedef);
+	ndef->updateTextures(tsrc);
+
+	meshgen_benchmark(&gamedef, dbpath);
+
+	delete ndef;
+	delete tsrc;
+}
+
+#endif
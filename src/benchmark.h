@@ -0,0 +1,43 @@
+/*
+Minetest-c55
+Copyright (C) 2010 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BENCHMARK_HEADER
+#define BENCHMARK_HEADER
+
+#include "common_irrlicht.h"
+#include <string>
+
+/*
+	Benchmarks run from the command line on an existing map
+*/
+
+// Prints the ratio and speed of each codec on the blocks of a map.sqlite
+void run_compression_benchmark(const std::string &dbpath);
+
+// Prints the time taken by stepping a number of Lua entities
+void run_luaentity_benchmark(u32 count);
+
+#ifndef SERVER
+// Prints the vertex count and making time of the meshes of the blocks
+// of a map.sqlite, with and without greedy meshing
+void run_meshgen_benchmark(IrrlichtDevice *device, const std::string &dbpath);
+#endif
+
+#endif
+
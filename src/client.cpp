@@ -44,6 +44,11 @@ static std::string getTextureCacheDir()
 	return porting::path_userdata + DIR_DELIM + "cache" + DIR_DELIM + "texture";
 }
 
+static std::string getAtlasCacheDir()
+{
+	return porting::path_userdata + DIR_DELIM + "cache" + DIR_DELIM + "atlas";
+}
+
 struct TextureRequest
 {
 	std::string name;
@@ -60,7 +65,10 @@ struct TextureRequest
 QueuedMeshUpdate::QueuedMeshUpdate():
 	p(-1337,-1337,-1337),
 	data(NULL),
-	ack_block_to_server(false)
+	ack_block_to_server(false),
+	priority(0),
+	heap_index(0),
+	next_in_bucket(NULL)
 {
 }
 
@@ -74,21 +82,23 @@ QueuedMeshUpdate::~QueuedMeshUpdate()
 	MeshUpdateQueue
 */
 	
-MeshUpdateQueue::MeshUpdateQueue()
+MeshUpdateQueue::MeshUpdateQueue():
+	m_camera_pos(0,0,0),
+	m_camera_dir(0,0,1),
+	m_priority_camera_pos(0,0,0),
+	m_priority_camera_dir(0,0,1)
 {
 	m_mutex.Init();
+	for(u32 i=0; i<BUCKET_COUNT; i++)
+		m_buckets[i] = NULL;
 }
 
 MeshUpdateQueue::~MeshUpdateQueue()
 {
 	JMutexAutoLock lock(m_mutex);
 
-	core::list<QueuedMeshUpdate*>::Iterator i;
-	for(i=m_queue.begin(); i!=m_queue.end(); i++)
-	{
-		QueuedMeshUpdate *q = *i;
-		delete q;
-	}
+	for(u32 i=0; i<m_heap.size(); i++)
+		delete m_heap[i];
 }
 
 /*
@@ -106,45 +116,220 @@ void MeshUpdateQueue::addBlock(v3s16 p, MeshMakeData *data, bool ack_block_to_se
 		Find if block is already in queue.
 		If it is, update the data and quit.
 	*/
-	core::list<QueuedMeshUpdate*>::Iterator i;
-	for(i=m_queue.begin(); i!=m_queue.end(); i++)
+	QueuedMeshUpdate *q = findQueued(p);
+	if(q != NULL)
 	{
-		QueuedMeshUpdate *q = *i;
-		if(q->p == p)
-		{
-			if(q->data)
-				delete q->data;
-			q->data = data;
-			if(ack_block_to_server)
-				q->ack_block_to_server = true;
-			return;
-		}
+		if(q->data)
+			delete q->data;
+		q->data = data;
+		if(ack_block_to_server)
+			q->ack_block_to_server = true;
+		return;
 	}
 	
 	/*
 		Add the block
 	*/
-	QueuedMeshUpdate *q = new QueuedMeshUpdate;
+	q = new QueuedMeshUpdate;
 	q->p = p;
 	q->data = data;
 	q->ack_block_to_server = ack_block_to_server;
-	m_queue.push_back(q);
+	q->priority = getPriority(p);
+	heapPush(q);
+	u32 bucket = getBucket(p);
+	q->next_in_bucket = m_buckets[bucket];
+	m_buckets[bucket] = q;
 }
 
 // Returned pointer must be deleted
-// Returns NULL if queue is empty
+// Returns NULL if there is nothing that can be made now
 QueuedMeshUpdate * MeshUpdateQueue::pop()
 {
 	JMutexAutoLock lock(m_mutex);
 
-	core::list<QueuedMeshUpdate*>::Iterator i = m_queue.begin();
-	if(i == m_queue.end())
+	/*
+		Blocks being made by another thread are put aside; there are
+		at most as many of them as there are threads.
+	*/
+	core::list<QueuedMeshUpdate*> skipped;
+	QueuedMeshUpdate *q = NULL;
+	while(q == NULL && m_heap.size() > 0)
+	{
+		QueuedMeshUpdate *top = heapPopTop();
+		bool in_progress = false;
+		for(core::list<v3s16>::Iterator i = m_in_progress.begin();
+				i != m_in_progress.end(); i++)
+		{
+			if(*i == top->p)
+			{
+				in_progress = true;
+				break;
+			}
+		}
+		if(in_progress)
+			skipped.push_back(top);
+		else
+			q = top;
+	}
+	for(core::list<QueuedMeshUpdate*>::Iterator i = skipped.begin();
+			i != skipped.end(); i++)
+		heapPush(*i);
+
+	if(q == NULL)
 		return NULL;
-	QueuedMeshUpdate *q = *i;
-	m_queue.erase(i);
+	indexRemove(q);
+	m_in_progress.push_back(q->p);
 	return q;
 }
 
+void MeshUpdateQueue::done(v3s16 p)
+{
+	JMutexAutoLock lock(m_mutex);
+
+	for(core::list<v3s16>::Iterator i = m_in_progress.begin();
+			i != m_in_progress.end(); i++)
+	{
+		if(*i == p)
+		{
+			m_in_progress.erase(i);
+			return;
+		}
+	}
+}
+
+void MeshUpdateQueue::setCamera(v3f pos, v3f dir)
+{
+	JMutexAutoLock lock(m_mutex);
+	m_camera_pos = pos;
+	m_camera_dir = dir;
+
+	/*
+		The priorities are computed when a task is added. Recompute
+		them all only when the camera has moved or turned enough to
+		change the order noticeably.
+	*/
+	if(pos.getDistanceFrom(m_priority_camera_pos) < BS*MAP_BLOCKSIZE/2
+			&& dir.dotProduct(m_priority_camera_dir) > 0.95)
+		return;
+	m_priority_camera_pos = pos;
+	m_priority_camera_dir = dir;
+
+	for(u32 i=0; i<m_heap.size(); i++)
+		m_heap[i]->priority = getPriority(m_heap[i]->p);
+	for(u32 i=m_heap.size()/2; i>0; i--)
+		heapDown(i-1);
+}
+
+f32 MeshUpdateQueue::getPriority(v3s16 p)
+{
+	v3f center = intToFloat(p * MAP_BLOCKSIZE
+			+ v3s16(MAP_BLOCKSIZE/2, MAP_BLOCKSIZE/2, MAP_BLOCKSIZE/2), BS);
+	v3f d = center - m_camera_pos;
+	f32 distance = d.getLength();
+	if(distance < 0.001)
+		return 0;
+	// 1.0 straight ahead, 2.0 straight behind
+	f32 cosangle = d.dotProduct(m_camera_dir) / distance;
+	return distance * (1.5 - 0.5 * cosangle);
+}
+
+void MeshUpdateQueue::heapPush(QueuedMeshUpdate *q)
+{
+	q->heap_index = m_heap.size();
+	m_heap.push_back(q);
+	heapUp(q->heap_index);
+}
+
+QueuedMeshUpdate * MeshUpdateQueue::heapPopTop()
+{
+	QueuedMeshUpdate *q = m_heap[0];
+	u32 last = m_heap.size() - 1;
+	if(last > 0)
+	{
+		m_heap[0] = m_heap[last];
+		m_heap[0]->heap_index = 0;
+	}
+	m_heap.erase(last);
+	if(m_heap.size() > 0)
+		heapDown(0);
+	return q;
+}
+
+void MeshUpdateQueue::heapUp(u32 i)
+{
+	while(i > 0)
+	{
+		u32 parent = (i - 1) / 2;
+		if(m_heap[parent]->priority <= m_heap[i]->priority)
+			break;
+		heapSwap(i, parent);
+		i = parent;
+	}
+}
+
+void MeshUpdateQueue::heapDown(u32 i)
+{
+	u32 size = m_heap.size();
+	for(;;)
+	{
+		u32 smallest = i;
+		u32 left = 2 * i + 1;
+		u32 right = left + 1;
+		if(left < size && m_heap[left]->priority
+				< m_heap[smallest]->priority)
+			smallest = left;
+		if(right < size && m_heap[right]->priority
+				< m_heap[smallest]->priority)
+			smallest = right;
+		if(smallest == i)
+			break;
+		heapSwap(i, smallest);
+		i = smallest;
+	}
+}
+
+void MeshUpdateQueue::heapSwap(u32 a, u32 b)
+{
+	QueuedMeshUpdate *tmp = m_heap[a];
+	m_heap[a] = m_heap[b];
+	m_heap[b] = tmp;
+	m_heap[a]->heap_index = a;
+	m_heap[b]->heap_index = b;
+}
+
+u32 MeshUpdateQueue::getBucket(v3s16 p)
+{
+	u32 h = (u32)p.X * 73856093 ^ (u32)p.Y * 19349663
+			^ (u32)p.Z * 83492791;
+	return h & (BUCKET_COUNT - 1);
+}
+
+QueuedMeshUpdate * MeshUpdateQueue::findQueued(v3s16 p)
+{
+	for(QueuedMeshUpdate *q = m_buckets[getBucket(p)];
+			q != NULL; q = q->next_in_bucket)
+	{
+		if(q->p == p)
+			return q;
+	}
+	return NULL;
+}
+
+void MeshUpdateQueue::indexRemove(QueuedMeshUpdate *q)
+{
+	QueuedMeshUpdate **pp = &m_buckets[getBucket(q->p)];
+	while(*pp != NULL)
+	{
+		if(*pp == q)
+		{
+			*pp = q->next_in_bucket;
+			q->next_in_bucket = NULL;
+			return;
+		}
+		pp = &(*pp)->next_in_bucket;
+	}
+}
+
 /*
 	MeshUpdateThread
 */
@@ -161,16 +346,7 @@ void * MeshUpdateThread::Thread()
 
 	while(getRun())
 	{
-		/*// Wait for output queue to flush.
-		// Allow 2 in queue, this makes less frametime jitter.
-		// Umm actually, there is no much difference
-		if(m_queue_out.size() >= 2)
-		{
-			sleep_ms(3);
-			continue;
-		}*/
-
-		QueuedMeshUpdate *q = m_queue_in.pop();
+		QueuedMeshUpdate *q = m_queue_in->pop();
 		if(q == NULL)
 		{
 			sleep_ms(3);
@@ -179,19 +355,29 @@ void * MeshUpdateThread::Thread()
 
 		ScopeProfiler sp(g_profiler, "Client: Mesh making");
 
-		scene::SMesh *mesh_new = NULL;
+		MapBlockMesh *mesh_new = NULL;
 		mesh_new = makeMapBlockMesh(q->data, m_gamedef);
 
 		MeshUpdateResult r;
 		r.p = q->p;
 		r.mesh = mesh_new;
+		const MapBlockSnapshot *snapshot = q->data->getSnapshot();
+		if(snapshot != NULL)
+		{
+			r.connectivity = getFaceConnectivity(snapshot, m_gamedef->ndef());
+			r.far_surface = getFarBlockSurface(snapshot, q->p,
+					m_gamedef->ndef());
+		}
 		r.ack_block_to_server = q->ack_block_to_server;
 
 		/*infostream<<"MeshUpdateThread: Processed "
 				<<"("<<q->p.X<<","<<q->p.Y<<","<<q->p.Z<<")"
 				<<std::endl;*/
 
-		m_queue_out.push_back(r);
+		m_queue_out->push_back(r);
+
+		// Now another thread may make the next mesh of the block
+		m_queue_in->done(q->p);
 
 		delete q;
 	}
@@ -201,6 +387,77 @@ void * MeshUpdateThread::Thread()
 	return NULL;
 }
 
+/*
+	MeshUpdateThreadPool
+*/
+
+MeshUpdateThreadPool::MeshUpdateThreadPool(IGameDef *gamedef):
+	m_gamedef(gamedef)
+{
+}
+
+MeshUpdateThreadPool::~MeshUpdateThreadPool()
+{
+	stop();
+	for(core::list<MeshUpdateThread*>::Iterator
+			i = m_threads.begin(); i != m_threads.end(); i++)
+		delete *i;
+}
+
+void MeshUpdateThreadPool::Start()
+{
+	if(m_threads.size() == 0)
+	{
+		s32 count = g_settings->getS32("mesh_update_threads");
+		if(count <= 0)
+		{
+			// Leave one processor for the main thread
+			count = porting::getNumberOfProcessors() - 1;
+			if(count < 1)
+				count = 1;
+		}
+		infostream<<"Starting "<<count<<" mesh update threads"<<std::endl;
+		for(s32 i=0; i<count; i++)
+			m_threads.push_back(new MeshUpdateThread(
+					&m_queue_in, &m_queue_out, m_gamedef));
+	}
+	for(core::list<MeshUpdateThread*>::Iterator
+			i = m_threads.begin(); i != m_threads.end(); i++)
+		(*i)->Start();
+}
+
+void MeshUpdateThreadPool::setRun(bool run)
+{
+	for(core::list<MeshUpdateThread*>::Iterator
+			i = m_threads.begin(); i != m_threads.end(); i++)
+		(*i)->setRun(run);
+}
+
+bool MeshUpdateThreadPool::IsRunning()
+{
+	for(core::list<MeshUpdateThread*>::Iterator
+			i = m_threads.begin(); i != m_threads.end(); i++)
+	{
+		if((*i)->IsRunning())
+			return true;
+	}
+	return false;
+}
+
+void MeshUpdateThreadPool::stop()
+{
+	setRun(false);
+	while(IsRunning())
+		sleep_ms(100);
+}
+
+bool MeshUpdateThreadPool::isQueueFull()
+{
+	// A few tasks per thread keeps them busy until the next frame
+	u32 limit = 4 * (m_threads.size() > 0 ? m_threads.size() : 1);
+	return m_queue_in.size() >= limit;
+}
+
 Client::Client(
 		IrrlichtDevice *device,
 		const char *playername,
@@ -215,7 +472,7 @@ Client::Client(
 	m_tooldef(tooldef),
 	m_nodedef(nodedef),
 	m_craftitemdef(craftitemdef),
-	m_mesh_update_thread(this),
+	m_mesh_update_pool(this),
 	m_env(
 		new ClientMap(this, this, control,
 			device->getSceneManager()->getRootSceneNode(),
@@ -255,7 +512,8 @@ Client::Client(
 	m_nodedef->updateTextures(m_tsrc);
 
 	// Start threads after setting up content definitions
-	m_mesh_update_thread.Start();
+	m_mesh_update_pool.Start();
+	m_occlusion_thread.Start();
 
 	/*
 		Add local player
@@ -279,9 +537,11 @@ Client::~Client()
 		m_con.Disconnect();
 	}
 
-	m_mesh_update_thread.setRun(false);
-	while(m_mesh_update_thread.IsRunning())
+	m_mesh_update_pool.setRun(false);
+	while(m_mesh_update_pool.IsRunning())
 		sleep_ms(100);
+
+	m_occlusion_thread.stop();
 }
 
 void Client::connect(Address address)
@@ -501,6 +761,14 @@ void Client::step(float dtime)
 		m_env.getMap().timerUpdate(map_timer_and_unload_dtime,
 				g_settings->getFloat("client_unload_unused_data_timeout"),
 				&deleted_blocks);
+
+		// The draw list can point to the deleted blocks
+		if(deleted_blocks.size() > 0)
+			m_env.getClientMap().invalidateDrawList();
+
+		for(core::list<v3s16>::Iterator i = deleted_blocks.begin();
+				i != deleted_blocks.end(); i++)
+			m_occlusion_thread.removeBlock(*i);
 				
 		/*if(deleted_blocks.size() > 0)
 			infostream<<"Client: Unloaded "<<deleted_blocks.size()
@@ -635,16 +903,19 @@ void Client::step(float dtime)
 		// 0ms
 		
 		/*infostream<<"Mesh update result queue size is "
-				<<m_mesh_update_thread.m_queue_out.size()
+				<<m_mesh_update_pool.m_queue_out.size()
 				<<std::endl;*/
 
-		while(m_mesh_update_thread.m_queue_out.size() > 0)
+		while(m_mesh_update_pool.m_queue_out.size() > 0)
 		{
-			MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_front();
+			MeshUpdateResult r = m_mesh_update_pool.m_queue_out.pop_front();
 			MapBlock *block = m_env.getMap().getBlockNoCreateNoEx(r.p);
 			if(block)
 			{
 				block->replaceMesh(r.mesh);
+				m_env.getClientMap().invalidateDrawList();
+				m_occlusion_thread.setBlock(r.p, r.connectivity);
+				m_far_surfaces.setBlock(r.p, r.far_surface);
 			}
 			if(r.ack_block_to_server)
 			{
@@ -1258,10 +1529,10 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 
 
 		// Stop threads while updating content definitions
-		m_mesh_update_thread.setRun(false);
+		m_mesh_update_pool.setRun(false);
 		// Process the remaining TextureSource queue to let MeshUpdateThread
 		// get it's remaining textures and thus let it stop
-		while(m_mesh_update_thread.IsRunning()){
+		while(m_mesh_update_pool.IsRunning()){
 			m_tsrc->processQueue();
 		}
 
@@ -1269,6 +1540,10 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 
 		core::list<TextureRequest> texture_requests;
 
+		// Digest of all the announced textures, used for caching the
+		// texture atlas
+		SHA1 announced_sha1;
+
 		for(int i=0; i<num_textures; i++){
 
 			bool texture_found = false;
@@ -1284,6 +1559,9 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 				continue;
 			}
 
+			std::string announced = name + " " + sha1_texture + "\n";
+			announced_sha1.addBytes(announced.c_str(), announced.size());
+
 			std::string tpath = getTextureCacheDir() + DIR_DELIM + name;
 			// Read data
 			std::ifstream fis(tpath.c_str(), std::ios_base::binary);
@@ -1362,9 +1640,20 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 			}
 
 		}
+
+		// Without announced textures the digest tells nothing about the
+		// textures, so the atlas is not cached
+		if(num_textures > 0)
+		{
+			unsigned char *digest = announced_sha1.getDigest();
+			m_tsrc->setAtlasCache(getAtlasCacheDir(),
+					base64_encode(digest, 20));
+			free(digest);
+		}
+
 		// Resume threads
-		m_mesh_update_thread.setRun(true);
-		m_mesh_update_thread.Start();
+		m_mesh_update_pool.setRun(true);
+		m_mesh_update_pool.Start();
 
 		ClientEvent event;
 		event.type = CE_TEXTURES_UPDATED;
@@ -1413,10 +1702,10 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		std::istringstream is(datastring, std::ios_base::binary);
 
 		// Stop threads while updating content definitions
-		m_mesh_update_thread.setRun(false);
+		m_mesh_update_pool.setRun(false);
 		// Process the remaining TextureSource queue to let MeshUpdateThread
 		// get it's remaining textures and thus let it stop
-		while(m_mesh_update_thread.IsRunning()){
+		while(m_mesh_update_pool.IsRunning()){
 			m_tsrc->processQueue();
 		}
 		
@@ -1498,8 +1787,8 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		}
 
 		// Resume threads
-		m_mesh_update_thread.setRun(true);
-		m_mesh_update_thread.Start();
+		m_mesh_update_pool.setRun(true);
+		m_mesh_update_pool.Start();
 
 		ClientEvent event;
 		event.type = CE_TEXTURES_UPDATED;
@@ -1516,10 +1805,10 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		m_tooldef_received = true;
 
 		// Stop threads while updating content definitions
-		m_mesh_update_thread.setRun(false);
+		m_mesh_update_pool.setRun(false);
 		// Process the remaining TextureSource queue to let MeshUpdateThread
 		// get it's remaining textures and thus let it stop
-		while(m_mesh_update_thread.IsRunning()){
+		while(m_mesh_update_pool.IsRunning()){
 			m_tsrc->processQueue();
 		}
 		
@@ -1527,8 +1816,8 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		m_tooldef->deSerialize(tmp_is);
 		
 		// Resume threads
-		m_mesh_update_thread.setRun(true);
-		m_mesh_update_thread.Start();
+		m_mesh_update_pool.setRun(true);
+		m_mesh_update_pool.Start();
 	}
 	else if(command == TOCLIENT_NODEDEF)
 	{
@@ -1541,7 +1830,7 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		m_nodedef_received = true;
 
 		// Stop threads while updating content definitions
-		m_mesh_update_thread.stop();
+		m_mesh_update_pool.stop();
 
 		std::istringstream tmp_is(deSerializeLongString(is), std::ios::binary);
 		m_nodedef->deSerialize(tmp_is, this);
@@ -1556,8 +1845,8 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		}
 
 		// Resume threads
-		m_mesh_update_thread.setRun(true);
-		m_mesh_update_thread.Start();
+		m_mesh_update_pool.setRun(true);
+		m_mesh_update_pool.Start();
 	}
 	else if(command == TOCLIENT_CRAFTITEMDEF)
 	{
@@ -1570,10 +1859,10 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		m_craftitemdef_received = true;
 
 		// Stop threads while updating content definitions
-		m_mesh_update_thread.setRun(false);
+		m_mesh_update_pool.setRun(false);
 		// Process the remaining TextureSource queue to let MeshUpdateThread
 		// get it's remaining textures and thus let it stop
-		while(m_mesh_update_thread.IsRunning()){
+		while(m_mesh_update_pool.IsRunning()){
 			m_tsrc->processQueue();
 		}
 		
@@ -1581,8 +1870,8 @@ void Client::ProcessData(u8 *data, u32 datasize, u16 sender_peer_id)
 		m_craftitemdef->deSerialize(tmp_is);
 		
 		// Resume threads
-		m_mesh_update_thread.setRun(true);
-		m_mesh_update_thread.Start();
+		m_mesh_update_pool.setRun(true);
+		m_mesh_update_pool.Start();
 	}
 	else
 	{
@@ -1907,6 +2196,7 @@ void Client::addNode(v3s16 p, MapNode n)
 void Client::updateCamera(v3f pos, v3f dir, f32 fov)
 {
 	m_env.getClientMap().updateCamera(pos, dir, fov);
+	m_mesh_update_pool.m_queue_in.setCamera(pos, dir);
 }
 
 void Client::renderPostFx()
@@ -2119,6 +2409,8 @@ void Client::setTempMod(v3s16 p, NodeMod mod)
 	{
 		i.getNode()->getValue()->updateMesh(m_env.getDayNightRatio());
 	}
+	if(affected_blocks.size() > 0)
+		m_env.getClientMap().invalidateDrawList();
 }
 
 void Client::clearTempMod(v3s16 p)
@@ -2136,6 +2428,8 @@ void Client::clearTempMod(v3s16 p)
 	{
 		i.getNode()->getValue()->updateMesh(m_env.getDayNightRatio());
 	}
+	if(affected_blocks.size() > 0)
+		m_env.getClientMap().invalidateDrawList();
 }
 
 void Client::addUpdateMeshTask(v3s16 p, bool ack_to_server)
@@ -2162,13 +2456,13 @@ void Client::addUpdateMeshTask(v3s16 p, bool ack_to_server)
 	}
 
 	// Debug wait
-	//while(m_mesh_update_thread.m_queue_in.size() > 0) sleep_ms(10);
+	//while(m_mesh_update_pool.m_queue_in.size() > 0) sleep_ms(10);
 	
 	// Add task to queue
-	m_mesh_update_thread.m_queue_in.addBlock(p, data, ack_to_server);
+	m_mesh_update_pool.m_queue_in.addBlock(p, data, ack_to_server);
 
 	/*infostream<<"Mesh update input queue size is "
-			<<m_mesh_update_thread.m_queue_in.size()
+			<<m_mesh_update_pool.m_queue_in.size()
 			<<std::endl;*/
 	
 #if 0
@@ -2199,28 +2493,12 @@ void Client::addUpdateMeshTaskWithEdge(v3s16 blockpos, bool ack_to_server)
 				<<std::endl;
 	}*/
 
-	try{
-		v3s16 p = blockpos + v3s16(0,0,0);
-		//MapBlock *b = m_env.getMap().getBlockNoCreate(p);
-		addUpdateMeshTask(p, ack_to_server);
-	}
-	catch(InvalidPositionException &e){}
+	// addUpdateMeshTask() ignores blocks that don't exist
+	addUpdateMeshTask(blockpos, ack_to_server);
 	// Leading edge
-	try{
-		v3s16 p = blockpos + v3s16(-1,0,0);
-		addUpdateMeshTask(p);
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,-1,0);
-		addUpdateMeshTask(p);
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,0,-1);
-		addUpdateMeshTask(p);
-	}
-	catch(InvalidPositionException &e){}
+	addUpdateMeshTask(blockpos + v3s16(-1,0,0));
+	addUpdateMeshTask(blockpos + v3s16(0,-1,0));
+	addUpdateMeshTask(blockpos + v3s16(0,0,-1));
 }
 
 ClientEvent Client::getClientEvent()
@@ -32,6 +32,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "inventorymanager.h"
 #include "filesys.h"
+#include "occlusion.h"
+#include "farmesh.h"
 
 struct MeshMakeData;
 class IGameDef;
@@ -40,6 +42,7 @@ class IWritableToolDefManager;
 class IWritableNodeDefManager;
 //class IWritableCraftDefManager;
 class IWritableCraftItemDefManager;
+class MapBlockMesh;
 
 class ClientNotReadyException : public BaseException
 {
@@ -55,12 +58,26 @@ struct QueuedMeshUpdate
 	MeshMakeData *data;
 	bool ack_block_to_server;
 
+	// Used by MeshUpdateQueue
+	f32 priority;
+	u32 heap_index;
+	QueuedMeshUpdate *next_in_bucket;
+
 	QueuedMeshUpdate();
 	~QueuedMeshUpdate();
 };
 
 /*
-	A thread-safe queue of mesh update tasks
+	A thread-safe queue of mesh update tasks.
+
+	Tasks are popped nearest to the camera first; blocks in front of
+	the camera are preferred over blocks behind it. The tasks are kept
+	in a binary heap by priority and in a hash index by position, so
+	that a new task for a queued block replaces the old one in place.
+
+	A block that is being made by one thread is not given to another
+	one before done() is called for it, so the results of one block
+	come out in the order they were queued.
 */
 class MeshUpdateQueue
 {
@@ -75,24 +92,58 @@ class MeshUpdateQueue
 	void addBlock(v3s16 p, MeshMakeData *data, bool ack_block_to_server);
 
 	// Returned pointer must be deleted
-	// Returns NULL if queue is empty
+	// Returns NULL if there is nothing that can be made now
 	QueuedMeshUpdate * pop();
 
+	// Called after the result of a popped task has been queued
+	void done(v3s16 p);
+
+	// Camera in node coordinates * BS, as given to ClientMap
+	void setCamera(v3f pos, v3f dir);
+
 	u32 size()
 	{
 		JMutexAutoLock lock(m_mutex);
-		return m_queue.size();
+		return m_heap.size();
 	}
 	
 private:
-	core::list<QueuedMeshUpdate*> m_queue;
+	// Smaller is more urgent
+	f32 getPriority(v3s16 p);
+
+	void heapPush(QueuedMeshUpdate *q);
+	QueuedMeshUpdate * heapPopTop();
+	void heapUp(u32 i);
+	void heapDown(u32 i);
+	void heapSwap(u32 a, u32 b);
+
+	u32 getBucket(v3s16 p);
+	QueuedMeshUpdate * findQueued(v3s16 p);
+	void indexRemove(QueuedMeshUpdate *q);
+
+	// Smallest priority first
+	core::array<QueuedMeshUpdate*> m_heap;
+	// Hash index of the tasks in m_heap by position
+	enum{ BUCKET_COUNT = 1024 };
+	QueuedMeshUpdate *m_buckets[BUCKET_COUNT];
+	// Blocks popped but not done yet; at most one per thread
+	core::list<v3s16> m_in_progress;
+	v3f m_camera_pos;
+	v3f m_camera_dir;
+	// Camera the priorities in the heap were computed with
+	v3f m_priority_camera_pos;
+	v3f m_priority_camera_dir;
 	JMutex m_mutex;
 };
 
 struct MeshUpdateResult
 {
 	v3s16 p;
-	scene::SMesh *mesh;
+	MapBlockMesh *mesh;
+	// Faces of the block that can be seen through it
+	FaceConnectivity connectivity;
+	// Surface of the block for the far terrain
+	FarBlockSurface far_surface;
 	bool ack_block_to_server;
 
 	MeshUpdateResult():
@@ -107,18 +158,53 @@ class MeshUpdateThread : public SimpleThread
 {
 public:
 
-	MeshUpdateThread(IGameDef *gamedef):
+	MeshUpdateThread(MeshUpdateQueue *queue_in,
+			MutexedQueue<MeshUpdateResult> *queue_out,
+			IGameDef *gamedef):
+		m_queue_in(queue_in),
+		m_queue_out(queue_out),
 		m_gamedef(gamedef)
 	{
 	}
 
 	void * Thread();
 
+	MeshUpdateQueue *m_queue_in;
+
+	MutexedQueue<MeshUpdateResult> *m_queue_out;
+
+	IGameDef *m_gamedef;
+};
+
+/*
+	A number of MeshUpdateThreads working on the same queues.
+	Controlled like a single thread.
+*/
+class MeshUpdateThreadPool
+{
+public:
+	MeshUpdateThreadPool(IGameDef *gamedef);
+	~MeshUpdateThreadPool();
+
+	// Creates the threads on the first call
+	// (setting "mesh_update_threads", 0 = one less than processors)
+	void Start();
+	void setRun(bool run);
+	// True if any of the threads is running
+	bool IsRunning();
+	void stop();
+
+	// Whether the queue holds all the work the threads can take for now.
+	// ClientMap stops adding tasks when this is true.
+	bool isQueueFull();
+
 	MeshUpdateQueue m_queue_in;
 
 	MutexedQueue<MeshUpdateResult> m_queue_out;
 
+private:
 	IGameDef *m_gamedef;
+	core::list<MeshUpdateThread*> m_threads;
 };
 
 enum ClientEventType
@@ -308,6 +394,33 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void addUpdateMeshTask(v3s16 blockpos, bool ack_to_server=false);
 	// Including blocks at appropriate edges
 	void addUpdateMeshTaskWithEdge(v3s16 blockpos, bool ack_to_server=false);
+	// Whether the mesh update threads have enough work queued
+	bool isMeshUpdateQueueFull()
+	{
+		return m_mesh_update_pool.isQueueFull();
+	}
+
+	/*
+		Occlusion culling of blocks is done in a background thread.
+		ClientMap tells the camera block and the range to search in
+		and takes the newest set of visible blocks when there is one
+		(see OcclusionThread::takeResult()).
+	*/
+	void setOcclusionCamera(v3s16 camera_block,
+			v3s16 range_min, v3s16 range_max)
+	{
+		m_occlusion_thread.setCamera(camera_block, range_min, range_max);
+	}
+	core::map<v3s16, bool> * takeVisibleBlocks(v3s16 *camera_block)
+	{
+		return m_occlusion_thread.takeResult(camera_block);
+	}
+
+	// Surfaces of the received blocks, for FarMesh
+	FarSurfaceMap & getFarSurfaces()
+	{
+		return m_far_surfaces;
+	}
 
 	// Get event from queue. CE_NONE is returned if queue is empty.
 	ClientEvent getClientEvent();
@@ -366,7 +479,9 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	IWritableToolDefManager *m_tooldef;
 	IWritableNodeDefManager *m_nodedef;
 	IWritableCraftItemDefManager *m_craftitemdef;
-	MeshUpdateThread m_mesh_update_thread;
+	MeshUpdateThreadPool m_mesh_update_pool;
+	OcclusionThread m_occlusion_thread;
+	FarSurfaceMap m_far_surfaces;
 	ClientEnvironment m_env;
 	con::Connection m_con;
 	IrrlichtDevice *m_device;
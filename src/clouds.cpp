@@ -34,9 +34,14 @@ Clouds::Clouds(
 ):
 	scene::ISceneNode(parent, mgr, id),
 	m_cloud_y(cloud_y),
+	m_brightness(1.0),
+	m_brightness_level(255),
 	m_seed(seed),
 	m_camera_pos(0,0),
-	m_time(0)
+	m_time(0),
+	m_buf(NULL),
+	m_mesh_center(0,0),
+	m_mesh_brightness_level(0)
 {
 	dstream<<__FUNCTION_NAME<<std::endl;
 
@@ -50,11 +55,19 @@ Clouds::Clouds(
 	m_box = core::aabbox3d<f32>(-BS*1000000,cloud_y-BS,-BS*1000000,
 			BS*1000000,cloud_y+BS,BS*1000000);
 
+	m_enable_3d = g_settings->getBool("enable_3d_clouds");
 }
 
 Clouds::~Clouds()
 {
 	dstream<<__FUNCTION_NAME<<std::endl;
+
+	if(m_buf)
+	{
+		// Hardware buffers are not freed automatically
+		SceneManager->getVideoDriver()->removeHardwareBuffer(m_buf);
+		m_buf->drop();
+	}
 }
 
 void Clouds::OnRegisterSceneNode()
@@ -70,76 +83,91 @@ void Clouds::OnRegisterSceneNode()
 
 #define MYROUND(x) (x > 0.0 ? (int)x : (int)x - 1)
 
-void Clouds::render()
+/*
+	Clouds move from X+ towards X-
+*/
+static const s16 cloud_radius_i = 12;
+static const float cloud_size = BS*48;
+static const v2f cloud_speed(-BS*2, 0);
+
+bool Clouds::isCloud(v2s16 p)
 {
-	video::IVideoDriver* driver = SceneManager->getVideoDriver();
+	core::map<v2s16, bool>::Node *n = m_cells.find(p);
+	if(n == NULL)
+		return false;
+	return n->getValue();
+}
 
-	/*if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_TRANSPARENT)
-		return;*/
-	if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_SOLID)
-		return;
+void Clouds::updateCells(v2s16 center)
+{
+	// Forget the cells that are out of view
+	core::list<v2s16> old_cells;
+	for(core::map<v2s16, bool>::Iterator i = m_cells.getIterator();
+			i.atEnd() == false; i++)
+	{
+		v2s16 p = i.getNode()->getKey();
+		if(p.X < center.X - cloud_radius_i || p.X >= center.X + cloud_radius_i
+				|| p.Y < center.Y - cloud_radius_i
+				|| p.Y >= center.Y + cloud_radius_i)
+			old_cells.push_back(p);
+	}
+	for(core::list<v2s16>::Iterator i = old_cells.begin();
+			i != old_cells.end(); i++)
+		m_cells.remove(*i);
 
-	ScopeProfiler sp(g_profiler, "Rendering of clouds, avg", SPT_AVG);
+	// Get the new ones from the noise
+	u32 new_count = 0;
+	for(s16 zi=-cloud_radius_i; zi<cloud_radius_i; zi++)
+	for(s16 xi=-cloud_radius_i; xi<cloud_radius_i; xi++)
+	{
+		v2s16 p_in_noise_i = center + v2s16(xi, zi);
+		if(m_cells.find(p_in_noise_i) != NULL)
+			continue;
+		double noise = noise2d_perlin_abs(
+				(float)p_in_noise_i.X*cloud_size/BS/200,
+				(float)p_in_noise_i.Y*cloud_size/BS/200,
+				m_seed, 3, 0.4);
+		m_cells.insert(p_in_noise_i, noise >= 0.95);
+		new_count++;
+	}
+	g_profiler->avg("Clouds: new cells", new_count);
+}
+
+void Clouds::buildMesh(v2s16 center)
+{
+	video::IVideoDriver* driver = SceneManager->getVideoDriver();
+
+	if(m_buf)
+	{
+		driver->removeHardwareBuffer(m_buf);
+		m_buf->drop();
+	}
+	m_buf = new scene::SMeshBuffer();
+	m_colors.set_used(0);
+	m_mesh_center = center;
 
 	int num_faces_to_draw = 1;
-	if(g_settings->getBool("enable_3d_clouds"))
+	if(m_enable_3d)
 		num_faces_to_draw = 6;
 
-	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
-	driver->setMaterial(m_material);
-	
-	/*
-		Clouds move from X+ towards X-
-	*/
+	const video::SColor c_top(128,240,240,255);
+	const video::SColor c_side_1(128,230,230,255);
+	const video::SColor c_side_2(128,220,220,245);
+	const video::SColor c_bottom(128,205,205,230);
 
-	const s16 cloud_radius_i = 12;
-	const float cloud_size = BS*48;
-	const v2f cloud_speed(-BS*2, 0);
-	
-	// Position of cloud noise origin in world coordinates
-	v2f world_cloud_origin_pos_f = m_time*cloud_speed;
-	// Position of cloud noise origin from the camera
-	v2f cloud_origin_from_camera_f = world_cloud_origin_pos_f - m_camera_pos;
-	// The center point of drawing in the noise
-	v2f center_of_drawing_in_noise_f = -cloud_origin_from_camera_f;
-	// The integer center point of drawing in the noise
-	v2s16 center_of_drawing_in_noise_i(
-		MYROUND(center_of_drawing_in_noise_f.X / cloud_size),
-		MYROUND(center_of_drawing_in_noise_f.Y / cloud_size)
-	);
-	// The world position of the integer center point of drawing in the noise
-	v2f world_center_of_drawing_in_noise_f = v2f(
-		center_of_drawing_in_noise_i.X * cloud_size,
-		center_of_drawing_in_noise_i.Y * cloud_size
-	) + world_cloud_origin_pos_f;
+	f32 rx = cloud_size;
+	f32 ry = 8*BS;
+	f32 rz = cloud_size;
 
 	for(s16 zi=-cloud_radius_i; zi<cloud_radius_i; zi++)
 	for(s16 xi=-cloud_radius_i; xi<cloud_radius_i; xi++)
 	{
-		v2s16 p_in_noise_i(
-			xi+center_of_drawing_in_noise_i.X,
-			zi+center_of_drawing_in_noise_i.Y
-		);
-
-		/*if((p_in_noise_i.X + p_in_noise_i.Y)%2==0)
-			continue;*/
-		/*if((p_in_noise_i.X/2 + p_in_noise_i.Y/2)%2==0)
-			continue;*/
-
-		v2f p0 = v2f(xi,zi)*cloud_size + world_center_of_drawing_in_noise_f;
-		
-		double noise = noise2d_perlin_abs(
-				(float)p_in_noise_i.X*cloud_size/BS/200,
-				(float)p_in_noise_i.Y*cloud_size/BS/200,
-				m_seed, 3, 0.4);
-		if(noise < 0.95)
+		v2s16 p_in_noise_i = center + v2s16(xi, zi);
+		if(isCloud(p_in_noise_i) == false)
 			continue;
 
-		float b = m_brightness;
-		video::SColor c_top(128,b*240,b*240,b*255);
-		video::SColor c_side_1(128,b*230,b*230,b*255);
-		video::SColor c_side_2(128,b*220,b*220,b*245);
-		video::SColor c_bottom(128,b*205,b*205,b*230);
+		// Relative to the center of the mesh
+		v3f pos = v3f(xi*cloud_size, m_cloud_y, zi*cloud_size);
 
 		video::S3DVertex v[4] =
 		{
@@ -149,12 +177,12 @@ void Clouds::render()
 			video::S3DVertex(0,0,0, 0,0,0, c_top, 0, 0)
 		};
 
-		f32 rx = cloud_size;
-		f32 ry = 8*BS;
-		f32 rz = cloud_size;
-
 		for(int i=0; i<num_faces_to_draw; i++)
 		{
+			/*
+				Clouds are twice the size of a cell, so a side that
+				has a cloud next to it is inside that cloud
+			*/
 			switch(i)
 			{
 				case 0:	// top
@@ -164,6 +192,8 @@ void Clouds::render()
 					v[3].Pos.X= rx; v[3].Pos.Y= ry, v[3].Pos.Z=-rz;
 					break;
 				case 1: // back
+					if(isCloud(p_in_noise_i + v2s16(0,-1)))
+						continue;
 					for(int j=0;j<4;j++)
 						v[j].Color=c_side_1;
 					v[0].Pos.X=-rx; v[0].Pos.Y= ry; v[0].Pos.Z=-rz;
@@ -172,6 +202,8 @@ void Clouds::render()
 					v[3].Pos.X=-rx; v[3].Pos.Y=-ry, v[3].Pos.Z=-rz;
 					break;
 				case 2: //right
+					if(isCloud(p_in_noise_i + v2s16(1,0)))
+						continue;
 					for(int j=0;j<4;j++)
 						v[j].Color=c_side_2;
 					v[0].Pos.X= rx; v[0].Pos.Y= ry; v[0].Pos.Z=-rz;
@@ -180,6 +212,8 @@ void Clouds::render()
 					v[3].Pos.X= rx; v[3].Pos.Y=-ry, v[3].Pos.Z=-rz;
 					break;
 				case 3: // front
+					if(isCloud(p_in_noise_i + v2s16(0,1)))
+						continue;
 					for(int j=0;j<4;j++)
 						v[j].Color=c_side_1;
 					v[0].Pos.X= rx; v[0].Pos.Y= ry; v[0].Pos.Z= rz;
@@ -188,6 +222,8 @@ void Clouds::render()
 					v[3].Pos.X= rx; v[3].Pos.Y=-ry, v[3].Pos.Z= rz;
 					break;
 				case 4: // left
+					if(isCloud(p_in_noise_i + v2s16(-1,0)))
+						continue;
 					for(int j=0;j<4;j++)
 						v[j].Color=c_side_2;
 					v[0].Pos.X=-rx; v[0].Pos.Y= ry; v[0].Pos.Z= rz;
@@ -205,16 +241,89 @@ void Clouds::render()
 					break;
 			}
 
-			v3f pos = v3f(p0.X,m_cloud_y,p0.Y);
-
-			for(u16 i=0; i<4; i++)
-				v[i].Pos += pos;
-			u16 indices[] = {0,1,2,2,3,0};
-			driver->drawVertexPrimitiveList(v, 4, indices, 2,
-					video::EVT_STANDARD, scene::EPT_TRIANGLES, video::EIT_16BIT);
+			u16 i0 = m_buf->Vertices.size();
+			for(u16 j=0; j<4; j++)
+			{
+				video::S3DVertex vertex = v[j];
+				vertex.Pos += pos;
+				m_buf->Vertices.push_back(vertex);
+				m_colors.push_back(vertex.Color);
+			}
+			const u16 indices[] = {0,1,2,2,3,0};
+			for(u16 j=0; j<6; j++)
+				m_buf->Indices.push_back(i0 + indices[j]);
 		}
+	}
+
+	m_buf->recalculateBoundingBox();
+	m_buf->setHardwareMappingHint(scene::EHM_STATIC);
+	colorMesh();
+}
+
+void Clouds::colorMesh()
+{
+	float b = m_brightness;
+	for(u32 i=0; i<m_colors.size(); i++)
+	{
+		video::SColor c = m_colors[i];
+		m_buf->Vertices[i].Color = video::SColor(c.getAlpha(),
+				b*c.getRed(), b*c.getGreen(), b*c.getBlue());
+	}
+	m_mesh_brightness_level = m_brightness_level;
+	m_buf->setDirty(scene::EBT_VERTEX);
+}
+
+void Clouds::render()
+{
+	video::IVideoDriver* driver = SceneManager->getVideoDriver();
+
+	/*if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_TRANSPARENT)
+		return;*/
+	if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_SOLID)
+		return;
+
+	ScopeProfiler sp(g_profiler, "Rendering of clouds, avg", SPT_AVG);
 
+	// Position of cloud noise origin in world coordinates
+	v2f world_cloud_origin_pos_f = m_time*cloud_speed;
+	// Position of cloud noise origin from the camera
+	v2f cloud_origin_from_camera_f = world_cloud_origin_pos_f - m_camera_pos;
+	// The center point of drawing in the noise
+	v2f center_of_drawing_in_noise_f = -cloud_origin_from_camera_f;
+	// The integer center point of drawing in the noise
+	v2s16 center_of_drawing_in_noise_i(
+		MYROUND(center_of_drawing_in_noise_f.X / cloud_size),
+		MYROUND(center_of_drawing_in_noise_f.Y / cloud_size)
+	);
+	// The world position of the integer center point of drawing in the noise
+	v2f world_center_of_drawing_in_noise_f = v2f(
+		center_of_drawing_in_noise_i.X * cloud_size,
+		center_of_drawing_in_noise_i.Y * cloud_size
+	) + world_cloud_origin_pos_f;
+
+	/*
+		The mesh is only built again when the center has moved to
+		another cell. Otherwise it is just moved.
+	*/
+	if(m_buf == NULL || center_of_drawing_in_noise_i != m_mesh_center)
+	{
+		updateCells(center_of_drawing_in_noise_i);
+		buildMesh(center_of_drawing_in_noise_i);
 	}
+	else if(m_mesh_brightness_level != m_brightness_level)
+	{
+		colorMesh();
+	}
+
+	core::matrix4 transform = AbsoluteTransformation;
+	transform.setTranslation(transform.getTranslation() + v3f(
+			world_center_of_drawing_in_noise_f.X, 0,
+			world_center_of_drawing_in_noise_f.Y));
+	driver->setTransform(video::ETS_WORLD, transform);
+	driver->setMaterial(m_material);
+
+	if(m_buf->getIndexCount() > 0)
+		driver->drawMeshBuffer(m_buf);
 }
 
 void Clouds::step(float dtime)
@@ -226,5 +335,5 @@ void Clouds::update(v2f camera_p, float brightness)
 {
 	m_camera_pos = camera_p;
 	m_brightness = brightness;
+	m_brightness_level = brightness * 255;
 }
-
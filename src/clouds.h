@@ -23,6 +23,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common_irrlicht.h"
 #include <iostream>
 
+/*
+	The cloud field is kept in a static mesh that is only moved as the
+	clouds scroll. It is built again when the field has scrolled by a
+	cloud, and only the cells that have come into view are taken from
+	the noise.
+*/
 class Clouds : public scene::ISceneNode
 {
 public:
@@ -68,13 +74,35 @@ class Clouds : public scene::ISceneNode
 	void update(v2f camera_p, float brightness);
 
 private:
+	// Gets the cloud cells around center from the noise, reusing
+	// the ones already known
+	void updateCells(v2s16 center);
+	void buildMesh(v2s16 center);
+	// Sets the vertex colors for the current brightness
+	void colorMesh();
+	bool isCloud(v2s16 p);
+
 	video::SMaterial m_material;
 	core::aabbox3d<f32> m_box;
 	float m_cloud_y;
 	float m_brightness;
+	u32 m_brightness_level;
 	u32 m_seed;
 	v2f m_camera_pos;
 	float m_time;
+	bool m_enable_3d;
+
+	// Noise position -> whether there is a cloud
+	core::map<v2s16, bool> m_cells;
+
+	// NULL until built
+	scene::SMeshBuffer *m_buf;
+	// Vertex colors at full brightness
+	core::array<video::SColor> m_colors;
+	// Noise position the mesh is built around
+	v2s16 m_mesh_center;
+	// Brightness level the vertex colors are for
+	u32 m_mesh_brightness_level;
 };
 
 
@@ -79,21 +79,18 @@ collisionMoveResult collisionMoveSimple(Map *map, IGameDef *gamedef,
 	s16 max_x = (box_0.MaxEdge.X / BS) + 1;
 	s16 max_y = (box_0.MaxEdge.Y / BS) + 1;
 	s16 max_z = (box_0.MaxEdge.Z / BS) + 1;
+	INodeDefManager *ndef = gamedef->getNodeDefManager();
 	for(s16 y = oldpos_i.Y + min_y; y <= oldpos_i.Y + max_y; y++)
 	for(s16 z = oldpos_i.Z + min_z; z <= oldpos_i.Z + max_z; z++)
 	for(s16 x = oldpos_i.X + min_x; x <= oldpos_i.X + max_x; x++)
 	{
-		try{
-			// Object collides into walkable nodes
-			MapNode n = map->getNode(v3s16(x,y,z));
-			if(gamedef->getNodeDefManager()->get(n).walkable == false)
-				continue;
-		}
-		catch(InvalidPositionException &e)
-		{
-			// Doing nothing here will block the object from
-			// walking over map borders
-		}
+		bool is_position_valid;
+		MapNode n = map->getNodeNoEx(v3s16(x,y,z), &is_position_valid);
+		// Object collides into walkable nodes. Unloaded nodes are
+		// walls, which blocks the object from walking over map
+		// borders.
+		if(is_position_valid && ndef->walkable(n.getContent()) == false)
+			continue;
 
 		core::aabbox3d<f32> nodebox = getNodeBox(v3s16(x,y,z), BS);
 		
@@ -247,4 +244,18 @@ collisionMoveResult collisionMovePrecise(Map *map, IGameDef *gamedef,
 	return final_result;
 }
 
-
+bool isGroundLoaded(Map *map, const core::aabbox3d<f32> &box_0,
+		v3f pos_f)
+{
+	v3s16 p0 = floatToInt(pos_f + box_0.MinEdge - v3f(0, 0.1*BS, 0), BS);
+	v3s16 p1 = floatToInt(pos_f + box_0.MaxEdge, BS);
+	for(s16 z = p0.Z; z <= p1.Z; z++)
+	for(s16 x = p0.X; x <= p1.X; x++)
+	{
+		bool is_position_valid;
+		map->getNodeNoEx(v3s16(x,p0.Y,z), &is_position_valid);
+		if(!is_position_valid)
+			return false;
+	}
+	return true;
+}
@@ -46,6 +46,14 @@ collisionMoveResult collisionMovePrecise(Map *map, IGameDef *gamedef,
 		f32 pos_max_d, const core::aabbox3d<f32> &box_0,
 		f32 dtime, v3f &pos_f, v3f &speed_f);
 
+/*
+	Whether the nodes right below the box at pos_f are loaded. Unloaded
+	nodes collide like walls, so an object resting on one must not be
+	put to sleep: nothing wakes it up when the block is loaded.
+*/
+bool isGroundLoaded(Map *map, const core::aabbox3d<f32> &box_0,
+		v3f pos_f);
+
 enum CollisionType
 {
 	COLLISION_FALL
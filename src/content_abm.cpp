@@ -49,8 +49,8 @@ class GrowGrassABM : public ActiveBlockModifier
 		ServerMap *map = &env->getServerMap();
 		
 		MapNode n_top = map->getNodeNoEx(p+v3s16(0,1,0));
-		if(ndef->get(n_top).light_propagates &&
-				!ndef->get(n_top).isLiquid() &&
+		if(ndef->lightPropagates(n_top.getContent()) &&
+				!ndef->isLiquid(n_top.getContent()) &&
 				n_top.getLightBlend(env->getDayNightRatio(), ndef) >= 13)
 		{
 			n.setContent(ndef->getId("dirt_with_grass"));
@@ -79,8 +79,8 @@ class RemoveGrassABM : public ActiveBlockModifier
 		ServerMap *map = &env->getServerMap();
 		
 		MapNode n_top = map->getNodeNoEx(p+v3s16(0,1,0));
-		if(!ndef->get(n_top).light_propagates ||
-				ndef->get(n_top).isLiquid())
+		if(!ndef->lightPropagates(n_top.getContent()) ||
+				ndef->isLiquid(n_top.getContent()))
 		{
 			n.setContent(ndef->getId("dirt"));
 			map->addNodeWithEvent(p, n);
@@ -32,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //  collector - the MeshCollector for the resulting polygons
 //  pa        - texture atlas pointer for the material
 //  c         - vertex colour - used for all
+//  l         - day/night light of the vertices, see MapBlock_DayNightLight()
 //  pos       - the position of the centre of the cuboid
 //  rz,ry,rz  - the radius of the cuboid in each dimension
 //  txc       - texture coordinates - this is a list of texture coordinates
@@ -42,7 +43,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //              If you specified 0,0,1,1 for each face, that would be the
 //              same as passing NULL.
 void makeCuboid(video::SMaterial &material, MeshCollector *collector,
-	AtlasPointer* pa, video::SColor &c,
+	AtlasPointer* pa, video::SColor &c, u16 l,
 	v3f &pos, f32 rx, f32 ry, f32 rz, f32* txc)
 {
 	f32 tu0=pa->x0();
@@ -114,7 +115,7 @@ void makeCuboid(video::SMaterial &material, MeshCollector *collector,
 		for(u16 i=0; i<4; i++)
 			v[i].Pos += pos;
 		u16 indices[] = {0,1,2,2,3,0};
-		collector->append(material, v, 4, indices, 6);
+		collector->append(material, v, 4, indices, 6, l);
 
 	}
 
@@ -155,7 +156,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 	{
 		v3s16 p(x,y,z);
 
-		MapNode n = data->m_vmanip.getNodeNoEx(blockpos_nodes+p);
+		MapNode n = data->getNodeNoEx(blockpos_nodes+p);
 		const ContentFeatures &f = nodedef->get(n);
 
 		// Only solidness=0 stuff is drawn here
@@ -186,16 +187,16 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					*nodedef->get(n).special_aps[0];
 
 			bool top_is_air = false;
-			MapNode n = data->m_vmanip.getNodeNoEx(blockpos_nodes + v3s16(x,y+1,z));
+			MapNode n = data->getNodeNoEx(blockpos_nodes + v3s16(x,y+1,z));
 			if(n.getContent() == CONTENT_AIR)
 				top_is_air = true;
 			
 			if(top_is_air == false)
 				continue;
 
-			u8 l = decode_light(n.getLightBlend(data->m_daynight_ratio, nodedef));
-			video::SColor c = MapBlock_LightColor(
-					nodedef->get(n).alpha, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef);
+			video::SColor c = MapBlock_LightColor(nodedef->get(n).alpha, l,
+					data->m_daynight_ratio);
 			
 			video::S3DVertex vertices[4] =
 			{
@@ -217,7 +218,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 			u16 indices[] = {0,1,2,2,3,0};
 			// Add to mesh collector
-			collector.append(liquid_material, vertices, 4, indices, 6);
+			collector.append(liquid_material, vertices, 4, indices, 6, l);
 		break;}
 		case NDT_FLOWINGLIQUID:
 		{
@@ -236,21 +237,21 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					*nodedef->get(n).special_aps[0];
 
 			bool top_is_same_liquid = false;
-			MapNode ntop = data->m_vmanip.getNodeNoEx(blockpos_nodes + v3s16(x,y+1,z));
-			content_t c_flowing = nodedef->getId(nodedef->get(n).liquid_alternative_flowing);
-			content_t c_source = nodedef->getId(nodedef->get(n).liquid_alternative_source);
+			MapNode ntop = data->getNodeNoEx(blockpos_nodes + v3s16(x,y+1,z));
+			content_t c_flowing = nodedef->liquidAlternativeFlowing(n.getContent());
+			content_t c_source = nodedef->liquidAlternativeSource(n.getContent());
 			if(ntop.getContent() == c_flowing || ntop.getContent() == c_source)
 				top_is_same_liquid = true;
 			
-			u8 l = 0;
+			u16 l = 0;
 			// Use the light of the node on top if possible
-			if(nodedef->get(ntop).param_type == CPT_LIGHT)
-				l = decode_light(ntop.getLightBlend(data->m_daynight_ratio, nodedef));
+			if(nodedef->hasLightParam(ntop.getContent()))
+				l = MapBlock_NodeDayNightLight(ntop, nodedef);
 			// Otherwise use the light of this node (the liquid)
 			else
-				l = decode_light(n.getLightBlend(data->m_daynight_ratio, nodedef));
-			video::SColor c = MapBlock_LightColor(
-					nodedef->get(n).alpha, l);
+				l = MapBlock_NodeDayNightLight(n, nodedef);
+			video::SColor c = MapBlock_LightColor(nodedef->get(n).alpha, l,
+					data->m_daynight_ratio);
 			
 			// Neighbor liquid levels (key = relative position)
 			// Includes current node
@@ -276,7 +277,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 				u8 flags = 0;
 				// Check neighbor
 				v3s16 p2 = p + neighbor_dirs[i];
-				MapNode n2 = data->m_vmanip.getNodeNoEx(blockpos_nodes + p2);
+				MapNode n2 = data->getNodeNoEx(blockpos_nodes + p2);
 				if(n2.getContent() != CONTENT_IGNORE)
 				{
 					content = n2.getContent();
@@ -291,7 +292,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					// NOTE: This doesn't get executed if neighbor
 					//       doesn't exist
 					p2.Y += 1;
-					n2 = data->m_vmanip.getNodeNoEx(blockpos_nodes + p2);
+					n2 = data->getNodeNoEx(blockpos_nodes + p2);
 					if(n2.getContent() == c_source ||
 							n2.getContent() == c_flowing)
 						flags |= neighborflag_top_is_same_liquid;
@@ -476,7 +477,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 				u16 indices[] = {0,1,2,2,3,0};
 				// Add to mesh collector
-				collector.append(*current_material, vertices, 4, indices, 6);
+				collector.append(*current_material, vertices, 4, indices, 6, l);
 			}
 			
 			/*
@@ -511,7 +512,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 				u16 indices[] = {0,1,2,2,3,0};
 				// Add to mesh collector
-				collector.append(liquid_material, vertices, 4, indices, 6);
+				collector.append(liquid_material, vertices, 4, indices, 6, l);
 			}
 		break;}
 		case NDT_GLASSLIKE:
@@ -524,14 +525,14 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			AtlasPointer pa_glass = f.tiles[0].texture;
 			material_glass.setTexture(0, pa_glass.atlas);
 
-			u8 l = decode_light(undiminish_light(n.getLightBlend(data->m_daynight_ratio, nodedef)));
-			video::SColor c = MapBlock_LightColor(255, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef, true);
+			video::SColor c = MapBlock_LightColor(255, l, data->m_daynight_ratio);
 
 			for(u32 j=0; j<6; j++)
 			{
 				// Check this neighbor
 				v3s16 n2p = blockpos_nodes + p + g_6dirs[j];
-				MapNode n2 = data->m_vmanip.getNodeNoEx(n2p);
+				MapNode n2 = data->getNodeNoEx(n2p);
 				// Don't make face if neighbor is of same type
 				if(n2.getContent() == n.getContent())
 					continue;
@@ -575,7 +576,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 				u16 indices[] = {0,1,2,2,3,0};
 				// Add to mesh collector
-				collector.append(material_glass, vertices, 4, indices, 6);
+				collector.append(material_glass, vertices, 4, indices, 6, l);
 			}
 		break;}
 		case NDT_ALLFACES:
@@ -588,8 +589,8 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			AtlasPointer pa_leaves1 = f.tiles[0].texture;
 			material_leaves1.setTexture(0, pa_leaves1.atlas);
 
-			u8 l = decode_light(undiminish_light(n.getLightBlend(data->m_daynight_ratio, nodedef)));
-			video::SColor c = MapBlock_LightColor(255, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef, true);
+			video::SColor c = MapBlock_LightColor(255, l, data->m_daynight_ratio);
 
 			for(u32 j=0; j<6; j++)
 			{
@@ -631,7 +632,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 				u16 indices[] = {0,1,2,2,3,0};
 				// Add to mesh collector
-				collector.append(material_leaves1, vertices, 4, indices, 6);
+				collector.append(material_leaves1, vertices, 4, indices, 6, l);
 			}
 		break;}
 		case NDT_ALLFACES_OPTIONAL:
@@ -665,6 +666,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					= video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF;
 			material.setTexture(0, ap.atlas);
 
+			u16 l = MapBlock_DayNightLight(255, 255);
 			video::SColor c(255,255,255,255);
 
 			// Wall at X+ of node
@@ -700,7 +702,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 			u16 indices[] = {0,1,2,2,3,0};
 			// Add to mesh collector
-			collector.append(material, vertices, 4, indices, 6);
+			collector.append(material, vertices, 4, indices, 6, l);
 		break;}
 		case NDT_SIGNLIKE:
 		{
@@ -715,8 +717,8 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			AtlasPointer ap = f.tiles[0].texture;
 			material.setTexture(0, ap.atlas);
 
-			u8 l = decode_light(n.getLightBlend(data->m_daynight_ratio, nodedef));
-			video::SColor c = MapBlock_LightColor(255, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef);
+			video::SColor c = MapBlock_LightColor(255, l, data->m_daynight_ratio);
 				
 			float d = (float)BS/16;
 			// Wall at X+ of node
@@ -754,7 +756,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 			u16 indices[] = {0,1,2,2,3,0};
 			// Add to mesh collector
-			collector.append(material, vertices, 4, indices, 6);
+			collector.append(material, vertices, 4, indices, 6, l);
 		break;}
 		case NDT_PLANTLIKE:
 		{
@@ -766,8 +768,8 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			AtlasPointer pa_papyrus = f.tiles[0].texture;
 			material_papyrus.setTexture(0, pa_papyrus.atlas);
 			
-			u8 l = decode_light(undiminish_light(n.getLightBlend(data->m_daynight_ratio, nodedef)));
-			video::SColor c = MapBlock_LightColor(255, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef, true);
+			video::SColor c = MapBlock_LightColor(255, l, data->m_daynight_ratio);
 
 			for(u32 j=0; j<4; j++)
 			{
@@ -814,7 +816,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 
 				u16 indices[] = {0,1,2,2,3,0};
 				// Add to mesh collector
-				collector.append(material_papyrus, vertices, 4, indices, 6);
+				collector.append(material_papyrus, vertices, 4, indices, 6, l);
 			}
 		break;}
 		case NDT_FENCELIKE:
@@ -827,8 +829,8 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			AtlasPointer pa_wood = f.tiles[0].texture;
 			material_wood.setTexture(0, pa_wood.atlas);
 
-			u8 l = decode_light(undiminish_light(n.getLightBlend(data->m_daynight_ratio, nodedef)));
-			video::SColor c = MapBlock_LightColor(255, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef, true);
+			video::SColor c = MapBlock_LightColor(255, l, data->m_daynight_ratio);
 
 			const f32 post_rad=(f32)BS/10;
 			const f32 bar_rad=(f32)BS/20;
@@ -844,13 +846,13 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					0.35,0,0.65,1,
 					0.4,0.4,0.6,0.6};
 			makeCuboid(material_wood, &collector,
-				&pa_wood, c, pos,
+				&pa_wood, c, l, pos,
 				post_rad,BS/2,post_rad, postuv);
 
 			// Now a section of fence, +X, if there's a post there
 			v3s16 p2 = p;
 			p2.X++;
-			MapNode n2 = data->m_vmanip.getNodeNoEx(blockpos_nodes + p2);
+			MapNode n2 = data->getNodeNoEx(blockpos_nodes + p2);
 			const ContentFeatures *f2 = &nodedef->get(n2);
 			if(f2->drawtype == NDT_FENCELIKE)
 			{
@@ -865,19 +867,19 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					0,0.4,1,0.6,
 					0,0.4,1,0.6};
 				makeCuboid(material_wood, &collector,
-					&pa_wood, c, pos,
+					&pa_wood, c, l, pos,
 					bar_len,bar_rad,bar_rad, xrailuv);
 
 				pos.Y -= BS/2;
 				makeCuboid(material_wood, &collector,
-					&pa_wood, c, pos,
+					&pa_wood, c, l, pos,
 					bar_len,bar_rad,bar_rad, xrailuv);
 			}
 
 			// Now a section of fence, +Z, if there's a post there
 			p2 = p;
 			p2.Z++;
-			n2 = data->m_vmanip.getNodeNoEx(blockpos_nodes + p2);
+			n2 = data->getNodeNoEx(blockpos_nodes + p2);
 			f2 = &nodedef->get(n2);
 			if(f2->drawtype == NDT_FENCELIKE)
 			{
@@ -892,11 +894,11 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					0,0.4,1,0.6,
 					0,0.4,1,0.6};
 				makeCuboid(material_wood, &collector,
-					&pa_wood, c, pos,
+					&pa_wood, c, l, pos,
 					bar_rad,bar_rad,bar_len, zrailuv);
 				pos.Y -= BS/2;
 				makeCuboid(material_wood, &collector,
-					&pa_wood, c, pos,
+					&pa_wood, c, l, pos,
 					bar_rad,bar_rad,bar_len, zrailuv);
 
 			}
@@ -906,10 +908,10 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			bool is_rail_x [] = { false, false };  /* x-1, x+1 */
 			bool is_rail_z [] = { false, false };  /* z-1, z+1 */
 
-			MapNode n_minus_x = data->m_vmanip.getNodeNoEx(blockpos_nodes + v3s16(x-1,y,z));
-			MapNode n_plus_x = data->m_vmanip.getNodeNoEx(blockpos_nodes + v3s16(x+1,y,z));
-			MapNode n_minus_z = data->m_vmanip.getNodeNoEx(blockpos_nodes + v3s16(x,y,z-1));
-			MapNode n_plus_z = data->m_vmanip.getNodeNoEx(blockpos_nodes + v3s16(x,y,z+1));
+			MapNode n_minus_x = data->getNodeNoEx(blockpos_nodes + v3s16(x-1,y,z));
+			MapNode n_plus_x = data->getNodeNoEx(blockpos_nodes + v3s16(x+1,y,z));
+			MapNode n_minus_z = data->getNodeNoEx(blockpos_nodes + v3s16(x,y,z-1));
+			MapNode n_plus_z = data->getNodeNoEx(blockpos_nodes + v3s16(x,y,z+1));
 			
 			content_t thiscontent = n.getContent();
 			if(n_minus_x.getContent() == thiscontent)
@@ -948,8 +950,8 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 					= video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF;
 			material_rail.setTexture(0, ap.atlas);
 
-			u8 l = decode_light(n.getLightBlend(data->m_daynight_ratio, nodedef));
-			video::SColor c = MapBlock_LightColor(255, l);
+			u16 l = MapBlock_NodeDayNightLight(n, nodedef);
+			video::SColor c = MapBlock_LightColor(255, l, data->m_daynight_ratio);
 
 			float d = (float)BS/16;
 			video::S3DVertex vertices[4] =
@@ -1006,7 +1008,7 @@ void mapblock_mesh_generate_special(MeshMakeData *data,
 			}
 
 			u16 indices[] = {0,1,2,2,3,0};
-			collector.append(material_rail, vertices, 4, indices, 6);
+			collector.append(material_rail, vertices, 4, indices, 6, l);
 		break;}
 		}
 	}
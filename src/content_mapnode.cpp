@@ -933,6 +933,8 @@ void content_mapnode_init(IWritableNodeDefManager *nodemgr)
 	setConstantMaterialProperties(f.material, 0.0);
 	f.furnace_burntime = 3;
 	nodemgr->set(i, f);
+
+	nodemgr->updateLiquidAlternatives();
 }
 
 
@@ -165,6 +165,19 @@ void ItemSAO::step(float dtime, bool send_recommended)
 	IGameDef *gamedef = m_env->getGameDef();
 	moveresult = collisionMoveSimple(&m_env->getMap(), gamedef,
 			pos_max_d, box, dtime, pos_f, m_speed_f);
+
+	// Lie still until the nodes around are changed. Make sure the
+	// client has the final position first.
+	if(moveresult.touching_ground &&
+			pos_f.getDistanceFrom(pos_f_old) < 0.001*BS &&
+			isGroundLoaded(&m_env->getMap(), box, pos_f))
+	{
+		setBasePosition(pos_f);
+		if(m_base_position != m_last_sent_position)
+			sendPosition();
+		goToSleep();
+		return;
+	}
 	
 	if(send_recommended == false)
 		return;
@@ -172,26 +185,31 @@ void ItemSAO::step(float dtime, bool send_recommended)
 	if(pos_f.getDistanceFrom(m_last_sent_position) > 0.05*BS)
 	{
 		setBasePosition(pos_f);
-		m_last_sent_position = pos_f;
-
-		std::ostringstream os(std::ios::binary);
-		char buf[6];
-		// command (0 = update position)
-		buf[0] = 0;
-		os.write(buf, 1);
-		// pos
-		writeS32((u8*)buf, m_base_position.X*1000);
-		os.write(buf, 4);
-		writeS32((u8*)buf, m_base_position.Y*1000);
-		os.write(buf, 4);
-		writeS32((u8*)buf, m_base_position.Z*1000);
-		os.write(buf, 4);
-		// create message and add to list
-		ActiveObjectMessage aom(getId(), false, os.str());
-		m_messages_out.push_back(aom);
+		sendPosition();
 	}
 }
 
+void ItemSAO::sendPosition()
+{
+	m_last_sent_position = m_base_position;
+
+	std::ostringstream os(std::ios::binary);
+	char buf[6];
+	// command (0 = update position)
+	buf[0] = 0;
+	os.write(buf, 1);
+	// pos
+	writeS32((u8*)buf, m_base_position.X*1000);
+	os.write(buf, 4);
+	writeS32((u8*)buf, m_base_position.Y*1000);
+	os.write(buf, 4);
+	writeS32((u8*)buf, m_base_position.Z*1000);
+	os.write(buf, 4);
+	// create message and add to list
+	ActiveObjectMessage aom(getId(), false, os.str());
+	m_messages_out.push_back(aom);
+}
+
 std::string ItemSAO::getClientInitializationData()
 {
 	std::ostringstream os(std::ios::binary);
@@ -1510,6 +1528,8 @@ LuaEntitySAO::LuaEntitySAO(ServerEnvironment *env, v3f pos,
 	m_init_name(name),
 	m_init_state(state),
 	m_registered(false),
+	m_constant_static_data(true),
+	m_has_on_step(false),
 	m_prop(new LuaEntityProperties),
 	m_velocity(0,0,0),
 	m_acceleration(0,0,0),
@@ -1548,6 +1568,9 @@ void LuaEntitySAO::addedToEnvironment()
 	if(m_registered){
 		// Get properties
 		scriptapi_luaentity_get_properties(L, m_id, m_prop);
+		m_constant_static_data =
+				!scriptapi_luaentity_has_get_staticdata(L, m_id);
+		m_has_on_step = scriptapi_luaentity_has_on_step(L, m_id);
 	}
 }
 
@@ -1573,6 +1596,9 @@ ServerActiveObject* LuaEntitySAO::create(ServerEnvironment *env, v3f pos,
 void LuaEntitySAO::step(float dtime, bool send_recommended)
 {
 	m_last_sent_position_timer += dtime;
+
+	v3f pos_old = m_base_position;
+	bool at_rest = false;
 	
 	if(m_prop->physical){
 		core::aabbox3d<f32> box = m_prop->collisionbox;
@@ -1589,18 +1615,43 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 		setBasePosition(p_pos);
 		m_velocity = p_velocity;
 
+		// Resting on the ground, held down by the acceleration if any
+		at_rest = (moveresult.touching_ground &&
+				p_velocity == v3f(0,0,0) &&
+				m_acceleration.X == 0 && m_acceleration.Z == 0 &&
+				m_acceleration.Y <= 0 &&
+				p_pos.getDistanceFrom(pos_old) < 0.001*BS &&
+				isGroundLoaded(&m_env->getMap(), box, p_pos));
+
 		m_velocity += dtime * m_acceleration;
 	} else {
 		m_base_position += dtime * m_velocity + 0.5 * dtime
 				* dtime * m_acceleration;
 		m_velocity += dtime * m_acceleration;
+
+		at_rest = (m_velocity == v3f(0,0,0) &&
+				m_acceleration == v3f(0,0,0));
 	}
 
-	if(m_registered){
+	if(m_registered && m_has_on_step){
 		lua_State *L = m_env->getLua();
 		scriptapi_luaentity_step(L, m_id, dtime);
 	}
 
+	/*
+		Entities without on_step have nothing to do when at rest.
+		Make sure the client has the final position and sleep until
+		woken up.
+	*/
+	if(at_rest && !m_has_on_step)
+	{
+		if(m_base_position != m_last_sent_position ||
+				m_yaw != m_last_sent_yaw)
+			sendPosition(false, true);
+		goToSleep();
+		return;
+	}
+
 	if(send_recommended == false)
 		return;
 	
@@ -1656,8 +1707,18 @@ std::string LuaEntitySAO::getStaticData()
 	return os.str();
 }
 
+bool LuaEntitySAO::hasConstantStaticData()
+{
+	/*
+		Unregistered entities keep their initial state, and the state of
+		registered ones only changes through get_staticdata.
+	*/
+	return m_constant_static_data;
+}
+
 void LuaEntitySAO::punch(ServerActiveObject *puncher, float time_from_last_punch)
 {
+	wakeUp();
 	if(!m_registered){
 		// Delete unknown LuaEntities when punched
 		m_removed = true;
@@ -1669,6 +1730,7 @@ void LuaEntitySAO::punch(ServerActiveObject *puncher, float time_from_last_punch
 
 void LuaEntitySAO::rightClick(ServerActiveObject *clicker)
 {
+	wakeUp();
 	if(!m_registered)
 		return;
 	lua_State *L = m_env->getLua();
@@ -1677,12 +1739,14 @@ void LuaEntitySAO::rightClick(ServerActiveObject *clicker)
 
 void LuaEntitySAO::setPos(v3f pos)
 {
+	wakeUp();
 	m_base_position = pos;
 	sendPosition(false, true);
 }
 
 void LuaEntitySAO::moveTo(v3f pos, bool continuous)
 {
+	wakeUp();
 	m_base_position = pos;
 	if(!continuous)
 		sendPosition(true, true);
@@ -1695,6 +1759,7 @@ float LuaEntitySAO::getMinimumSavedMovement()
 
 void LuaEntitySAO::setVelocity(v3f velocity)
 {
+	wakeUp();
 	m_velocity = velocity;
 }
 
@@ -1705,6 +1770,7 @@ v3f LuaEntitySAO::getVelocity()
 
 void LuaEntitySAO::setAcceleration(v3f acceleration)
 {
+	wakeUp();
 	m_acceleration = acceleration;
 }
 
@@ -1715,6 +1781,7 @@ v3f LuaEntitySAO::getAcceleration()
 
 void LuaEntitySAO::setYaw(float yaw)
 {
+	wakeUp();
 	m_yaw = yaw;
 }
 
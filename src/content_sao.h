@@ -52,7 +52,11 @@ class ItemSAO : public ServerActiveObject
 	InventoryItem* createInventoryItem();
 	void punch(ServerActiveObject *puncher, float time_from_last_punch);
 	float getMinimumSavedMovement(){ return 0.1*BS; }
+	// The inventory string never changes
+	bool hasConstantStaticData(){ return true; }
 private:
+	void sendPosition();
+
 	std::string m_inventorystring;
 	v3f m_speed_f;
 	v3f m_last_sent_position;
@@ -206,6 +210,7 @@ class LuaEntitySAO : public ServerActiveObject
 	void step(float dtime, bool send_recommended);
 	std::string getClientInitializationData();
 	std::string getStaticData();
+	bool hasConstantStaticData();
 	void punch(ServerActiveObject *puncher, float time_from_last_punch);
 	void rightClick(ServerActiveObject *clicker);
 	void setPos(v3f pos);
@@ -228,6 +233,8 @@ class LuaEntitySAO : public ServerActiveObject
 	std::string m_init_name;
 	std::string m_init_state;
 	bool m_registered;
+	bool m_constant_static_data;
+	bool m_has_on_step;
 	struct LuaEntityProperties *m_prop;
 	
 	v3f m_velocity;
@@ -66,8 +66,10 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("new_style_water", "false");
 	settings->setDefault("new_style_leaves", "false");
 	settings->setDefault("smooth_lighting", "true");
+	settings->setDefault("greedy_meshing", "false");
 	settings->setDefault("frametime_graph", "false");
 	settings->setDefault("enable_texture_atlas", "true");
+	settings->setDefault("mesh_update_threads", "0");
 	settings->setDefault("texture_path", "");
 	settings->setDefault("video_driver", "opengl");
 	settings->setDefault("free_move", "false");
@@ -97,9 +99,15 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("enable_pvp", "true");
 
 	settings->setDefault("profiler_print_interval", "0");
+	settings->setDefault("lua_profiler_print_interval", "0");
 	settings->setDefault("enable_mapgen_debug_info", "false");
 	settings->setDefault("active_object_send_range_blocks", "3");
 	settings->setDefault("active_block_range", "2");
+	settings->setDefault("abm_time_budget", "0.05");
+	settings->setDefault("globalstep_time_budget", "0.05");
+	settings->setDefault("lua_gc_pause", "200");
+	settings->setDefault("lua_gc_stepmul", "200");
+	settings->setDefault("lua_gc_idle_step_time", "0.005");
 	//settings->setDefault("max_simultaneous_block_sends_per_client", "1");
 	// This causes frametime jitter on client side, or does it?
 	settings->setDefault("max_simultaneous_block_sends_per_client", "2");
@@ -111,6 +119,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("server_unload_unused_data_timeout", "29");
 	settings->setDefault("server_map_save_interval", "5.3");
 	settings->setDefault("full_block_send_enable_min_time_from_building", "2.0");
+	settings->setDefault("compression_codec", "zlib");
+	settings->setDefault("zlib_compression_level", "-1");
 	settings->setDefault("enable_experimental", "false");
 }
 
@@ -292,6 +292,155 @@ void ActiveBlockList::update(core::list<v3s16> &active_positions,
 	ServerEnvironment
 */
 
+struct ActiveABM
+{
+	ActiveBlockModifier *abm;
+	int chance;
+	std::set<content_t> required_neighbors;
+};
+
+class ABMHandler
+{
+private:
+	ServerEnvironment *m_env;
+	std::map<content_t, std::list<ActiveABM> > m_aabms;
+public:
+	ABMHandler(core::list<ABMWithState> &abms,
+			float dtime_s, ServerEnvironment *env,
+			bool use_timers):
+		m_env(env)
+	{
+		if(dtime_s < 0.001)
+			return;
+		INodeDefManager *ndef = env->getGameDef()->ndef();
+		for(core::list<ABMWithState>::Iterator
+				i = abms.begin(); i != abms.end(); i++){
+			ActiveBlockModifier *abm = i->abm;
+			float trigger_interval = abm->getTriggerInterval();
+			if(trigger_interval < 0.001)
+				trigger_interval = 0.001;
+			float actual_interval = dtime_s;
+			if(use_timers){
+				i->timer += dtime_s;
+				if(i->timer < trigger_interval)
+					continue;
+				i->timer -= trigger_interval;
+				actual_interval = trigger_interval;
+			}
+			ActiveABM aabm;
+			aabm.abm = abm;
+			float intervals = actual_interval / trigger_interval;
+			float chance = abm->getTriggerChance();
+			if(chance == 0)
+				chance = 1;
+			aabm.chance = 1.0 / pow((float)1.0/chance, (float)intervals);
+			if(aabm.chance == 0)
+				aabm.chance = 1;
+			// Trigger neighbors
+			std::set<std::string> required_neighbors_s
+					= abm->getRequiredNeighbors();
+			for(std::set<std::string>::iterator
+					i = required_neighbors_s.begin();
+					i != required_neighbors_s.end(); i++){
+				content_t c = ndef->getId(*i);
+				if(c == CONTENT_IGNORE)
+					continue;
+				aabm.required_neighbors.insert(c);
+			}
+			// Trigger contents
+			std::set<std::string> contents_s = abm->getTriggerContents();
+			for(std::set<std::string>::iterator
+					i = contents_s.begin(); i != contents_s.end(); i++){
+				content_t c = ndef->getId(*i);
+				if(c == CONTENT_IGNORE)
+					continue;
+				std::map<content_t, std::list<ActiveABM> >::iterator j;
+				j = m_aabms.find(c);
+				if(j == m_aabms.end()){
+					std::list<ActiveABM> aabmlist;
+					m_aabms[c] = aabmlist;
+					j = m_aabms.find(c);
+				}
+				j->second.push_back(aabm);
+			}
+		}
+	}
+	void apply(MapBlock *block)
+	{
+		if(m_aabms.empty())
+			return;
+
+		ServerMap *map = &m_env->getServerMap();
+
+		v3s16 p0;
+		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
+		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
+		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
+		{
+			MapNode n = block->getNodeNoEx(p0);
+			content_t c = n.getContent();
+			v3s16 p = p0 + block->getPosRelative();
+
+			std::map<content_t, std::list<ActiveABM> >::iterator j;
+			j = m_aabms.find(c);
+			if(j == m_aabms.end())
+				continue;
+
+			for(std::list<ActiveABM>::iterator
+					i = j->second.begin(); i != j->second.end(); i++)
+			{
+				if(myrand() % i->chance != 0)
+					continue;
+
+				// Check neighbors
+				if(!i->required_neighbors.empty())
+				{
+					v3s16 p1;
+					for(p1.X = p.X-1; p1.X <= p.X+1; p1.X++)
+					for(p1.Y = p.Y-1; p1.Y <= p.Y+1; p1.Y++)
+					for(p1.Z = p.Z-1; p1.Z <= p.Z+1; p1.Z++)
+					{
+						if(p1 == p)
+							continue;
+						MapNode n = map->getNodeNoEx(p1);
+						content_t c = n.getContent();
+						std::set<content_t>::const_iterator k;
+						k = i->required_neighbors.find(c);
+						if(k != i->required_neighbors.end()){
+							goto neighbor_found;
+						}
+					}
+					// No required neighbor found
+					continue;
+				}
+neighbor_found:
+
+				// Find out how many objects the block contains
+				u32 active_object_count = block->m_static_objects.m_active.size();
+				// Find out how many objects this and all the neighbors contain
+				u32 active_object_count_wider = 0;
+				for(s16 x=-1; x<=1; x++)
+				for(s16 y=-1; y<=1; y++)
+				for(s16 z=-1; z<=1; z++)
+				{
+					MapBlock *block2 = map->getBlockNoCreateNoEx(
+							block->getPos() + v3s16(x,y,z));
+					if(block2==NULL)
+						continue;
+					active_object_count_wider +=
+							block2->m_static_objects.m_active.size()
+							+ block2->m_static_objects.m_stored.size();
+				}
+
+				// Call all the trigger variations
+				i->abm->trigger(m_env, p, n);
+				i->abm->trigger(m_env, p, n,
+						active_object_count, active_object_count_wider);
+			}
+		}
+	}
+};
+
 ServerEnvironment::ServerEnvironment(ServerMap *map, lua_State *L,
 		IGameDef *gamedef, IBackgroundBlockEmerger *emerger):
 	m_map(map),
@@ -301,12 +450,16 @@ ServerEnvironment::ServerEnvironment(ServerMap *map, lua_State *L,
 	m_random_spawn_timer(3),
 	m_send_recommended_timer(0),
 	m_game_time(0),
-	m_game_time_fraction_counter(0)
+	m_game_time_fraction_counter(0),
+	m_abm_handler(NULL)
 {
+	m_map->addEventReceiver(this);
 }
 
 ServerEnvironment::~ServerEnvironment()
 {
+	m_map->removeEventReceiver(this);
+
 	// Clear active block list.
 	// This makes the next one delete all active objects.
 	m_active_blocks.clear();
@@ -317,6 +470,8 @@ ServerEnvironment::~ServerEnvironment()
 	// Drop/delete map
 	m_map->drop();
 
+	delete m_abm_handler;
+
 	// Delete ActiveBlockModifiers
 	for(core::list<ABMWithState>::Iterator
 			i = m_abms.begin(); i != m_abms.end(); i++){
@@ -577,155 +732,6 @@ void ServerEnvironment::loadMeta(const std::string &savedir)
 	}
 }
 
-struct ActiveABM
-{
-	ActiveBlockModifier *abm;
-	int chance;
-	std::set<content_t> required_neighbors;
-};
-
-class ABMHandler
-{
-private:
-	ServerEnvironment *m_env;
-	std::map<content_t, std::list<ActiveABM> > m_aabms;
-public:
-	ABMHandler(core::list<ABMWithState> &abms,
-			float dtime_s, ServerEnvironment *env,
-			bool use_timers):
-		m_env(env)
-	{
-		if(dtime_s < 0.001)
-			return;
-		INodeDefManager *ndef = env->getGameDef()->ndef();
-		for(core::list<ABMWithState>::Iterator
-				i = abms.begin(); i != abms.end(); i++){
-			ActiveBlockModifier *abm = i->abm;
-			float trigger_interval = abm->getTriggerInterval();
-			if(trigger_interval < 0.001)
-				trigger_interval = 0.001;
-			float actual_interval = dtime_s;
-			if(use_timers){
-				i->timer += dtime_s;
-				if(i->timer < trigger_interval)
-					continue;
-				i->timer -= trigger_interval;
-				actual_interval = trigger_interval;
-			}
-			ActiveABM aabm;
-			aabm.abm = abm;
-			float intervals = actual_interval / trigger_interval;
-			float chance = abm->getTriggerChance();
-			if(chance == 0)
-				chance = 1;
-			aabm.chance = 1.0 / pow((float)1.0/chance, (float)intervals);
-			if(aabm.chance == 0)
-				aabm.chance = 1;
-			// Trigger neighbors
-			std::set<std::string> required_neighbors_s
-					= abm->getRequiredNeighbors();
-			for(std::set<std::string>::iterator
-					i = required_neighbors_s.begin();
-					i != required_neighbors_s.end(); i++){
-				content_t c = ndef->getId(*i);
-				if(c == CONTENT_IGNORE)
-					continue;
-				aabm.required_neighbors.insert(c);
-			}
-			// Trigger contents
-			std::set<std::string> contents_s = abm->getTriggerContents();
-			for(std::set<std::string>::iterator
-					i = contents_s.begin(); i != contents_s.end(); i++){
-				content_t c = ndef->getId(*i);
-				if(c == CONTENT_IGNORE)
-					continue;
-				std::map<content_t, std::list<ActiveABM> >::iterator j;
-				j = m_aabms.find(c);
-				if(j == m_aabms.end()){
-					std::list<ActiveABM> aabmlist;
-					m_aabms[c] = aabmlist;
-					j = m_aabms.find(c);
-				}
-				j->second.push_back(aabm);
-			}
-		}
-	}
-	void apply(MapBlock *block)
-	{
-		if(m_aabms.empty())
-			return;
-
-		ServerMap *map = &m_env->getServerMap();
-
-		v3s16 p0;
-		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
-		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
-		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
-		{
-			MapNode n = block->getNodeNoEx(p0);
-			content_t c = n.getContent();
-			v3s16 p = p0 + block->getPosRelative();
-
-			std::map<content_t, std::list<ActiveABM> >::iterator j;
-			j = m_aabms.find(c);
-			if(j == m_aabms.end())
-				continue;
-
-			for(std::list<ActiveABM>::iterator
-					i = j->second.begin(); i != j->second.end(); i++)
-			{
-				if(myrand() % i->chance != 0)
-					continue;
-
-				// Check neighbors
-				if(!i->required_neighbors.empty())
-				{
-					v3s16 p1;
-					for(p1.X = p.X-1; p1.X <= p.X+1; p1.X++)
-					for(p1.Y = p.Y-1; p1.Y <= p.Y+1; p1.Y++)
-					for(p1.Z = p.Z-1; p1.Z <= p.Z+1; p1.Z++)
-					{
-						if(p1 == p)
-							continue;
-						MapNode n = map->getNodeNoEx(p1);
-						content_t c = n.getContent();
-						std::set<content_t>::const_iterator k;
-						k = i->required_neighbors.find(c);
-						if(k != i->required_neighbors.end()){
-							goto neighbor_found;
-						}
-					}
-					// No required neighbor found
-					continue;
-				}
-neighbor_found:
-
-				// Find out how many objects the block contains
-				u32 active_object_count = block->m_static_objects.m_active.size();
-				// Find out how many objects this and all the neighbors contain
-				u32 active_object_count_wider = 0;
-				for(s16 x=-1; x<=1; x++)
-				for(s16 y=-1; y<=1; y++)
-				for(s16 z=-1; z<=1; z++)
-				{
-					MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block->getPos() + v3s16(x,y,z));
-					if(block2==NULL)
-						continue;
-					active_object_count_wider +=
-							block2->m_static_objects.m_active.size()
-							+ block2->m_static_objects.m_stored.size();
-				}
-
-				// Call all the trigger variations
-				i->abm->trigger(m_env, p, n);
-				i->abm->trigger(m_env, p, n,
-						active_object_count, active_object_count_wider);
-			}
-		}
-	}
-};
-
 void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 {
 	// Get time difference
@@ -773,12 +779,10 @@ void ServerEnvironment::addActiveBlockModifier(ActiveBlockModifier *abm)
 std::set<u16> ServerEnvironment::getObjectsInsideRadius(v3f pos, float radius)
 {
 	std::set<u16> objects;
-	for(core::map<u16, ServerActiveObject*>::Iterator
-			i = m_active_objects.getIterator();
-			i.atEnd()==false; i++)
+	for(u32 i=0; i<m_active_objects.size(); i++)
 	{
-		ServerActiveObject* obj = i.getNode()->getValue();
-		u16 id = i.getNode()->getKey();
+		ServerActiveObject* obj = m_active_objects.getAt(i);
+		u16 id = m_active_objects.getIdAt(i);
 		v3f objectpos = obj->getBasePosition();
 		if(objectpos.getDistanceFrom(pos) > radius)
 			continue;
@@ -787,17 +791,37 @@ std::set<u16> ServerEnvironment::getObjectsInsideRadius(v3f pos, float radius)
 	return objects;
 }
 
+void ServerEnvironment::wakeObjectsInBlock(v3s16 blockpos)
+{
+	m_wake_blocks.insert(blockpos, true);
+}
+
+void ServerEnvironment::onMapEditEvent(MapEditEvent *event)
+{
+	if(event->type == MEET_ADDNODE || event->type == MEET_REMOVENODE)
+	{
+		wakeObjectsInBlock(getNodeBlockPos(event->p));
+	}
+	else if(event->type == MEET_OTHER)
+	{
+		for(core::map<v3s16, bool>::Iterator
+				i = event->modified_blocks.getIterator();
+				i.atEnd()==false; i++)
+		{
+			wakeObjectsInBlock(i.getNode()->getKey());
+		}
+	}
+}
+
 void ServerEnvironment::clearAllObjects()
 {
 	infostream<<"ServerEnvironment::clearAllObjects(): "
 			<<"Removing all active objects"<<std::endl;
 	core::list<u16> objects_to_remove;
-	for(core::map<u16, ServerActiveObject*>::Iterator
-			i = m_active_objects.getIterator();
-			i.atEnd()==false; i++)
+	for(u32 i=0; i<m_active_objects.size(); i++)
 	{
-		ServerActiveObject* obj = i.getNode()->getValue();
-		u16 id = i.getNode()->getKey();		
+		ServerActiveObject* obj = m_active_objects.getAt(i);
+		u16 id = m_active_objects.getIdAt(i);		
 		v3f objectpos = obj->getBasePosition();	
 		// Delete static object if block is loaded
 		if(obj->m_static_exists){
@@ -927,16 +951,13 @@ void ServerEnvironment::step(float dtime)
 			{
 				// Get node that is at BS/4 under player
 				v3s16 bottompos = floatToInt(playerpos + v3f(0,-BS/4,0), BS);
-				try{
-					MapNode n = m_map->getNode(bottompos);
-					if(n.getContent() == LEGN(m_gamedef->ndef(), "CONTENT_GRASS"))
-					{
-						n.setContent(LEGN(m_gamedef->ndef(), "CONTENT_GRASS_FOOTSTEPS"));
-						m_map->setNode(bottompos, n);
-					}
-				}
-				catch(InvalidPositionException &e)
+				bool is_position_valid;
+				MapNode n = m_map->getNodeNoEx(bottompos, &is_position_valid);
+				if(is_position_valid && n.getContent()
+						== LEGN(m_gamedef->ndef(), "CONTENT_GRASS"))
 				{
+					n.setContent(LEGN(m_gamedef->ndef(), "CONTENT_GRASS_FOOTSTEPS"));
+					m_map->setNode(bottompos, n);
 				}
 			}
 		}
@@ -1071,24 +1092,65 @@ void ServerEnvironment::step(float dtime)
 		}
 	}
 	
+	/*
+		Handle ActiveBlockModifiers
+
+		A round over the active blocks is started every abm_interval.
+		A step only spends abm_time_budget seconds on it; the blocks
+		that are left are handled on the next steps in the same order,
+		and a new round is not started before the old one is done.
+	*/
 	const float abm_interval = 1.0;
 	if(m_active_block_modifier_interval.step(dtime, abm_interval))
 	{
-		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg /1s", SPT_AVG);
-		TimeTaker timer("modify in active blocks");
+		if(m_abm_handler != NULL)
+		{
+			infostream<<"ServerEnvironment: active block modifiers are "
+					<<"running behind, "<<m_abm_blocks.size()
+					<<" blocks left"<<std::endl;
+			g_profiler->add("SEnv: ABM rounds skipped", 1);
+		}
+		else
+		{
+			m_abm_handler = new ABMHandler(m_abms, abm_interval, this, true);
+			for(core::map<v3s16, bool>::Iterator
+					i = m_active_blocks.m_list.getIterator();
+					i.atEnd()==false; i++)
+				m_abm_blocks.push_back(i.getNode()->getKey());
+		}
+	}
+	if(m_abm_handler != NULL)
+	{
+		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg", SPT_AVG);
 		
-		// Initialize handling of ActiveBlockModifiers
-		ABMHandler abmhandler(m_abms, abm_interval, this, true);
+		u32 budget_us = g_settings->getFloat("abm_time_budget") * 1000000;
+		u32 start_time = porting::getTimeUs();
+		scriptapi_budget_start(m_lua);
 
-		for(core::map<v3s16, bool>::Iterator
-				i = m_active_blocks.m_list.getIterator();
-				i.atEnd()==false; i++)
+		u32 handled_count = 0;
+		while(m_abm_blocks.size() != 0)
 		{
-			v3s16 p = i.getNode()->getKey();
-			
+			// Handle at least one block on every step so that the round
+			// finishes even with a tiny budget
+			if(handled_count != 0 && budget_us != 0
+					&& porting::getTimeUs() - start_time >= budget_us)
+			{
+				scriptapi_budget_overrun(m_lua);
+				g_profiler->add("SEnv: ABM budget overruns", 1);
+				break;
+			}
+
+			core::list<v3s16>::Iterator first = m_abm_blocks.begin();
+			v3s16 p = *first;
+			m_abm_blocks.erase(first);
+
 			/*infostream<<"Server: Block ("<<p.X<<","<<p.Y<<","<<p.Z
 					<<") being handled"<<std::endl;*/
 
+			// The block may have become inactive during the round
+			if(m_active_blocks.contains(p) == false)
+				continue;
+
 			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
 			if(block==NULL)
 				continue;
@@ -1097,15 +1159,14 @@ void ServerEnvironment::step(float dtime)
 			block->setTimestampNoChangedFlag(m_game_time);
 
 			/* Handle ActiveBlockModifiers */
-			abmhandler.apply(block);
+			m_abm_handler->apply(block);
+			handled_count++;
 		}
 
-		u32 time_ms = timer.stop(true);
-		u32 max_time_ms = 200;
-		if(time_ms > max_time_ms){
-			infostream<<"WARNING: active block modifiers took "
-					<<time_ms<<"ms (longer than "
-					<<max_time_ms<<"ms)"<<std::endl;
+		if(m_abm_blocks.size() == 0)
+		{
+			delete m_abm_handler;
+			m_abm_handler = NULL;
 		}
 	}
 	
@@ -1132,28 +1193,53 @@ void ServerEnvironment::step(float dtime)
 			send_recommended = true;
 		}
 
-		for(core::map<u16, ServerActiveObject*>::Iterator
-				i = m_active_objects.getIterator();
+		bool only_peaceful_mobs = g_settings->getBool("only_peaceful_mobs");
+
+		/*
+			Take the blocks changed since the last step. Changes done
+			by the objects below wake up objects at the next step.
+		*/
+		core::map<v3s16, bool> wake_blocks;
+		for(core::map<v3s16, bool>::Iterator
+				i = m_wake_blocks.getIterator();
 				i.atEnd()==false; i++)
 		{
-			ServerActiveObject* obj = i.getNode()->getValue();
+			wake_blocks.insert(i.getNode()->getKey(), true);
+		}
+		m_wake_blocks.clear();
+
+		u32 sleeping_count = 0;
+
+		for(u32 i=0; i<m_active_objects.size(); i++)
+		{
+			ServerActiveObject* obj = m_active_objects.getAt(i);
 			// Remove non-peaceful mobs on peaceful mode
-			if(g_settings->getBool("only_peaceful_mobs")){
+			if(only_peaceful_mobs){
 				if(!obj->isPeaceful())
 					obj->m_removed = true;
 			}
 			// Don't step if is to be removed or stored statically
 			if(obj->m_removed || obj->m_pending_deactivation)
 				continue;
-			// Step object
-			obj->step(dtime, send_recommended);
+			// Wake up if nodes around have changed
+			if(wake_blocks.size() != 0)
+				obj->wakeUpIfInBlocks(wake_blocks);
+			// Step object unless it is sleeping
+			if(obj->isSleeping())
+				sleeping_count++;
+			else
+				obj->step(dtime, send_recommended);
 			// Read messages from object
+			u16 generation = m_active_objects.getGeneration(obj->getId());
 			while(obj->m_messages_out.size() > 0)
 			{
-				m_active_object_messages.push_back(
-						obj->m_messages_out.pop_front());
+				ActiveObjectMessage aom = obj->m_messages_out.pop_front();
+				aom.generation = generation;
+				m_active_object_messages.push_back(aom);
 			}
 		}
+
+		g_profiler->avg("SEnv: num of sleeping objects", sleeping_count);
 	}
 	
 	/*
@@ -1171,43 +1257,7 @@ void ServerEnvironment::step(float dtime)
 
 ServerActiveObject* ServerEnvironment::getActiveObject(u16 id)
 {
-	core::map<u16, ServerActiveObject*>::Node *n;
-	n = m_active_objects.find(id);
-	if(n == NULL)
-		return NULL;
-	return n->getValue();
-}
-
-bool isFreeServerActiveObjectId(u16 id,
-		core::map<u16, ServerActiveObject*> &objects)
-{
-	if(id == 0)
-		return false;
-	
-	for(core::map<u16, ServerActiveObject*>::Iterator
-			i = objects.getIterator();
-			i.atEnd()==false; i++)
-	{
-		if(i.getNode()->getKey() == id)
-			return false;
-	}
-	return true;
-}
-
-u16 getFreeServerActiveObjectId(
-		core::map<u16, ServerActiveObject*> &objects)
-{
-	u16 new_id = 1;
-	for(;;)
-	{
-		if(isFreeServerActiveObjectId(new_id, objects))
-			return new_id;
-		
-		if(new_id == 65535)
-			return 0;
-
-		new_id++;
-	}
+	return m_active_objects.get(id);
 }
 
 u16 ServerEnvironment::addActiveObject(ServerActiveObject *object)
@@ -1277,13 +1327,11 @@ void ServerEnvironment::getAddedActiveObjects(v3s16 pos, s16 radius,
 		- discard objects that are found in current_objects.
 		- add remaining objects to added_objects
 	*/
-	for(core::map<u16, ServerActiveObject*>::Iterator
-			i = m_active_objects.getIterator();
-			i.atEnd()==false; i++)
+	for(u32 i=0; i<m_active_objects.size(); i++)
 	{
-		u16 id = i.getNode()->getKey();
+		u16 id = m_active_objects.getIdAt(i);
 		// Get object
-		ServerActiveObject *object = i.getNode()->getValue();
+		ServerActiveObject *object = m_active_objects.getAt(i);
 		if(object == NULL)
 			continue;
 		// Discard if removed
@@ -1361,10 +1409,15 @@ void ServerEnvironment::getRemovedActiveObjects(v3s16 pos, s16 radius,
 
 ActiveObjectMessage ServerEnvironment::getActiveObjectMessage()
 {
-	if(m_active_object_messages.size() == 0)
-		return ActiveObjectMessage(0);
-	
-	return m_active_object_messages.pop_front();
+	while(m_active_object_messages.size() != 0)
+	{
+		ActiveObjectMessage aom = m_active_object_messages.pop_front();
+		// Drop the messages of objects removed since, as their id may
+		// already belong to another object
+		if(m_active_objects.get(aom.id, aom.generation) != NULL)
+			return aom;
+	}
+	return ActiveObjectMessage(0);
 }
 
 /*
@@ -1376,7 +1429,7 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 {
 	assert(object);
 	if(object->getId() == 0){
-		u16 new_id = getFreeServerActiveObjectId(m_active_objects);
+		u16 new_id = m_active_objects.getFreeId();
 		if(new_id == 0)
 		{
 			errorstream<<"ServerEnvironment::addActiveObjectRaw(): "
@@ -1391,7 +1444,7 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 		verbosestream<<"ServerEnvironment::addActiveObjectRaw(): "
 				<<"supplied with id "<<object->getId()<<std::endl;
 	}
-	if(isFreeServerActiveObjectId(object->getId(), m_active_objects) == false)
+	if(m_active_objects.insert(object->getId(), object) == false)
 	{
 		errorstream<<"ServerEnvironment::addActiveObjectRaw(): "
 				<<"id is not free ("<<object->getId()<<")"<<std::endl;
@@ -1401,8 +1454,6 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 	}
 	/*infostream<<"ServerEnvironment::addActiveObjectRaw(): "
 			<<"added (id="<<object->getId()<<")"<<std::endl;*/
-			
-	m_active_objects.insert(object->getId(), object);
   
 	verbosestream<<"ServerEnvironment::addActiveObjectRaw(): "
 			<<"Added id="<<object->getId()<<"; there are now "
@@ -1450,12 +1501,10 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 void ServerEnvironment::removeRemovedObjects()
 {
 	core::list<u16> objects_to_remove;
-	for(core::map<u16, ServerActiveObject*>::Iterator
-			i = m_active_objects.getIterator();
-			i.atEnd()==false; i++)
+	for(u32 i=0; i<m_active_objects.size(); i++)
 	{
-		u16 id = i.getNode()->getKey();
-		ServerActiveObject* obj = i.getNode()->getValue();
+		u16 id = m_active_objects.getIdAt(i);
+		ServerActiveObject* obj = m_active_objects.getAt(i);
 		// This shouldn't happen but check it
 		if(obj == NULL)
 		{
@@ -1636,11 +1685,9 @@ void ServerEnvironment::activateObjects(MapBlock *block)
 void ServerEnvironment::deactivateFarObjects(bool force_delete)
 {
 	core::list<u16> objects_to_remove;
-	for(core::map<u16, ServerActiveObject*>::Iterator
-			i = m_active_objects.getIterator();
-			i.atEnd()==false; i++)
+	for(u32 i=0; i<m_active_objects.size(); i++)
 	{
-		ServerActiveObject* obj = i.getNode()->getValue();
+		ServerActiveObject* obj = m_active_objects.getAt(i);
 		assert(obj);
 		
 		// Do not deactivate if static data creation not allowed
@@ -1651,7 +1698,7 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 		if(!force_delete && obj->m_pending_deactivation)
 			continue;
 
-		u16 id = i.getNode()->getKey();		
+		u16 id = m_active_objects.getIdAt(i);		
 		v3f objectpos = obj->getBasePosition();	
 
 		// The block in which the object resides in
@@ -1674,9 +1721,8 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 
 		if(obj->isStaticAllowed())
 		{
-			// Create new static object
-			std::string staticdata_new = obj->getStaticData();
-			StaticObject s_obj(obj->getType(), objectpos, staticdata_new);
+			std::string staticdata_new;
+			bool have_staticdata = false;
 			
 			bool stays_in_same_block = false;
 			bool data_changed = true;
@@ -1692,6 +1738,18 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 				if(n){
 					StaticObject static_old = n->getValue();
 
+					/*
+						If the data of the object never changes, reuse
+						the stored copy instead of creating it again.
+					*/
+					if(!obj->hasConstantStaticData()){
+						staticdata_new = obj->getStaticData();
+					} else {
+						staticdata_new = static_old.data;
+						g_profiler->add("SEnv: static data reused", 1);
+					}
+					have_staticdata = true;
+
 					float save_movem = obj->getMinimumSavedMovement();
 
 					if(static_old.data == staticdata_new &&
@@ -1705,6 +1763,12 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 				}
 			}
 
+			if(!have_staticdata)
+				staticdata_new = obj->getStaticData();
+
+			// Create new static object
+			StaticObject s_obj(obj->getType(), objectpos, staticdata_new);
+
 			bool shall_be_written = (!stays_in_same_block || data_changed);
 			
 			// Delete old static object
@@ -2051,13 +2115,14 @@ void ClientEnvironment::step(float dtime)
 		
 		// Update lighting on all players on client
 		u8 light = LIGHT_MAX;
-		try{
+		{
 			// Get node at head
 			v3s16 p = player->getLightPosition();
-			MapNode n = m_map->getNode(p);
-			light = n.getLightBlend(getDayNightRatio(), m_gamedef->ndef());
+			bool is_position_valid;
+			MapNode n = m_map->getNodeNoEx(p, &is_position_valid);
+			if(is_position_valid)
+				light = n.getLightBlend(getDayNightRatio(), m_gamedef->ndef());
 		}
-		catch(InvalidPositionException &e) {}
 		player->updateLight(light);
 
 		/*
@@ -2067,25 +2132,23 @@ void ClientEnvironment::step(float dtime)
 		{
 			// Get node that is at BS/4 under player
 			v3s16 bottompos = floatToInt(playerpos + v3f(0,-BS/4,0), BS);
-			try{
-				MapNode n = m_map->getNode(bottompos);
-				if(n.getContent() == LEGN(m_gamedef->ndef(), "CONTENT_GRASS"))
+			bool is_position_valid;
+			MapNode n = m_map->getNodeNoEx(bottompos, &is_position_valid);
+			if(is_position_valid && n.getContent()
+					== LEGN(m_gamedef->ndef(), "CONTENT_GRASS"))
+			{
+				n.setContent(LEGN(m_gamedef->ndef(), "CONTENT_GRASS_FOOTSTEPS"));
+				m_map->setNode(bottompos, n);
+				// Update mesh on client
+				if(m_map->mapType() == MAPTYPE_CLIENT)
 				{
-					n.setContent(LEGN(m_gamedef->ndef(), "CONTENT_GRASS_FOOTSTEPS"));
-					m_map->setNode(bottompos, n);
-					// Update mesh on client
-					if(m_map->mapType() == MAPTYPE_CLIENT)
-					{
-						v3s16 p_blocks = getNodeBlockPos(bottompos);
-						MapBlock *b = m_map->getBlockNoCreate(p_blocks);
-						//b->updateMesh(getDayNightRatio());
+					v3s16 p_blocks = getNodeBlockPos(bottompos);
+					MapBlock *b = m_map->getBlockNoCreateNoEx(p_blocks);
+					//b->updateMesh(getDayNightRatio());
+					if(b)
 						b->setMeshExpired(true);
-					}
 				}
 			}
-			catch(InvalidPositionException &e)
-			{
-			}
 		}
 	}
 	
@@ -2106,13 +2169,14 @@ void ClientEnvironment::step(float dtime)
 			// Update lighting
 			//u8 light = LIGHT_MAX;
 			u8 light = 0;
-			try{
+			{
 				// Get node at head
 				v3s16 p = obj->getLightPosition();
-				MapNode n = m_map->getNode(p);
-				light = n.getLightBlend(getDayNightRatio(), m_gamedef->ndef());
+				bool is_position_valid;
+				MapNode n = m_map->getNodeNoEx(p, &is_position_valid);
+				if(is_position_valid)
+					light = n.getLightBlend(getDayNightRatio(), m_gamedef->ndef());
 			}
-			catch(InvalidPositionException &e) {}
 			obj->updateLight(light);
 		}
 	}
@@ -2197,13 +2261,14 @@ u16 ClientEnvironment::addActiveObject(ClientActiveObject *object)
 	object->addToScene(m_smgr, m_texturesource, m_irr);
 	{ // Update lighting immediately
 		u8 light = 0;
-		try{
+		{
 			// Get node at head
 			v3s16 p = object->getLightPosition();
-			MapNode n = m_map->getNode(p);
-			light = n.getLightBlend(getDayNightRatio(), m_gamedef->ndef());
+			bool is_position_valid;
+			MapNode n = m_map->getNodeNoEx(p, &is_position_valid);
+			if(is_position_valid)
+				light = n.getLightBlend(getDayNightRatio(), m_gamedef->ndef());
 		}
-		catch(InvalidPositionException &e) {}
 		object->updateLight(light);
 	}
 	return object->getId();
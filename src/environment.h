@@ -132,6 +132,8 @@ struct ABMWithState
 	ABMWithState(ActiveBlockModifier *abm_);
 };
 
+class ABMHandler;
+
 /*
 	List of active blocks, used by ServerEnvironment
 */
@@ -169,7 +171,7 @@ class IBackgroundBlockEmerger
 	This is not thread-safe. Server uses an environment mutex.
 */
 
-class ServerEnvironment : public Environment
+class ServerEnvironment : public Environment, public MapEventReceiver
 {
 public:
 	ServerEnvironment(ServerMap *map, lua_State *L, IGameDef *gamedef,
@@ -275,6 +277,15 @@ class ServerEnvironment : public Environment
 	
 	// Clear all objects, loading and going through every MapBlock
 	void clearAllObjects();
+
+	/*
+		Wake up sleeping objects in or right above a block whose nodes
+		have changed. Done at the next step.
+	*/
+	void wakeObjectsInBlock(v3s16 blockpos);
+
+	// Calls wakeObjectsInBlock() for the changed blocks
+	void onMapEditEvent(MapEditEvent *event);
 	
 	// This makes stuff happen
 	void step(f32 dtime);
@@ -332,9 +343,11 @@ class ServerEnvironment : public Environment
 	// Background block emerger (the server, in practice)
 	IBackgroundBlockEmerger *m_emerger;
 	// Active object list
-	core::map<u16, ServerActiveObject*> m_active_objects;
+	ActiveObjectMap<ServerActiveObject> m_active_objects;
 	// Outgoing network message buffer for active objects
 	Queue<ActiveObjectMessage> m_active_object_messages;
+	// Blocks whose sleeping objects are woken up at the next step
+	core::map<v3s16, bool> m_wake_blocks;
 	// Some timers
 	float m_random_spawn_timer; // used for experimental code
 	float m_send_recommended_timer;
@@ -350,6 +363,10 @@ class ServerEnvironment : public Environment
 	// A helper variable for incrementing the latter
 	float m_game_time_fraction_counter;
 	core::list<ABMWithState> m_abms;
+	// The ActiveBlockModifier round in progress, or NULL
+	ABMHandler *m_abm_handler;
+	// Blocks left in the round
+	core::list<v3s16> m_abm_blocks;
 };
 
 #ifndef SERVER
@@ -409,18 +426,13 @@ class ClientEnvironment : public Environment
 	void updateMeshes(v3s16 blockpos);
 	void expireMeshes(bool only_daynight_diffed);
 
+	/*
+		Meshes don't need to be remade when the day/night ratio
+		changes; ClientMap recolors them when they are drawn.
+	*/
 	void setTimeOfDay(u32 time)
 	{
-		u32 old_dr = getDayNightRatio();
-
 		Environment::setTimeOfDay(time);
-
-		if(getDayNightRatio() != old_dr)
-		{
-			/*infostream<<"ClientEnvironment: DayNightRatio changed"
-					<<" -> expiring meshes"<<std::endl;*/
-			expireMeshes(true);
-		}
 	}
 
 	/*
@@ -18,8 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 /*
-	A quick messy implementation of terrain rendering for a long
-	distance according to map seed
+	Terrain rendering for a long distance, see farmesh.h
 */
 
 #include "farmesh.h"
@@ -28,11 +27,179 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "debug.h"
 #include "noise.h"
 #include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
 #include "client.h"
-#include "tile.h" // ITextureSource
+#include "main.h" // For g_profiler
+#include "profiler.h"
 
 #include "mapgen.h" // Shouldn't really be done this way
 
+/*
+	FarBlockSurface
+*/
+
+// Ground, trees, buildings and liquids. Plants and such are left out.
+static bool isSurface(const ContentFeatures &f)
+{
+	return (f.walkable || f.isLiquid());
+}
+
+FarBlockSurface getFarBlockSurface(const MapBlockSnapshot *block,
+		v3s16 blockpos, INodeDefManager *ndef)
+{
+	FarBlockSurface s;
+	s16 y0 = blockpos.Y * MAP_BLOCKSIZE;
+
+	if(block->isUniform())
+	{
+		MapNode n = block->getNodeNoCheck(v3s16(0,0,0));
+		if(isSurface(ndef->get(n)))
+		{
+			s.has_surface = true;
+			s.columns = MAP_BLOCKSIZE*MAP_BLOCKSIZE;
+			s.height = y0 + MAP_BLOCKSIZE - 0.5;
+			s.content = n.getContent();
+		}
+		return s;
+	}
+
+	// Content of the topmost node of each column that has one
+	core::array<content_t> contents;
+	f32 height_sum = 0;
+	for(s16 z=0; z<MAP_BLOCKSIZE; z++)
+	for(s16 x=0; x<MAP_BLOCKSIZE; x++)
+	{
+		for(s16 y=MAP_BLOCKSIZE-1; y>=0; y--)
+		{
+			MapNode n = block->getNodeNoCheck(v3s16(x,y,z));
+			if(isSurface(ndef->get(n)) == false)
+				continue;
+			height_sum += y0 + y + 0.5;
+			contents.push_back(n.getContent());
+			break;
+		}
+	}
+
+	if(contents.size() == 0)
+		return s;
+
+	s.has_surface = true;
+	s.columns = contents.size();
+	s.height = height_sum / contents.size();
+
+	contents.sort();
+	u32 best_count = 0;
+	for(u32 i=0; i<contents.size();)
+	{
+		u32 j = i;
+		while(j < contents.size() && contents[j] == contents[i])
+			j++;
+		if(j - i > best_count)
+		{
+			best_count = j - i;
+			s.content = contents[i];
+		}
+		i = j;
+	}
+
+	return s;
+}
+
+/*
+	FarSurfaceMap
+*/
+
+FarSurfaceMap::~FarSurfaceMap()
+{
+	for(core::map<v2s16, SectorSurfaces*>::Iterator
+			i = m_sectors.getIterator();
+			i.atEnd() == false; i++)
+	{
+		delete i.getNode()->getValue();
+	}
+}
+
+void FarSurfaceMap::setBlock(v3s16 p, const FarBlockSurface &s)
+{
+	v2s16 p2d(p.X, p.Z);
+
+	SectorSurfaces *sector = NULL;
+	core::map<v2s16, SectorSurfaces*>::Node *n = m_sectors.find(p2d);
+	if(n != NULL)
+		sector = n->getValue();
+
+	// Blocks without a surface don't need to be stored
+	if(s.has_surface == false)
+	{
+		if(sector == NULL || sector->find(p.Y) == NULL)
+			return;
+		sector->remove(p.Y);
+	}
+	else
+	{
+		if(sector == NULL)
+		{
+			sector = new SectorSurfaces;
+			m_sectors.insert(p2d, sector);
+		}
+		SectorSurfaces::Node *n2 = sector->find(p.Y);
+		if(n2 != NULL && n2->getValue() == s)
+			return;
+		(*sector)[p.Y] = s;
+	}
+
+	// The corners of the neighboring sectors depend on this one too
+	for(s16 z=-1; z<=1; z++)
+	for(s16 x=-1; x<=1; x++)
+	{
+		v2s16 rp = getContainerPos(p2d + v2s16(x,z), FARMESH_REGION_SIZE);
+		m_changed_regions[rp] = true;
+	}
+}
+
+bool FarSurfaceMap::getSector(v2s16 p, FarBlockSurface *s)
+{
+	core::map<v2s16, SectorSurfaces*>::Node *n = m_sectors.find(p);
+	if(n == NULL)
+		return false;
+
+	// A quarter of the sector
+	const u16 min_columns = MAP_BLOCKSIZE*MAP_BLOCKSIZE/4;
+
+	bool found = false;
+	bool found_covering = false;
+	for(SectorSurfaces::Iterator i = n->getValue()->getIterator();
+			i.atEnd() == false; i++)
+	{
+		const FarBlockSurface &s2 = i.getNode()->getValue();
+		bool covering = (s2.columns >= min_columns);
+		if(found_covering && covering == false)
+			continue;
+		if(found && (covering == found_covering) && s2.height <= s->height)
+			continue;
+		*s = s2;
+		found = true;
+		found_covering = covering;
+	}
+	return found;
+}
+
+void FarSurfaceMap::takeChangedRegions(core::list<v2s16> &regions)
+{
+	for(core::map<v2s16, bool>::Iterator
+			i = m_changed_regions.getIterator();
+			i.atEnd() == false; i++)
+	{
+		regions.push_back(i.getNode()->getKey());
+	}
+	m_changed_regions.clear();
+}
+
+/*
+	FarMesh
+*/
+
 FarMesh::FarMesh(
 		scene::ISceneNode* parent,
 		scene::ISceneManager* mgr,
@@ -41,32 +208,21 @@ FarMesh::FarMesh(
 		Client *client
 ):
 	scene::ISceneNode(parent, mgr, id),
+	m_brightness(1.0),
+	m_brightness_level(64),
 	m_seed(seed),
 	m_camera_pos(0,0),
 	m_time(0),
 	m_client(client),
-	m_render_range(20*MAP_BLOCKSIZE)
+	m_render_range(20*MAP_BLOCKSIZE),
+	m_near_range(0)
 {
 	dstream<<__FUNCTION_NAME<<std::endl;
 	
-	//video::IVideoDriver* driver = mgr->getVideoDriver();
-
-	m_materials[0].setFlag(video::EMF_LIGHTING, false);
-	m_materials[0].setFlag(video::EMF_BACK_FACE_CULLING, true);
-	//m_materials[0].setFlag(video::EMF_BACK_FACE_CULLING, false);
-	m_materials[0].setFlag(video::EMF_BILINEAR_FILTER, false);
-	m_materials[0].setFlag(video::EMF_FOG_ENABLE, false);
-	//m_materials[0].setFlag(video::EMF_ANTI_ALIASING, true);
-	//m_materials[0].MaterialType = video::EMT_TRANSPARENT_VERTEX_ALPHA;
-	m_materials[0].setFlag(video::EMF_FOG_ENABLE, true);
-	
-	m_materials[1].setFlag(video::EMF_LIGHTING, false);
-	m_materials[1].setFlag(video::EMF_BACK_FACE_CULLING, false);
-	m_materials[1].setFlag(video::EMF_BILINEAR_FILTER, false);
-	m_materials[1].setFlag(video::EMF_FOG_ENABLE, false);
-	m_materials[1].setTexture(0, client->tsrc()->getTextureRaw("treeprop.png"));
-	m_materials[1].MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF;
-	m_materials[1].setFlag(video::EMF_FOG_ENABLE, true);
+	m_material.setFlag(video::EMF_LIGHTING, false);
+	m_material.setFlag(video::EMF_BACK_FACE_CULLING, true);
+	m_material.setFlag(video::EMF_BILINEAR_FILTER, false);
+	m_material.setFlag(video::EMF_FOG_ENABLE, true);
 
 	m_box = core::aabbox3d<f32>(-BS*1000000,-BS*31000,-BS*1000000,
 			BS*1000000,BS*31000,BS*1000000);
@@ -76,16 +232,23 @@ FarMesh::FarMesh(
 FarMesh::~FarMesh()
 {
 	dstream<<__FUNCTION_NAME<<std::endl;
+
+	for(core::map<v2s16, Region*>::Iterator
+			i = m_regions.getIterator();
+			i.atEnd() == false; i++)
+	{
+		deleteRegion(i.getNode()->getValue());
+	}
 }
 
 u32 FarMesh::getMaterialCount() const
 {
-	return FARMESH_MATERIAL_COUNT;
+	return 1;
 }
 
 video::SMaterial& FarMesh::getMaterial(u32 i)
 {
-	return m_materials[i];
+	return m_material;
 }
 	
 
@@ -93,23 +256,18 @@ void FarMesh::OnRegisterSceneNode()
 {
 	if(IsVisible)
 	{
-		//SceneManager->registerNodeForRendering(this, scene::ESNRP_TRANSPARENT);
 		SceneManager->registerNodeForRendering(this, scene::ESNRP_SOLID);
-		//SceneManager->registerNodeForRendering(this, scene::ESNRP_SKY_BOX);
 	}
 
 	ISceneNode::OnRegisterSceneNode();
 }
 
-#define MYROUND(x) (x > 0.0 ? (int)x : (int)x - 1)
-
-// Temporary hack
+// Guess of the terrain generated from the map seed
 struct HeightPoint
 {
 	float gh; // ground height
 	float ma; // mud amount
 	float have_sand;
-	float tree_amount;
 };
 core::map<v2s16, HeightPoint> g_heights;
 
@@ -122,282 +280,305 @@ HeightPoint ground_height(u64 seed, v2s16 p2d)
 	s16 level = mapgen::find_ground_level_from_noise(seed, p2d, 3);
 	hp.gh = (level-4)*BS;
 	hp.ma = (4)*BS;
-	/*hp.gh = BS*base_rock_level_2d(seed, p2d);
-	hp.ma = BS*get_mud_add_amount(seed, p2d);*/
 	hp.have_sand = mapgen::get_have_sand(seed, p2d);
-	if(hp.gh > BS*WATER_LEVEL)
-		hp.tree_amount = mapgen::tree_amount_2d(seed, p2d);
-	else
-		hp.tree_amount = 0;
 	// No mud has been added if mud amount is less than 1
 	if(hp.ma < 1.0*BS)
 		hp.ma = 0.0;
-	//hp.gh -= BS*3; // Lower a bit so that it is not that much in the way
 	g_heights[p2d] = hp;
 	return hp;
 }
 
+video::SColor FarMesh::getContentColor(content_t c)
+{
+	// Averaged from the node's texture when the textures were loaded
+	video::SColor color = m_client->ndef()->get(c).average_color;
+	if(color.getAlpha() == 0)
+		return video::SColor(255,128,128,128);
+	return color;
+}
+
+void FarMesh::getSectorSurface(v2s16 p, f32 *height, video::SColor *color)
+{
+	FarBlockSurface s;
+	if(m_client->getFarSurfaces().getSector(p, &s))
+	{
+		*height = s.height * BS;
+		*color = getContentColor(s.content);
+		return;
+	}
+
+	/*
+		Nothing has been received from here; guess from the map seed
+	*/
+	HeightPoint hp = ground_height(m_seed, v2s16(
+			p.X*MAP_BLOCKSIZE + MAP_BLOCKSIZE/2,
+			p.Y*MAP_BLOCKSIZE + MAP_BLOCKSIZE/2));
+	f32 h = hp.gh + hp.ma;
+	*height = h;
+	if(h < WATER_LEVEL*BS)
+	{
+		*height = WATER_LEVEL*BS;
+		*color = video::SColor(255,74,105,170);
+	}
+	else if(hp.ma < 2.0*BS)
+	{
+		*color = video::SColor(255,128,128,128);
+	}
+	else if(h <= 2.5*BS && hp.have_sand)
+	{
+		*color = video::SColor(255,210,194,156);
+	}
+	else
+	{
+		*color = video::SColor(255,107,134,51);
+	}
+}
+
+FarMesh::Region * FarMesh::buildRegion(v2s16 rp)
+{
+	const s16 size = FARMESH_REGION_SIZE;
+	v2s16 p0 = rp * size;
+
+	/*
+		Get the surfaces of the region and the sectors around it.
+		Corners are at the average height of the four sectors around
+		them so that the terrain has no holes.
+	*/
+	f32 heights[size+2][size+2];
+	video::SColor colors[size+2][size+2];
+	for(s16 z=0; z<size+2; z++)
+	for(s16 x=0; x<size+2; x++)
+	{
+		getSectorSurface(p0 + v2s16(x-1, z-1),
+				&heights[z][x], &colors[z][x]);
+	}
+
+	Region *r = new Region;
+	r->buf = new scene::SMeshBuffer();
+	r->brightness_level = m_brightness_level + 1;
+
+	const f32 sector_size = MAP_BLOCKSIZE*BS;
+
+	for(s16 z=0; z<size; z++)
+	for(s16 x=0; x<size; x++)
+	{
+		s16 cx = x + 1;
+		s16 cz = z + 1;
+		f32 h00 = (heights[cz][cx] + heights[cz-1][cx]
+				+ heights[cz][cx-1] + heights[cz-1][cx-1]) / 4;
+		f32 h01 = (heights[cz][cx] + heights[cz+1][cx]
+				+ heights[cz][cx-1] + heights[cz+1][cx-1]) / 4;
+		f32 h11 = (heights[cz][cx] + heights[cz+1][cx]
+				+ heights[cz][cx+1] + heights[cz+1][cx+1]) / 4;
+		f32 h10 = (heights[cz][cx] + heights[cz-1][cx]
+				+ heights[cz][cx+1] + heights[cz-1][cx+1]) / 4;
+
+		// Shade slopes a bit
+		f32 light_f = (h00 + h01 - h11 - h10) / 100;
+		if(light_f < -1.0) light_f = -1.0;
+		if(light_f > 1.0) light_f = 1.0;
+		f32 b = 1.0 + light_f*0.1;
+		video::SColor c = colors[cz][cx];
+		c = video::SColor(255,
+				MYMIN(255, b*c.getRed()),
+				MYMIN(255, b*c.getGreen()),
+				MYMIN(255, b*c.getBlue()));
+
+		// Sector edges are half a node off the node centers
+		v2f p0f = v2f(p0.X + x, p0.Y + z) * sector_size - v2f(0.5,0.5) * BS;
+		v2f p1f = p0f + v2f(1,1) * sector_size;
+
+		u16 i0 = r->buf->Vertices.size();
+		r->buf->Vertices.push_back(video::S3DVertex(
+				p0f.X,h00,p0f.Y, 0,1,0, c, 0,1));
+		r->buf->Vertices.push_back(video::S3DVertex(
+				p0f.X,h01,p1f.Y, 0,1,0, c, 1,1));
+		r->buf->Vertices.push_back(video::S3DVertex(
+				p1f.X,h11,p1f.Y, 0,1,0, c, 1,0));
+		r->buf->Vertices.push_back(video::S3DVertex(
+				p1f.X,h10,p0f.Y, 0,1,0, c, 0,0));
+		for(u32 i=0; i<4; i++)
+			r->colors.push_back(c);
+
+		const u16 indices[] = {0,1,2,2,3,0};
+		for(u32 i=0; i<6; i++)
+			r->buf->Indices.push_back(i0 + indices[i]);
+	}
+
+	r->buf->recalculateBoundingBox();
+	r->buf->setHardwareMappingHint(scene::EHM_STATIC);
+	colorRegion(r);
+
+	return r;
+}
+
+void FarMesh::colorRegion(Region *r)
+{
+	f32 b = m_brightness;
+	for(u32 i=0; i<r->colors.size(); i++)
+	{
+		video::SColor c = r->colors[i];
+		r->buf->Vertices[i].Color = video::SColor(255,
+				MYMIN(255, b*c.getRed()),
+				MYMIN(255, b*c.getGreen()),
+				MYMIN(255, b*c.getBlue()));
+	}
+	r->brightness_level = m_brightness_level;
+	r->buf->setDirty(scene::EBT_VERTEX);
+}
+
+void FarMesh::deleteRegion(Region *r)
+{
+	// Hardware buffers are not freed automatically
+	SceneManager->getVideoDriver()->removeHardwareBuffer(r->buf);
+	r->buf->drop();
+	delete r;
+}
+
 void FarMesh::render()
 {
 	video::IVideoDriver* driver = SceneManager->getVideoDriver();
 
-	/*if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_TRANSPARENT)
-		return;*/
 	if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_SOLID)
 		return;
-	/*if(SceneManager->getSceneNodeRenderPass() != scene::ESNRP_SKY_BOX)
-		return;*/
+
+	ScopeProfiler sp(g_profiler, "FarMesh: render", SPT_AVG);
 
 	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
 	
-	//const s16 grid_radius_i = 12;
-	//const float grid_size = BS*50;
-	const s16 grid_radius_i = m_render_range/MAP_BLOCKSIZE;
-	const float grid_size = BS*MAP_BLOCKSIZE;
-	const v2f grid_speed(-BS*0, 0);
-	
-	// Position of grid noise origin in world coordinates
-	v2f world_grid_origin_pos_f(0,0);
-	// Position of grid noise origin from the camera
-	v2f grid_origin_from_camera_f = world_grid_origin_pos_f - m_camera_pos;
-	// The center point of drawing in the noise
-	v2f center_of_drawing_in_noise_f = -grid_origin_from_camera_f;
-	// The integer center point of drawing in the noise
-	v2s16 center_of_drawing_in_noise_i(
-		MYROUND(center_of_drawing_in_noise_f.X / grid_size),
-		MYROUND(center_of_drawing_in_noise_f.Y / grid_size)
-	);
-	// The world position of the integer center point of drawing in the noise
-	v2f world_center_of_drawing_in_noise_f = v2f(
-		center_of_drawing_in_noise_i.X * grid_size,
-		center_of_drawing_in_noise_i.Y * grid_size
-	) + world_grid_origin_pos_f;
-
-	for(s16 zi=-grid_radius_i; zi<grid_radius_i; zi++)
-	for(s16 xi=-grid_radius_i; xi<grid_radius_i; xi++)
+	const s16 region_nodes = FARMESH_REGION_SIZE*MAP_BLOCKSIZE;
+
+	v2s16 camera_node(
+			m_camera_pos.X / BS + (m_camera_pos.X > 0 ? 0.5 : -0.5),
+			m_camera_pos.Y / BS + (m_camera_pos.Y > 0 ? 0.5 : -0.5));
+	v2s16 camera_region = getContainerPos(camera_node, region_nodes);
+	s16 radius = m_render_range / region_nodes + 1;
+
+	/*
+		Regions with new surfaces are built again
+	*/
+	core::list<v2s16> changed;
+	m_client->getFarSurfaces().takeChangedRegions(changed);
+	for(core::list<v2s16>::Iterator i = changed.begin();
+			i != changed.end(); i++)
 	{
-		/*// Don't draw very close to player
-		s16 dd = 3;
-		if(zi > -dd && zi < dd && xi > -dd && xi < dd)
-			continue;*/
-
-		v2s16 p_in_noise_i(
-			xi+center_of_drawing_in_noise_i.X,
-			zi+center_of_drawing_in_noise_i.Y
-		);
-		
-		// If sector was drawn, don't draw it this way
-		if(m_client->m_env.getClientMap().sectorWasDrawn(p_in_noise_i))
-			continue;
+		if(m_regions.find(*i) != NULL)
+			m_dirty_regions[*i] = true;
+	}
 
-		/*if((p_in_noise_i.X + p_in_noise_i.Y)%2==0)
-			continue;*/
-		/*if((p_in_noise_i.X/2 + p_in_noise_i.Y/2)%2==0)
-			continue;*/
-
-		v2f p0 = v2f(xi,zi)*grid_size + world_center_of_drawing_in_noise_f;
-		
-		/*double noise[4];
-		double d = 100*BS;
-		noise[0] = d*noise2d_perlin(
-				(float)(p_in_noise_i.X+0)*grid_size/BS/100,
-				(float)(p_in_noise_i.Y+0)*grid_size/BS/100,
-				m_seed, 3, 0.5);
-		
-		noise[1] = d*noise2d_perlin(
-				(float)(p_in_noise_i.X+0)*grid_size/BS/100,
-				(float)(p_in_noise_i.Y+1)*grid_size/BS/100,
-				m_seed, 3, 0.5);
-		
-		noise[2] = d*noise2d_perlin(
-				(float)(p_in_noise_i.X+1)*grid_size/BS/100,
-				(float)(p_in_noise_i.Y+1)*grid_size/BS/100,
-				m_seed, 3, 0.5);
-		
-		noise[3] = d*noise2d_perlin(
-				(float)(p_in_noise_i.X+1)*grid_size/BS/100,
-				(float)(p_in_noise_i.Y+0)*grid_size/BS/100,
-				m_seed, 3, 0.5);*/
-		
-		HeightPoint hps[5];
-		hps[0] = ground_height(m_seed, v2s16(
-				(p_in_noise_i.X+0)*grid_size/BS,
-				(p_in_noise_i.Y+0)*grid_size/BS));
-		hps[1] = ground_height(m_seed, v2s16(
-				(p_in_noise_i.X+0)*grid_size/BS,
-				(p_in_noise_i.Y+1)*grid_size/BS));
-		hps[2] = ground_height(m_seed, v2s16(
-				(p_in_noise_i.X+1)*grid_size/BS,
-				(p_in_noise_i.Y+1)*grid_size/BS));
-		hps[3] = ground_height(m_seed, v2s16(
-				(p_in_noise_i.X+1)*grid_size/BS,
-				(p_in_noise_i.Y+0)*grid_size/BS));
-		v2s16 centerpoint(
-				(p_in_noise_i.X+0)*grid_size/BS+MAP_BLOCKSIZE/2,
-				(p_in_noise_i.Y+0)*grid_size/BS+MAP_BLOCKSIZE/2);
-		hps[4] = ground_height(m_seed, centerpoint);
-		
-		float noise[5];
-		float h_min = BS*65535;
-		float h_max = -BS*65536;
-		float ma_avg = 0;
-		float h_avg = 0;
-		u32 have_sand_count = 0;
-		float tree_amount_avg = 0;
-		for(u32 i=0; i<5; i++)
-		{
-			noise[i] = hps[i].gh + hps[i].ma;
-			if(noise[i] < h_min)
-				h_min = noise[i];
-			if(noise[i] > h_max)
-				h_max = noise[i];
-			ma_avg += hps[i].ma;
-			h_avg += noise[i];
-			if(hps[i].have_sand)
-				have_sand_count++;
-			tree_amount_avg += hps[i].tree_amount;
-		}
-		ma_avg /= 5.0;
-		h_avg /= 5.0;
-		tree_amount_avg /= 5.0;
-
-		float steepness = (h_max - h_min)/grid_size;
-		
-		float light_f = noise[0]+noise[1]-noise[2]-noise[3];
-		light_f /= 100;
-		if(light_f < -1.0) light_f = -1.0;
-		if(light_f > 1.0) light_f = 1.0;
-		//light_f += 1.0;
-		//light_f /= 2.0;
-		
-		v2f p1 = p0 + v2f(1,1)*grid_size;
-		
-		bool ground_is_sand = false;
-		bool ground_is_rock = false;
-		bool ground_is_mud = false;
-		video::SColor c;
-		// Detect water
-		if(h_avg < WATER_LEVEL*BS && h_max < (WATER_LEVEL+5)*BS)
-		{
-			//c = video::SColor(255,59,86,146);
-			//c = video::SColor(255,82,120,204);
-			c = video::SColor(255,74,105,170);
-
-			/*// Set to water level
-			for(u32 i=0; i<4; i++)
-			{
-				if(noise[i] < BS*WATER_LEVEL)
-					noise[i] = BS*WATER_LEVEL;
-			}*/
-			light_f = 0;
-		}
-		// Steep cliffs
-		else if(steepness > 2.0)
+	/*
+		Delete regions that are out of range
+	*/
+	core::list<v2s16> far_away;
+	for(core::map<v2s16, Region*>::Iterator
+			i = m_regions.getIterator();
+			i.atEnd() == false; i++)
+	{
+		v2s16 d = i.getNode()->getKey() - camera_region;
+		if(abs(d.X) > radius + 1 || abs(d.Y) > radius + 1)
+			far_away.push_back(i.getNode()->getKey());
+	}
+	for(core::list<v2s16>::Iterator i = far_away.begin();
+			i != far_away.end(); i++)
+	{
+		deleteRegion(m_regions[*i]);
+		m_regions.remove(*i);
+		m_dirty_regions.remove(*i);
+	}
+
+	/*
+		Build missing and changed regions, nearest first and only a
+		few per frame
+	*/
+	u32 built_count = 0;
+	const u32 max_built_count = 4;
+	for(s16 d=0; d<=radius && built_count < max_built_count; d++)
+	for(s16 z=-d; z<=d && built_count < max_built_count; z++)
+	for(s16 x=-d; x<=d && built_count < max_built_count; x++)
+	{
+		// Only the edge of the square at distance d
+		if(abs(x) != d && abs(z) != d)
+			continue;
+		v2s16 rp = camera_region + v2s16(x,z);
+		core::map<v2s16, Region*>::Node *n = m_regions.find(rp);
+		if(n != NULL && m_dirty_regions.find(rp) == NULL)
+			continue;
+		Region *r = buildRegion(rp);
+		if(n != NULL)
 		{
-			c = video::SColor(255,128,128,128);
-			ground_is_rock = true;
+			deleteRegion(n->getValue());
+			n->setValue(r);
 		}
-		// Basic ground
 		else
 		{
-			if(ma_avg < 2.0*BS)
-			{
-				c = video::SColor(255,128,128,128);
-				ground_is_rock = true;
-			}
-			else
-			{
-				if(h_avg <= 2.5*BS && have_sand_count >= 2)
-				{
-					c = video::SColor(255,210,194,156);
-					ground_is_sand = true;
-				}
-				else
-				{
-					/*// Trees if there are over 0.01 trees per MapNode
-					if(tree_amount_avg > 0.01)
-						c = video::SColor(255,50,128,50);
-					else
-						c = video::SColor(255,107,134,51);*/
-					c = video::SColor(255,107,134,51);
-					ground_is_mud = true;
-				}
-			}
-		}
-		
-		// Set to water level
-		for(u32 i=0; i<4; i++)
-		{
-			if(noise[i] < BS*WATER_LEVEL)
-				noise[i] = BS*WATER_LEVEL;
+			m_regions.insert(rp, r);
 		}
+		m_dirty_regions.remove(rp);
+		built_count++;
+	}
+	g_profiler->avg("FarMesh: regions built", built_count);
 
-		float b = m_brightness + light_f*0.1*m_brightness;
-		if(b < 0) b = 0;
-		if(b > 2) b = 2;
-		
-		c = video::SColor(255, b*c.getRed(), b*c.getGreen(), b*c.getBlue());
-		
-		driver->setMaterial(m_materials[0]);
+	/*
+		Draw. Sectors drawn by ClientMap are left out, which needs
+		going through the cells of the regions near the camera.
+	*/
+	
+	s16 near_d = m_near_range + 4*MAP_BLOCKSIZE;
+	v2s16 near_min = camera_node - v2s16(1,1)*near_d;
+	v2s16 near_max = camera_node + v2s16(1,1)*near_d;
+
+	driver->setMaterial(m_material);
 
-		video::S3DVertex vertices[4] =
+	u32 regions_drawn = 0;
+	core::array<u16> indices;
+	for(core::map<v2s16, Region*>::Iterator
+			i = m_regions.getIterator();
+			i.atEnd() == false; i++)
+	{
+		v2s16 rp = i.getNode()->getKey();
+		Region *r = i.getNode()->getValue();
+
+		v2s16 d = rp - camera_region;
+		if(abs(d.X) > radius || abs(d.Y) > radius)
+			continue;
+
+		// Update vertex colors if the brightness has changed
+		if(r->brightness_level != m_brightness_level)
+			colorRegion(r);
+
+		regions_drawn++;
+
+		v2s16 region_min = rp * region_nodes;
+		v2s16 region_max = region_min + v2s16(1,1)*(region_nodes-1);
+		bool near = !(region_max.X < near_min.X || region_min.X > near_max.X
+				|| region_max.Y < near_min.Y || region_min.Y > near_max.Y);
+		if(near == false)
 		{
-			video::S3DVertex(p0.X,noise[0],p0.Y, 0,0,0, c, 0,1),
-			video::S3DVertex(p0.X,noise[1],p1.Y, 0,0,0, c, 1,1),
-			video::S3DVertex(p1.X,noise[2],p1.Y, 0,0,0, c, 1,0),
-			video::S3DVertex(p1.X,noise[3],p0.Y, 0,0,0, c, 0,0),
-		};
-		u16 indices[] = {0,1,2,2,3,0};
-		driver->drawVertexPrimitiveList(vertices, 4, indices, 2,
-				video::EVT_STANDARD, scene::EPT_TRIANGLES, video::EIT_16BIT);
-
-		// Add some trees if appropriate
-		if(tree_amount_avg >= 0.0065 && steepness < 1.4
-				&& ground_is_mud == true)
+			driver->drawMeshBuffer(r->buf);
+			continue;
+		}
+
+		indices.set_used(0);
+		ClientMap &map = m_client->m_env.getClientMap();
+		for(s16 z=0; z<FARMESH_REGION_SIZE; z++)
+		for(s16 x=0; x<FARMESH_REGION_SIZE; x++)
 		{
-			driver->setMaterial(m_materials[1]);
-			
-			float b = m_brightness;
-			c = video::SColor(255, b*255, b*255, b*255);
-			
-			{
-				video::S3DVertex vertices[4] =
-				{
-					video::S3DVertex(p0.X,noise[0],p0.Y,
-							0,0,0, c, 0,1),
-					video::S3DVertex(p0.X,noise[0]+BS*MAP_BLOCKSIZE,p0.Y,
-							0,0,0, c, 0,0),
-					video::S3DVertex(p1.X,noise[2]+BS*MAP_BLOCKSIZE,p1.Y,
-							0,0,0, c, 1,0),
-					video::S3DVertex(p1.X,noise[2],p1.Y,
-							0,0,0, c, 1,1),
-				};
-				u16 indices[] = {0,1,2,2,3,0};
-				driver->drawVertexPrimitiveList(vertices, 4, indices, 2,
-						video::EVT_STANDARD, scene::EPT_TRIANGLES,
-						video::EIT_16BIT);
-			}
-			{
-				video::S3DVertex vertices[4] =
-				{
-					video::S3DVertex(p1.X,noise[3],p0.Y,
-							0,0,0, c, 0,1),
-					video::S3DVertex(p1.X,noise[3]+BS*MAP_BLOCKSIZE,p0.Y,
-							0,0,0, c, 0,0),
-					video::S3DVertex(p0.X,noise[1]+BS*MAP_BLOCKSIZE,p1.Y,
-							0,0,0, c, 1,0),
-					video::S3DVertex(p0.X,noise[1],p1.Y,
-							0,0,0, c, 1,1),
-				};
-				u16 indices[] = {0,1,2,2,3,0};
-				driver->drawVertexPrimitiveList(vertices, 4, indices, 2,
-						video::EVT_STANDARD, scene::EPT_TRIANGLES,
-						video::EIT_16BIT);
-			}
+			v2s16 sp = rp*FARMESH_REGION_SIZE + v2s16(x,z);
+			if(map.sectorWasDrawn(sp))
+				continue;
+			u16 cell = z*FARMESH_REGION_SIZE + x;
+			const u16 *cell_indices = &r->buf->Indices[cell*6];
+			for(u32 j=0; j<6; j++)
+				indices.push_back(cell_indices[j]);
 		}
+		if(indices.size() == 0)
+			continue;
+		driver->drawVertexPrimitiveList(r->buf->getVertices(),
+				r->buf->getVertexCount(), indices.pointer(),
+				indices.size() / 3, video::EVT_STANDARD,
+				scene::EPT_TRIANGLES, video::EIT_16BIT);
 	}
-
-	//driver->clearZBuffer();
+	g_profiler->avg("FarMesh: regions drawn", regions_drawn);
 }
 
 void FarMesh::step(float dtime)
@@ -405,11 +586,13 @@ void FarMesh::step(float dtime)
 	m_time += dtime;
 }
 
-void FarMesh::update(v2f camera_p, float brightness, s16 render_range)
+void FarMesh::update(v2f camera_p, float brightness, s16 render_range,
+		s16 near_range)
 {
 	m_camera_pos = camera_p;
 	m_brightness = brightness;
+	m_brightness_level = brightness * 64;
 	m_render_range = render_range;
+	m_near_range = near_range;
 }
 
-
@@ -21,15 +21,83 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FARMESH_HEADER
 
 /*
-	A quick messy implementation of terrain rendering for a long
-	distance according to map seed
+	Terrain rendering for a long distance.
+
+	The terrain is drawn from summaries of the surface of the blocks
+	the client has received, which are kept after the blocks have been
+	unloaded. Where nothing has been received, the height is guessed
+	from the map seed.
 */
 
 #include "common_irrlicht.h"
-
-#define FARMESH_MATERIAL_COUNT 2
+#include "mapnode.h"
 
 class Client;
+class MapBlockSnapshot;
+class INodeDefManager;
+
+/*
+	The topmost ground or liquid in a block
+*/
+struct FarBlockSurface
+{
+	bool has_surface;
+	// Number of node columns that have their top in the block
+	u16 columns;
+	// Average height of the top of the topmost nodes, in nodes
+	f32 height;
+	// Most common content of the topmost nodes
+	content_t content;
+
+	FarBlockSurface():
+		has_surface(false),
+		columns(0),
+		height(0),
+		content(CONTENT_IGNORE)
+	{}
+
+	bool operator==(const FarBlockSurface &other) const
+	{
+		return (has_surface == other.has_surface
+				&& columns == other.columns
+				&& height == other.height
+				&& content == other.content);
+	}
+};
+
+FarBlockSurface getFarBlockSurface(const MapBlockSnapshot *block,
+		v3s16 blockpos, INodeDefManager *ndef);
+
+/*
+	Surfaces of every block that has been received, by sector
+*/
+class FarSurfaceMap
+{
+public:
+	~FarSurfaceMap();
+
+	void setBlock(v3s16 p, const FarBlockSurface &s);
+
+	/*
+		Gets the highest surface in the sector that covers a good part
+		of it, so that single trees and such don't lift the whole
+		sector. False if no surface is known.
+	*/
+	bool getSector(v2s16 p, FarBlockSurface *s);
+
+	// Gets the regions (see FarMesh) that have changed since the last
+	// call
+	void takeChangedRegions(core::list<v2s16> &regions);
+
+private:
+	// Block y -> surface
+	typedef core::map<s16, FarBlockSurface> SectorSurfaces;
+	core::map<v2s16, SectorSurfaces*> m_sectors;
+	core::map<v2s16, bool> m_changed_regions;
+};
+
+// Size of a far terrain mesh region in sectors (on each axis)
+#define FARMESH_REGION_SIZE 8
 
 class FarMesh : public scene::ISceneNode
 {
@@ -67,18 +135,48 @@ class FarMesh : public scene::ISceneNode
 
 	void step(float dtime);
 
-	void update(v2f camera_p, float brightness, s16 render_range);
+	/*
+		render_range: how far to draw, in nodes
+		near_range: range of the map drawn by ClientMap, in nodes.
+		            Sectors drawn by it are left out.
+	*/
+	void update(v2f camera_p, float brightness, s16 render_range,
+			s16 near_range);
 
 private:
-	video::SMaterial m_materials[FARMESH_MATERIAL_COUNT];
+	/*
+		A static mesh of FARMESH_REGION_SIZE^2 sectors, one quad each
+	*/
+	struct Region
+	{
+		scene::SMeshBuffer *buf;
+		// Vertex colors at full brightness
+		core::array<video::SColor> colors;
+		// Brightness level the vertex colors are for
+		u32 brightness_level;
+	};
+
+	// Gets the height (in BS units) and color of the far terrain
+	// at the center of a sector
+	void getSectorSurface(v2s16 p, f32 *height, video::SColor *color);
+	video::SColor getContentColor(content_t c);
+	Region * buildRegion(v2s16 p);
+	void colorRegion(Region *r);
+	void deleteRegion(Region *r);
+
+	video::SMaterial m_material;
 	core::aabbox3d<f32> m_box;
-	float m_cloud_y;
 	float m_brightness;
+	u32 m_brightness_level;
 	u64 m_seed;
 	v2f m_camera_pos;
 	float m_time;
 	Client *m_client;
 	s16 m_render_range;
+	s16 m_near_range;
+	core::map<v2s16, Region*> m_regions;
+	// Regions that have to be built again
+	core::map<v2s16, bool> m_dirty_regions;
 };
 
 #endif
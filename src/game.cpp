@@ -2074,7 +2074,9 @@ void the_game(
 
 			farmesh->step(dtime);
 			farmesh->update(v2f(player_position.X, player_position.Z),
-					0.05+brightness*0.95, farmesh_range);
+					0.05+brightness*0.95, farmesh_range,
+					draw_control.range_all ?
+					farmesh_range : draw_control.wanted_range);
 		}
 		
 		// Store brightness value
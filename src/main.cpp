@@ -411,6 +411,7 @@ Doing currently:
 #include "common_irrlicht.h"
 #include "debug.h"
 #include "test.h"
+#include "benchmark.h"
 #include "server.h"
 #include "constants.h"
 #include "porting.h"
@@ -1121,6 +1122,9 @@ int main(int argc, char *argv[])
 	allowed_options.insert("dstream-on-stderr", ValueSpec(VALUETYPE_FLAG));
 #endif
 	allowed_options.insert("speedtests", ValueSpec(VALUETYPE_FLAG));
+	allowed_options.insert("benchmark-meshgen", ValueSpec(VALUETYPE_STRING,
+			"Make the meshes of the blocks in a map.sqlite with the null "
+			"video driver and print vertex counts and times"));
 	allowed_options.insert("info-on-stderr", ValueSpec(VALUETYPE_FLAG));
 
 	Settings cmd_args;
@@ -1379,6 +1383,10 @@ int main(int argc, char *argv[])
 		driverType = video::EDT_OPENGL;
 	}
 
+	// The mesh benchmark doesn't draw anything
+	if(cmd_args.exists("benchmark-meshgen"))
+		driverType = video::EDT_NULL;
+
 	/*
 		Create device and exit if creation failed
 	*/
@@ -1426,6 +1434,13 @@ int main(int argc, char *argv[])
 		SpeedTests();
 		return 0;
 	}
+
+	if(cmd_args.exists("benchmark-meshgen"))
+	{
+		run_meshgen_benchmark(device, cmd_args.get("benchmark-meshgen"));
+		device->drop();
+		return 0;
+	}
 	
 	device->setResizable(true);
 
@@ -163,14 +163,10 @@ MapBlock * Map::getBlockNoCreate(v3s16 p3d)
 bool Map::isNodeUnderground(v3s16 p)
 {
 	v3s16 blockpos = getNodeBlockPos(p);
-	try{
-		MapBlock * block = getBlockNoCreate(blockpos);
-		return block->getIsUnderground();
-	}
-	catch(InvalidPositionException &e)
-	{
+	MapBlock *block = getBlockNoCreateNoEx(blockpos);
+	if(block == NULL)
 		return false;
-	}
+	return block->getIsUnderground();
 }
 
 bool Map::isValidPosition(v3s16 p)
@@ -181,12 +177,18 @@ bool Map::isValidPosition(v3s16 p)
 }
 
 // Returns a CONTENT_IGNORE node if not found
-MapNode Map::getNodeNoEx(v3s16 p)
+MapNode Map::getNodeNoEx(v3s16 p, bool *is_valid_position)
 {
 	v3s16 blockpos = getNodeBlockPos(p);
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
-	if(block == NULL)
+	if(block == NULL || block->isDummy())
+	{
+		if(is_valid_position)
+			*is_valid_position = false;
 		return MapNode(CONTENT_IGNORE);
+	}
+	if(is_valid_position)
+		*is_valid_position = true;
 	v3s16 relpos = p - blockpos*MAP_BLOCKSIZE;
 	return block->getNodeNoCheck(relpos);
 }
@@ -277,21 +279,15 @@ void Map::unspreadLight(enum LightBank bank,
 		v3s16 blockpos = getNodeBlockPos(pos);
 		
 		// Only fetch a new block if the block position has changed
-		try{
-			if(block == NULL || blockpos != blockpos_last){
-				block = getBlockNoCreate(blockpos);
-				blockpos_last = blockpos;
+		if(block == NULL || blockpos != blockpos_last){
+			block = getBlockNoCreateNoEx(blockpos);
+			blockpos_last = blockpos;
 
-				block_checked_in_modified = false;
-				blockchangecount++;
-			}
-		}
-		catch(InvalidPositionException &e)
-		{
-			continue;
+			block_checked_in_modified = false;
+			blockchangecount++;
 		}
 
-		if(block->isDummy())
+		if(block == NULL || block->isDummy())
 			continue;
 
 		// Calculate relative position in block
@@ -311,88 +307,78 @@ void Map::unspreadLight(enum LightBank bank,
 			// Get the block where the node is located
 			v3s16 blockpos = getNodeBlockPos(n2pos);
 
-			try
-			{
-				// Only fetch a new block if the block position has changed
-				try{
-					if(block == NULL || blockpos != blockpos_last){
-						block = getBlockNoCreate(blockpos);
-						blockpos_last = blockpos;
+			// Only fetch a new block if the block position has changed
+			if(block == NULL || blockpos != blockpos_last){
+				block = getBlockNoCreateNoEx(blockpos);
+				blockpos_last = blockpos;
 
-						block_checked_in_modified = false;
-						blockchangecount++;
-					}
-				}
-				catch(InvalidPositionException &e)
-				{
-					continue;
-				}
+				block_checked_in_modified = false;
+				blockchangecount++;
+			}
 
-				// Calculate relative position in block
-				v3s16 relpos = n2pos - blockpos * MAP_BLOCKSIZE;
-				// Get node straight from the block
-				MapNode n2 = block->getNode(relpos);
+			if(block == NULL || block->isDummy())
+				continue;
+
+			// Calculate relative position in block
+			v3s16 relpos = n2pos - blockpos * MAP_BLOCKSIZE;
+			// Get node straight from the block
+			MapNode n2 = block->getNodeNoCheck(relpos);
 
-				bool changed = false;
+			bool changed = false;
 
-				//TODO: Optimize output by optimizing light_sources?
+			//TODO: Optimize output by optimizing light_sources?
 
+			/*
+				If the neighbor is dimmer than what was specified
+				as oldlight (the light of the previous node)
+			*/
+			if(n2.getLight(bank, nodemgr) < oldlight)
+			{
 				/*
-					If the neighbor is dimmer than what was specified
-					as oldlight (the light of the previous node)
+					And the neighbor is transparent and it has some light
 				*/
-				if(n2.getLight(bank, nodemgr) < oldlight)
+				if(nodemgr->lightPropagates(n2.getContent())
+						&& n2.getLight(bank, nodemgr) != 0)
 				{
 					/*
-						And the neighbor is transparent and it has some light
+						Set light to 0 and add to queue
 					*/
-					if(nodemgr->get(n2).light_propagates
-							&& n2.getLight(bank, nodemgr) != 0)
-					{
-						/*
-							Set light to 0 and add to queue
-						*/
-
-						u8 current_light = n2.getLight(bank, nodemgr);
-						n2.setLight(bank, 0, nodemgr);
-						block->setNode(relpos, n2);
-
-						unlighted_nodes.insert(n2pos, current_light);
-						changed = true;
-
-						/*
-							Remove from light_sources if it is there
-							NOTE: This doesn't happen nearly at all
-						*/
-						/*if(light_sources.find(n2pos))
-						{
-							infostream<<"Removed from light_sources"<<std::endl;
-							light_sources.remove(n2pos);
-						}*/
-					}
 
-					/*// DEBUG
-					if(light_sources.find(n2pos) != NULL)
-						light_sources.remove(n2pos);*/
-				}
-				else{
-					light_sources.insert(n2pos, true);
-				}
+					u8 current_light = n2.getLight(bank, nodemgr);
+					n2.setLight(bank, 0, nodemgr);
+					block->setNode(relpos, n2);
 
-				// Add to modified_blocks
-				if(changed == true && block_checked_in_modified == false)
-				{
-					// If the block is not found in modified_blocks, add.
-					if(modified_blocks.find(blockpos) == NULL)
+					unlighted_nodes.insert(n2pos, current_light);
+					changed = true;
+
+					/*
+						Remove from light_sources if it is there
+						NOTE: This doesn't happen nearly at all
+					*/
+					/*if(light_sources.find(n2pos))
 					{
-						modified_blocks.insert(blockpos, block);
-					}
-					block_checked_in_modified = true;
+						infostream<<"Removed from light_sources"<<std::endl;
+						light_sources.remove(n2pos);
+					}*/
 				}
+
+				/*// DEBUG
+				if(light_sources.find(n2pos) != NULL)
+					light_sources.remove(n2pos);*/
+			}
+			else{
+				light_sources.insert(n2pos, true);
 			}
-			catch(InvalidPositionException &e)
+
+			// Add to modified_blocks
+			if(changed == true && block_checked_in_modified == false)
 			{
-				continue;
+				// If the block is not found in modified_blocks, add.
+				if(modified_blocks.find(blockpos) == NULL)
+				{
+					modified_blocks.insert(blockpos, block);
+				}
+				block_checked_in_modified = true;
 			}
 		}
 	}
@@ -465,21 +451,15 @@ void Map::spreadLight(enum LightBank bank,
 		v3s16 blockpos = getNodeBlockPos(pos);
 
 		// Only fetch a new block if the block position has changed
-		try{
-			if(block == NULL || blockpos != blockpos_last){
-				block = getBlockNoCreate(blockpos);
-				blockpos_last = blockpos;
+		if(block == NULL || blockpos != blockpos_last){
+			block = getBlockNoCreateNoEx(blockpos);
+			blockpos_last = blockpos;
 
-				block_checked_in_modified = false;
-				blockchangecount++;
-			}
-		}
-		catch(InvalidPositionException &e)
-		{
-			continue;
+			block_checked_in_modified = false;
+			blockchangecount++;
 		}
 
-		if(block->isDummy())
+		if(block == NULL || block->isDummy())
 			continue;
 
 		// Calculate relative position in block
@@ -499,69 +479,59 @@ void Map::spreadLight(enum LightBank bank,
 			// Get the block where the node is located
 			v3s16 blockpos = getNodeBlockPos(n2pos);
 
-			try
-			{
-				// Only fetch a new block if the block position has changed
-				try{
-					if(block == NULL || blockpos != blockpos_last){
-						block = getBlockNoCreate(blockpos);
-						blockpos_last = blockpos;
+			// Only fetch a new block if the block position has changed
+			if(block == NULL || blockpos != blockpos_last){
+				block = getBlockNoCreateNoEx(blockpos);
+				blockpos_last = blockpos;
 
-						block_checked_in_modified = false;
-						blockchangecount++;
-					}
-				}
-				catch(InvalidPositionException &e)
-				{
-					continue;
-				}
+				block_checked_in_modified = false;
+				blockchangecount++;
+			}
 
-				// Calculate relative position in block
-				v3s16 relpos = n2pos - blockpos * MAP_BLOCKSIZE;
-				// Get node straight from the block
-				MapNode n2 = block->getNode(relpos);
+			if(block == NULL || block->isDummy())
+				continue;
 
-				bool changed = false;
-				/*
-					If the neighbor is brighter than the current node,
-					add to list (it will light up this node on its turn)
-				*/
-				if(n2.getLight(bank, nodemgr) > undiminish_light(oldlight))
+			// Calculate relative position in block
+			v3s16 relpos = n2pos - blockpos * MAP_BLOCKSIZE;
+			// Get node straight from the block
+			MapNode n2 = block->getNodeNoCheck(relpos);
+
+			bool changed = false;
+			/*
+				If the neighbor is brighter than the current node,
+				add to list (it will light up this node on its turn)
+			*/
+			if(n2.getLight(bank, nodemgr) > undiminish_light(oldlight))
+			{
+				lighted_nodes.insert(n2pos, true);
+				//lighted_nodes.push_back(n2pos);
+				changed = true;
+			}
+			/*
+				If the neighbor is dimmer than how much light this node
+				would spread on it, add to list
+			*/
+			if(n2.getLight(bank, nodemgr) < newlight)
+			{
+				if(nodemgr->lightPropagates(n2.getContent()))
 				{
+					n2.setLight(bank, newlight, nodemgr);
+					block->setNode(relpos, n2);
 					lighted_nodes.insert(n2pos, true);
 					//lighted_nodes.push_back(n2pos);
 					changed = true;
 				}
-				/*
-					If the neighbor is dimmer than how much light this node
-					would spread on it, add to list
-				*/
-				if(n2.getLight(bank, nodemgr) < newlight)
-				{
-					if(nodemgr->get(n2).light_propagates)
-					{
-						n2.setLight(bank, newlight, nodemgr);
-						block->setNode(relpos, n2);
-						lighted_nodes.insert(n2pos, true);
-						//lighted_nodes.push_back(n2pos);
-						changed = true;
-					}
-				}
+			}
 
-				// Add to modified_blocks
-				if(changed == true && block_checked_in_modified == false)
+			// Add to modified_blocks
+			if(changed == true && block_checked_in_modified == false)
+			{
+				// If the block is not found in modified_blocks, add.
+				if(modified_blocks.find(blockpos) == NULL)
 				{
-					// If the block is not found in modified_blocks, add.
-					if(modified_blocks.find(blockpos) == NULL)
-					{
-						modified_blocks.insert(blockpos, block);
-					}
-					block_checked_in_modified = true;
+					modified_blocks.insert(blockpos, block);
 				}
-			}
-			catch(InvalidPositionException &e)
-			{
-				continue;
+				block_checked_in_modified = true;
 			}
 		}
 	}
@@ -608,14 +578,10 @@ v3s16 Map::getBrightestNeighbour(enum LightBank bank, v3s16 p)
 	for(u16 i=0; i<6; i++){
 		// Get the position of the neighbor node
 		v3s16 n2pos = p + dirs[i];
-		MapNode n2;
-		try{
-			n2 = getNode(n2pos);
-		}
-		catch(InvalidPositionException &e)
-		{
+		bool is_valid_position;
+		MapNode n2 = getNodeNoEx(n2pos, &is_valid_position);
+		if(is_valid_position == false)
 			continue;
-		}
 		if(n2.getLight(bank, nodemgr) > brightest_light || found_something == false){
 			brightest_light = n2.getLight(bank, nodemgr);
 			brightest_pos = n2pos;
@@ -648,19 +614,14 @@ s16 Map::propagateSunlight(v3s16 start,
 		v3s16 pos(start.X, y, start.Z);
 
 		v3s16 blockpos = getNodeBlockPos(pos);
-		MapBlock *block;
-		try{
-			block = getBlockNoCreate(blockpos);
-		}
-		catch(InvalidPositionException &e)
-		{
+		MapBlock *block = getBlockNoCreateNoEx(blockpos);
+		if(block == NULL || block->isDummy())
 			break;
-		}
 
 		v3s16 relpos = pos - blockpos*MAP_BLOCKSIZE;
-		MapNode n = block->getNode(relpos);
+		MapNode n = block->getNodeNoCheck(relpos);
 
-		if(nodemgr->get(n).sunlight_propagates)
+		if(nodemgr->sunlightPropagates(n.getContent()))
 		{
 			n.setLight(LIGHTBANK_DAY, LIGHT_SUN, nodemgr);
 			block->setNode(relpos, n);
@@ -721,35 +682,23 @@ void Map::updateLighting(enum LightBank bank,
 			for(s16 x=0; x<MAP_BLOCKSIZE; x++)
 			for(s16 y=0; y<MAP_BLOCKSIZE; y++)
 			{
-
-				try{
-					v3s16 p(x,y,z);
-					MapNode n = block->getNode(v3s16(x,y,z));
-					u8 oldlight = n.getLight(bank, nodemgr);
-					n.setLight(bank, 0, nodemgr);
-					block->setNode(v3s16(x,y,z), n);
-
-					// Collect borders for unlighting
-					if(x==0 || x == MAP_BLOCKSIZE-1
-					|| y==0 || y == MAP_BLOCKSIZE-1
-					|| z==0 || z == MAP_BLOCKSIZE-1)
-					{
-						v3s16 p_map = p + v3s16(
-								MAP_BLOCKSIZE*pos.X,
-								MAP_BLOCKSIZE*pos.Y,
-								MAP_BLOCKSIZE*pos.Z);
-						unlight_from.insert(p_map, oldlight);
-					}
-				}
-				catch(InvalidPositionException &e)
+				// Dummy blocks were skipped above
+				v3s16 p(x,y,z);
+				MapNode n = block->getNodeNoCheck(p);
+				u8 oldlight = n.getLight(bank, nodemgr);
+				n.setLight(bank, 0, nodemgr);
+				block->setNodeNoCheck(p, n);
+
+				// Collect borders for unlighting
+				if(x==0 || x == MAP_BLOCKSIZE-1
+				|| y==0 || y == MAP_BLOCKSIZE-1
+				|| z==0 || z == MAP_BLOCKSIZE-1)
 				{
-					/*
-						This would happen when dealing with a
-						dummy block.
-					*/
-					//assert(0);
-					infostream<<"updateLighting(): InvalidPositionException"
-							<<std::endl;
+					v3s16 p_map = p + v3s16(
+							MAP_BLOCKSIZE*pos.X,
+							MAP_BLOCKSIZE*pos.Y,
+							MAP_BLOCKSIZE*pos.Z);
+					unlight_from.insert(p_map, oldlight);
 				}
 			}
 
@@ -779,13 +728,8 @@ void Map::updateLighting(enum LightBank bank,
 			// Bottom sunlight is not valid; get the block and loop to it
 
 			pos.Y--;
-			try{
-				block = getBlockNoCreate(pos);
-			}
-			catch(InvalidPositionException &e)
-			{
-				assert(0);
-			}
+			block = getBlockNoCreateNoEx(pos);
+			assert(block);
 
 		}
 	}
@@ -942,15 +886,11 @@ void Map::addNodeAndUpdate(v3s16 p, MapNode n,
 
 		Otherwise there probably is.
 	*/
-	try{
-		MapNode topnode = getNode(toppos);
-
-		if(topnode.getLight(LIGHTBANK_DAY, nodemgr) != LIGHT_SUN)
-			node_under_sunlight = false;
-	}
-	catch(InvalidPositionException &e)
-	{
-	}
+	bool is_valid_position;
+	MapNode topnode = getNodeNoEx(toppos, &is_valid_position);
+	if(is_valid_position
+			&& topnode.getLight(LIGHTBANK_DAY, nodemgr) != LIGHT_SUN)
+		node_under_sunlight = false;
 
 	/*
 		Remove all light that has come out of this node
@@ -989,7 +929,7 @@ void Map::addNodeAndUpdate(v3s16 p, MapNode n,
 		If node lets sunlight through and is under sunlight, it has
 		sunlight too.
 	*/
-	if(node_under_sunlight && nodemgr->get(n).sunlight_propagates)
+	if(node_under_sunlight && nodemgr->sunlightPropagates(n.getContent()))
 	{
 		n.setLight(LIGHTBANK_DAY, LIGHT_SUN, nodemgr);
 	}
@@ -1023,21 +963,17 @@ void Map::addNodeAndUpdate(v3s16 p, MapNode n,
 		TODO: This could be optimized by mass-unlighting instead
 			  of looping
 	*/
-	if(node_under_sunlight && !nodemgr->get(n).sunlight_propagates)
+	if(node_under_sunlight && !nodemgr->sunlightPropagates(n.getContent()))
 	{
 		s16 y = p.Y - 1;
 		for(;; y--){
 			//m_dout<<DTIME<<"y="<<y<<std::endl;
 			v3s16 n2pos(p.X, y, p.Z);
 
-			MapNode n2;
-			try{
-				n2 = getNode(n2pos);
-			}
-			catch(InvalidPositionException &e)
-			{
+			bool is_valid_position;
+			MapNode n2 = getNodeNoEx(n2pos, &is_valid_position);
+			if(is_valid_position == false)
 				break;
-			}
 
 			if(n2.getLight(LIGHTBANK_DAY, nodemgr) == LIGHT_SUN)
 			{
@@ -1088,20 +1024,15 @@ void Map::addNodeAndUpdate(v3s16 p, MapNode n,
 	};
 	for(u16 i=0; i<7; i++)
 	{
-		try
-		{
-
 		v3s16 p2 = p + dirs[i];
 
-		MapNode n2 = getNode(p2);
-		if(nodemgr->get(n2).isLiquid() || n2.getContent() == CONTENT_AIR)
+		bool is_valid_position;
+		MapNode n2 = getNodeNoEx(p2, &is_valid_position);
+		if(is_valid_position && (nodemgr->isLiquid(n2.getContent())
+				|| n2.getContent() == CONTENT_AIR))
 		{
 			m_transforming_liquid.push_back(p2);
 		}
-
-		}catch(InvalidPositionException &e)
-		{
-		}
 	}
 }
 
@@ -1127,15 +1058,11 @@ void Map::removeNodeAndUpdate(v3s16 p,
 		If there is a node at top and it doesn't have sunlight,
 		there will be no sunlight going down.
 	*/
-	try{
-		MapNode topnode = getNode(toppos);
-
-		if(topnode.getLight(LIGHTBANK_DAY, nodemgr) != LIGHT_SUN)
-			node_under_sunlight = false;
-	}
-	catch(InvalidPositionException &e)
-	{
-	}
+	bool is_valid_position;
+	MapNode topnode = getNodeNoEx(toppos, &is_valid_position);
+	if(is_valid_position
+			&& topnode.getLight(LIGHTBANK_DAY, nodemgr) != LIGHT_SUN)
+		node_under_sunlight = false;
 
 	core::map<v3s16, bool> light_sources;
 
@@ -1264,20 +1191,15 @@ void Map::removeNodeAndUpdate(v3s16 p,
 	};
 	for(u16 i=0; i<7; i++)
 	{
-		try
-		{
-
 		v3s16 p2 = p + dirs[i];
 
-		MapNode n2 = getNode(p2);
-		if(nodemgr->get(n2).isLiquid() || n2.getContent() == CONTENT_AIR)
+		bool is_valid_position;
+		MapNode n2 = getNodeNoEx(p2, &is_valid_position);
+		if(is_valid_position && (nodemgr->isLiquid(n2.getContent())
+				|| n2.getContent() == CONTENT_AIR))
 		{
 			m_transforming_liquid.push_back(p2);
 		}
-
-		}catch(InvalidPositionException &e)
-		{
-		}
 	}
 }
 
@@ -1311,6 +1233,107 @@ bool Map::addNodeWithEvent(v3s16 p, MapNode n)
 	return succeeded;
 }
 
+u32 Map::addNodesWithEvent(core::map<v3s16, MapNode> &nodes)
+{
+	INodeDefManager *nodemgr = m_gamedef->ndef();
+
+	core::map<v3s16, MapBlock*> changed_blocks;
+	core::map<v3s16, bool> liquid_check;
+	u32 count = 0;
+
+	for(core::map<v3s16, MapNode>::Iterator
+			i = nodes.getIterator();
+			i.atEnd() == false; i++)
+	{
+		v3s16 p = i.getNode()->getKey();
+		MapNode n = i.getNode()->getValue();
+
+		v3s16 blockpos = getNodeBlockPos(p);
+		MapBlock *block = getBlockNoCreateNoEx(blockpos);
+		if(block == NULL || block->isDummy())
+			continue;
+
+		// The lighting is calculated again below
+		n.setLight(LIGHTBANK_DAY, 0, nodemgr);
+		n.setLight(LIGHTBANK_NIGHT, 0, nodemgr);
+		block->setNodeNoCheck(p - blockpos * MAP_BLOCKSIZE, n);
+		changed_blocks.insert(blockpos, block);
+		count++;
+
+		// Add intial metadata
+		std::string metadata_name = nodemgr->get(n).metadata_name;
+		if(metadata_name != ""){
+			NodeMetadata *meta = NodeMetadata::create(metadata_name,
+					m_gamedef);
+			if(!meta){
+				errorstream<<"Failed to create node metadata \""
+						<<metadata_name<<"\""<<std::endl;
+			} else {
+				setNodeMetadata(p, meta);
+			}
+		}
+
+		// The node and its neighbors may start flowing
+		liquid_check.insert(p, true);
+		for(u16 j=0; j<6; j++)
+			liquid_check.insert(p + g_6dirs[j], true);
+	}
+
+	if(count == 0)
+		return 0;
+
+	for(core::map<v3s16, bool>::Iterator
+			i = liquid_check.getIterator();
+			i.atEnd() == false; i++)
+	{
+		v3s16 p2 = i.getNode()->getKey();
+		bool is_valid_position;
+		MapNode n2 = getNodeNoEx(p2, &is_valid_position);
+		if(is_valid_position && (nodemgr->isLiquid(n2.getContent())
+				|| n2.getContent() == CONTENT_AIR))
+		{
+			m_transforming_liquid.push_back(p2);
+		}
+	}
+
+	core::map<v3s16, MapBlock*> modified_blocks;
+	updateWrittenBlocks(changed_blocks, modified_blocks,
+			"addNodesWithEvent");
+
+	return count;
+}
+
+void Map::updateWrittenBlocks(core::map<v3s16, MapBlock*> &written_blocks,
+		core::map<v3s16, MapBlock*> &modified_blocks,
+		const std::string &reason)
+{
+	core::map<v3s16, MapBlock*> lighting_update_blocks;
+	for(core::map<v3s16, MapBlock*>::Iterator
+			i = written_blocks.getIterator();
+			i.atEnd() == false; i++)
+	{
+		i.getNode()->getValue()->raiseModified(MOD_STATE_WRITE_NEEDED,
+				reason);
+		modified_blocks.insert(i.getNode()->getKey(),
+				i.getNode()->getValue());
+		lighting_update_blocks.insert(i.getNode()->getKey(),
+				i.getNode()->getValue());
+	}
+	// Update the lighting of all of them at once
+	updateLighting(lighting_update_blocks, modified_blocks);
+
+	// Send all of them to clients in one event
+	MapEditEvent event;
+	event.type = MEET_OTHER;
+	for(core::map<v3s16, MapBlock*>::Iterator
+			i = modified_blocks.getIterator();
+			i.atEnd() == false; i++)
+	{
+		event.modified_blocks.insert(i.getNode()->getKey(), false);
+	}
+	dispatchEvent(&event);
+}
+
 bool Map::removeNodeWithEvent(v3s16 p)
 {
 	MapEditEvent event;
@@ -1341,58 +1364,22 @@ bool Map::removeNodeWithEvent(v3s16 p)
 
 bool Map::dayNightDiffed(v3s16 blockpos)
 {
-	try{
-		v3s16 p = blockpos + v3s16(0,0,0);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
-			return true;
-	}
-	catch(InvalidPositionException &e){}
-	// Leading edges
-	try{
-		v3s16 p = blockpos + v3s16(-1,0,0);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
-			return true;
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,-1,0);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
-			return true;
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,0,-1);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
-			return true;
-	}
-	catch(InvalidPositionException &e){}
-	// Trailing edges
-	try{
-		v3s16 p = blockpos + v3s16(1,0,0);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
-			return true;
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,1,0);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
-			return true;
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,0,1);
-		MapBlock *b = getBlockNoCreate(p);
-		if(b->dayNightDiffed())
+	// The block, its leading edges and its trailing edges
+	v3s16 dirs[7] = {
+		v3s16(0,0,0),
+		v3s16(-1,0,0),
+		v3s16(0,-1,0),
+		v3s16(0,0,-1),
+		v3s16(1,0,0),
+		v3s16(0,1,0),
+		v3s16(0,0,1),
+	};
+	for(u32 i=0; i<7; i++)
+	{
+		MapBlock *b = getBlockNoCreateNoEx(blockpos + dirs[i]);
+		if(b && b->dayNightDiffed())
 			return true;
 	}
-	catch(InvalidPositionException &e){}
-
 	return false;
 }
 
@@ -1615,11 +1602,11 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 		 */
 		s8 liquid_level = -1;
 		u8 liquid_kind = CONTENT_IGNORE;
-		LiquidType liquid_type = nodemgr->get(n0).liquid_type;
+		LiquidType liquid_type = nodemgr->liquidType(n0.getContent());
 		switch (liquid_type) {
 			case LIQUID_SOURCE:
 				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = nodemgr->getId(nodemgr->get(n0).liquid_alternative_flowing);
+				liquid_kind = nodemgr->liquidAlternativeFlowing(n0.getContent());
 				break;
 			case LIQUID_FLOWING:
 				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
@@ -1659,7 +1646,7 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 			}
 			v3s16 npos = p0 + dirs[i];
 			NodeNeighbor nb = {getNodeNoEx(npos), nt, npos};
-			switch (nodemgr->get(nb.n.getContent()).liquid_type) {
+			switch (nodemgr->liquidType(nb.n.getContent())) {
 				case LIQUID_NONE:
 					if (nb.n.getContent() == CONTENT_AIR) {
 						airs[num_airs++] = nb;
@@ -1679,8 +1666,8 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 				case LIQUID_SOURCE:
 					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter 
 					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = nodemgr->getId(nodemgr->get(nb.n).liquid_alternative_flowing);
-					if (nodemgr->getId(nodemgr->get(nb.n).liquid_alternative_flowing) != liquid_kind) {
+						liquid_kind = nodemgr->liquidAlternativeFlowing(nb.n.getContent());
+					if (nodemgr->liquidAlternativeFlowing(nb.n.getContent()) != liquid_kind) {
 						neutrals[num_neutrals++] = nb;
 					} else {
 						// Do not count bottom source, it will screw things up
@@ -1691,8 +1678,8 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 				case LIQUID_FLOWING:
 					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
 					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = nodemgr->getId(nodemgr->get(nb.n).liquid_alternative_flowing);
-					if (nodemgr->getId(nodemgr->get(nb.n).liquid_alternative_flowing) != liquid_kind) {
+						liquid_kind = nodemgr->liquidAlternativeFlowing(nb.n.getContent());
+					if (nodemgr->liquidAlternativeFlowing(nb.n.getContent()) != liquid_kind) {
 						neutrals[num_neutrals++] = nb;
 					} else {
 						flows[num_flows++] = nb;
@@ -1713,7 +1700,7 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
 			// or the flowing alternative of the first of the surrounding sources (if it's air), so
 			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = nodemgr->getId(nodemgr->get(liquid_kind).liquid_alternative_source);
+			new_node_content = nodemgr->liquidAlternativeSource(liquid_kind);
 		} else if (num_sources == 1 && sources[0].t != NEIGHBOR_LOWER) {
 			// liquid_kind is set properly, see above
 			new_node_content = liquid_kind;
@@ -1768,7 +1755,7 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 		/*
 			check if anything has changed. if not, just continue with the next node.
 		 */
-		if (new_node_content == n0.getContent() && (nodemgr->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+		if (new_node_content == n0.getContent() && (nodemgr->liquidType(n0.getContent()) != LIQUID_FLOWING ||
 										 ((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
 										 ((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
 										 == flowing_down)))
@@ -1779,7 +1766,7 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 			update the current node
 		 */
 		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (nodemgr->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		if (nodemgr->liquidType(new_node_content) == LIQUID_FLOWING) {
 			// set level to last 3 bits, flowing down bit to 4th bit
 			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
 		} else {
@@ -1793,14 +1780,14 @@ void Map::transformLiquids(core::map<v3s16, MapBlock*> & modified_blocks)
 		if(block != NULL) {
 			modified_blocks.insert(blockpos, block);
 			// If node emits light, MapBlock requires lighting update
-			if(nodemgr->get(n0).light_source != 0)
+			if(nodemgr->lightSource(n0.getContent()) != 0)
 				lighting_modified_blocks[block->getPos()] = block;
 		}
 
 		/*
 			enqueue neighbors for update if neccessary
 		 */
-		switch (nodemgr->get(n0.getContent()).liquid_type) {
+		switch (nodemgr->liquidType(n0.getContent())) {
 			case LIQUID_SOURCE:
 			case LIQUID_FLOWING:
 				// make sure source flows into all neighboring nodes
@@ -2311,6 +2298,11 @@ MapBlock* ServerMap::finishBlockMake(mapgen::BlockMakeData *data,
 	{
 		MapBlock *block = i.getNode()->getValue();
 		assert(block);
+		/*
+			Free the node data of blocks that ended up all air or
+			all stone
+		*/
+		block->compactIfUniform();
 		/*
 			Update day/night difference cache of the MapBlocks
 		*/
@@ -3561,7 +3553,14 @@ ClientMap::ClientMap(
 	m_control(control),
 	m_camera_position(0,0,0),
 	m_camera_direction(0,0,1),
-	m_camera_fov(PI)
+	m_camera_fov(PI),
+	m_drawlist_draw_count(0),
+	m_drawlist_dirty(true),
+	m_drawlist_camera_block(0,0,0),
+	m_drawlist_camera_direction(0,0,1),
+	m_drawlist_camera_fov(PI),
+	m_visible_blocks(NULL),
+	m_visible_blocks_camera(0,0,0)
 {
 	m_camera_mutex.Init();
 	assert(m_camera_mutex.IsInitialized());
@@ -3572,6 +3571,8 @@ ClientMap::ClientMap(
 
 ClientMap::~ClientMap()
 {
+	delete m_visible_blocks;
+
 	/*JMutexAutoLock lock(mesh_mutex);
 	
 	if(mesh != NULL)
@@ -3642,80 +3643,44 @@ void ClientMap::OnRegisterSceneNode()
 	ISceneNode::OnRegisterSceneNode();
 }
 
-static bool isOccluded(Map *map, v3s16 p0, v3s16 p1, float step, float stepfac,
-		float start_off, float end_off, u32 needed_count, INodeDefManager *nodemgr)
+/*
+	Checks if a sphere is at least partly inside the viewing cone of
+	the camera. Used for culling whole regions of blocks before
+	checking the blocks themselves with isBlockInSight(); radius has
+	to include the margin isBlockInSight() gives to a block.
+*/
+static bool isSphereInSight(v3f center, f32 radius, v3f camera_pos,
+		v3f camera_dir, f32 camera_fov)
 {
-	float d0 = (float)BS * p0.getDistanceFrom(p1);
-	v3s16 u0 = p1 - p0;
-	v3f uf = v3f(u0.X, u0.Y, u0.Z) * BS;
-	uf.normalize();
-	v3f p0f = v3f(p0.X, p0.Y, p0.Z) * BS;
-	u32 count = 0;
-	for(float s=start_off; s<d0+end_off; s+=step){
-		v3f pf = p0f + uf * s;
-		v3s16 p = floatToInt(pf, BS);
-		MapNode n = map->getNodeNoEx(p);
-		bool is_transparent = false;
-		const ContentFeatures &f = nodemgr->get(n);
-		if(f.solidness == 0)
-			is_transparent = (f.visual_solidness != 2);
-		else
-			is_transparent = (f.solidness != 2);
-		if(!is_transparent){
-			count++;
-			if(count >= needed_count)
-				return true;
-		}
-		step *= stepfac;
-	}
-	return false;
+	v3f relative = center - camera_pos;
+	f32 d = relative.getLength();
+	if(d <= radius)
+		return true;
+	// Angle between the camera direction and the sphere center
+	f32 cosangle = relative.dotProduct(camera_dir) / d;
+	if(cosangle > 1.0)
+		cosangle = 1.0;
+	if(cosangle < -1.0)
+		cosangle = -1.0;
+	// Half of the angle the sphere covers as seen from the camera
+	f32 halfwidth = asin(radius / d);
+	return acos(cosangle) - halfwidth <= camera_fov / 2;
 }
 
-void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
-{
-	INodeDefManager *nodemgr = m_gamedef->ndef();
-
-	//m_dout<<DTIME<<"Rendering map..."<<std::endl;
-	DSTACK(__FUNCTION_NAME);
-
-	bool is_transparent_pass = pass == scene::ESNRP_TRANSPARENT;
-	
-	std::string prefix;
-	if(pass == scene::ESNRP_SOLID)
-		prefix = "CM: solid: ";
-	else
-		prefix = "CM: transparent: ";
-
-	/*
-		This is called two times per frame, reset on the non-transparent one
-	*/
-	if(pass == scene::ESNRP_SOLID)
-	{
-		m_last_drawn_sectors.clear();
-	}
-
-	/*
-		Get time for measuring timeout.
-		
-		Measuring time is very useful for long delays when the
-		machine is swapping a lot.
-	*/
-	int time1 = time(0);
-
-	//u32 daynight_ratio = m_client->getDayNightRatio();
+// Size of a culling region in blocks (on each axis)
+#define DRAWLIST_REGION_SIZE 4
 
+void ClientMap::updateDrawList()
+{
 	m_camera_mutex.Lock();
 	v3f camera_position = m_camera_position;
 	v3f camera_direction = m_camera_direction;
 	f32 camera_fov = m_camera_fov;
 	m_camera_mutex.Unlock();
 
-	/*
-		Get all blocks and draw all visible ones
-	*/
-
 	v3s16 cam_pos_nodes = floatToInt(camera_position, BS);
-	
+	v3s16 camera_block = getNodeBlockPos(cam_pos_nodes);
+
 	v3s16 box_nodes_d = m_control.wanted_range * v3s16(1,1,1);
 
 	v3s16 p_nodes_min = cam_pos_nodes - box_nodes_d;
@@ -3731,13 +3696,87 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 			p_nodes_max.X / MAP_BLOCKSIZE + 1,
 			p_nodes_max.Y / MAP_BLOCKSIZE + 1,
 			p_nodes_max.Z / MAP_BLOCKSIZE + 1);
-	
-	u32 vertex_count = 0;
-	u32 meshbuffer_count = 0;
+
+	/*
+		Occlusion culling is done in the background. Ask for the
+		blocks seen from the current camera block and take the
+		newest result if there is one.
+	*/
+	if(m_control.range_all)
+		m_client->setOcclusionCamera(camera_block,
+				v3s16(-32768,-32768,-32768), v3s16(32767,32767,32767));
+	else
+		m_client->setOcclusionCamera(camera_block,
+				p_blocks_min, p_blocks_max);
+	{
+		v3s16 visible_camera_block;
+		core::map<v3s16, bool> *visible =
+				m_client->takeVisibleBlocks(&visible_camera_block);
+		if(visible != NULL)
+		{
+			delete m_visible_blocks;
+			m_visible_blocks = visible;
+			m_visible_blocks_camera = visible_camera_block;
+			m_drawlist_dirty = true;
+		}
+	}
+
+	/*
+		Check if the list is still valid. A small turn of the camera
+		is covered by the margin isBlockInSight() gives to blocks.
+	*/
+	if(m_drawlist_dirty == false
+			&& camera_block == m_drawlist_camera_block
+			&& camera_direction.dotProduct(m_drawlist_camera_direction)
+				> 0.9998 // about one degree
+			&& camera_fov == m_drawlist_camera_fov
+			&& m_control.range_all == m_drawlist_control.range_all
+			&& m_control.wanted_range == m_drawlist_control.wanted_range
+			&& m_control.wanted_max_blocks
+				== m_drawlist_control.wanted_max_blocks
+			&& m_control.wanted_min_range
+				== m_drawlist_control.wanted_min_range)
+	{
+		g_profiler->avg("CM: draw list rebuilt (frac)", 0);
+		return;
+	}
+	g_profiler->avg("CM: draw list rebuilt (frac)", 1);
+
+	ScopeProfiler sp(g_profiler, "CM: collecting blocks for drawing", SPT_AVG);
+
+	m_drawlist_dirty = false;
+	m_drawlist_camera_block = camera_block;
+	m_drawlist_camera_direction = camera_direction;
+	m_drawlist_camera_fov = camera_fov;
+	m_drawlist_control = m_control;
+
+	m_drawlist.clear();
+	m_drawlist_draw_count = 0;
+	m_last_drawn_sectors.clear();
+
+	/*
+		Use the set of visible blocks if it was made for this camera
+		block or one next to it. The next one is usually ready in a
+		few frames. After a jump farther away everything in sight is
+		drawn until then.
+	*/
+	bool use_visible_blocks = false;
+	if(m_visible_blocks != NULL)
+	{
+		v3s16 d = camera_block - m_visible_blocks_camera;
+		use_visible_blocks = (abs(d.X) <= 1 && abs(d.Y) <= 1
+				&& abs(d.Z) <= 1);
+	}
 	
 	// For limiting number of mesh updates per frame
 	u32 mesh_update_count = 0;
+	// Don't queue more than the mesh update threads can finish
+	bool mesh_queue_full = m_client->isMeshUpdateQueueFull();
 	
+	// Number of regions checked for being in sight
+	u32 regions_checked = 0;
+	// Number of sectors skipped because no region of them is in sight
+	u32 sectors_culled = 0;
 	// Number of blocks in rendering range
 	u32 blocks_in_range = 0;
 	// Number of blocks occlusion culled
@@ -3747,21 +3786,19 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 	// Blocks that had mesh that would have been drawn according to
 	// rendering range (if max blocks limit didn't kick in)
 	u32 blocks_would_have_drawn = 0;
-	// Blocks that were drawn and had a mesh
-	u32 blocks_drawn = 0;
-	// Blocks which had a corresponding meshbuffer for this pass
-	u32 blocks_had_pass_meshbuf = 0;
-	// Blocks from which stuff was actually drawn
-	u32 blocks_without_stuff = 0;
+
+	// Blocks dropped by the max blocks limit
+	core::array<MapBlock*> blocks_over_limit;
 
 	/*
-		Collect a set of blocks for drawing
+		Regions of DRAWLIST_REGION_SIZE^3 blocks are checked against
+		the viewing cone first, so that sectors and blocks far off to
+		the side or behind the camera are dropped without looking at
+		them one by one.
 	*/
-	
-	core::map<v3s16, MapBlock*> drawset;
-
-	{
-	ScopeProfiler sp(g_profiler, prefix+"collecting blocks for drawing", SPT_AVG);
+	core::map<v3s16, bool> region_in_sight;
+	f32 region_radius = 0.5 * 1.74 * DRAWLIST_REGION_SIZE * MAP_BLOCKSIZE * BS
+			+ 1.44*1.44*MAP_BLOCKSIZE*BS;
 
 	for(core::map<v2s16, MapSector*>::Iterator
 			si = m_sectors.getIterator();
@@ -3779,6 +3816,46 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 				continue;
 		}
 
+		/*
+			Find the regions of the sector column inside the range
+			and skip the whole sector if none of them is in sight
+		*/
+
+		v3s16 region_min = getContainerPos(
+				v3s16(sp.X, p_blocks_min.Y, sp.Y), DRAWLIST_REGION_SIZE);
+		v3s16 region_max = getContainerPos(
+				v3s16(sp.X, p_blocks_max.Y, sp.Y), DRAWLIST_REGION_SIZE);
+		bool sector_in_sight = m_control.range_all;
+		for(s16 y=region_min.Y;
+				m_control.range_all == false && y<=region_max.Y; y++)
+		{
+			v3s16 rp(region_min.X, y, region_min.Z);
+			core::map<v3s16, bool>::Node *n = region_in_sight.find(rp);
+			bool in_sight;
+			if(n != NULL)
+			{
+				in_sight = n->getValue();
+			}
+			else
+			{
+				v3f center = intToFloat(
+						rp * DRAWLIST_REGION_SIZE * MAP_BLOCKSIZE, BS)
+						+ v3f(1,1,1) * (0.5 * DRAWLIST_REGION_SIZE
+						* MAP_BLOCKSIZE - 0.5) * BS;
+				in_sight = isSphereInSight(center, region_radius,
+						camera_position, camera_direction, camera_fov);
+				region_in_sight.insert(rp, in_sight);
+				regions_checked++;
+			}
+			if(in_sight)
+				sector_in_sight = true;
+		}
+		if(sector_in_sight == false)
+		{
+			sectors_culled++;
+			continue;
+		}
+
 		core::list< MapBlock * > sectorblocks;
 		sector->getBlocks(sectorblocks);
 		
@@ -3793,6 +3870,19 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 		{
 			MapBlock *block = *i;
 
+			/*
+				Skip the block if its region was found to be out
+				of sight
+			*/
+			if(m_control.range_all == false)
+			{
+				v3s16 rp = getContainerPos(block->getPos(),
+						DRAWLIST_REGION_SIZE);
+				core::map<v3s16, bool>::Node *n = region_in_sight.find(rp);
+				if(n == NULL || n->getValue() == false)
+					continue;
+			}
+
 			/*
 				Compare block position to camera position, skip
 				if not seen on display
@@ -3810,14 +3900,8 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 				continue;
 			}
 
-			// This is ugly (spherical distance limit?)
-			/*if(m_control.range_all == false &&
-					d - 0.5*BS*MAP_BLOCKSIZE > range)
-				continue;*/
-
 			blocks_in_range++;
 			
-#if 1
 			/*
 				Update expired mesh (used for day/night change)
 
@@ -3841,13 +3925,12 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 			}
 
 			f32 faraway = BS*50;
-			//f32 faraway = m_control.wanted_range * BS;
 			
 			/*
 				This has to be done with the mesh_mutex unlocked
 			*/
 			// Pretty random but this should work somewhat nicely
-			if(mesh_expired && (
+			if(mesh_expired && !mesh_queue_full && (
 					(mesh_update_count < 3
 						&& (d < faraway || mesh_update_count < 2)
 					)
@@ -3855,67 +3938,37 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 					(m_control.range_all && mesh_update_count < 20)
 				)
 			)
-			/*if(mesh_expired && mesh_update_count < 6
-					&& (d < faraway || mesh_update_count < 3))*/
 			{
 				mesh_update_count++;
 
 				// Mesh has been expired: generate new mesh
-				//block->updateMesh(daynight_ratio);
 				m_client->addUpdateMeshTask(block->getPos());
 
 				mesh_expired = false;
 			}
-#endif
+
+			// Queue the rest of the expired meshes on a later frame
+			if(mesh_expired)
+				m_drawlist_dirty = true;
 
 			/*
 				Occlusion culling
 			*/
 
-			v3s16 cpn = block->getPos() * MAP_BLOCKSIZE;
-			cpn += v3s16(MAP_BLOCKSIZE/2, MAP_BLOCKSIZE/2, MAP_BLOCKSIZE/2);
-			float step = BS*1;
-			float stepfac = 1.1;
-			float startoff = BS*1;
-			float endoff = -BS*MAP_BLOCKSIZE*1.42*1.42;
-			v3s16 spn = cam_pos_nodes + v3s16(0,0,0);
-			s16 bs2 = MAP_BLOCKSIZE/2 + 1;
-			u32 needed_count = 1;
-			if(
-				isOccluded(this, spn, cpn + v3s16(0,0,0),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(bs2,bs2,bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(bs2,bs2,-bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(bs2,-bs2,bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(bs2,-bs2,-bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(-bs2,bs2,bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(-bs2,bs2,-bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(-bs2,-bs2,bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr) &&
-				isOccluded(this, spn, cpn + v3s16(-bs2,-bs2,-bs2),
-					step, stepfac, startoff, endoff, needed_count, nodemgr)
-			)
+			if(use_visible_blocks &&
+					m_visible_blocks->find(block->getPos()) == NULL)
 			{
 				blocks_occlusion_culled++;
 				continue;
 			}
 			
-			// This block is in range. Reset usage timer.
-			block->resetUsageTimer();
-
 			/*
 				Ignore if mesh doesn't exist
 			*/
 			{
 				JMutexAutoLock lock(block->mesh_mutex);
 
-				scene::SMesh *mesh = block->mesh;
+				MapBlockMesh *mesh = block->mesh;
 				
 				if(mesh == NULL){
 					blocks_in_range_without_mesh++;
@@ -3925,24 +3978,86 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 			
 			// Limit block count in case of a sudden increase
 			blocks_would_have_drawn++;
-			if(blocks_drawn >= m_control.wanted_max_blocks
+			if(m_drawlist_draw_count >= m_control.wanted_max_blocks
 					&& m_control.range_all == false
 					&& d > m_control.wanted_min_range * BS)
+			{
+				blocks_over_limit.push_back(block);
 				continue;
+			}
 			
-			// Add to set
-			drawset[block->getPos()] = block;
+			// Add to list
+			m_drawlist.push_back(block);
+			m_drawlist_draw_count++;
 			
 			sector_blocks_drawn++;
-			blocks_drawn++;
 
 		} // foreach sectorblocks
 
 		if(sector_blocks_drawn != 0)
 			m_last_drawn_sectors[sp] = true;
 	}
-	} // ScopeProfiler
+
+	for(u32 i=0; i<blocks_over_limit.size(); i++)
+		m_drawlist.push_back(blocks_over_limit[i]);
+
+	g_profiler->avg("CM: regions checked", regions_checked);
+	g_profiler->avg("CM: sectors culled", sectors_culled);
+	g_profiler->avg("CM: blocks in range", blocks_in_range);
+	g_profiler->avg("CM: blocks occlusion culled", blocks_occlusion_culled);
+	if(blocks_in_range != 0)
+		g_profiler->avg("CM: blocks in range without mesh (frac)",
+				(float)blocks_in_range_without_mesh/blocks_in_range);
+	g_profiler->avg("CM: blocks drawn", m_drawlist_draw_count);
+
+	m_control.blocks_drawn = m_drawlist_draw_count;
+	m_control.blocks_would_have_drawn = blocks_would_have_drawn;
+}
+
+void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
+{
+	//m_dout<<DTIME<<"Rendering map..."<<std::endl;
+	DSTACK(__FUNCTION_NAME);
+
+	bool is_transparent_pass = pass == scene::ESNRP_TRANSPARENT;
 	
+	std::string prefix;
+	if(pass == scene::ESNRP_SOLID)
+		prefix = "CM: solid: ";
+	else
+		prefix = "CM: transparent: ";
+
+	/*
+		This is called two times per frame, update the list of blocks
+		to draw on the non-transparent one
+	*/
+	if(pass == scene::ESNRP_SOLID)
+	{
+		updateDrawList();
+
+		// These blocks are in sight. Reset usage timers.
+		for(u32 i=0; i<m_drawlist.size(); i++)
+			m_drawlist[i]->resetUsageTimer();
+	}
+
+	/*
+		Get time for measuring timeout.
+		
+		Measuring time is very useful for long delays when the
+		machine is swapping a lot.
+	*/
+	int time1 = time(0);
+
+	u32 daynight_ratio = m_client->getDayNightRatio();
+
+	u32 vertex_count = 0;
+	u32 meshbuffer_count = 0;
+	
+	// Blocks which had a corresponding meshbuffer for this pass
+	u32 blocks_had_pass_meshbuf = 0;
+	// Blocks from which stuff was actually drawn
+	u32 blocks_without_stuff = 0;
+
 	/*
 		Draw the selected MapBlocks
 	*/
@@ -3951,9 +4066,7 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 	ScopeProfiler sp(g_profiler, prefix+"drawing blocks", SPT_AVG);
 
 	int timecheck_counter = 0;
-	for(core::map<v3s16, MapBlock*>::Iterator
-			i = drawset.getIterator();
-			i.atEnd() == false; i++)
+	for(u32 i=0; i<m_drawlist_draw_count; i++)
 	{
 		{
 			timecheck_counter++;
@@ -3971,7 +4084,7 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 			}
 		}
 		
-		MapBlock *block = i.getNode()->getValue();
+		MapBlock *block = m_drawlist[i];
 
 		/*
 			Draw the faces of the block
@@ -3979,8 +4092,13 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 		{
 			JMutexAutoLock lock(block->mesh_mutex);
 
-			scene::SMesh *mesh = block->mesh;
-			assert(mesh);
+			MapBlockMesh *mesh = block->mesh;
+			// The mesh can go away before the list is rebuilt
+			if(mesh == NULL)
+				continue;
+
+			// Update vertex colors if the time of day has changed
+			mesh->setDayNightRatio(daynight_ratio);
 			
 			u32 c = mesh->getMeshBufferCount();
 			bool stuff_actually_drawn = false;
@@ -4017,26 +4135,13 @@ void ClientMap::renderMap(video::IVideoDriver* driver, s32 pass)
 	}
 	} // ScopeProfiler
 	
-	// Log only on solid pass because values are the same
-	if(pass == scene::ESNRP_SOLID){
-		g_profiler->avg("CM: blocks in range", blocks_in_range);
-		g_profiler->avg("CM: blocks occlusion culled", blocks_occlusion_culled);
-		if(blocks_in_range != 0)
-			g_profiler->avg("CM: blocks in range without mesh (frac)",
-					(float)blocks_in_range_without_mesh/blocks_in_range);
-		g_profiler->avg("CM: blocks drawn", blocks_drawn);
-	}
-	
 	g_profiler->avg(prefix+"vertices drawn", vertex_count);
 	if(blocks_had_pass_meshbuf != 0)
 		g_profiler->avg(prefix+"meshbuffers per block",
 				(float)meshbuffer_count / (float)blocks_had_pass_meshbuf);
-	if(blocks_drawn != 0)
+	if(m_drawlist_draw_count != 0)
 		g_profiler->avg(prefix+"empty blocks (frac)",
-				(float)blocks_without_stuff / blocks_drawn);
-
-	m_control.blocks_drawn = blocks_drawn;
-	m_control.blocks_would_have_drawn = blocks_would_have_drawn;
+				(float)blocks_without_stuff / m_drawlist_draw_count);
 
 	/*infostream<<"renderMap(): is_transparent_pass="<<is_transparent_pass
 			<<", rendered "<<vertex_count<<" vertices."<<std::endl;*/
@@ -4168,6 +4273,9 @@ void ClientMap::expireMeshes(bool only_daynight_diffed)
 {
 	TimeTaker timer("expireMeshes()");
 
+	// Expired meshes are queued for update when the list is built
+	invalidateDrawList();
+
 	core::map<v2s16, MapSector*>::Iterator si;
 	si = m_sectors.getIterator();
 	for(; si.atEnd() == false; si++)
@@ -4204,35 +4312,22 @@ void ClientMap::updateMeshes(v3s16 blockpos, u32 daynight_ratio)
 {
 	assert(mapType() == MAPTYPE_CLIENT);
 
-	try{
-		v3s16 p = blockpos + v3s16(0,0,0);
-		MapBlock *b = getBlockNoCreate(p);
-		b->updateMesh(daynight_ratio);
-		//b->setMeshExpired(true);
-	}
-	catch(InvalidPositionException &e){}
-	// Leading edge
-	try{
-		v3s16 p = blockpos + v3s16(-1,0,0);
-		MapBlock *b = getBlockNoCreate(p);
-		b->updateMesh(daynight_ratio);
-		//b->setMeshExpired(true);
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,-1,0);
-		MapBlock *b = getBlockNoCreate(p);
-		b->updateMesh(daynight_ratio);
-		//b->setMeshExpired(true);
-	}
-	catch(InvalidPositionException &e){}
-	try{
-		v3s16 p = blockpos + v3s16(0,0,-1);
-		MapBlock *b = getBlockNoCreate(p);
+	// The block and the ones at its leading edges
+	v3s16 dirs[4] = {
+		v3s16(0,0,0),
+		v3s16(-1,0,0),
+		v3s16(0,-1,0),
+		v3s16(0,0,-1),
+	};
+	for(u32 i=0; i<4; i++)
+	{
+		MapBlock *b = getBlockNoCreateNoEx(blockpos + dirs[i]);
+		if(b == NULL)
+			continue;
 		b->updateMesh(daynight_ratio);
 		//b->setMeshExpired(true);
 	}
-	catch(InvalidPositionException &e){}
+	invalidateDrawList();
 }
 
 #if 0
@@ -4318,7 +4413,6 @@ void MapVoxelManipulator::emerge(VoxelArea a, s32 caller_id)
 			continue;
 		
 		bool block_data_inexistent = false;
-		try
 		{
 			TimeTaker timer1("emerge load", &emerge_load_time);
 
@@ -4328,16 +4422,12 @@ void MapVoxelManipulator::emerge(VoxelArea a, s32 caller_id)
 			a.print(infostream);
 			infostream<<std::endl;*/
 			
-			MapBlock *block = m_map->getBlockNoCreate(p);
-			if(block->isDummy())
+			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+			if(block == NULL || block->isDummy())
 				block_data_inexistent = true;
 			else
 				block->copyTo(*this);
 		}
-		catch(InvalidPositionException &e)
-		{
-			block_data_inexistent = true;
-		}
 
 		if(block_data_inexistent)
 		{
@@ -4478,20 +4568,15 @@ void ManualMapVoxelManipulator::initialEmerge(
 			continue;
 		
 		bool block_data_inexistent = false;
-		try
 		{
 			TimeTaker timer1("emerge load", &emerge_load_time);
 
-			MapBlock *block = m_map->getBlockNoCreate(p);
-			if(block->isDummy())
+			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+			if(block == NULL || block->isDummy())
 				block_data_inexistent = true;
 			else
 				block->copyTo(*this);
 		}
-		catch(InvalidPositionException &e)
-		{
-			block_data_inexistent = true;
-		}
 
 		if(block_data_inexistent)
 		{
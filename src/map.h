@@ -175,8 +175,12 @@ class Map /*: public NodeContainer*/
 	// throws InvalidPositionException if not found
 	void setNode(v3s16 p, MapNode & n);
 	
-	// Returns a CONTENT_IGNORE node if not found
-	MapNode getNodeNoEx(v3s16 p);
+	/*
+		Returns a CONTENT_IGNORE node if not found. If is_valid_position
+		is not NULL, it is set to whether the node was found. Use this
+		instead of catching InvalidPositionException from getNode().
+	*/
+	MapNode getNodeNoEx(v3s16 p, bool *is_valid_position=NULL);
 
 	void unspreadLight(enum LightBank bank,
 			core::map<v3s16, u8> & from_nodes,
@@ -223,6 +227,25 @@ class Map /*: public NodeContainer*/
 	*/
 	bool addNodeWithEvent(v3s16 p, MapNode n);
 	bool removeNodeWithEvent(v3s16 p);
+
+	/*
+		Sets many nodes at once. The nodes are written straight into
+		their blocks, the lighting of all the changed blocks is updated
+		in one go and a single MEET_OTHER event is sent for them.
+		Nodes in blocks that are not loaded are skipped.
+		Returns the number of nodes set.
+	*/
+	u32 addNodesWithEvent(core::map<v3s16, MapNode> &nodes);
+
+	/*
+		To be called after nodes have been written straight into
+		written_blocks. Marks them modified, updates their lighting in
+		one go and sends a single MEET_OTHER event for them and the
+		blocks the lighting spread to, which all go to modified_blocks.
+	*/
+	void updateWrittenBlocks(core::map<v3s16, MapBlock*> &written_blocks,
+			core::map<v3s16, MapBlock*> &modified_blocks,
+			const std::string &reason);
 	
 	/*
 		Takes the blocks at the edges into account
@@ -566,6 +589,25 @@ class ClientMap : public Map, public scene::ISceneNode
 		return m_box;
 	}
 
+	/*
+		Rebuilds the list of blocks to be drawn if the camera has
+		moved to another block or turned, the drawing range has
+		changed or invalidateDrawList() has been called. Called by
+		renderMap() on the solid pass; the transparent pass draws
+		from the same list.
+	*/
+	void updateDrawList();
+
+	/*
+		Makes updateDrawList() rebuild the list on the next frame.
+		Has to be called when meshes are replaced or blocks are
+		deleted, as the list holds pointers to blocks.
+	*/
+	void invalidateDrawList()
+	{
+		m_drawlist_dirty = true;
+	}
+
 	void renderMap(video::IVideoDriver* driver, s32 pass);
 
 	void renderPostFx();
@@ -623,6 +665,24 @@ class ClientMap : public Map, public scene::ISceneNode
 	JMutex m_camera_mutex;
 	
 	core::map<v2s16, bool> m_last_drawn_sectors;
+
+	/*
+		Blocks in sight with a mesh. The first m_drawlist_draw_count
+		are drawn, the rest were dropped by wanted_max_blocks and are
+		only kept from being unloaded.
+	*/
+	core::array<MapBlock*> m_drawlist;
+	u32 m_drawlist_draw_count;
+	bool m_drawlist_dirty;
+	// Camera and range the draw list was built for
+	v3s16 m_drawlist_camera_block;
+	v3f m_drawlist_camera_direction;
+	f32 m_drawlist_camera_fov;
+	MapDrawControl m_drawlist_control;
+
+	// Newest result of occlusion culling and the block it was made for
+	core::map<v3s16, bool> *m_visible_blocks;
+	v3s16 m_visible_blocks_camera;
 };
 
 #endif
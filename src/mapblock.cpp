@@ -31,6 +31,28 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nameidmapping.h"
 #include "content_mapnode.h" // For legacy name-id mapping
 
+/*
+	MapBlockSnapshot
+*/
+
+MapBlockSnapshot::MapBlockSnapshot(const u8 *planes, MapNode uniform_node):
+	m_data(NULL),
+	m_uniform_node(uniform_node),
+	m_refcount(1)
+{
+	m_refcount_mutex.Init();
+	if(planes != NULL)
+	{
+		m_data = new u8[nodecount * 3];
+		memcpy(m_data, planes, nodecount * 3);
+	}
+}
+
+MapBlockSnapshot::~MapBlockSnapshot()
+{
+	delete[] m_data;
+}
+
 /*
 	MapBlock
 */
@@ -52,6 +74,8 @@ MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_usage_timer(0)
 {
 	data = NULL;
+	m_uniform = false;
+	m_snapshot = NULL;
 	if(dummy == false)
 		reallocate();
 	
@@ -79,6 +103,8 @@ MapBlock::~MapBlock()
 
 	delete m_node_metadata;
 
+	invalidateSnapshot();
+
 	if(data)
 		delete[] data;
 }
@@ -102,9 +128,9 @@ MapNode MapBlock::getNodeParent(v3s16 p)
 	}
 	else
 	{
-		if(data == NULL)
+		if(isDummy())
 			throw InvalidPositionException();
-		return data[p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X];
+		return readNode(p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X);
 	}
 }
 
@@ -116,32 +142,22 @@ void MapBlock::setNodeParent(v3s16 p, MapNode & n)
 	}
 	else
 	{
-		if(data == NULL)
+		if(isDummy())
 			throw InvalidPositionException();
-		data[p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X] = n;
+		writeNode(p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X, n);
 	}
 }
 
-MapNode MapBlock::getNodeParentNoEx(v3s16 p)
+MapNode MapBlock::getNodeParentNoEx(v3s16 p, bool *is_valid_position)
 {
-	if(isValidPosition(p) == false)
+	if(p.X < 0 || p.X >= MAP_BLOCKSIZE
+			|| p.Y < 0 || p.Y >= MAP_BLOCKSIZE
+			|| p.Z < 0 || p.Z >= MAP_BLOCKSIZE)
 	{
-		try{
-			return m_parent->getNode(getPosRelative() + p);
-		}
-		catch(InvalidPositionException &e)
-		{
-			return MapNode(CONTENT_IGNORE);
-		}
-	}
-	else
-	{
-		if(data == NULL)
-		{
-			return MapNode(CONTENT_IGNORE);
-		}
-		return data[p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X];
+		return m_parent->getNodeNoEx(getPosRelative() + p,
+				is_valid_position);
 	}
+	return getNodeNoEx(p, is_valid_position);
 }
 
 #ifndef SERVER
@@ -163,7 +179,7 @@ void MapBlock::updateMesh(u32 daynight_ratio)
 	MeshMakeData data;
 	data.fill(daynight_ratio, this);
 	
-	scene::SMesh *mesh_new = makeMapBlockMesh(&data, m_gamedef);
+	MapBlockMesh *mesh_new = makeMapBlockMesh(&data, m_gamedef);
 	
 	/*
 		Replace the mesh
@@ -174,14 +190,14 @@ void MapBlock::updateMesh(u32 daynight_ratio)
 }
 #endif
 
-void MapBlock::replaceMesh(scene::SMesh *mesh_new)
+void MapBlock::replaceMesh(MapBlockMesh *mesh_new)
 {
 	mesh_mutex.Lock();
 
 	//scene::SMesh *mesh_old = mesh[daynight_i];
 	//mesh[daynight_i] = mesh_new;
 
-	scene::SMesh *mesh_old = mesh;
+	MapBlockMesh *mesh_old = mesh;
 	mesh = mesh_new;
 	setMeshExpired(false);
 	
@@ -278,7 +294,7 @@ bool MapBlock::propagateSunlight(core::map<v3s16, bool> & light_sources,
 				else
 				{
 					MapNode n = getNode(v3s16(x, MAP_BLOCKSIZE-1, z));
-					if(m_gamedef->ndef()->get(n).sunlight_propagates == false)
+					if(m_gamedef->ndef()->sunlightPropagates(n.getContent()) == false)
 					{
 						no_sunlight = true;
 					}
@@ -321,17 +337,18 @@ bool MapBlock::propagateSunlight(core::map<v3s16, bool> & light_sources,
 			for(; y >= 0; y--)
 			{
 				v3s16 pos(x, y, z);
-				MapNode &n = getNodeRef(pos);
+				u32 i = z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x;
+				MapNode n = readNode(i);
 				
 				if(current_light == 0)
 				{
 					// Do nothing
 				}
-				else if(current_light == LIGHT_SUN && nodemgr->get(n).sunlight_propagates)
+				else if(current_light == LIGHT_SUN && nodemgr->sunlightPropagates(n.getContent()))
 				{
 					// Do nothing: Sunlight is continued
 				}
-				else if(nodemgr->get(n).light_propagates == false)
+				else if(nodemgr->lightPropagates(n.getContent()) == false)
 				{
 					// A solid object is on the way.
 					stopped_to_solid_object = true;
@@ -350,6 +367,7 @@ bool MapBlock::propagateSunlight(core::map<v3s16, bool> & light_sources,
 				if(current_light > old_light || remove_light)
 				{
 					n.setLight(LIGHTBANK_DAY, current_light, nodemgr);
+					writeNode(i, n);
 				}
 				
 				if(diminish_light(current_light) != 0)
@@ -382,7 +400,7 @@ bool MapBlock::propagateSunlight(core::map<v3s16, bool> & light_sources,
 			if(block_below_is_valid)
 			{
 				MapNode n = getNodeParent(v3s16(x, -1, z));
-				if(nodemgr->get(n).light_propagates)
+				if(nodemgr->lightPropagates(n.getContent()))
 				{
 					if(n.getLight(LIGHTBANK_DAY, nodemgr) == LIGHT_SUN
 							&& sunlight_should_go_down == false)
@@ -411,9 +429,16 @@ void MapBlock::copyTo(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 	
+	// Uniform blocks have no planes to copy from
+	if(m_uniform)
+	{
+		dst.copyFromUniform(m_uniform_node, getPosRelative(), data_size);
+		return;
+	}
+
 	// Copy from data to VoxelManipulator
-	dst.copyFrom(data, data_area, v3s16(0,0,0),
-			getPosRelative(), data_size);
+	dst.copyFromPlanes(getParam0Data(), getParam1Data(), getParam2Data(),
+			data_area, v3s16(0,0,0), getPosRelative(), data_size);
 }
 
 void MapBlock::copyFrom(VoxelManipulator &dst)
@@ -421,29 +446,279 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 	
+	invalidateSnapshot();
+
+	// The voxel data is arbitrary; give it somewhere to go
+	materialize();
+
 	// Copy from VoxelManipulator to data
-	dst.copyTo(data, data_area, v3s16(0,0,0),
-			getPosRelative(), data_size);
+	dst.copyToPlanes(getParam0Data(), getParam1Data(), getParam2Data(),
+			data_area, v3s16(0,0,0), getPosRelative(), data_size);
+}
+
+bool MapBlock::isUniform(MapNode *n) const
+{
+	if(data == NULL)
+	{
+		if(m_uniform && n != NULL)
+			*n = m_uniform_node;
+		return m_uniform;
+	}
+	
+	// A plane is uniform if every byte equals the one after it
+	for(u32 k=0; k<3; k++)
+	{
+		const u8 *p = data + nodecount * k;
+		if(memcmp(p, p + 1, nodecount - 1) != 0)
+			return false;
+	}
+	
+	if(n != NULL)
+	{
+		n->param0 = data[0];
+		n->param1 = data[nodecount];
+		n->param2 = data[nodecount * 2];
+	}
+	return true;
+}
+
+bool MapBlock::compactIfUniform()
+{
+	if(data == NULL)
+		return m_uniform;
+	
+	MapNode n;
+	if(isUniform(&n) == false)
+		return false;
+	
+	m_uniform_node = n;
+	m_uniform = true;
+	u8 *d = data;
+	data = NULL;
+	delete[] d;
+	return true;
+}
+
+void MapBlock::copyPlanesTo(u8 *dst)
+{
+	if(data != NULL)
+	{
+		memcpy(dst, data, nodecount * 3);
+		return;
+	}
+	memset(dst, m_uniform_node.param0, nodecount);
+	memset(dst + nodecount, m_uniform_node.param1, nodecount);
+	memset(dst + nodecount * 2, m_uniform_node.param2, nodecount);
+}
+
+MapBlockSnapshot* MapBlock::getSnapshot()
+{
+	if(isDummy())
+		return NULL;
+	if(m_snapshot == NULL)
+		m_snapshot = new MapBlockSnapshot(data, m_uniform_node);
+	m_snapshot->grab();
+	return m_snapshot;
+}
+
+void MapBlock::getContentPalette(std::vector<content_t> &palette,
+		u16 *indices) const
+{
+	palette.clear();
+	if(data == NULL)
+	{
+		palette.push_back(m_uniform_node.getContent());
+		if(indices)
+			memset(indices, 0, nodecount * sizeof(u16));
+		return;
+	}
+
+	// Content type -> palette index + 1 (0 = not in palette yet)
+	std::vector<u16> lookup(MAX_CONTENT + 1, 0);
+	const u8 *param0 = data;
+	const u8 *param2 = data + nodecount * 2;
+	for(u32 i=0; i<nodecount; i++)
+	{
+		// Same as MapNode::getContent()
+		content_t c = param0[i];
+		if(c >= 0x80)
+			c = (c<<4) | (param2[i]>>4);
+		u16 &k = lookup[c];
+		if(k == 0)
+		{
+			palette.push_back(c);
+			k = palette.size();
+		}
+		if(indices)
+			indices[i] = k - 1;
+	}
+}
+
+// Bits per packed palette index; powers of two so that indices never
+// cross a byte boundary
+static u8 palette_index_bits(u32 palette_size)
+{
+	if(palette_size <= 1)
+		return 0;
+	if(palette_size <= 2)
+		return 1;
+	if(palette_size <= 4)
+		return 2;
+	if(palette_size <= 16)
+		return 4;
+	if(palette_size <= 256)
+		return 8;
+	return 16;
+}
+
+/*
+	Layout:
+	u16 palette size N
+	N * u16 content types
+	u8 bits per index
+	nodecount * bits / 8 bytes of indices, low bits first
+	nodecount bytes of param1
+	nodecount bytes of param2 (including the extended content nibble)
+*/
+SharedBuffer<u8> MapBlock::serializePaletteNodes() const
+{
+	assert(data != NULL);
+
+	std::vector<content_t> palette;
+	SharedBuffer<u16> indices(nodecount);
+	getContentPalette(palette, *indices);
+
+	u8 bits = palette_index_bits(palette.size());
+	u32 index_bytes = nodecount * bits / 8;
+	u32 len = 2 + palette.size() * 2 + 1 + index_bytes + nodecount * 2;
+	SharedBuffer<u8> buf(len);
+	u8 *p = *buf;
+
+	writeU16(p, palette.size());
+	p += 2;
+	for(u32 k=0; k<palette.size(); k++)
+	{
+		writeU16(p, palette[k]);
+		p += 2;
+	}
+	*p++ = bits;
+
+	if(bits == 16)
+	{
+		for(u32 i=0; i<nodecount; i++)
+			writeU16(&p[i*2], indices[i]);
+	}
+	else if(bits != 0)
+	{
+		u32 per_byte = 8 / bits;
+		memset(p, 0, index_bytes);
+		for(u32 i=0; i<nodecount; i++)
+			p[i / per_byte] |= indices[i] << ((i % per_byte) * bits);
+	}
+	p += index_bytes;
+
+	memcpy(p, data + nodecount, nodecount * 2);
+	return buf;
+}
+
+void MapBlock::deSerializePaletteNodes(const std::string &s)
+{
+	const u8 *p = (const u8*)s.c_str();
+	const u8 *end = p + s.size();
+
+	if(end - p < 2)
+		throw SerializationError("MapBlock: palette truncated");
+	u32 palette_size = readU16((u8*)p);
+	p += 2;
+	if(palette_size == 0 || palette_size > MAX_CONTENT + 1)
+		throw SerializationError("MapBlock: invalid palette size");
+	if((u32)(end - p) < palette_size * 2 + 1)
+		throw SerializationError("MapBlock: palette truncated");
+
+	// Content types are stored as the param0 byte they map to; the
+	// extended nibble comes with the param2 plane
+	u8 palette_param0[MAX_CONTENT + 1];
+	for(u32 k=0; k<palette_size; k++)
+	{
+		content_t c = readU16((u8*)p) & MAX_CONTENT;
+		palette_param0[k] = (c < 0x80) ? c : (c >> 4);
+		p += 2;
+	}
+
+	u8 bits = *p++;
+	if(bits != palette_index_bits(palette_size))
+		throw SerializationError("MapBlock: invalid palette index size");
+	u32 index_bytes = nodecount * bits / 8;
+	if((u32)(end - p) != index_bytes + nodecount * 2)
+		throw SerializationError("MapBlock: invalid palette node data size");
+
+	materialize();
+	u8 *param0 = data;
+
+	if(bits == 0)
+	{
+		memset(param0, palette_param0[0], nodecount);
+	}
+	else if(bits == 16)
+	{
+		for(u32 i=0; i<nodecount; i++)
+		{
+			u16 k = readU16((u8*)&p[i*2]);
+			if(k >= palette_size)
+				throw SerializationError("MapBlock: invalid palette index");
+			param0[i] = palette_param0[k];
+		}
+	}
+	else
+	{
+		u32 per_byte = 8 / bits;
+		u8 mask = (1 << bits) - 1;
+		for(u32 i=0; i<nodecount; i++)
+		{
+			u8 k = (p[i / per_byte] >> ((i % per_byte) * bits)) & mask;
+			if(k >= palette_size)
+				throw SerializationError("MapBlock: invalid palette index");
+			param0[i] = palette_param0[k];
+		}
+	}
+	p += index_bytes;
+
+	memcpy(data + nodecount, p, nodecount * 2);
 }
 
 void MapBlock::updateDayNightDiff()
 {
 	INodeDefManager *nodemgr = m_gamedef->ndef();
 
-	if(data == NULL)
+	if(isDummy())
 	{
 		m_day_night_differs = false;
 		return;
 	}
 
+	// A single node decides for the whole uniform block
+	if(m_uniform)
+	{
+		m_day_night_differs = m_uniform_node.getContent() != CONTENT_AIR
+				&& m_uniform_node.getLight(LIGHTBANK_DAY, nodemgr)
+				!= m_uniform_node.getLight(LIGHTBANK_NIGHT, nodemgr);
+		return;
+	}
+
 	bool differs = false;
+	const u8 *param0 = getParam0Data();
+	const u8 *param1 = getParam1Data();
 
 	/*
-		Check if any lighting value differs
+		Check if any lighting value differs.
+		Nodes whose day and night nibbles are equal can't differ, so
+		only those are looked up as full nodes.
 	*/
-	for(u32 i=0; i<MAP_BLOCKSIZE*MAP_BLOCKSIZE*MAP_BLOCKSIZE; i++)
+	for(u32 i=0; i<nodecount; i++)
 	{
-		MapNode &n = data[i];
+		if((param1[i] & 0x0f) == (param1[i] >> 4))
+			continue;
+		MapNode n = readNode(i);
 		if(n.getLight(LIGHTBANK_DAY, nodemgr) != n.getLight(LIGHTBANK_NIGHT, nodemgr))
 		{
 			differs = true;
@@ -457,11 +732,11 @@ void MapBlock::updateDayNightDiff()
 	*/
 	if(differs)
 	{
+		// CONTENT_AIR is a short content type; it only depends on param0
 		bool only_air = true;
-		for(u32 i=0; i<MAP_BLOCKSIZE*MAP_BLOCKSIZE*MAP_BLOCKSIZE; i++)
+		for(u32 i=0; i<nodecount; i++)
 		{
-			MapNode &n = data[i];
-			if(n.getContent() != CONTENT_AIR)
+			if(param0[i] != CONTENT_AIR)
 			{
 				only_air = false;
 				break;
@@ -484,8 +759,8 @@ s16 MapBlock::getGroundLevel(v2s16 p2d)
 		s16 y = MAP_BLOCKSIZE-1;
 		for(; y>=0; y--)
 		{
-			MapNode n = getNodeRef(p2d.X, y, p2d.Y);
-			if(m_gamedef->ndef()->get(n).walkable)
+			MapNode n = getNode(p2d.X, y, p2d.Y);
+			if(m_gamedef->ndef()->walkable(n.getContent()))
 			{
 				if(y == MAP_BLOCKSIZE-1)
 					return -2;
@@ -510,13 +785,11 @@ static void getBlockNodeIdMapping(NameIdMapping *nimap, MapBlock *block,
 		INodeDefManager *nodedef)
 {
 	std::set<content_t> unknown_contents;
-	for(s16 z0=0; z0<MAP_BLOCKSIZE; z0++)
-	for(s16 y0=0; y0<MAP_BLOCKSIZE; y0++)
-	for(s16 x0=0; x0<MAP_BLOCKSIZE; x0++)
+	std::vector<content_t> palette;
+	block->getContentPalette(palette);
+	for(u32 k=0; k<palette.size(); k++)
 	{
-		v3s16 p(x0,y0,z0);
-		MapNode n = block->getNode(p);
-		content_t id = n.getContent();
+		content_t id = palette[k];
 		const ContentFeatures &f = nodedef->get(id);
 		const std::string &name = f.name;
 		if(name == "")
@@ -566,9 +839,13 @@ void correctBlockNodeIds(const NameIdMapping *nimap, MapBlock *block,
 				continue;
 			}
 		}
+		if(global_id == local_id)
+			continue;
 		n.setContent(global_id);
 		block->setNode(p, n);
 	}
+	// Rewriting ids materializes uniform blocks
+	block->compactIfUniform();
 	for(std::set<content_t>::const_iterator
 			i = unnamed_contents.begin();
 			i != unnamed_contents.end(); i++){
@@ -590,7 +867,7 @@ void MapBlock::serialize(std::ostream &os, u8 version)
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 	
-	if(data == NULL)
+	if(isDummy())
 	{
 		throw SerializationError("ERROR: Not writing dummy block.");
 	}
@@ -607,7 +884,7 @@ void MapBlock::serialize(std::ostream &os, u8 version)
 		for(u32 i=0; i<nodecount; i++)
 		{
 			u32 s = 1 + i * MapNode::serializedLength(version);
-			data[i].serialize(&dest[s], version);
+			readNode(i).serialize(&dest[s], version);
 		}
 		
 		os.write((char*)*dest, dest.getSize());
@@ -624,30 +901,21 @@ void MapBlock::serialize(std::ostream &os, u8 version)
 
 		u32 nodecount = MAP_BLOCKSIZE*MAP_BLOCKSIZE*MAP_BLOCKSIZE;
 
+		SharedBuffer<u8> planes(nodecount*3);
+		copyPlanesTo(*planes);
+
 		// Get and compress materials
-		SharedBuffer<u8> materialdata(nodecount);
-		for(u32 i=0; i<nodecount; i++)
-		{
-			materialdata[i] = data[i].param0;
-		}
+		SharedBuffer<u8> materialdata(*planes, nodecount);
 		compress(materialdata, os, version);
 
 		// Get and compress lights
-		SharedBuffer<u8> lightdata(nodecount);
-		for(u32 i=0; i<nodecount; i++)
-		{
-			lightdata[i] = data[i].param1;
-		}
+		SharedBuffer<u8> lightdata(*planes + nodecount, nodecount);
 		compress(lightdata, os, version);
 		
 		if(version >= 10)
 		{
 			// Get and compress param2
-			SharedBuffer<u8> param2data(nodecount);
-			for(u32 i=0; i<nodecount; i++)
-			{
-				param2data[i] = data[i].param2;
-			}
+			SharedBuffer<u8> param2data(*planes + nodecount*2, nodecount);
 			compress(param2data, os, version);
 		}
 	}
@@ -667,6 +935,11 @@ void MapBlock::serialize(std::ostream &os, u8 version)
 			if(m_generated == false)
 				flags |= 0x08;
 		}
+		// Uniform blocks are stored as a single node
+		MapNode uniform_node;
+		bool write_uniform = (version >= 22 && isUniform(&uniform_node));
+		if(write_uniform)
+			flags |= 0x10;
 		os.write((char*)&flags, 1);
 		
 		u32 nodecount = MAP_BLOCKSIZE*MAP_BLOCKSIZE*MAP_BLOCKSIZE;
@@ -675,20 +948,38 @@ void MapBlock::serialize(std::ostream &os, u8 version)
 			Get data
 		*/
 
-		// Serialize nodes
-		SharedBuffer<u8> databuf_nodelist(nodecount*3);
-		for(u32 i=0; i<nodecount; i++)
+		// Buffer with different parameters sorted
+		SharedBuffer<u8> databuf;
+		if(write_uniform)
 		{
-			data[i].serialize(&databuf_nodelist[i*3], version);
+			databuf = SharedBuffer<u8>(3);
+			databuf[0] = uniform_node.param0;
+			databuf[1] = uniform_node.param1;
+			databuf[2] = uniform_node.param2;
 		}
-		
-		// Create buffer with different parameters sorted
-		SharedBuffer<u8> databuf(nodecount*3);
-		for(u32 i=0; i<nodecount; i++)
+		else if(version >= 23)
+		{
+			databuf = serializePaletteNodes();
+		}
+		else if(version >= 20)
 		{
-			databuf[i] = databuf_nodelist[i*3];
-			databuf[i+nodecount] = databuf_nodelist[i*3+1];
-			databuf[i+nodecount*2] = databuf_nodelist[i*3+2];
+			// Nodes are stored as-is; the in-memory planes already
+			// have the serialized layout
+			databuf = SharedBuffer<u8>(nodecount*3);
+			copyPlanesTo(*databuf);
+		}
+		else
+		{
+			databuf = SharedBuffer<u8>(nodecount*3);
+			// Translate each node to the old format
+			for(u32 i=0; i<nodecount; i++)
+			{
+				u8 buf[3];
+				readNode(i).serialize(buf, version);
+				databuf[i] = buf[0];
+				databuf[i+nodecount] = buf[1];
+				databuf[i+nodecount*2] = buf[2];
+			}
 		}
 
 		/*
@@ -716,13 +1007,22 @@ void MapBlock::serialize(std::ostream &os, u8 version)
 					os<<serializeString("");
 				}
 			}
-			else
+			else if(version <= 23)
 			{
 				std::ostringstream oss(std::ios_base::binary);
 				m_node_metadata->serialize(oss);
 				compressZlib(oss.str(), os);
 				//os<<serializeLongString(oss.str());
 			}
+			else
+			{
+				std::ostringstream oss(std::ios_base::binary);
+				m_node_metadata->serialize(oss);
+				std::string metadata = oss.str();
+				SharedBuffer<u8> metabuf((u8*)metadata.c_str(),
+						metadata.size());
+				compress(metabuf, os, version);
+			}
 		}
 	}
 }
@@ -732,6 +1032,8 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
+	invalidateSnapshot();
+
 	// These have no lighting info
 	if(version <= 1)
 	{
@@ -762,7 +1064,9 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 			if(is.gcount() != len)
 				throw SerializationError
 						("MapBlock::deSerialize: no enough input data");
-			data[i].deSerialize(*d, version);
+			MapNode n;
+			n.deSerialize(*d, version);
+			writeNode(i, n);
 		}
 	}
 	else if(version <= 10)
@@ -773,6 +1077,8 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 		is.read((char*)&t8, 1);
 		is_underground = t8;
 
+		materialize();
+
 		{
 			// Uncompress and set material data
 			std::ostringstream os(std::ios_base::binary);
@@ -781,10 +1087,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 			if(s.size() != nodecount)
 				throw SerializationError
 						("MapBlock::deSerialize: invalid format");
-			for(u32 i=0; i<s.size(); i++)
-			{
-				data[i].param0 = s[i];
-			}
+			memcpy(getParam0Data(), s.c_str(), nodecount);
 		}
 		{
 			// Uncompress and set param data
@@ -794,10 +1097,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 			if(s.size() != nodecount)
 				throw SerializationError
 						("MapBlock::deSerialize: invalid format");
-			for(u32 i=0; i<s.size(); i++)
-			{
-				data[i].param1 = s[i];
-			}
+			memcpy(getParam1Data(), s.c_str(), nodecount);
 		}
 	
 		if(version >= 10)
@@ -809,10 +1109,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 			if(s.size() != nodecount)
 				throw SerializationError
 						("MapBlock::deSerialize: invalid format");
-			for(u32 i=0; i<s.size(); i++)
-			{
-				data[i].param2 = s[i];
-			}
+			memcpy(getParam2Data(), s.c_str(), nodecount);
 		}
 	}
 	// All other versions (newest)
@@ -827,24 +1124,51 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 		m_lighting_expired = (flags & 0x04) ? true : false;
 		if(version >= 18)
 			m_generated = (flags & 0x08) ? false : true;
+		bool read_uniform = (version >= 22 && (flags & 0x10));
 
 		// Uncompress data
 		std::ostringstream os(std::ios_base::binary);
 		decompress(is, os, version);
 		std::string s = os.str();
-		if(s.size() != nodecount*3)
+		// Palette node data has a variable size and is checked while
+		// reading it
+		bool palette = (version >= 23 && !read_uniform);
+		if(!palette && s.size() != (read_uniform ? 3 : nodecount*3))
 			throw SerializationError
 					("MapBlock::deSerialize: decompress resulted in size"
-					" other than nodecount*3");
+					" other than expected");
 
 		// deserialize nodes from buffer
-		for(u32 i=0; i<nodecount; i++)
+		if(read_uniform)
+		{
+			MapNode n;
+			n.param0 = s[0];
+			n.param1 = s[1];
+			n.param2 = s[2];
+			fill(n);
+		}
+		else if(palette)
+		{
+			deSerializePaletteNodes(s);
+		}
+		else if(version >= 20)
+		{
+			// Same layout as the in-memory planes
+			materialize();
+			memcpy(data, s.c_str(), nodecount*3);
+		}
+		else
 		{
-			u8 buf[3];
-			buf[0] = s[i];
-			buf[1] = s[i+nodecount];
-			buf[2] = s[i+nodecount*2];
-			data[i].deSerialize(buf, version);
+			for(u32 i=0; i<nodecount; i++)
+			{
+				u8 buf[3];
+				buf[0] = s[i];
+				buf[1] = s[i+nodecount];
+				buf[2] = s[i+nodecount*2];
+				MapNode n;
+				n.deSerialize(buf, version);
+				writeNode(i, n);
+			}
 		}
 		
 		/*
@@ -860,7 +1184,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 					std::istringstream iss(data, std::ios_base::binary);
 					m_node_metadata->deSerialize(iss, m_gamedef);
 				}
-				else
+				else if(version <= 23)
 				{
 					//std::string data = deSerializeLongString(is);
 					std::ostringstream oss(std::ios_base::binary);
@@ -868,6 +1192,13 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 					std::istringstream iss(oss.str(), std::ios_base::binary);
 					m_node_metadata->deSerialize(iss, m_gamedef);
 				}
+				else
+				{
+					std::ostringstream oss(std::ios_base::binary);
+					decompress(is, oss, version);
+					std::istringstream iss(oss.str(), std::ios_base::binary);
+					m_node_metadata->deSerialize(iss, m_gamedef);
+				}
 			}
 			catch(SerializationError &e)
 			{
@@ -876,6 +1207,9 @@ void MapBlock::deSerialize(std::istream &is, u8 version)
 			}
 		}
 	}
+
+	// Older formats store uniform blocks in full
+	compactIfUniform();
 }
 
 void MapBlock::serializeDiskExtra(std::ostream &os, u8 version)
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <jmutex.h>
 #include <jmutexautolock.h>
 #include <exception>
+#include <vector>
 #include "debug.h"
 #include "common_irrlicht.h"
 #include "mapnode.h"
@@ -101,6 +102,70 @@ class NodeContainer
 };
 #endif
 
+/*
+	An immutable copy of the nodes of a MapBlock.
+
+	A block keeps its current snapshot until its nodes change, so
+	taking a snapshot of an unchanged block doesn't copy anything.
+	Snapshots are reference counted and can be dropped in any thread.
+*/
+
+class MapBlockSnapshot
+{
+public:
+	// planes is nodecount*3 bytes like MapBlock::data, or NULL if
+	// every node is uniform_node
+	MapBlockSnapshot(const u8 *planes, MapNode uniform_node);
+
+	void grab()
+	{
+		JMutexAutoLock lock(m_refcount_mutex);
+		m_refcount++;
+	}
+	void drop()
+	{
+		bool last = false;
+		{
+			JMutexAutoLock lock(m_refcount_mutex);
+			assert(m_refcount > 0);
+			m_refcount--;
+			last = (m_refcount == 0);
+		}
+		if(last)
+			delete this;
+	}
+
+	// True if every node is the same
+	bool isUniform() const
+	{
+		return m_data == NULL;
+	}
+
+	// p is relative to the block and has to be inside it
+	MapNode getNodeNoCheck(v3s16 p) const
+	{
+		if(m_data == NULL)
+			return m_uniform_node;
+		u32 i = p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X;
+		MapNode n;
+		n.param0 = m_data[i];
+		n.param1 = m_data[i + nodecount];
+		n.param2 = m_data[i + nodecount * 2];
+		return n;
+	}
+
+private:
+	// Only deleted by drop()
+	~MapBlockSnapshot();
+
+	static const u32 nodecount = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+	u8 *m_data;
+	MapNode m_uniform_node;
+	u32 m_refcount;
+	JMutex m_refcount_mutex;
+};
+
 /*
 	MapBlock itself
 */
@@ -123,24 +188,64 @@ class MapBlock /*: public NodeContainer*/
 
 	void reallocate()
 	{
-		if(data != NULL)
-			delete[] data;
-		u32 l = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
-		data = new MapNode[l];
-		for(u32 i=0; i<l; i++){
-			//data[i] = MapNode();
-			data[i] = MapNode(CONTENT_IGNORE);
-		}
+		// Node data is allocated lazily at the first write
+		fill(MapNode(CONTENT_IGNORE));
 		raiseModified(MOD_STATE_WRITE_NEEDED, "reallocate");
 	}
 
+	/*
+		Uniform blocks
+
+		A block whose nodes are all identical (eg. air above ground or
+		stone deep underground) only stores that one node. The node
+		data is allocated when something is first written to the block.
+	*/
+
+	bool isUniform()
+	{
+		return m_uniform;
+	}
+	/*
+		Checks whether all nodes are identical, also when the node data
+		is allocated. Does not modify the block. If uniform and n is not
+		NULL, the node is written to n.
+	*/
+	bool isUniform(MapNode *n) const;
+	// Sets all nodes to n, freeing the node data
+	void fill(MapNode n)
+	{
+		invalidateSnapshot();
+		if(data != NULL)
+			delete[] data;
+		data = NULL;
+		m_uniform = true;
+		m_uniform_node = n;
+		raiseModified(MOD_STATE_WRITE_NEEDED, "fill");
+	}
+	// Frees the node data if all nodes are identical.
+	// Returns true if the block is uniform afterwards.
+	bool compactIfUniform();
+	/*
+		Collects the distinct content types of the block in order of
+		first appearance. If indices is not NULL, the palette index of
+		each node is written to it (one entry per node).
+	*/
+	void getContentPalette(std::vector<content_t> &palette,
+			u16 *indices=NULL) const;
+
+	/*
+		Returns a grabbed snapshot of the nodes, or NULL for a dummy
+		block. Call from the thread that modifies the block.
+	*/
+	MapBlockSnapshot* getSnapshot();
+
 	/*
 		Flags
 	*/
 
 	bool isDummy()
 	{
-		return (data == NULL);
+		return (data == NULL && !m_uniform);
 	}
 	void unDummify()
 	{
@@ -236,7 +341,7 @@ class MapBlock /*: public NodeContainer*/
 	{
 		if(m_lighting_expired)
 			return false;
-		if(data == NULL)
+		if(isDummy())
 			return false;
 		return true;
 	}
@@ -269,7 +374,7 @@ class MapBlock /*: public NodeContainer*/
 	
 	bool isValidPosition(v3s16 p)
 	{
-		if(data == NULL)
+		if(isDummy())
 			return false;
 		return (p.X >= 0 && p.X < MAP_BLOCKSIZE
 				&& p.Y >= 0 && p.Y < MAP_BLOCKSIZE
@@ -278,12 +383,12 @@ class MapBlock /*: public NodeContainer*/
 
 	MapNode getNode(s16 x, s16 y, s16 z)
 	{
-		if(data == NULL)
+		if(isDummy())
 			throw InvalidPositionException();
 		if(x < 0 || x >= MAP_BLOCKSIZE) throw InvalidPositionException();
 		if(y < 0 || y >= MAP_BLOCKSIZE) throw InvalidPositionException();
 		if(z < 0 || z >= MAP_BLOCKSIZE) throw InvalidPositionException();
-		return data[z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x];
+		return readNode(z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x);
 	}
 	
 	MapNode getNode(v3s16 p)
@@ -291,23 +396,25 @@ class MapBlock /*: public NodeContainer*/
 		return getNode(p.X, p.Y, p.Z);
 	}
 	
-	MapNode getNodeNoEx(v3s16 p)
+	// Returns CONTENT_IGNORE if not found; see Map::getNodeNoEx()
+	MapNode getNodeNoEx(v3s16 p, bool *is_valid_position=NULL)
 	{
-		try{
-			return getNode(p.X, p.Y, p.Z);
-		}catch(InvalidPositionException &e){
+		bool valid = isValidPosition(p);
+		if(is_valid_position)
+			*is_valid_position = valid;
+		if(valid == false)
 			return MapNode(CONTENT_IGNORE);
-		}
+		return readNode(p.Z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + p.Y*MAP_BLOCKSIZE + p.X);
 	}
 	
 	void setNode(s16 x, s16 y, s16 z, MapNode & n)
 	{
-		if(data == NULL)
+		if(isDummy())
 			throw InvalidPositionException();
 		if(x < 0 || x >= MAP_BLOCKSIZE) throw InvalidPositionException();
 		if(y < 0 || y >= MAP_BLOCKSIZE) throw InvalidPositionException();
 		if(z < 0 || z >= MAP_BLOCKSIZE) throw InvalidPositionException();
-		data[z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x] = n;
+		writeNode(z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x, n);
 		raiseModified(MOD_STATE_WRITE_NEEDED, "setNode");
 	}
 	
@@ -322,9 +429,9 @@ class MapBlock /*: public NodeContainer*/
 
 	MapNode getNodeNoCheck(s16 x, s16 y, s16 z)
 	{
-		if(data == NULL)
+		if(isDummy())
 			throw InvalidPositionException();
-		return data[z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x];
+		return readNode(z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x);
 	}
 	
 	MapNode getNodeNoCheck(v3s16 p)
@@ -334,9 +441,9 @@ class MapBlock /*: public NodeContainer*/
 	
 	void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode & n)
 	{
-		if(data == NULL)
+		if(isDummy())
 			throw InvalidPositionException();
-		data[z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x] = n;
+		writeNode(z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x, n);
 		raiseModified(MOD_STATE_WRITE_NEEDED, "setNodeNoCheck");
 	}
 	
@@ -345,6 +452,25 @@ class MapBlock /*: public NodeContainer*/
 		setNodeNoCheck(p.X, p.Y, p.Z, n);
 	}
 
+	/*
+		Direct read-only access to the node parameter planes.
+		Each plane has one byte per node, indexed like
+		[z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x].
+		NULL for dummy and uniform blocks.
+	*/
+	const u8* getParam0Data() const
+	{
+		return data;
+	}
+	const u8* getParam1Data() const
+	{
+		return data ? data + nodecount : NULL;
+	}
+	const u8* getParam2Data() const
+	{
+		return data ? data + nodecount * 2 : NULL;
+	}
+
 	/*
 		These functions consult the parent container if the position
 		is not valid on this MapBlock.
@@ -352,7 +478,8 @@ class MapBlock /*: public NodeContainer*/
 	bool isValidPositionParent(v3s16 p);
 	MapNode getNodeParent(v3s16 p);
 	void setNodeParent(v3s16 p, MapNode & n);
-	MapNode getNodeParentNoEx(v3s16 p);
+	// Returns CONTENT_IGNORE if not found; see Map::getNodeNoEx()
+	MapNode getNodeParentNoEx(v3s16 p, bool *is_valid_position=NULL);
 
 	void drawbox(s16 x0, s16 y0, s16 z0, s16 w, s16 h, s16 d, MapNode node)
 	{
@@ -397,7 +524,7 @@ class MapBlock /*: public NodeContainer*/
 	void updateMesh(u32 daynight_ratio);
 #endif
 	// Replace the mesh with a new one
-	void replaceMesh(scene::SMesh *mesh_new);
+	void replaceMesh(MapBlockMesh *mesh_new);
 #endif
 	
 	// See comments in mapblock.cpp
@@ -545,18 +672,74 @@ class MapBlock /*: public NodeContainer*/
 		Used only internally, because changes can't be tracked
 	*/
 
-	MapNode & getNodeRef(s16 x, s16 y, s16 z)
+	// Drops the snapshot after the nodes have changed
+	void invalidateSnapshot()
+	{
+		if(m_snapshot == NULL)
+			return;
+		m_snapshot->drop();
+		m_snapshot = NULL;
+	}
+	// Allocates node data for a uniform block
+	void materialize()
+	{
+		if(data != NULL || !m_uniform)
+			return;
+		u8 *d = new u8[nodecount * 3];
+		memset(d, m_uniform_node.param0, nodecount);
+		memset(d + nodecount, m_uniform_node.param1, nodecount);
+		memset(d + nodecount * 2, m_uniform_node.param2, nodecount);
+		data = d;
+		m_uniform = false;
+	}
+	// Writes the planes of all nodes to dst (nodecount*3 bytes)
+	void copyPlanesTo(u8 *dst);
+	// Node data of serialization version >= 23: a content palette,
+	// bit-packed palette indices and the param1 and param2 planes
+	SharedBuffer<u8> serializePaletteNodes() const;
+	void deSerializePaletteNodes(const std::string &s);
+
+	// The planes are only valid if data != NULL
+	u8* getParam0Data()
+	{
+		return data;
+	}
+	u8* getParam1Data()
+	{
+		return data + nodecount;
+	}
+	u8* getParam2Data()
+	{
+		return data + nodecount * 2;
+	}
+
+	// Gather/scatter a node from/to the parameter planes
+	MapNode readNode(u32 i) const
 	{
 		if(data == NULL)
-			throw InvalidPositionException();
-		if(x < 0 || x >= MAP_BLOCKSIZE) throw InvalidPositionException();
-		if(y < 0 || y >= MAP_BLOCKSIZE) throw InvalidPositionException();
-		if(z < 0 || z >= MAP_BLOCKSIZE) throw InvalidPositionException();
-		return data[z*MAP_BLOCKSIZE*MAP_BLOCKSIZE + y*MAP_BLOCKSIZE + x];
+			return m_uniform_node;
+		MapNode n;
+		n.param0 = data[i];
+		n.param1 = data[i + nodecount];
+		n.param2 = data[i + nodecount * 2];
+		return n;
 	}
-	MapNode & getNodeRef(v3s16 &p)
+	void writeNode(u32 i, const MapNode &n)
 	{
-		return getNodeRef(p.X, p.Y, p.Z);
+		if(m_snapshot != NULL)
+			invalidateSnapshot();
+		if(data == NULL)
+		{
+			// Writing the node a uniform block consists of is a no-op
+			if(m_uniform_node.param0 == n.param0
+					&& m_uniform_node.param1 == n.param1
+					&& m_uniform_node.param2 == n.param2)
+				return;
+			materialize();
+		}
+		data[i] = n.param0;
+		data[i + nodecount] = n.param1;
+		data[i + nodecount * 2] = n.param2;
 	}
 
 public:
@@ -565,7 +748,7 @@ class MapBlock /*: public NodeContainer*/
 	*/
 
 #ifndef SERVER // Only on client
-	scene::SMesh *mesh;
+	MapBlockMesh *mesh;
 	JMutex mesh_mutex;
 #endif
 	
@@ -584,11 +767,25 @@ class MapBlock /*: public NodeContainer*/
 
 	IGameDef *m_gamedef;
 	
+	static const u32 nodecount = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
 	/*
-		If NULL, block is a dummy block.
+		Node data, stored as three planes of nodecount bytes:
+		all param0s, then all param1s, then all param2s.
+		Content scans only touch param0 (and param2 for extended
+		content types), lighting mostly touches param1.
+
+		If NULL, block is a dummy block or a uniform block.
 		Dummy blocks are used for caching not-found-on-disk blocks.
 	*/
-	MapNode * data;
+	u8 *data;
+	
+	// If true, data is NULL and every node is m_uniform_node
+	bool m_uniform;
+	MapNode m_uniform_node;
+
+	// Snapshot of the current nodes, if one has been taken
+	MapBlockSnapshot *m_snapshot;
 
 	/*
 		- On the server, this is used for telling whether the
@@ -30,13 +30,28 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "content_mapblock.h"
 #include "mineral.h" // For mineral_block_texture
 
+MeshMakeData::MeshMakeData():
+	m_daynight_ratio(1000),
+	m_blockpos(0,0,0)
+{
+	for(u32 i=0; i<27; i++)
+		m_blocks[i] = NULL;
+}
+
+MeshMakeData::~MeshMakeData()
+{
+	for(u32 i=0; i<27; i++)
+	{
+		if(m_blocks[i])
+			m_blocks[i]->drop();
+	}
+}
+
 void MeshMakeData::fill(u32 daynight_ratio, MapBlock *block)
 {
 	m_daynight_ratio = daynight_ratio;
 	m_blockpos = block->getPos();
 
-	v3s16 blockpos_nodes = m_blockpos*MAP_BLOCKSIZE;
-	
 	/*
 		There is no harm not copying the TempMods of the neighbors
 		because they are already copied to this block
@@ -44,45 +59,43 @@ void MeshMakeData::fill(u32 daynight_ratio, MapBlock *block)
 	m_temp_mods.clear();
 	block->copyTempMods(m_temp_mods);
 	
-	/*
-		Copy data
-	*/
-
-	// Allocate this block + neighbors
-	m_vmanip.clear();
-	m_vmanip.addArea(VoxelArea(blockpos_nodes-v3s16(1,1,1)*MAP_BLOCKSIZE,
-			blockpos_nodes+v3s16(1,1,1)*MAP_BLOCKSIZE*2-v3s16(1,1,1)));
-
+	for(u32 i=0; i<27; i++)
 	{
-		//TimeTaker timer("copy central block data");
-		// 0ms
-
-		// Copy our data
-		block->copyTo(m_vmanip);
+		if(m_blocks[i])
+			m_blocks[i]->drop();
+		m_blocks[i] = NULL;
 	}
-	{
-		//TimeTaker timer("copy neighbor block data");
-		// 0ms
 
-		/*
-			Copy neighbors. This is lightning fast.
-			Copying only the borders would be *very* slow.
-		*/
-		
-		// Get map
-		Map *map = block->getParent();
+	m_blocks[getBlockIndex(v3s16(0,0,0))] = block->getSnapshot();
 
-		for(u16 i=0; i<6; i++)
-		{
-			const v3s16 &dir = g_6dirs[i];
-			v3s16 bp = m_blockpos + dir;
-			MapBlock *b = map->getBlockNoCreateNoEx(bp);
-			if(b)
-				b->copyTo(m_vmanip);
-		}
+	Map *map = block->getParent();
+	for(u16 i=0; i<6; i++)
+	{
+		const v3s16 &dir = g_6dirs[i];
+		MapBlock *b = map->getBlockNoCreateNoEx(m_blockpos + dir);
+		if(b)
+			m_blocks[getBlockIndex(dir)] = b->getSnapshot();
 	}
 }
 
+MapNode MeshMakeData::getNodeNoEx(v3s16 p) const
+{
+	// Position relative to the lower corner of the block
+	p -= m_blockpos * MAP_BLOCKSIZE;
+	if(p.X < -MAP_BLOCKSIZE || p.X >= MAP_BLOCKSIZE * 2
+			|| p.Y < -MAP_BLOCKSIZE || p.Y >= MAP_BLOCKSIZE * 2
+			|| p.Z < -MAP_BLOCKSIZE || p.Z >= MAP_BLOCKSIZE * 2)
+		return MapNode(CONTENT_IGNORE);
+	v3s16 dir(
+		p.X < 0 ? -1 : (p.X >= MAP_BLOCKSIZE ? 1 : 0),
+		p.Y < 0 ? -1 : (p.Y >= MAP_BLOCKSIZE ? 1 : 0),
+		p.Z < 0 ? -1 : (p.Z >= MAP_BLOCKSIZE ? 1 : 0));
+	const MapBlockSnapshot *b = m_blocks[getBlockIndex(dir)];
+	if(b == NULL)
+		return MapNode(CONTENT_IGNORE);
+	return b->getNodeNoCheck(p - dir * MAP_BLOCKSIZE);
+}
+
 /*
 	vertex_dirs: v3s16[4]
 */
@@ -166,15 +179,93 @@ video::SColor MapBlock_LightColor(u8 alpha, u8 light)
 #endif
 }
 
+video::SColor MapBlock_LightColor(u8 alpha, u16 daynight_light,
+		u32 daynight_ratio)
+{
+	u32 day = daynight_light >> 8;
+	u32 night = daynight_light & 0xff;
+	u8 light = (day * daynight_ratio + night * (1000 - daynight_ratio)) / 1000;
+	return MapBlock_LightColor(alpha, light);
+}
+
+u16 MapBlock_NodeDayNightLight(MapNode n, INodeDefManager *ndef,
+		bool undiminish)
+{
+	u8 day = n.getLightBlend(1000, ndef);
+	u8 night = n.getLightBlend(0, ndef);
+	if(undiminish)
+	{
+		day = undiminish_light(day);
+		night = undiminish_light(night);
+	}
+	return MapBlock_DayNightLight(decode_light(day), decode_light(night));
+}
+
+/*
+	MapBlockMesh
+*/
+
+void MapBlockMesh::addMeshBuffer(scene::IMeshBuffer *buf,
+		const core::array<u16> &daynight_lights)
+{
+	assert(daynight_lights.size() == buf->getVertexCount());
+	scene::SMesh::addMeshBuffer(buf);
+	m_daynight_lights.push_back(daynight_lights);
+	for(u32 i=0; i<daynight_lights.size(); i++)
+	{
+		if((daynight_lights[i] >> 8) != (daynight_lights[i] & 0xff))
+		{
+			m_daynight_diff = true;
+			break;
+		}
+	}
+}
+
+void MapBlockMesh::setDayNightRatio(u32 daynight_ratio)
+{
+	if(daynight_ratio == m_daynight_ratio)
+		return;
+	m_daynight_ratio = daynight_ratio;
+	if(m_daynight_diff == false)
+		return;
+
+	// Color of each blended light value (MapBlock_LightColor is slow)
+	video::SColor colors[256];
+	for(u32 l=0; l<256; l++)
+		colors[l] = MapBlock_LightColor(255, l);
+
+	for(u32 i=0; i<getMeshBufferCount(); i++)
+	{
+		scene::IMeshBuffer *buf = getMeshBuffer(i);
+		video::S3DVertex *vertices = (video::S3DVertex*)buf->getVertices();
+		const core::array<u16> &lights = m_daynight_lights[i];
+		for(u32 j=0; j<buf->getVertexCount(); j++)
+		{
+			u32 day = lights[j] >> 8;
+			u32 night = lights[j] & 0xff;
+			// Constant light, color doesn't depend on the ratio
+			if(day == night)
+				continue;
+			u32 l = (day * daynight_ratio + night * (1000 - daynight_ratio))
+					/ 1000;
+			video::SColor c = colors[l];
+			c.setAlpha(vertices[j].Color.getAlpha());
+			vertices[j].Color = c;
+		}
+		buf->setDirty(scene::EBT_VERTEX);
+	}
+}
+
 struct FastFace
 {
 	TileSpec tile;
 	video::S3DVertex vertices[4]; // Precalculated vertices
+	u16 lights[4]; // MapBlock_DayNightLight() of the vertices
 };
 
-static void makeFastFace(TileSpec tile, u8 li0, u8 li1, u8 li2, u8 li3, v3f p,
-		v3s16 dir, v3f scale, v3f posRelative_f,
-		core::array<FastFace> &dest)
+static void makeFastFace(TileSpec tile, u16 li0, u16 li1, u16 li2, u16 li3,
+		v3f p, v3s16 dir, v3f scale, v3f posRelative_f,
+		u32 daynight_ratio, core::array<FastFace> &dest)
 {
 	FastFace face;
 	
@@ -202,10 +293,16 @@ static void makeFastFace(TileSpec tile, u8 li0, u8 li1, u8 li2, u8 li3, v3f p,
 		vertex_pos[i] += pos + posRelative_f;
 	}
 
-	f32 abs_scale = 1.;
-	if     (scale.X < 0.999 || scale.X > 1.001) abs_scale = scale.X;
-	else if(scale.Y < 0.999 || scale.Y > 1.001) abs_scale = scale.Y;
-	else if(scale.Z < 0.999 || scale.Z > 1.001) abs_scale = scale.Z;
+	/*
+		Number of times the texture is repeated along the X and Y
+		axes of the texture (vertices 1->0 and 3->0)
+	*/
+	v3s16 tex_x = vertex_dirs[0] - vertex_dirs[1];
+	v3s16 tex_y = vertex_dirs[0] - vertex_dirs[3];
+	f32 abs_scale = fabs(tex_x.X*scale.X + tex_x.Y*scale.Y
+			+ tex_x.Z*scale.Z) / 2.;
+	f32 abs_scale_y = fabs(tex_y.X*scale.X + tex_y.Y*scale.Y
+			+ tex_y.Z*scale.Z) / 2.;
 
 	v3f zerovector = v3f(0,0,0);
 	
@@ -231,17 +328,21 @@ static void makeFastFace(TileSpec tile, u8 li0, u8 li1, u8 li2, u8 li3, v3f p,
 			core::vector2d<f32>(x0+w*abs_scale, y0));*/
 
 	face.vertices[0] = video::S3DVertex(vertex_pos[0], v3f(0,1,0),
-			MapBlock_LightColor(alpha, li0),
-			core::vector2d<f32>(x0+w*abs_scale, y0+h));
+			MapBlock_LightColor(alpha, li0, daynight_ratio),
+			core::vector2d<f32>(x0+w*abs_scale, y0+h*abs_scale_y));
 	face.vertices[1] = video::S3DVertex(vertex_pos[1], v3f(0,1,0),
-			MapBlock_LightColor(alpha, li1),
-			core::vector2d<f32>(x0, y0+h));
+			MapBlock_LightColor(alpha, li1, daynight_ratio),
+			core::vector2d<f32>(x0, y0+h*abs_scale_y));
 	face.vertices[2] = video::S3DVertex(vertex_pos[2], v3f(0,1,0),
-			MapBlock_LightColor(alpha, li2),
+			MapBlock_LightColor(alpha, li2, daynight_ratio),
 			core::vector2d<f32>(x0, y0));
 	face.vertices[3] = video::S3DVertex(vertex_pos[3], v3f(0,1,0),
-			MapBlock_LightColor(alpha, li3),
+			MapBlock_LightColor(alpha, li3, daynight_ratio),
 			core::vector2d<f32>(x0+w*abs_scale, y0));
+	face.lights[0] = li0;
+	face.lights[1] = li1;
+	face.lights[2] = li2;
+	face.lights[3] = li3;
 
 	face.tile = tile;
 	//DEBUG
@@ -410,21 +511,23 @@ v3s16 dirs8[8] = {
 	v3s16(1,1,1),
 };
 
-// Calculate lighting at the XYZ- corner of p
-static u8 getSmoothLight(v3s16 p, VoxelManipulator &vmanip, u32 daynight_ratio,
+// Calculate day and night lighting at the XYZ- corner of p
+static u16 getSmoothLight(v3s16 p, const MeshMakeData *data,
 		INodeDefManager *ndef)
 {
 	u16 ambient_occlusion = 0;
-	u16 light = 0;
+	u16 light_day = 0;
+	u16 light_night = 0;
 	u16 light_count = 0;
 	for(u32 i=0; i<8; i++)
 	{
-		MapNode n = vmanip.getNodeNoEx(p - dirs8[i]);
-		if(ndef->get(n).param_type == CPT_LIGHT
+		MapNode n = data->getNodeNoEx(p - dirs8[i]);
+		if(ndef->hasLightParam(n.getContent())
 				// Fast-style leaves look better this way
 				&& ndef->get(n).solidness != 2)
 		{
-			light += decode_light(n.getLightBlend(daynight_ratio, ndef));
+			light_day += decode_light(n.getLightBlend(1000, ndef));
+			light_night += decode_light(n.getLightBlend(0, ndef));
 			light_count++;
 		}
 		else
@@ -435,22 +538,25 @@ static u8 getSmoothLight(v3s16 p, VoxelManipulator &vmanip, u32 daynight_ratio,
 	}
 
 	if(light_count == 0)
-		return 255;
+		return MapBlock_DayNightLight(255, 255);
 	
-	light /= light_count;
+	light_day /= light_count;
+	light_night /= light_count;
 
 	if(ambient_occlusion > 4)
 	{
 		ambient_occlusion -= 4;
-		light = (float)light / ((float)ambient_occlusion * 0.5 + 1.0);
+		float f = (float)ambient_occlusion * 0.5 + 1.0;
+		light_day = (float)light_day / f;
+		light_night = (float)light_night / f;
 	}
 
-	return light;
+	return MapBlock_DayNightLight(light_day, light_night);
 }
 
-// Calculate lighting at the given corner of p
-static u8 getSmoothLight(v3s16 p, v3s16 corner,
-		VoxelManipulator &vmanip, u32 daynight_ratio, INodeDefManager *ndef)
+// Calculate day and night lighting at the given corner of p
+static u16 getSmoothLight(v3s16 p, v3s16 corner,
+		const MeshMakeData *data, INodeDefManager *ndef)
 {
 	if(corner.X == 1) p.X += 1;
 	else              assert(corner.X == -1);
@@ -459,7 +565,7 @@ static u8 getSmoothLight(v3s16 p, v3s16 corner,
 	if(corner.Z == 1) p.Z += 1;
 	else              assert(corner.Z == -1);
 	
-	return getSmoothLight(p, vmanip, daynight_ratio, ndef);
+	return getSmoothLight(p, data, ndef);
 }
 
 static void getTileInfo(
@@ -467,8 +573,7 @@ static void getTileInfo(
 		v3s16 blockpos_nodes,
 		v3s16 p,
 		v3s16 face_dir,
-		u32 daynight_ratio,
-		VoxelManipulator &vmanip,
+		const MeshMakeData *data,
 		NodeModMap &temp_mods,
 		bool smooth_lighting,
 		IGameDef *gamedef,
@@ -476,15 +581,15 @@ static void getTileInfo(
 		bool &makes_face,
 		v3s16 &p_corrected,
 		v3s16 &face_dir_corrected,
-		u8 *lights,
+		u16 *lights,
 		TileSpec &tile
 	)
 {
 	ITextureSource *tsrc = gamedef->tsrc();
 	INodeDefManager *ndef = gamedef->ndef();
 
-	MapNode n0 = vmanip.getNodeNoEx(blockpos_nodes + p);
-	MapNode n1 = vmanip.getNodeNoEx(blockpos_nodes + p + face_dir);
+	MapNode n0 = data->getNodeNoEx(blockpos_nodes + p);
+	MapNode n1 = data->getNodeNoEx(blockpos_nodes + p + face_dir);
 	TileSpec tile0 = getNodeTile(n0, p, face_dir, temp_mods, tsrc, ndef);
 	TileSpec tile1 = getNodeTile(n1, p + face_dir, -face_dir, temp_mods, tsrc, ndef);
 	
@@ -521,8 +626,9 @@ static void getTileInfo(
 	
 	if(smooth_lighting == false)
 	{
-		lights[0] = lights[1] = lights[2] = lights[3] =
-				decode_light(getFaceLight(daynight_ratio, n0, n1, face_dir, ndef));
+		lights[0] = lights[1] = lights[2] = lights[3] = MapBlock_DayNightLight(
+				decode_light(getFaceLight(1000, n0, n1, face_dir, ndef)),
+				decode_light(getFaceLight(0, n0, n1, face_dir, ndef)));
 	}
 	else
 	{
@@ -531,7 +637,7 @@ static void getTileInfo(
 		for(u16 i=0; i<4; i++)
 		{
 			lights[i] = getSmoothLight(blockpos_nodes + p_corrected,
-					vertex_dirs[i], vmanip, daynight_ratio, ndef);
+					vertex_dirs[i], data, ndef);
 		}
 	}
 	
@@ -554,7 +660,7 @@ static void updateFastFaceRow(
 		v3f face_dir_f,
 		core::array<FastFace> &dest,
 		NodeModMap &temp_mods,
-		VoxelManipulator &vmanip,
+		const MeshMakeData *data,
 		v3s16 blockpos_nodes,
 		bool smooth_lighting,
 		IGameDef *gamedef)
@@ -566,10 +672,10 @@ static void updateFastFaceRow(
 	bool makes_face = false;
 	v3s16 p_corrected;
 	v3s16 face_dir_corrected;
-	u8 lights[4] = {0,0,0,0};
+	u16 lights[4] = {0,0,0,0};
 	TileSpec tile;
-	getTileInfo(blockpos_nodes, p, face_dir, daynight_ratio,
-			vmanip, temp_mods, smooth_lighting, gamedef,
+	getTileInfo(blockpos_nodes, p, face_dir,
+			data, temp_mods, smooth_lighting, gamedef,
 			makes_face, p_corrected, face_dir_corrected, lights, tile);
 
 	for(u16 j=0; j<length; j++)
@@ -582,7 +688,7 @@ static void updateFastFaceRow(
 		bool next_makes_face = false;
 		v3s16 next_p_corrected;
 		v3s16 next_face_dir_corrected;
-		u8 next_lights[4] = {0,0,0,0};
+		u16 next_lights[4] = {0,0,0,0};
 		TileSpec next_tile;
 		
 		// If at last position, there is nothing to compare to and
@@ -591,8 +697,8 @@ static void updateFastFaceRow(
 		{
 			p_next = p + translate_dir;
 			
-			getTileInfo(blockpos_nodes, p_next, face_dir, daynight_ratio,
-					vmanip, temp_mods, smooth_lighting, gamedef,
+			getTileInfo(blockpos_nodes, p_next, face_dir,
+					data, temp_mods, smooth_lighting, gamedef,
 					next_makes_face, next_p_corrected,
 					next_face_dir_corrected, next_lights,
 					next_tile);
@@ -681,7 +787,7 @@ static void updateFastFaceRow(
 				
 				makeFastFace(tile, lights[0], lights[1], lights[2], lights[3],
 						sp, face_dir_corrected, scale,
-						posRelative_f, dest);
+						posRelative_f, daynight_ratio, dest);
 				
 				g_profiler->avg("Meshgen: faces drawn by tiling", 0);
 				for(int i=1; i<continuous_tiles_count; i++){
@@ -705,7 +811,136 @@ static void updateFastFaceRow(
 	}
 }
 
-scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
+/*
+	Face of a node in a layer, as returned by getTileInfo()
+*/
+struct LayerFace
+{
+	bool makes_face;
+	// Set when the face has been merged into a rectangle
+	bool done;
+	v3s16 p_corrected;
+	v3s16 face_dir_corrected;
+	u16 lights[4];
+	TileSpec tile;
+};
+
+// Whether face b can be merged into a rectangle that starts at a
+// and where b is at offset from a
+static bool canMergeFaces(LayerFace &a, LayerFace &b, v3s16 offset)
+{
+	return (b.makes_face && b.done == false
+			&& b.p_corrected == a.p_corrected + offset
+			&& b.face_dir_corrected == a.face_dir_corrected
+			&& b.lights[0] == a.lights[0]
+			&& b.lights[1] == a.lights[1]
+			&& b.lights[2] == a.lights[2]
+			&& b.lights[3] == a.lights[3]
+			&& b.tile == a.tile);
+}
+
+/*
+	Makes the faces of one layer of nodes, greedily merging rectangles
+	of faces that have the same tile and lights.
+
+	startpos: corner of the layer
+	u_dir: direction of the texture X axis of the faces
+	v_dir: direction of the texture Y axis of the faces
+	face_dir: normal of the layer
+
+	Textures in the atlas are only tiled X-wise and at most
+	tile.texture.tiled times, so their faces are merged in rows
+	like in updateFastFaceRow(). Other textures are merged in both
+	directions.
+*/
+static void updateFastFaceLayer(
+		u32 daynight_ratio,
+		v3f posRelative_f,
+		v3s16 startpos,
+		v3s16 u_dir,
+		v3s16 v_dir,
+		v3s16 face_dir,
+		core::array<FastFace> &dest,
+		NodeModMap &temp_mods,
+		const MeshMakeData *data,
+		v3s16 blockpos_nodes,
+		bool smooth_lighting,
+		IGameDef *gamedef)
+{
+	// Indexed by [v][u]
+	LayerFace faces[MAP_BLOCKSIZE][MAP_BLOCKSIZE];
+
+	for(s16 v=0; v<MAP_BLOCKSIZE; v++)
+	for(s16 u=0; u<MAP_BLOCKSIZE; u++)
+	{
+		LayerFace &f = faces[v][u];
+		f.done = false;
+		f.lights[0] = f.lights[1] = f.lights[2] = f.lights[3] = 0;
+		getTileInfo(blockpos_nodes, startpos + u_dir*u + v_dir*v,
+				face_dir, data, temp_mods, smooth_lighting, gamedef,
+				f.makes_face, f.p_corrected, f.face_dir_corrected,
+				f.lights, f.tile);
+	}
+
+	for(s16 v=0; v<MAP_BLOCKSIZE; v++)
+	for(s16 u=0; u<MAP_BLOCKSIZE; u++)
+	{
+		LayerFace &f = faces[v][u];
+		if(f.makes_face == false || f.done)
+			continue;
+
+		// Same rule as in updateFastFaceRow()
+		bool tiles_freely = (f.tile.texture.atlas == NULL
+				|| f.tile.texture.tiled == 0);
+		s16 max_w = MAP_BLOCKSIZE - u;
+		if(tiles_freely == false && f.tile.texture.tiled < max_w)
+			max_w = f.tile.texture.tiled;
+
+		// Grow along u
+		s16 w = 1;
+		while(w < max_w && canMergeFaces(f, faces[v][u+w], u_dir*w))
+			w++;
+
+		// Grow along v while the whole next row matches
+		s16 h = 1;
+		while(tiles_freely && v + h < MAP_BLOCKSIZE)
+		{
+			bool row_matches = true;
+			for(s16 i=0; i<w; i++)
+			{
+				if(canMergeFaces(f, faces[v+h][u+i],
+						u_dir*i + v_dir*h) == false)
+				{
+					row_matches = false;
+					break;
+				}
+			}
+			if(row_matches == false)
+				break;
+			h++;
+		}
+
+		for(s16 j=0; j<h; j++)
+		for(s16 i=0; i<w; i++)
+			faces[v+j][u+i].done = true;
+
+		v3f u_dir_f(u_dir.X, u_dir.Y, u_dir.Z);
+		v3f v_dir_f(v_dir.X, v_dir.Y, v_dir.Z);
+		// Center point of the rectangle
+		v3f sp(f.p_corrected.X, f.p_corrected.Y, f.p_corrected.Z);
+		sp += u_dir_f * ((f32)(w - 1) / 2.) + v_dir_f * ((f32)(h - 1) / 2.);
+		v3f scale(1,1,1);
+		scale += u_dir_f * (w - 1) + v_dir_f * (h - 1);
+
+		makeFastFace(f.tile, f.lights[0], f.lights[1], f.lights[2],
+				f.lights[3], sp, f.face_dir_corrected, scale,
+				posRelative_f, daynight_ratio, dest);
+
+		g_profiler->avg("Meshgen: faces drawn by greedy merging", w * h);
+	}
+}
+
+MapBlockMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 {
 	// 4-21ms for MAP_BLOCKSIZE=16
 	// 24-155ms for MAP_BLOCKSIZE=32
@@ -724,6 +959,7 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 	//bool new_style_water = g_settings->getBool("new_style_water");
 	//bool new_style_leaves = g_settings->getBool("new_style_leaves");
 	bool smooth_lighting = g_settings->getBool("smooth_lighting");
+	bool greedy_meshing = g_settings->getBool("greedy_meshing");
 	
 	/*
 		We are including the faces of the trailing edges of the block.
@@ -733,6 +969,61 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 		NOTE: This is the slowest part of this method.
 	*/
 	
+	if(greedy_meshing)
+	{
+		/*
+			Go through every layer of y and get top(y+) faces in
+			rectangles of x+,z+
+		*/
+		for(s16 y=0; y<MAP_BLOCKSIZE; y++){
+			updateFastFaceLayer(data->m_daynight_ratio, posRelative_f,
+					v3s16(0,y,0),
+					v3s16(1,0,0),
+					v3s16(0,0,1),
+					v3s16(0,1,0), //face dir
+					fastfaces_new,
+					data->m_temp_mods,
+					data,
+					blockpos_nodes,
+					smooth_lighting,
+					gamedef);
+		}
+		/*
+			Go through every layer of x and get right(x+) faces in
+			rectangles of z+,y+
+		*/
+		for(s16 x=0; x<MAP_BLOCKSIZE; x++){
+			updateFastFaceLayer(data->m_daynight_ratio, posRelative_f,
+					v3s16(x,0,0),
+					v3s16(0,0,1),
+					v3s16(0,1,0),
+					v3s16(1,0,0),
+					fastfaces_new,
+					data->m_temp_mods,
+					data,
+					blockpos_nodes,
+					smooth_lighting,
+					gamedef);
+		}
+		/*
+			Go through every layer of z and get back(z+) faces in
+			rectangles of x+,y+
+		*/
+		for(s16 z=0; z<MAP_BLOCKSIZE; z++){
+			updateFastFaceLayer(data->m_daynight_ratio, posRelative_f,
+					v3s16(0,0,z),
+					v3s16(1,0,0),
+					v3s16(0,1,0),
+					v3s16(0,0,1),
+					fastfaces_new,
+					data->m_temp_mods,
+					data,
+					blockpos_nodes,
+					smooth_lighting,
+					gamedef);
+		}
+	}
+	else
 	{
 		// 4-23ms for MAP_BLOCKSIZE=16
 		//TimeTaker timer2("updateMesh() collect");
@@ -750,7 +1041,7 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 						v3f  (0,1,0),
 						fastfaces_new,
 						data->m_temp_mods,
-						data->m_vmanip,
+						data,
 						blockpos_nodes,
 						smooth_lighting,
 						gamedef);
@@ -769,7 +1060,7 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 						v3f  (1,0,0),
 						fastfaces_new,
 						data->m_temp_mods,
-						data->m_vmanip,
+						data,
 						blockpos_nodes,
 						smooth_lighting,
 						gamedef);
@@ -788,7 +1079,7 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 						v3f  (0,0,1),
 						fastfaces_new,
 						data->m_temp_mods,
-						data->m_vmanip,
+						data,
 						blockpos_nodes,
 						smooth_lighting,
 						gamedef);
@@ -844,7 +1135,7 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 					|| f.vertices[1].Color == f.vertices[3].Color)
 				indices_p = indices_alternate;
 			
-			collector.append(material, f.vertices, 4, indices_p, 6);
+			collector.append(material, f.vertices, 4, indices_p, 6, f.lights);
 		}
 	}
 
@@ -862,8 +1153,8 @@ scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef)
 		Add stuff from collector to mesh
 	*/
 	
-	scene::SMesh *mesh_new = NULL;
-	mesh_new = new scene::SMesh();
+	MapBlockMesh *mesh_new = NULL;
+	mesh_new = new MapBlockMesh(data->m_daynight_ratio);
 	
 	collector.fillMesh(mesh_new);
 
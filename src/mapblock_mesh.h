@@ -25,6 +25,55 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "voxel.h"
 
 class IGameDef;
+class INodeDefManager;
+
+/*
+	Light of a vertex by day (high byte) and by night (low byte),
+	both decoded to 0-255. The vertex color is blended from these
+	according to the day/night ratio.
+*/
+inline u16 MapBlock_DayNightLight(u8 day, u8 night)
+{
+	return ((u16)day << 8) | night;
+}
+
+/*
+	Mesh of a MapBlock.
+
+	Keeps the day and night light of each vertex so that vertex colors
+	can be updated for a new day/night ratio without making the mesh
+	again.
+*/
+class MapBlockMesh : public scene::SMesh
+{
+public:
+	MapBlockMesh(u32 daynight_ratio):
+		m_daynight_ratio(daynight_ratio),
+		m_daynight_diff(false)
+	{
+	}
+
+	// Recolors the vertices if the ratio is different from the
+	// current one
+	void setDayNightRatio(u32 daynight_ratio);
+
+	u32 getDayNightRatio()
+	{
+		return m_daynight_ratio;
+	}
+
+	// Adds a mesh buffer with the day/night lights of its vertices
+	void addMeshBuffer(scene::IMeshBuffer *buf,
+			const core::array<u16> &daynight_lights);
+
+private:
+	// Ratio the vertex colors are currently for
+	u32 m_daynight_ratio;
+	// One array per mesh buffer, one value per vertex
+	core::array<core::array<u16> > m_daynight_lights;
+	// Whether any vertex has a different light by day and by night
+	bool m_daynight_diff;
+};
 
 /*
 	Mesh making stuff
@@ -38,17 +87,24 @@ struct PreMeshBuffer
 	video::SMaterial material;
 	core::array<u16> indices;
 	core::array<video::S3DVertex> vertices;
+	// See MapBlock_DayNightLight()
+	core::array<u16> daynight_lights;
 };
 
 class MeshCollector
 {
 public:
+	/*
+		daynight_lights: one value per vertex, see
+		MapBlock_DayNightLight()
+	*/
 	void append(
 			video::SMaterial material,
 			const video::S3DVertex* const vertices,
 			u32 numVertices,
 			const u16* const indices,
-			u32 numIndices
+			u32 numIndices,
+			const u16* const daynight_lights
 		)
 	{
 		PreMeshBuffer *p = NULL;
@@ -84,10 +140,28 @@ class MeshCollector
 		for(u32 i=0; i<numVertices; i++)
 		{
 			p->vertices.push_back(vertices[i]);
+			p->daynight_lights.push_back(daynight_lights[i]);
 		}
 	}
 
-	void fillMesh(scene::SMesh *mesh)
+	// Same as above with the same light for all vertices
+	void append(
+			video::SMaterial material,
+			const video::S3DVertex* const vertices,
+			u32 numVertices,
+			const u16* const indices,
+			u32 numIndices,
+			u16 daynight_light
+		)
+	{
+		core::array<u16> lights(numVertices);
+		for(u32 i=0; i<numVertices; i++)
+			lights.push_back(daynight_light);
+		append(material, vertices, numVertices, indices, numIndices,
+				lights.pointer());
+	}
+
+	void fillMesh(MapBlockMesh *mesh)
 	{
 		/*dstream<<"Filling mesh with "<<m_prebuffers.size()
 				<<" meshbuffers"<<std::endl;*/
@@ -109,13 +183,12 @@ class MeshCollector
 			//((scene::SMeshBuffer*)buf)->Material = p.material;
 			// Use VBO
 			//buf->setHardwareMappingHint(scene::EHM_STATIC);
+			buf->append(p.vertices.pointer(), p.vertices.size(),
+					p.indices.pointer(), p.indices.size());
 			// Add to mesh
-			mesh->addMeshBuffer(buf);
+			mesh->addMeshBuffer(buf, p.daynight_lights);
 			// Mesh grabbed it
 			buf->drop();
-
-			buf->append(p.vertices.pointer(), p.vertices.size(),
-					p.indices.pointer(), p.indices.size());
 		}
 	}
 
@@ -125,25 +198,63 @@ class MeshCollector
 
 // Helper functions
 video::SColor MapBlock_LightColor(u8 alpha, u8 light);
+// Blends a MapBlock_DayNightLight() value for a day/night ratio (0-1000)
+video::SColor MapBlock_LightColor(u8 alpha, u16 daynight_light,
+		u32 daynight_ratio);
+// Day/night light of vertices inside node n. If undiminish is true,
+// the light is one level brighter (see undiminish_light()).
+u16 MapBlock_NodeDayNightLight(MapNode n, INodeDefManager *ndef,
+		bool undiminish=false);
 
 class MapBlock;
+class MapBlockSnapshot;
 
 struct MeshMakeData
 {
 	u32 m_daynight_ratio;
 	NodeModMap m_temp_mods;
-	VoxelManipulator m_vmanip;
 	v3s16 m_blockpos;
+	/*
+		Snapshots of the block and its six neighbors, indexed by
+		getBlockIndex(). NULL where there is no block.
+	*/
+	MapBlockSnapshot *m_blocks[27];
+
+	MeshMakeData();
+	~MeshMakeData();
 	
 	/*
-		Copy central data directly from block, and other data from
-		parent of block.
+		Take snapshots of the block and its neighbors in the parent
+		of block. Blocks that haven't changed since their last
+		snapshot are not copied.
 	*/
 	void fill(u32 daynight_ratio, MapBlock *block);
+
+	/*
+		Gets a node by absolute position. Returns CONTENT_IGNORE
+		outside of the block and its six neighbors.
+	*/
+	MapNode getNodeNoEx(v3s16 p) const;
+
+	// Snapshot of the block itself
+	const MapBlockSnapshot * getSnapshot() const
+	{
+		return m_blocks[getBlockIndex(v3s16(0,0,0))];
+	}
+
+private:
+	// dir has components of -1, 0 or 1
+	static u32 getBlockIndex(v3s16 dir)
+	{
+		return (dir.Z+1)*9 + (dir.Y+1)*3 + (dir.X+1);
+	}
+	// Snapshots can't be shared by copies
+	MeshMakeData(const MeshMakeData &);
+	MeshMakeData& operator=(const MeshMakeData &);
 };
 
 // This is the highest-level function in here
-scene::SMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef);
+MapBlockMesh* makeMapBlockMesh(MeshMakeData *data, IGameDef *gamedef);
 
 #endif
 
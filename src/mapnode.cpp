@@ -52,8 +52,13 @@ u8 face_contents(content_t m1, content_t m2, bool *equivalent,
 	const ContentFeatures &f2 = nodemgr->get(m2);
 
 	// Contents don't differ for different forms of same liquid
-	if(f1.sameLiquid(f2))
-		contents_differ = false;
+	if(nodemgr->isLiquid(m1) && nodemgr->isLiquid(m2))
+	{
+		content_t alt1 = nodemgr->liquidAlternativeFlowing(m1);
+		content_t alt2 = nodemgr->liquidAlternativeFlowing(m2);
+		if(alt1 != CONTENT_IGNORE && alt1 == alt2)
+			contents_differ = false;
+	}
 	
 	u8 c1 = f1.solidness;
 	u8 c2 = f2.solidness;
@@ -158,12 +163,13 @@ v3s16 unpackDir(u8 b)
 // Create directly from a nodename
 // If name is unknown, sets CONTENT_IGNORE
 MapNode::MapNode(INodeDefManager *ndef, const std::string &name,
-		u8 a_param1, u8 a_param2)
+		u8 a_param1, u8 a_param2):
+	param0(0),
+	param1(a_param1),
+	param2(a_param2)
 {
 	content_t id = CONTENT_IGNORE;
 	ndef->getId(name, id);
-	param1 = a_param1;
-	param2 = a_param2;
 	// Set content (param0 and (param2&0xf0)) after other params
 	// because this needs to override part of param2
 	setContent(id);
@@ -172,7 +178,7 @@ MapNode::MapNode(INodeDefManager *ndef, const std::string &name,
 void MapNode::setLight(enum LightBank bank, u8 a_light, INodeDefManager *nodemgr)
 {
 	// If node doesn't contain light data, ignore this
-	if(nodemgr->get(*this).param_type != CPT_LIGHT)
+	if(!nodemgr->hasLightParam(getContent()))
 		return;
 	if(bank == LIGHTBANK_DAY)
 	{
@@ -191,8 +197,9 @@ void MapNode::setLight(enum LightBank bank, u8 a_light, INodeDefManager *nodemgr
 u8 MapNode::getLight(enum LightBank bank, INodeDefManager *nodemgr) const
 {
 	// Select the brightest of [light source, propagated light]
+	content_t c = getContent();
 	u8 light = 0;
-	if(nodemgr->get(*this).param_type == CPT_LIGHT)
+	if(nodemgr->hasLightParam(c))
 	{
 		if(bank == LIGHTBANK_DAY)
 			light = param1 & 0x0f;
@@ -201,25 +208,28 @@ u8 MapNode::getLight(enum LightBank bank, INodeDefManager *nodemgr) const
 		else
 			assert(0);
 	}
-	if(nodemgr->get(*this).light_source > light)
-		light = nodemgr->get(*this).light_source;
+	u8 source = nodemgr->lightSource(c);
+	if(source > light)
+		light = source;
 	return light;
 }
 
 u8 MapNode::getLightBanksWithSource(INodeDefManager *nodemgr) const
 {
 	// Select the brightest of [light source, propagated light]
+	content_t c = getContent();
 	u8 lightday = 0;
 	u8 lightnight = 0;
-	if(nodemgr->get(*this).param_type == CPT_LIGHT)
+	if(nodemgr->hasLightParam(c))
 	{
 		lightday = param1 & 0x0f;
 		lightnight = (param1>>4)&0x0f;
 	}
-	if(nodemgr->get(*this).light_source > lightday)
-		lightday = nodemgr->get(*this).light_source;
-	if(nodemgr->get(*this).light_source > lightnight)
-		lightnight = nodemgr->get(*this).light_source;
+	u8 source = nodemgr->lightSource(c);
+	if(source > lightday)
+		lightday = source;
+	if(source > lightnight)
+		lightnight = source;
 	return (lightday&0x0f) | ((lightnight<<4)&0xf0);
 }
 
@@ -139,12 +139,14 @@ struct MapNode
 		*this = n;
 	}
 	
-	MapNode(content_t content=CONTENT_AIR, u8 a_param1=0, u8 a_param2=0)
+	MapNode(content_t content=CONTENT_AIR, u8 a_param1=0, u8 a_param2=0):
+		param0(0),
+		param1(a_param1),
+		param2(a_param2)
 	{
-		param1 = a_param1;
-		param2 = a_param2;
 		// Set content (param0 and (param2&0xf0)) after other params
-		// because this needs to override part of param2
+		// because this needs to override part of param2.
+		// setContent() reads param0, so it has to be initialized first.
 		setContent(content);
 	}
 	
@@ -112,6 +112,7 @@ void ContentFeatures::reset()
 	solidness = 2;
 	visual_solidness = 0;
 	backface_culling = true;
+	average_color = video::SColor(0,0,0,0);
 #endif
 	used_texturenames.clear();
 	/*
@@ -356,6 +357,50 @@ class CNodeDefManager: public IWritableNodeDefManager
 			m_content_features[c] = f;
 			m_name_id_mapping.set(c, f.name);
 		}
+		
+		for(u16 i=0; i<=MAX_CONTENT; i++)
+			updateContentFlags(i, m_content_features[i]);
+		updateLiquidAlternatives();
+	}
+	// Refresh the fast lookup tables of c from its definition
+	void updateContentFlags(content_t c, const ContentFeatures &f)
+	{
+		u16 flags = 0;
+		if(f.light_propagates)
+			flags |= CF_LIGHT_PROPAGATES;
+		if(f.sunlight_propagates)
+			flags |= CF_SUNLIGHT_PROPAGATES;
+		if(f.walkable)
+			flags |= CF_WALKABLE;
+		if(f.climbable)
+			flags |= CF_CLIMBABLE;
+		if(f.buildable_to)
+			flags |= CF_BUILDABLE_TO;
+		if(f.is_ground_content)
+			flags |= CF_IS_GROUND_CONTENT;
+		if(f.param_type == CPT_LIGHT)
+			flags |= CF_PARAM_LIGHT;
+		if(f.liquid_type == LIQUID_FLOWING)
+			flags |= CF_LIQUID_FLOWING;
+		else if(f.liquid_type == LIQUID_SOURCE)
+			flags |= CF_LIQUID_SOURCE;
+		m_content_flags[c] = flags;
+		m_content_light_source[c] = f.light_source;
+	}
+	virtual void updateLiquidAlternatives()
+	{
+		for(u16 i=0; i<=MAX_CONTENT; i++)
+		{
+			m_content_liquid_alt_flowing[i] = CONTENT_IGNORE;
+			m_content_liquid_alt_source[i] = CONTENT_IGNORE;
+			if(!isLiquid(i))
+				continue;
+			const ContentFeatures &f = m_content_features[i];
+			m_content_liquid_alt_flowing[i] =
+					getId(f.liquid_alternative_flowing);
+			m_content_liquid_alt_source[i] =
+					getId(f.liquid_alternative_source);
+		}
 	}
 	// CONTENT_IGNORE = not found
 	content_t getFreeId(bool require_full_param2)
@@ -390,6 +435,7 @@ class CNodeDefManager: public IWritableNodeDefManager
 		{
 			mgr->set(i, get(i));
 		}
+		mgr->updateLiquidAlternatives();
 		return mgr;
 	}
 	virtual const ContentFeatures& get(content_t c) const
@@ -450,6 +496,7 @@ class CNodeDefManager: public IWritableNodeDefManager
 			return;
 		}
 		m_content_features[c] = def;
+		updateContentFlags(c, def);
 		if(def.name != "")
 			m_name_id_mapping.set(c, def.name);
 
@@ -458,6 +505,7 @@ class CNodeDefManager: public IWritableNodeDefManager
 		if(alias_removed)
 			infostream<<"ndef: erased alias "<<def.name
 					<<" because node was defined"<<std::endl;
+
 	}
 	virtual content_t set(const std::string &name,
 			const ContentFeatures &def)
@@ -601,6 +649,8 @@ class CNodeDefManager: public IWritableNodeDefManager
 				else
 					f->tiles[j].material_flags &= ~MATERIAL_FLAG_BACKFACE_CULLING;
 			}
+			f->average_color = tsrc->getTextureAverageColor(
+					f->tiles[0].texture.id);
 			// Special textures
 			for(u16 j=0; j<CF_SPECIAL_COUNT; j++){
 				// Remove all stuff
@@ -675,6 +725,7 @@ class CNodeDefManager: public IWritableNodeDefManager
 				continue;*/
 			ContentFeatures *f = &m_content_features[i];
 			f->deSerialize(tmp_is, gamedef);
+			updateContentFlags(i, *f);
 			if(f->name != "")
 				m_name_id_mapping.set(i, f->name);
 		}
@@ -687,6 +738,7 @@ class CNodeDefManager: public IWritableNodeDefManager
 				m_aliases[name] = convert_to;
 			}
 		}
+		updateLiquidAlternatives();
 	}
 private:
 	// Features indexed by id
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <string>
 #include <iostream>
 #include <set>
+#include <cstring>
 #include "mapnode.h"
 #ifndef SERVER
 #include "tile.h"
@@ -132,6 +133,9 @@ struct ContentFeatures
 	u8 solidness; // Used when choosing which face is drawn
 	u8 visual_solidness; // When solidness=0, this tells how it looks like
 	bool backface_culling;
+	// Average color of the top tile, for drawing from far away.
+	// Alpha is 0 if unknown.
+	video::SColor average_color;
 #endif
 	
 	// List of textures that are used and are wanted to be included in
@@ -242,10 +246,35 @@ struct ContentFeatures
 	}
 };
 
+/*
+	Bits of INodeDefManager's compact per-content flag table.
+	These mirror fields of ContentFeatures.
+*/
+enum ContentFlag
+{
+	CF_LIGHT_PROPAGATES = 0x0001,
+	CF_SUNLIGHT_PROPAGATES = 0x0002,
+	CF_WALKABLE = 0x0004,
+	CF_CLIMBABLE = 0x0008,
+	CF_BUILDABLE_TO = 0x0010,
+	CF_IS_GROUND_CONTENT = 0x0020,
+	CF_PARAM_LIGHT = 0x0040, // param_type == CPT_LIGHT
+	CF_LIQUID_FLOWING = 0x0080,
+	CF_LIQUID_SOURCE = 0x0100,
+};
+
 class INodeDefManager
 {
 public:
-	INodeDefManager(){}
+	INodeDefManager()
+	{
+		memset(m_content_flags, 0, sizeof(m_content_flags));
+		memset(m_content_light_source, 0, sizeof(m_content_light_source));
+		for(u32 i=0; i<=MAX_CONTENT; i++){
+			m_content_liquid_alt_flowing[i] = CONTENT_IGNORE;
+			m_content_liquid_alt_source[i] = CONTENT_IGNORE;
+		}
+	}
 	virtual ~INodeDefManager(){}
 	// Get node definition
 	virtual const ContentFeatures& get(content_t c) const=0;
@@ -256,6 +285,79 @@ class INodeDefManager
 	virtual std::string getAlias(const std::string &name) const =0;
 	
 	virtual void serialize(std::ostream &os)=0;
+
+	/*
+		Fast lookups of the properties read in hot loops (lighting,
+		collision, liquids). These read small dense tables instead of
+		going through the large ContentFeatures structs and a virtual
+		call. The tables are kept up to date by the implementation.
+	*/
+	u16 getContentFlags(content_t c) const
+	{
+		return m_content_flags[c & MAX_CONTENT];
+	}
+	bool lightPropagates(content_t c) const
+	{
+		return getContentFlags(c) & CF_LIGHT_PROPAGATES;
+	}
+	bool sunlightPropagates(content_t c) const
+	{
+		return getContentFlags(c) & CF_SUNLIGHT_PROPAGATES;
+	}
+	bool walkable(content_t c) const
+	{
+		return getContentFlags(c) & CF_WALKABLE;
+	}
+	bool climbable(content_t c) const
+	{
+		return getContentFlags(c) & CF_CLIMBABLE;
+	}
+	bool buildableTo(content_t c) const
+	{
+		return getContentFlags(c) & CF_BUILDABLE_TO;
+	}
+	bool isGroundContent(content_t c) const
+	{
+		return getContentFlags(c) & CF_IS_GROUND_CONTENT;
+	}
+	bool hasLightParam(content_t c) const
+	{
+		return getContentFlags(c) & CF_PARAM_LIGHT;
+	}
+	bool isLiquid(content_t c) const
+	{
+		return getContentFlags(c) & (CF_LIQUID_FLOWING | CF_LIQUID_SOURCE);
+	}
+	enum LiquidType liquidType(content_t c) const
+	{
+		u16 flags = getContentFlags(c);
+		if(flags & CF_LIQUID_SOURCE)
+			return LIQUID_SOURCE;
+		if(flags & CF_LIQUID_FLOWING)
+			return LIQUID_FLOWING;
+		return LIQUID_NONE;
+	}
+	u8 lightSource(content_t c) const
+	{
+		return m_content_light_source[c & MAX_CONTENT];
+	}
+
+	// Flowing/source version of liquid c, CONTENT_IGNORE if none
+	content_t liquidAlternativeFlowing(content_t c) const
+	{
+		return m_content_liquid_alt_flowing[c & MAX_CONTENT];
+	}
+	content_t liquidAlternativeSource(content_t c) const
+	{
+		return m_content_liquid_alt_source[c & MAX_CONTENT];
+	}
+
+protected:
+	// Filled by the implementation
+	u16 m_content_flags[MAX_CONTENT+1];
+	u8 m_content_light_source[MAX_CONTENT+1];
+	content_t m_content_liquid_alt_flowing[MAX_CONTENT+1];
+	content_t m_content_liquid_alt_source[MAX_CONTENT+1];
 };
 
 class IWritableNodeDefManager : public INodeDefManager
@@ -287,6 +389,13 @@ class IWritableNodeDefManager : public INodeDefManager
 	virtual void setAlias(const std::string &name,
 			const std::string &convert_to)=0;
 
+	/*
+		Resolve the names of the liquid alternatives to ids.
+		The alternatives are usually defined after the liquid itself,
+		so call this once after all nodes and aliases are registered.
+	*/
+	virtual void updateLiquidAlternatives()=0;
+
 	/*
 		Update tile textures to latest return values of TextueSource.
 		Call after updating the texture atlas of a TextureSource.
@@ -0,0 +1,362 @@
+/*
+Minetest-c55
+Copyright (C) 2011 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "occlusion.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "main.h"
+#include "profiler.h"
+#include "log.h"
+#include "debug.h"
+
+/*
+	Nodes that don't let light through are drawn as full opaque cubes.
+	Things like glass, leaves and liquids are seen through.
+*/
+static bool isOpaque(MapNode n, INodeDefManager *ndef)
+{
+	return (ndef->lightPropagates(n.getContent()) == false);
+}
+
+FaceConnectivity getFaceConnectivity(const MapBlockSnapshot *block,
+		INodeDefManager *ndef)
+{
+	FaceConnectivity c;
+
+	if(block->isUniform())
+	{
+		if(isOpaque(block->getNodeNoCheck(v3s16(0,0,0)), ndef))
+			c.clear();
+		return c;
+	}
+
+	c.clear();
+
+	const s16 size = MAP_BLOCKSIZE;
+	const u32 nodecount = size*size*size;
+
+	// 0 = opaque or already filled, 1 = not filled yet
+	u8 open[nodecount];
+	u32 open_count = 0;
+	for(s16 z=0; z<size; z++)
+	for(s16 y=0; y<size; y++)
+	for(s16 x=0; x<size; x++)
+	{
+		u32 i = z*size*size + y*size + x;
+		open[i] = isOpaque(block->getNodeNoCheck(v3s16(x,y,z)), ndef) ? 0 : 1;
+		open_count += open[i];
+	}
+
+	// Nothing to see through
+	if(open_count == 0)
+		return c;
+
+	u16 stack[nodecount];
+
+	for(u32 start=0; start<nodecount; start++)
+	{
+		if(open[start] == 0)
+			continue;
+
+		// Faces touched by this group of nodes
+		u8 faces = 0;
+
+		u32 stack_size = 0;
+		stack[stack_size++] = start;
+		open[start] = 0;
+		while(stack_size > 0)
+		{
+			u16 i = stack[--stack_size];
+			s16 x = i % size;
+			s16 y = (i / size) % size;
+			s16 z = i / (size*size);
+
+			// In the order of g_6dirs
+			if(z == size-1) faces |= (1<<0);
+			if(y == size-1) faces |= (1<<1);
+			if(x == size-1) faces |= (1<<2);
+			if(z == 0) faces |= (1<<3);
+			if(y == 0) faces |= (1<<4);
+			if(x == 0) faces |= (1<<5);
+
+			for(u32 d=0; d<6; d++)
+			{
+				v3s16 p = v3s16(x,y,z) + g_6dirs[d];
+				if(p.X < 0 || p.Y < 0 || p.Z < 0
+						|| p.X >= size || p.Y >= size || p.Z >= size)
+					continue;
+				u32 j = p.Z*size*size + p.Y*size + p.X;
+				if(open[j] == 0)
+					continue;
+				open[j] = 0;
+				stack[stack_size++] = j;
+			}
+		}
+
+		for(u8 f1=0; f1<6; f1++)
+		for(u8 f2=f1; f2<6; f2++)
+		{
+			if((faces & (1<<f1)) && (faces & (1<<f2)))
+				c.connect(f1, f2);
+		}
+	}
+
+	return c;
+}
+
+/*
+	OcclusionGrid
+*/
+
+bool OcclusionGrid::setBlock(v3s16 p, const FaceConnectivity &c)
+{
+	core::map<v3s16, FaceConnectivity>::Node *n = m_blocks.find(p);
+	if(n != NULL)
+	{
+		if(n->getValue() == c)
+			return false;
+		n->setValue(c);
+		return true;
+	}
+	m_blocks.insert(p, c);
+	return true;
+}
+
+void OcclusionGrid::removeBlock(v3s16 p)
+{
+	m_blocks.remove(p);
+}
+
+struct OcclusionStep
+{
+	v3s16 p;
+	// Face of p that was entered through
+	u8 entry_face;
+	// Directions taken from the camera (bits in the order of g_6dirs)
+	u8 directions;
+};
+
+void OcclusionGrid::findVisibleBlocks(v3s16 camera_block,
+		v3s16 range_min, v3s16 range_max,
+		core::map<v3s16, bool> &visible)
+{
+	// Used as the entry face of the camera block
+	const u8 no_face = 6;
+
+	/*
+		A block can be entered through each of its faces once, as what
+		can be seen out of it depends on where it was entered.
+	*/
+	core::map<v3s16, u8> entered_faces;
+	core::list<OcclusionStep> queue;
+
+	visible[camera_block] = true;
+
+	OcclusionStep start;
+	start.p = camera_block;
+	start.entry_face = no_face;
+	start.directions = 0;
+	queue.push_back(start);
+
+	while(queue.size() > 0)
+	{
+		core::list<OcclusionStep>::Iterator i = queue.begin();
+		OcclusionStep s = *i;
+		queue.erase(i);
+
+		const FaceConnectivity *c = NULL;
+		if(s.entry_face != no_face)
+			c = &m_blocks.find(s.p)->getValue();
+
+		for(u8 d=0; d<6; d++)
+		{
+			u8 back = (d + 3) % 6;
+
+			// Never turn back towards the camera
+			if(s.directions & (1<<back))
+				continue;
+
+			if(c != NULL && c->connects(s.entry_face, d) == false)
+				continue;
+
+			v3s16 p = s.p + g_6dirs[d];
+			if(p.X < range_min.X || p.Y < range_min.Y || p.Z < range_min.Z
+					|| p.X > range_max.X || p.Y > range_max.Y
+					|| p.Z > range_max.Z)
+				continue;
+
+			// Not loaded
+			if(m_blocks.find(p) == NULL)
+				continue;
+
+			visible[p] = true;
+
+			u8 faces = 0;
+			core::map<v3s16, u8>::Node *n = entered_faces.find(p);
+			if(n != NULL)
+				faces = n->getValue();
+			if(faces & (1<<back))
+				continue;
+			entered_faces[p] = faces | (1<<back);
+
+			OcclusionStep next;
+			next.p = p;
+			next.entry_face = back;
+			next.directions = s.directions | (1<<d);
+			queue.push_back(next);
+		}
+	}
+}
+
+/*
+	OcclusionThread
+*/
+
+OcclusionThread::OcclusionThread():
+	m_camera_set(false),
+	m_camera_block(0,0,0),
+	m_range_min(0,0,0),
+	m_range_max(0,0,0),
+	m_result(NULL),
+	m_result_camera_block(0,0,0)
+{
+	m_mutex.Init();
+}
+
+OcclusionThread::~OcclusionThread()
+{
+	delete m_result;
+}
+
+void OcclusionThread::setBlock(v3s16 p, const FaceConnectivity &c)
+{
+	BlockUpdate u;
+	u.p = p;
+	u.remove = false;
+	u.connectivity = c;
+	m_updates.push_back(u);
+}
+
+void OcclusionThread::removeBlock(v3s16 p)
+{
+	BlockUpdate u;
+	u.p = p;
+	u.remove = true;
+	m_updates.push_back(u);
+}
+
+void OcclusionThread::setCamera(v3s16 camera_block,
+		v3s16 range_min, v3s16 range_max)
+{
+	JMutexAutoLock lock(m_mutex);
+	m_camera_set = true;
+	m_camera_block = camera_block;
+	m_range_min = range_min;
+	m_range_max = range_max;
+}
+
+core::map<v3s16, bool> * OcclusionThread::takeResult(v3s16 *camera_block)
+{
+	JMutexAutoLock lock(m_mutex);
+	core::map<v3s16, bool> *result = m_result;
+	if(result != NULL)
+		*camera_block = m_result_camera_block;
+	m_result = NULL;
+	return result;
+}
+
+void * OcclusionThread::Thread()
+{
+	ThreadStarted();
+
+	log_register_thread("OcclusionThread");
+
+	DSTACK(__FUNCTION_NAME);
+
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	// What the last search was done with
+	bool searched = false;
+	v3s16 last_camera_block;
+	v3s16 last_range_min;
+	v3s16 last_range_max;
+
+	while(getRun())
+	{
+		bool changed = false;
+		while(m_updates.size() > 0)
+		{
+			BlockUpdate u = m_updates.pop_front();
+			if(u.remove)
+			{
+				m_grid.removeBlock(u.p);
+				changed = true;
+			}
+			else if(m_grid.setBlock(u.p, u.connectivity))
+			{
+				changed = true;
+			}
+		}
+
+		bool camera_set;
+		v3s16 camera_block;
+		v3s16 range_min;
+		v3s16 range_max;
+		{
+			JMutexAutoLock lock(m_mutex);
+			camera_set = m_camera_set;
+			camera_block = m_camera_block;
+			range_min = m_range_min;
+			range_max = m_range_max;
+		}
+
+		if(camera_set == false || (searched && changed == false
+				&& camera_block == last_camera_block
+				&& range_min == last_range_min
+				&& range_max == last_range_max))
+		{
+			sleep_ms(5);
+			continue;
+		}
+
+		core::map<v3s16, bool> *visible = new core::map<v3s16, bool>;
+		{
+			ScopeProfiler sp(g_profiler, "Client: Occlusion culling");
+			m_grid.findVisibleBlocks(camera_block, range_min, range_max,
+					*visible);
+		}
+
+		{
+			JMutexAutoLock lock(m_mutex);
+			delete m_result;
+			m_result = visible;
+			m_result_camera_block = camera_block;
+		}
+
+		searched = true;
+		last_camera_block = camera_block;
+		last_range_min = range_min;
+		last_range_max = range_max;
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER(errorstream)
+
+	return NULL;
+}
+
@@ -0,0 +1,165 @@
+/*
+Minetest-c55
+Copyright (C) 2011 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef OCCLUSION_HEADER
+#define OCCLUSION_HEADER
+
+#include "common_irrlicht.h"
+#include "utility.h"
+
+class MapBlockSnapshot;
+class INodeDefManager;
+
+/*
+	Tells which faces of a MapBlock can be seen from each other
+	through the non-opaque nodes inside the block.
+
+	Faces are numbered like g_6dirs.
+*/
+class FaceConnectivity
+{
+public:
+	// Every face is connected to every face, like in a block of air
+	FaceConnectivity()
+	{
+		for(u32 i=0; i<6; i++)
+			m_faces[i] = 0x3f;
+	}
+
+	void clear()
+	{
+		for(u32 i=0; i<6; i++)
+			m_faces[i] = 0;
+	}
+
+	void connect(u8 face1, u8 face2)
+	{
+		m_faces[face1] |= (1<<face2);
+		m_faces[face2] |= (1<<face1);
+	}
+
+	bool connects(u8 face1, u8 face2) const
+	{
+		return (m_faces[face1] & (1<<face2)) != 0;
+	}
+
+	bool operator==(const FaceConnectivity &other) const
+	{
+		for(u32 i=0; i<6; i++)
+			if(m_faces[i] != other.m_faces[i])
+				return false;
+		return true;
+	}
+
+private:
+	// Bit j of m_faces[i] is set if face i is connected to face j
+	u8 m_faces[6];
+};
+
+/*
+	Flood fills the non-opaque nodes of a block and connects the
+	faces each connected group of them touches.
+*/
+FaceConnectivity getFaceConnectivity(const MapBlockSnapshot *block,
+		INodeDefManager *ndef);
+
+/*
+	Face connectivity of the loaded blocks, used for finding which of
+	them can be seen from the camera.
+*/
+class OcclusionGrid
+{
+public:
+	// Returns true if the connectivity of the block changed
+	bool setBlock(v3s16 p, const FaceConnectivity &c);
+	void removeBlock(v3s16 p);
+
+	u32 size()
+	{
+		return m_blocks.size();
+	}
+
+	/*
+		Finds the blocks between range_min and range_max (inclusive)
+		that can be seen from camera_block.
+
+		The search goes from block to block through connected faces
+		and never turns back towards the camera. Blocks that are not
+		in the grid are not searched through.
+	*/
+	void findVisibleBlocks(v3s16 camera_block,
+			v3s16 range_min, v3s16 range_max,
+			core::map<v3s16, bool> &visible);
+
+private:
+	core::map<v3s16, FaceConnectivity> m_blocks;
+};
+
+/*
+	Runs the visibility search of OcclusionGrid in the background.
+
+	The main thread passes block changes and the camera position in,
+	and takes the newest set of visible blocks out when there is one.
+*/
+class OcclusionThread : public SimpleThread
+{
+public:
+	OcclusionThread();
+	~OcclusionThread();
+
+	void * Thread();
+
+	void setBlock(v3s16 p, const FaceConnectivity &c);
+	void removeBlock(v3s16 p);
+
+	// The search is done again when these change
+	void setCamera(v3s16 camera_block, v3s16 range_min, v3s16 range_max);
+
+	/*
+		Returns the newest set of visible blocks if there is one that
+		hasn't been taken yet, otherwise NULL. The caller has to
+		delete it. camera_block is set to the block the set was made
+		for.
+	*/
+	core::map<v3s16, bool> * takeResult(v3s16 *camera_block);
+
+private:
+	struct BlockUpdate
+	{
+		v3s16 p;
+		bool remove;
+		FaceConnectivity connectivity;
+	};
+	MutexedQueue<BlockUpdate> m_updates;
+
+	// Only used by the thread
+	OcclusionGrid m_grid;
+
+	JMutex m_mutex;
+	// These are protected by m_mutex
+	bool m_camera_set;
+	v3s16 m_camera_block;
+	v3s16 m_range_min;
+	v3s16 m_range_max;
+	core::map<v3s16, bool> *m_result;
+	v3s16 m_result_camera_block;
+};
+
+#endif
+
@@ -236,13 +236,13 @@ void LocalPlayer::move(f32 dtime, Map &map, f32 pos_max_d,
 		if(in_water)
 		{
 			v3s16 pp = floatToInt(position + v3f(0,BS*0.1,0), BS);
-			in_water = nodemgr->get(map.getNode(pp).getContent()).isLiquid();
+			in_water = nodemgr->isLiquid(map.getNode(pp).getContent());
 		}
 		// If not in water, the threshold of going in is at lower y
 		else
 		{
 			v3s16 pp = floatToInt(position + v3f(0,BS*0.5,0), BS);
-			in_water = nodemgr->get(map.getNode(pp).getContent()).isLiquid();
+			in_water = nodemgr->isLiquid(map.getNode(pp).getContent());
 		}
 	}
 	catch(InvalidPositionException &e)
@@ -255,7 +255,7 @@ void LocalPlayer::move(f32 dtime, Map &map, f32 pos_max_d,
 	*/
 	try{
 		v3s16 pp = floatToInt(position + v3f(0,0,0), BS);
-		in_water_stable = nodemgr->get(map.getNode(pp).getContent()).isLiquid();
+		in_water_stable = nodemgr->isLiquid(map.getNode(pp).getContent());
 	}
 	catch(InvalidPositionException &e)
 	{
@@ -269,8 +269,8 @@ void LocalPlayer::move(f32 dtime, Map &map, f32 pos_max_d,
 	try {
 		v3s16 pp = floatToInt(position + v3f(0,0.5*BS,0), BS);
 		v3s16 pp2 = floatToInt(position + v3f(0,-0.2*BS,0), BS);
-		is_climbing = ((nodemgr->get(map.getNode(pp).getContent()).climbable ||
-		nodemgr->get(map.getNode(pp2).getContent()).climbable) && !free_move);
+		is_climbing = ((nodemgr->climbable(map.getNode(pp).getContent()) ||
+		nodemgr->climbable(map.getNode(pp2).getContent())) && !free_move);
 	}
 	catch(InvalidPositionException &e)
 	{
@@ -382,7 +382,7 @@ void LocalPlayer::move(f32 dtime, Map &map, f32 pos_max_d,
 		bool is_unloaded = false;
 		try{
 			// Player collides into walkable nodes
-			if(nodemgr->get(map.getNode(v3s16(x,y,z))).walkable == false)
+			if(nodemgr->walkable(map.getNode(v3s16(x,y,z)).getContent()) == false)
 				continue;
 		}
 		catch(InvalidPositionException &e)
@@ -548,10 +548,10 @@ void LocalPlayer::move(f32 dtime, Map &map, f32 pos_max_d,
 
 			try{
 				// The node to be sneaked on has to be walkable
-				if(nodemgr->get(map.getNode(p)).walkable == false)
+				if(nodemgr->walkable(map.getNode(p).getContent()) == false)
 					continue;
 				// And the node above it has to be nonwalkable
-				if(nodemgr->get(map.getNode(p+v3s16(0,1,0))).walkable == true)
+				if(nodemgr->walkable(map.getNode(p+v3s16(0,1,0)).getContent()) == true)
 					continue;
 			}
 			catch(InvalidPositionException &e)
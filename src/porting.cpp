@@ -300,5 +300,17 @@ void initializePaths()
 	dstream<<"path_userdata = "<<path_userdata<<std::endl;
 }
 
+u32 getNumberOfProcessors()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+#endif
+}
+
 } //namespace porting
 
@@ -80,6 +80,11 @@ std::string getDataPath(const char *subpath);
 */
 void initializePaths();
 
+/*
+	Number of processors available to the process, at least 1
+*/
+u32 getNumberOfProcessors();
+
 /*
 	Resolution is 10-20ms.
 	Remember to check for overflows.
@@ -108,6 +113,28 @@ void initializePaths();
 	}*/
 #endif
 
+/*
+	Time in microseconds, for measuring short durations.
+	Wraps around about every 71 minutes; only use differences.
+*/
+#ifdef _WIN32 // Windows
+	inline u32 getTimeUs()
+	{
+		LARGE_INTEGER freq, t;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&t);
+		return (u32)((t.QuadPart / freq.QuadPart) * 1000000
+				+ (t.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+	}
+#else // Posix
+	inline u32 getTimeUs()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return tv.tv_sec * 1000000 + tv.tv_usec;
+	}
+#endif
+
 } // namespace porting
 
 #endif // PORTING_HEADER
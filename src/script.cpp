@@ -24,6 +24,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cstdlib>
 #include "log.h"
 #include <iostream>
+#include "porting.h"
+#include "settings.h"
+#include "main.h" // For g_settings
 
 extern "C" {
 #include <lua.h>
@@ -108,16 +111,270 @@ bool script_load(lua_State *L, const char *path)
 	return true;
 }
 
+/*
+	ScriptAllocator
+*/
+
+ScriptAllocator::ScriptAllocator():
+	m_used_bytes(0),
+	m_reserved_bytes(0)
+{
+	for(u32 i=0; i<SIZE_CLASS_COUNT; i++)
+		m_free[i] = NULL;
+}
+
+ScriptAllocator::~ScriptAllocator()
+{
+	for(u32 i=0; i<m_chunks.size(); i++)
+		free(m_chunks[i]);
+}
+
+void * ScriptAllocator::allocSmall(size_t size)
+{
+	u32 c = getSizeClass(size);
+	if(m_free[c] == NULL)
+	{
+		// Cut a new chunk into blocks of the class
+		size_t block_size = (c + 1) * SIZE_CLASS_STEP;
+		char *chunk = (char*)malloc(CHUNK_SIZE);
+		if(chunk == NULL)
+			return NULL;
+		m_chunks.push_back(chunk);
+		m_reserved_bytes += CHUNK_SIZE;
+		for(size_t i = 0; i + block_size <= CHUNK_SIZE; i += block_size)
+		{
+			void *block = chunk + i;
+			*(void**)block = m_free[c];
+			m_free[c] = block;
+		}
+	}
+	void *block = m_free[c];
+	m_free[c] = *(void**)block;
+	return block;
+}
+
+void ScriptAllocator::freeSmall(void *ptr, size_t size)
+{
+	u32 c = getSizeClass(size);
+	*(void**)ptr = m_free[c];
+	m_free[c] = ptr;
+}
+
+void * ScriptAllocator::reallocate(void *ptr, size_t osize, size_t nsize)
+{
+	if(ptr == NULL)
+		osize = 0;
+
+	if(nsize == 0)
+	{
+		if(ptr == NULL)
+			return NULL;
+		if(osize <= MAX_SMALL_SIZE)
+		{
+			freeSmall(ptr, osize);
+		}
+		else
+		{
+			free(ptr);
+			m_reserved_bytes -= osize;
+		}
+		m_used_bytes -= osize;
+		return NULL;
+	}
+
+	bool osmall = (ptr == NULL || osize <= MAX_SMALL_SIZE);
+	bool nsmall = (nsize <= MAX_SMALL_SIZE);
+	void *p = NULL;
+
+	if(ptr != NULL && osmall && nsmall
+			&& getSizeClass(osize) == getSizeClass(nsize))
+	{
+		// Fits in the same block
+		p = ptr;
+	}
+	else if(ptr != NULL && !osmall && !nsmall)
+	{
+		p = realloc(ptr, nsize);
+		if(p == NULL)
+			return NULL;
+		m_reserved_bytes += nsize;
+		m_reserved_bytes -= osize;
+	}
+	else
+	{
+		if(nsmall)
+		{
+			p = allocSmall(nsize);
+		}
+		else
+		{
+			p = malloc(nsize);
+			if(p != NULL)
+				m_reserved_bytes += nsize;
+		}
+		if(p == NULL)
+		{
+			/*
+				Lua expects shrinking to always work. A big block that
+				is kept works as a block of the small class when it is
+				freed, it is just never given back to the system.
+			*/
+			if(ptr != NULL && nsize <= osize)
+			{
+				m_used_bytes += nsize;
+				m_used_bytes -= osize;
+				return ptr;
+			}
+			return NULL;
+		}
+		if(ptr != NULL)
+		{
+			memcpy(p, ptr, osize < nsize ? osize : nsize);
+			if(osmall)
+			{
+				freeSmall(ptr, osize);
+			}
+			else
+			{
+				free(ptr);
+				m_reserved_bytes -= osize;
+			}
+		}
+	}
+
+	m_used_bytes += nsize;
+	m_used_bytes -= osize;
+	return p;
+}
+
+void * ScriptAllocator::luaAlloc(void *ud, void *ptr, size_t osize,
+		size_t nsize)
+{
+	return ((ScriptAllocator*)ud)->reallocate(ptr, osize, nsize);
+}
+
+GlobalstepScheduler::GlobalstepScheduler():
+	m_next(0),
+	m_run_count(0),
+	m_overran(false)
+{
+}
+
+void GlobalstepScheduler::reset()
+{
+	m_dtimes.clear();
+	m_next = 0;
+	m_run_count = 0;
+	m_overran = false;
+}
+
+void GlobalstepScheduler::beginStep(u32 count, float dtime)
+{
+	m_dtimes.resize(count, 0);
+	for(u32 i=0; i<count; i++)
+		m_dtimes[i] += dtime;
+	// Globalsteps may have been registered or removed since
+	if(m_next >= count)
+		m_next = 0;
+	m_run_count = 0;
+	m_overran = false;
+}
+
+bool GlobalstepScheduler::next(bool over_budget, u32 *index, float *dtime)
+{
+	if(m_next >= m_dtimes.size())
+	{
+		// The pass is complete; the next step starts a new one
+		m_next = 0;
+		return false;
+	}
+	if(over_budget && m_run_count != 0)
+	{
+		m_overran = true;
+		return false;
+	}
+	*index = m_next;
+	*dtime = m_dtimes[m_next];
+	m_dtimes[m_next] = 0;
+	m_next++;
+	m_run_count++;
+	return true;
+}
+
+static int script_panic(lua_State *L)
+{
+	// The error object need not be a string
+	const char *msg = lua_tostring(L, -1);
+	if(msg == NULL)
+		msg = lua_typename(L, lua_type(L, -1));
+	errorstream<<"Unprotected error in Lua: "<<msg<<std::endl;
+	return 0;
+}
+
+// Memory in use when the idle collector may start the next cycle
+static size_t g_gc_idle_start_bytes = 0;
+
 lua_State* script_init()
 {
-	lua_State *L = luaL_newstate();
+	ScriptAllocator *allocator = new ScriptAllocator();
+	lua_State *L = lua_newstate(ScriptAllocator::luaAlloc, allocator);
+	if(L == NULL)
+	{
+		delete allocator;
+		return NULL;
+	}
+	lua_atpanic(L, script_panic);
 	luaL_openlibs(L);
+
+	lua_gc(L, LUA_GCSETPAUSE, g_settings->getS32("lua_gc_pause"));
+	lua_gc(L, LUA_GCSETSTEPMUL, g_settings->getS32("lua_gc_stepmul"));
+	g_gc_idle_start_bytes = 0;
 	return L;
 }
 
 void script_deinit(lua_State *L)
 {
+	void *allocator = NULL;
+	lua_getallocf(L, &allocator);
 	lua_close(L);
+	delete (ScriptAllocator*)allocator;
+}
+
+void script_gc_idle_step(lua_State *L, u32 max_time_us)
+{
+	if(max_time_us == 0)
+		return;
+
+	size_t used_bytes = 0;
+	size_t reserved_bytes = 0;
+	script_get_memory_usage(L, &used_bytes, &reserved_bytes);
+	if(used_bytes < g_gc_idle_start_bytes)
+		return;
+
+	u32 start_time = porting::getTimeUs();
+	do{
+		// Returns 1 when a cycle is finished
+		if(lua_gc(L, LUA_GCSTEP, 0))
+		{
+			script_get_memory_usage(L, &used_bytes, &reserved_bytes);
+			s32 pause = g_settings->getS32("lua_gc_pause");
+			if(pause < 100)
+				pause = 100;
+			g_gc_idle_start_bytes = used_bytes
+					+ used_bytes * (pause - 100) / 200;
+			break;
+		}
+	}
+	while(porting::getTimeUs() - start_time < max_time_us);
+}
+
+void script_get_memory_usage(lua_State *L, size_t *used_bytes,
+		size_t *reserved_bytes)
+{
+	void *allocator = NULL;
+	lua_getallocf(L, &allocator);
+	*used_bytes = ((ScriptAllocator*)allocator)->getUsedBytes();
+	*reserved_bytes = ((ScriptAllocator*)allocator)->getReservedBytes();
 }
 
 
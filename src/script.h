@@ -22,6 +22,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <exception>
 #include <string>
+#include <vector>
+#include <cstddef>
+#include "irrlichttypes.h"
 
 typedef struct lua_State lua_State;
 
@@ -39,11 +42,107 @@ class LuaError : public std::exception
 	std::string m_s;
 };
 
+/*
+	Memory allocator of the Lua state.
+
+	Lua makes and frees lots of small strings, tables and closures.
+	Blocks up to MAX_SMALL_SIZE bytes are taken from free lists of
+	size classes, which are filled from big chunks that are kept until
+	the allocator is deleted. Lua tells the old size of a block when
+	resizing or freeing it, so the blocks don't need headers.
+	Bigger blocks are handled by realloc() and free().
+*/
+class ScriptAllocator
+{
+public:
+	ScriptAllocator();
+	~ScriptAllocator();
+
+	// Works like lua_Alloc
+	void * reallocate(void *ptr, size_t osize, size_t nsize);
+	// A lua_Alloc that takes a ScriptAllocator as ud
+	static void * luaAlloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+	// Bytes in blocks given to Lua
+	size_t getUsedBytes()
+	{
+		return m_used_bytes;
+	}
+	// Bytes taken from the system, including free blocks in the pools
+	size_t getReservedBytes()
+	{
+		return m_reserved_bytes;
+	}
+
+	static const size_t MAX_SMALL_SIZE = 256;
+
+private:
+	static const size_t SIZE_CLASS_STEP = 8;
+	static const size_t SIZE_CLASS_COUNT = MAX_SMALL_SIZE / SIZE_CLASS_STEP;
+	static const size_t CHUNK_SIZE = 16384;
+
+	static u32 getSizeClass(size_t size)
+	{
+		return (size - 1) / SIZE_CLASS_STEP;
+	}
+	void * allocSmall(size_t size);
+	void freeSmall(void *ptr, size_t size);
+
+	// Heads of the singly linked free lists
+	void *m_free[SIZE_CLASS_COUNT];
+	std::vector<void*> m_chunks;
+	size_t m_used_bytes;
+	size_t m_reserved_bytes;
+};
+
+/*
+	Decides which globalsteps run on a server step when they have a time
+	budget. A pass runs all of them in registration order. When a step
+	runs out of time, the next step continues the pass from the first
+	one left over, and the pass after that starts from the first one
+	again. At least one is run on every step. The ones that are left
+	over get the time they missed added to their next dtime.
+*/
+class GlobalstepScheduler
+{
+public:
+	GlobalstepScheduler();
+
+	void reset();
+	// Called at the start of each step with the number of globalsteps
+	void beginStep(u32 count, float dtime);
+	/*
+		Gets the index and dtime of the next globalstep to run on this
+		step. Returns false when the step is done, either because the
+		pass is complete or because over_budget is set.
+	*/
+	bool next(bool over_budget, u32 *index, float *dtime);
+	// Whether the last step ran out of time before the pass was done
+	bool overran(){ return m_overran; }
+
+private:
+	std::vector<float> m_dtimes;
+	u32 m_next;
+	u32 m_run_count;
+	bool m_overran;
+};
+
 lua_State* script_init();
 void script_deinit(lua_State *L);
 std::string script_get_backtrace(lua_State *L);
 void script_error(lua_State *L, const char *fmt, ...);
 bool script_load(lua_State *L, const char *path);
 
+/*
+	Runs incremental garbage collection for at most max_time_us, to
+	be called when the server has nothing else to do. After finishing
+	a cycle, waits until about half of the way to the point where Lua
+	would start the next one by itself.
+*/
+void script_gc_idle_step(lua_State *L, u32 max_time_us);
+// Bytes used by Lua and bytes taken from the system for it
+void script_get_memory_usage(lua_State *L, size_t *used_bytes,
+		size_t *reserved_bytes);
+
 #endif
 
@@ -20,7 +20,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "scriptapi.h"
 
 #include <iostream>
+#include <sstream>
 #include <list>
+#include <vector>
+#include <algorithm>
 extern "C" {
 #include <lua.h>
 #include <lualib.h>
@@ -46,6 +49,7 @@ extern "C" {
 #include "mapblock.h" // For getNodeBlockPos
 #include "content_nodemeta.h"
 #include "utility.h"
+#include "profiler.h"
 
 static void stackDump(lua_State *L, std::ostream &o)
 {
@@ -167,6 +171,318 @@ void check_modname_prefix(lua_State *L, std::string &name)
 				+"\"contains unallowed characters");
 }
 
+/*
+	Lua callback time accounting
+
+	The time spent in callbacks is added up under a name made of what
+	registered the callback and the kind of callback, like
+	"default globalstep", "default abm 3" or "default:rat on_step".
+	The time of each environment step is moved into g_profiler as
+	"Lua: <name>". Totals since the last clear are kept for the
+	luaprofile chat command and the lua_profiler_print_interval log.
+
+	The time of a callback includes the callbacks it causes to be run.
+*/
+
+class ScriptProfiler
+{
+public:
+	ScriptProfiler():
+		m_last_slot(SLOT_NONE)
+	{
+	}
+
+	// Returns the slot of name, adding it if it doesn't exist
+	u32 getSlot(const std::string &name)
+	{
+		core::map<std::string, u32>::Node *n = m_slot_ids.find(name);
+		if(n != NULL)
+			return n->getValue();
+		Slot slot;
+		slot.name = name;
+		slot.profiler_name = "Lua: " + name;
+		slot.step_us = 0;
+		slot.interval_us = 0;
+		slot.total_us = 0;
+		slot.calls = 0;
+		slot.interval_overruns = 0;
+		slot.overruns = 0;
+		m_slots.push_back(slot);
+		u32 id = m_slots.size() - 1;
+		m_slot_ids.insert(name, id);
+		return id;
+	}
+
+	/*
+		The slot of a callback is cached by something that identifies
+		it (a function or an entity prototype) and its kind, so that
+		the name doesn't have to be made on every call.
+	*/
+	bool getCachedSlot(const void *key, const char *kind, u32 *slot)
+	{
+		core::map<SlotKey, u32>::Node *n =
+				m_cached_slots.find(SlotKey(key, kind));
+		if(n == NULL)
+			return false;
+		*slot = n->getValue();
+		return true;
+	}
+	void cacheSlot(const void *key, const char *kind, u32 slot)
+	{
+		m_cached_slots[SlotKey(key, kind)] = slot;
+	}
+
+	void add(u32 slot, u32 time_us)
+	{
+		Slot &s = m_slots[slot];
+		s.step_us += time_us;
+		s.interval_us += time_us;
+		s.total_us += time_us;
+		s.calls++;
+		m_last_slot = slot;
+	}
+
+	/*
+		Counts an overrun of a time budget for the callback that
+		finished last, if one has since forgetLastSlot(). Over many
+		overruns the counts show which callbacks use the budgets.
+	*/
+	void forgetLastSlot()
+	{
+		m_last_slot = SLOT_NONE;
+	}
+	void countOverrun()
+	{
+		if(m_last_slot == SLOT_NONE)
+			return;
+		Slot &s = m_slots[m_last_slot];
+		s.interval_overruns++;
+		s.overruns++;
+		g_profiler->add("Lua budget overruns: " + s.name, 1);
+	}
+
+	// Moves the time of the current step into g_profiler
+	void flushStep()
+	{
+		for(u32 i=0; i<m_slots.size(); i++)
+		{
+			Slot &s = m_slots[i];
+			if(s.step_us == 0)
+				continue;
+			g_profiler->add(s.profiler_name, (float)s.step_us / 1000000.0);
+			s.step_us = 0;
+		}
+	}
+
+	// Prints the slots that have taken the most time since clear()
+	void printTotals(std::ostream &o, u32 max_count)
+	{
+		std::vector<u32> order = sortedSlots(&Slot::total_us);
+		if(order.size() > max_count)
+			order.resize(max_count);
+		for(u32 i=0; i<order.size(); i++)
+		{
+			Slot &s = m_slots[order[i]];
+			if(i != 0)
+				o<<", ";
+			o<<s.name<<" "<<((float)s.total_us / 1000)<<"ms/"<<s.calls
+					<<" calls";
+			if(s.overruns != 0)
+				o<<"/"<<s.overruns<<" overruns";
+		}
+	}
+
+	/*
+		Prints the slots that have taken the most time since the last
+		call to this
+	*/
+	void printInterval(std::ostream &o, u32 max_count)
+	{
+		std::vector<u32> order = sortedSlots(&Slot::interval_us);
+		if(order.size() > max_count)
+			order.resize(max_count);
+		for(u32 i=0; i<order.size(); i++)
+		{
+			Slot &s = m_slots[order[i]];
+			if(i != 0)
+				o<<", ";
+			o<<s.name<<" "<<((float)s.interval_us / 1000)<<"ms";
+			if(s.interval_overruns != 0)
+				o<<" ("<<s.interval_overruns<<" overruns)";
+		}
+		for(u32 i=0; i<m_slots.size(); i++)
+		{
+			m_slots[i].interval_us = 0;
+			m_slots[i].interval_overruns = 0;
+		}
+	}
+
+	void clear()
+	{
+		for(u32 i=0; i<m_slots.size(); i++)
+		{
+			m_slots[i].total_us = 0;
+			m_slots[i].calls = 0;
+			m_slots[i].overruns = 0;
+		}
+	}
+
+	// Forgets everything; the cached keys are only valid in one state
+	void reset()
+	{
+		m_slots.clear();
+		m_slot_ids.clear();
+		m_cached_slots.clear();
+		m_last_slot = SLOT_NONE;
+	}
+
+private:
+	struct Slot
+	{
+		std::string name;
+		std::string profiler_name;
+		u32 step_us;
+		u64 interval_us;
+		u64 total_us;
+		u32 calls;
+		u32 interval_overruns;
+		u32 overruns;
+	};
+
+	// Slots that have used time, the ones that have used most first
+	std::vector<u32> sortedSlots(u64 Slot::*time)
+	{
+		std::vector<std::pair<u64, u32> > times;
+		for(u32 i=0; i<m_slots.size(); i++)
+		{
+			if(m_slots[i].*time != 0)
+				times.push_back(std::make_pair(m_slots[i].*time, i));
+		}
+		std::sort(times.begin(), times.end());
+		std::vector<u32> order;
+		for(u32 i=times.size(); i>0; i--)
+			order.push_back(times[i-1].second);
+		return order;
+	}
+
+	typedef std::pair<const void*, const char*> SlotKey;
+
+	static const u32 SLOT_NONE = 0xffffffff;
+
+	std::vector<Slot> m_slots;
+	core::map<std::string, u32> m_slot_ids;
+	core::map<SlotKey, u32> m_cached_slots;
+	u32 m_last_slot;
+};
+
+// There is only one scripting state at a time
+static ScriptProfiler g_script_profiler;
+static IntervalLimiter g_script_profiler_print_interval;
+
+static GlobalstepScheduler g_globalsteps;
+
+class ScriptCallbackTimer
+{
+public:
+	ScriptCallbackTimer(u32 slot):
+		m_slot(slot),
+		m_start(porting::getTimeUs())
+	{
+	}
+	~ScriptCallbackTimer()
+	{
+		g_script_profiler.add(m_slot, porting::getTimeUs() - m_start);
+	}
+private:
+	u32 m_slot;
+	u32 m_start;
+};
+
+/*
+	Returns the mod that registered the function at index, as recorded
+	in minetest.callback_origins
+*/
+static std::string get_callback_origin(lua_State *L, int index)
+{
+	std::string origin = "unknown";
+	lua_getglobal(L, "minetest");
+	lua_getfield(L, -1, "callback_origins");
+	if(lua_istable(L, -1)){
+		lua_pushvalue(L, index);
+		lua_rawget(L, -2);
+		if(lua_type(L, -1) == LUA_TSTRING)
+			origin = lua_tostring(L, -1);
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 2);
+	return origin;
+}
+
+// Records the current mod as the origin of the function at index
+static void set_callback_origin(lua_State *L, int index)
+{
+	std::string modname = get_current_modname(L);
+	if(modname == "")
+		return;
+	lua_getglobal(L, "minetest");
+	lua_getfield(L, -1, "callback_origins");
+	if(lua_istable(L, -1)){
+		lua_pushvalue(L, index);
+		lua_pushstring(L, modname.c_str());
+		lua_rawset(L, -3);
+	}
+	lua_pop(L, 2);
+}
+
+// Returns the profiler slot of the registered callback function at index
+static u32 get_callback_slot(lua_State *L, int index, const char *kind)
+{
+	const void *func = lua_topointer(L, index);
+	u32 slot;
+	if(g_script_profiler.getCachedSlot(func, kind, &slot))
+		return slot;
+	slot = g_script_profiler.getSlot(
+			get_callback_origin(L, index) + " " + kind);
+	g_script_profiler.cacheSlot(func, kind, slot);
+	return slot;
+}
+
+// Returns the profiler slot of the callback of the craftitem name at
+// index. Items that share a function share the slot.
+static u32 get_craftitem_slot(lua_State *L, int index, const char *name,
+		const char *kind)
+{
+	const void *func = lua_topointer(L, index);
+	u32 slot;
+	if(g_script_profiler.getCachedSlot(func, kind, &slot))
+		return slot;
+	slot = g_script_profiler.getSlot(std::string(name) + " " + kind);
+	g_script_profiler.cacheSlot(func, kind, slot);
+	return slot;
+}
+
+// Returns the profiler slot of a callback of the luaentity at index
+static u32 get_luaentity_slot(lua_State *L, int index, const char *kind)
+{
+	// The entities of a type share the prototype as their metatable
+	const void *prototype = NULL;
+	if(lua_getmetatable(L, index)){
+		prototype = lua_topointer(L, -1);
+		lua_pop(L, 1);
+	}
+	u32 slot;
+	if(g_script_profiler.getCachedSlot(prototype, kind, &slot))
+		return slot;
+	std::string name = "unknown";
+	lua_getfield(L, index, "name");
+	if(lua_type(L, -1) == LUA_TSTRING)
+		name = lua_tostring(L, -1);
+	lua_pop(L, 1);
+	slot = g_script_profiler.getSlot(name + " " + kind);
+	g_script_profiler.cacheSlot(prototype, kind, slot);
+	return slot;
+}
+
 static void push_v3f(lua_State *L, v3f p)
 {
 	lua_newtable(L);
@@ -786,28 +1102,56 @@ struct EnumString es_Diggability[] =
 	Getters for stuff in main tables
 */
 
+/*
+	Registry references to the tables that callbacks are dispatched
+	from, so that they don't have to be looked up by name on every
+	call. The tables made by scriptapi_export() are referenced there
+	and the ones made by builtin.lua in scriptapi_add_environment().
+	There is only one scripting state at a time.
+*/
+struct ScriptApiRefs
+{
+	int object_refs;
+	int luaentities;
+	int registered_globalsteps;
+	int registered_on_placenodes;
+	int registered_on_dignodes;
+	int registered_on_punchnodes;
+	int registered_on_generateds;
+	int registered_on_chat_messages;
+	int registered_on_newplayers;
+	int registered_on_dieplayers;
+	int registered_on_respawnplayers;
+};
+static ScriptApiRefs g_refs;
+
+// Makes a registry reference to minetest[name]
+static int ref_minetest_table(lua_State *L, const char *name)
+{
+	lua_getglobal(L, "minetest");
+	lua_getfield(L, -1, name);
+	luaL_checktype(L, -1, LUA_TTABLE);
+	int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pop(L, 1); // minetest
+	return ref;
+}
+
 static void objectref_get(lua_State *L, u16 id)
 {
 	// Get minetest.object_refs[i]
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "object_refs");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.object_refs);
 	luaL_checktype(L, -1, LUA_TTABLE);
-	lua_pushnumber(L, id);
-	lua_gettable(L, -2);
+	lua_rawgeti(L, -1, id);
 	lua_remove(L, -2); // object_refs
-	lua_remove(L, -2); // minetest
 }
 
 static void luaentity_get(lua_State *L, u16 id)
 {
 	// Get minetest.luaentities[i]
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "luaentities");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.luaentities);
 	luaL_checktype(L, -1, LUA_TTABLE);
-	lua_pushnumber(L, id);
-	lua_gettable(L, -2);
+	lua_rawgeti(L, -1, id);
 	lua_remove(L, -2); // luaentities
-	lua_remove(L, -2); // minetest
 }
 
 /*
@@ -2284,6 +2628,227 @@ static void objectref_get_or_create(lua_State *L,
 	}
 }
 
+/*
+	LuaVoxelManip
+*/
+
+// Largest area that can be read at once, in MapBlocks
+#define VOXELMANIP_MAX_BLOCKS (8*8*8)
+
+class LuaVoxelManip
+{
+private:
+	ManualMapVoxelManipulator *m_vm;
+
+	static const char className[];
+	static const luaL_reg methods[];
+
+	static LuaVoxelManip *checkobject(lua_State *L, int narg)
+	{
+		luaL_checktype(L, narg, LUA_TUSERDATA);
+		void *ud = luaL_checkudata(L, narg, className);
+		if(!ud) luaL_typerror(L, narg, className);
+		return *(LuaVoxelManip**)ud;  // unbox pointer
+	}
+
+	static void push_area(lua_State *L, const VoxelArea &a)
+	{
+		push_v3s16(L, a.MinEdge);
+		push_v3s16(L, a.MaxEdge);
+	}
+
+	// Exported functions
+
+	// VoxelManip:read_from_map(p1, p2) -> minp, maxp
+	static int l_read_from_map(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		ServerEnvironment *env = get_env(L);
+		if(env == NULL) return 0;
+		v3s16 p1 = read_v3s16(L, 2);
+		v3s16 p2 = read_v3s16(L, 3);
+		v3s16 bp1 = getNodeBlockPos(v3s16(MYMIN(p1.X, p2.X),
+				MYMIN(p1.Y, p2.Y), MYMIN(p1.Z, p2.Z)));
+		v3s16 bp2 = getNodeBlockPos(v3s16(MYMAX(p1.X, p2.X),
+				MYMAX(p1.Y, p2.Y), MYMAX(p1.Z, p2.Z)));
+		v3s16 bsize = bp2 - bp1 + v3s16(1,1,1);
+		if((s32)bsize.X * bsize.Y * bsize.Z > VOXELMANIP_MAX_BLOCKS)
+			return luaL_error(L, "VoxelManip: area too large");
+		// Start over
+		delete o->m_vm;
+		o->m_vm = new ManualMapVoxelManipulator(&env->getMap());
+		o->m_vm->initialEmerge(bp1, bp2);
+		push_area(L, o->m_vm->m_area);
+		return 2;
+	}
+
+	// VoxelManip:get_emerged_area() -> minp, maxp
+	static int l_get_emerged_area(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		push_area(L, o->m_vm->m_area);
+		return 2;
+	}
+
+	// VoxelManip:get_data() -> {content id, ...}
+	static int l_get_data(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		ManualMapVoxelManipulator *vm = o->m_vm;
+		s32 volume = vm->m_area.getVolume();
+		lua_createtable(L, volume, 0);
+		for(s32 i=0; i<volume; i++)
+		{
+			content_t c = CONTENT_IGNORE;
+			if(!(vm->m_flags[i] & VOXELFLAG_INEXISTENT))
+				c = vm->m_data[i].getContent();
+			lua_pushinteger(L, c);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	// VoxelManip:set_data({content id, ...})
+	static int l_set_data(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		luaL_checktype(L, 2, LUA_TTABLE);
+		ManualMapVoxelManipulator *vm = o->m_vm;
+		s32 volume = vm->m_area.getVolume();
+		for(s32 i=0; i<volume; i++)
+		{
+			lua_rawgeti(L, 2, i + 1);
+			if(lua_isnumber(L, -1))
+			{
+				lua_Integer c = lua_tointeger(L, -1);
+				if(c < 0 || c > MAX_CONTENT)
+					return luaL_error(L, "VoxelManip: invalid content id");
+				// Unloaded nodes can't be written
+				if(!(vm->m_flags[i] & VOXELFLAG_INEXISTENT))
+					vm->m_data[i].setContent(c);
+			}
+			lua_pop(L, 1);
+		}
+		return 0;
+	}
+
+	// VoxelManip:get_param2_data() -> {param2, ...}
+	static int l_get_param2_data(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		ManualMapVoxelManipulator *vm = o->m_vm;
+		s32 volume = vm->m_area.getVolume();
+		lua_createtable(L, volume, 0);
+		for(s32 i=0; i<volume; i++)
+		{
+			lua_pushinteger(L, vm->m_data[i].param2);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	// VoxelManip:set_param2_data({param2, ...})
+	static int l_set_param2_data(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		luaL_checktype(L, 2, LUA_TTABLE);
+		ManualMapVoxelManipulator *vm = o->m_vm;
+		s32 volume = vm->m_area.getVolume();
+		for(s32 i=0; i<volume; i++)
+		{
+			lua_rawgeti(L, 2, i + 1);
+			if(lua_isnumber(L, -1) && !(vm->m_flags[i] & VOXELFLAG_INEXISTENT))
+				vm->m_data[i].param2 = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+		return 0;
+	}
+
+	// VoxelManip:write_to_map()
+	static int l_write_to_map(lua_State *L)
+	{
+		LuaVoxelManip *o = checkobject(L, 1);
+		ServerEnvironment *env = get_env(L);
+		if(env == NULL) return 0;
+		Map *map = &env->getMap();
+		o->m_vm->setMap(map);
+
+		core::map<v3s16, MapBlock*> written_blocks;
+		o->m_vm->blitBackAll(&written_blocks);
+
+		core::map<v3s16, MapBlock*> modified_blocks;
+		map->updateWrittenBlocks(written_blocks, modified_blocks,
+				"VoxelManip");
+		return 0;
+	}
+
+	static int gc_object(lua_State *L) {
+		LuaVoxelManip *o = *(LuaVoxelManip **)(lua_touserdata(L, 1));
+		delete o;
+		return 0;
+	}
+
+public:
+	LuaVoxelManip(Map *map):
+		m_vm(new ManualMapVoxelManipulator(map))
+	{
+	}
+
+	~LuaVoxelManip()
+	{
+		delete m_vm;
+	}
+
+	// Creates a LuaVoxelManip and leaves it on top of stack
+	// Not callable from Lua; EnvRef:get_voxel_manip() creates these.
+	static void create(lua_State *L, Map *map)
+	{
+		LuaVoxelManip *o = new LuaVoxelManip(map);
+		*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+		luaL_getmetatable(L, className);
+		lua_setmetatable(L, -2);
+	}
+
+	static void Register(lua_State *L)
+	{
+		lua_newtable(L);
+		int methodtable = lua_gettop(L);
+		luaL_newmetatable(L, className);
+		int metatable = lua_gettop(L);
+
+		lua_pushliteral(L, "__metatable");
+		lua_pushvalue(L, methodtable);
+		lua_settable(L, metatable);  // hide metatable from Lua getmetatable()
+
+		lua_pushliteral(L, "__index");
+		lua_pushvalue(L, methodtable);
+		lua_settable(L, metatable);
+
+		lua_pushliteral(L, "__gc");
+		lua_pushcfunction(L, gc_object);
+		lua_settable(L, metatable);
+
+		lua_pop(L, 1);  // drop metatable
+
+		luaL_openlib(L, 0, methods, 0);  // fill methodtable
+		lua_pop(L, 1);  // drop methodtable
+
+		// Cannot be created from Lua
+		//lua_register(L, className, create_object);
+	}
+};
+const char LuaVoxelManip::className[] = "VoxelManip";
+const luaL_reg LuaVoxelManip::methods[] = {
+	method(LuaVoxelManip, read_from_map),
+	method(LuaVoxelManip, get_emerged_area),
+	method(LuaVoxelManip, get_data),
+	method(LuaVoxelManip, set_data),
+	method(LuaVoxelManip, get_param2_data),
+	method(LuaVoxelManip, set_param2_data),
+	method(LuaVoxelManip, write_to_map),
+	{0,0}
+};
+
 /*
 	EnvRef
 */
@@ -2324,6 +2889,36 @@ class EnvRef
 		return 1;
 	}
 
+	// EnvRef:set_nodes({{pos=pos, node=node}, ...}) -> number of nodes set
+	// Lighting is updated and clients are told once for all of them
+	static int l_set_nodes(lua_State *L)
+	{
+		EnvRef *o = checkobject(L, 1);
+		ServerEnvironment *env = o->m_env;
+		if(env == NULL) return 0;
+		INodeDefManager *ndef = env->getGameDef()->ndef();
+		luaL_checktype(L, 2, LUA_TTABLE);
+		core::map<v3s16, MapNode> nodes;
+		int count = lua_objlen(L, 2);
+		for(int i=1; i<=count; i++)
+		{
+			lua_rawgeti(L, 2, i);
+			luaL_checktype(L, -1, LUA_TTABLE);
+			int entry = lua_gettop(L);
+			lua_getfield(L, entry, "pos");
+			v3s16 pos = check_v3s16(L, -1);
+			lua_getfield(L, entry, "node");
+			luaL_checktype(L, -1, LUA_TTABLE);
+			MapNode n = readnode(L, lua_gettop(L), ndef);
+			// The last one of the same position is used
+			nodes[pos] = n;
+			lua_pop(L, 3);
+		}
+		u32 set_count = env->getMap().addNodesWithEvent(nodes);
+		lua_pushnumber(L, set_count);
+		return 1;
+	}
+
 	// EnvRef:remove_node(pos)
 	// pos = {x=num, y=num, z=num}
 	static int l_remove_node(lua_State *L)
@@ -2380,6 +2975,45 @@ class EnvRef
 		}
 	}
 
+	// EnvRef:get_node_raw(x, y, z) -> content id, param1, param2
+	// Like get_node() but without any tables or names
+	static int l_get_node_raw(lua_State *L)
+	{
+		EnvRef *o = checkobject(L, 1);
+		ServerEnvironment *env = o->m_env;
+		if(env == NULL) return 0;
+		// pos
+		v3s16 pos(luaL_checkint(L, 2), luaL_checkint(L, 3),
+				luaL_checkint(L, 4));
+		// Do it
+		MapNode n = env->getMap().getNodeNoEx(pos);
+		lua_pushinteger(L, n.getContent());
+		lua_pushinteger(L, n.getParam1());
+		lua_pushinteger(L, n.getParam2());
+		return 3;
+	}
+
+	// EnvRef:set_node_raw(x, y, z, content id, param1, param2)
+	// Like add_node() but without any tables or names
+	static int l_set_node_raw(lua_State *L)
+	{
+		EnvRef *o = checkobject(L, 1);
+		ServerEnvironment *env = o->m_env;
+		if(env == NULL) return 0;
+		// pos
+		v3s16 pos(luaL_checkint(L, 2), luaL_checkint(L, 3),
+				luaL_checkint(L, 4));
+		// content
+		int c = luaL_checkint(L, 5);
+		if(c < 0 || c > MAX_CONTENT)
+			return luaL_error(L, "set_node_raw: invalid content id %d", c);
+		MapNode n(c, luaL_optint(L, 6, 0), luaL_optint(L, 7, 0));
+		// Do it
+		bool succeeded = env->getMap().addNodeWithEvent(pos, n);
+		lua_pushboolean(L, succeeded);
+		return 1;
+	}
+
 	// EnvRef:get_node_light(pos, timeofday)
 	// pos = {x=num, y=num, z=num}
 	// timeofday: nil = current time, 0 = night, 0.5 = day
@@ -2543,6 +3177,17 @@ class EnvRef
 		return 1;
 	}
 
+	// EnvRef:get_voxel_manip()
+	static int l_get_voxel_manip(lua_State *L)
+	{
+		EnvRef *o = checkobject(L, 1);
+		ServerEnvironment *env = o->m_env;
+		if(env == NULL) return 0;
+		// Do it
+		LuaVoxelManip::create(L, &env->getMap());
+		return 1;
+	}
+
 	static int gc_object(lua_State *L) {
 		EnvRef *o = *(EnvRef **)(lua_touserdata(L, 1));
 		delete o;
@@ -2609,9 +3254,12 @@ class EnvRef
 const char EnvRef::className[] = "EnvRef";
 const luaL_reg EnvRef::methods[] = {
 	method(EnvRef, add_node),
+	method(EnvRef, set_nodes),
 	method(EnvRef, remove_node),
 	method(EnvRef, get_node),
 	method(EnvRef, get_node_or_nil),
+	method(EnvRef, get_node_raw),
+	method(EnvRef, set_node_raw),
 	method(EnvRef, get_node_light),
 	method(EnvRef, add_entity),
 	method(EnvRef, add_item),
@@ -2620,6 +3268,7 @@ const luaL_reg EnvRef::methods[] = {
 	method(EnvRef, get_meta),
 	method(EnvRef, get_player_by_name),
 	method(EnvRef, get_objects_inside_radius),
+	method(EnvRef, get_voxel_manip),
 	{0,0}
 };
 
@@ -2680,25 +3329,33 @@ class LuaABM : public ActiveBlockModifier
 {
 private:
 	lua_State *m_lua;
-	int m_id;
+	// Registry reference to the action function
+	int m_action_ref;
+	u32 m_profiler_slot;
 
 	std::set<std::string> m_trigger_contents;
 	std::set<std::string> m_required_neighbors;
 	float m_trigger_interval;
 	u32 m_trigger_chance;
 public:
-	LuaABM(lua_State *L, int id,
+	LuaABM(lua_State *L, int action_ref, u32 profiler_slot,
 			const std::set<std::string> &trigger_contents,
 			const std::set<std::string> &required_neighbors,
 			float trigger_interval, u32 trigger_chance):
 		m_lua(L),
-		m_id(id),
+		m_action_ref(action_ref),
+		m_profiler_slot(profiler_slot),
 		m_trigger_contents(trigger_contents),
 		m_required_neighbors(required_neighbors),
 		m_trigger_interval(trigger_interval),
 		m_trigger_chance(trigger_chance)
 	{
 	}
+	~LuaABM()
+	{
+		// The environment is deleted before the scripting state
+		luaL_unref(m_lua, LUA_REGISTRYINDEX, m_action_ref);
+	}
 	virtual std::set<std::string> getTriggerContents()
 	{
 		return m_trigger_contents;
@@ -2724,26 +3381,14 @@ class LuaABM : public ActiveBlockModifier
 		assert(lua_checkstack(L, 20));
 		StackUnroller stack_unroller(L);
 
-		// Get minetest.registered_abms
-		lua_getglobal(L, "minetest");
-		lua_getfield(L, -1, "registered_abms");
-		luaL_checktype(L, -1, LUA_TTABLE);
-		int registered_abms = lua_gettop(L);
-
-		// Get minetest.registered_abms[m_id]
-		lua_pushnumber(L, m_id);
-		lua_gettable(L, registered_abms);
-		if(lua_isnil(L, -1))
-			assert(0);
-		
-		// Call action
-		luaL_checktype(L, -1, LUA_TTABLE);
-		lua_getfield(L, -1, "action");
+		// Get the action function
+		lua_rawgeti(L, LUA_REGISTRYINDEX, m_action_ref);
 		luaL_checktype(L, -1, LUA_TFUNCTION);
 		push_v3s16(L, p);
 		pushnode(L, n, env->getGameDef()->ndef());
 		lua_pushnumber(L, active_object_count);
 		lua_pushnumber(L, active_object_count_wider);
+		ScriptCallbackTimer timer(m_profiler_slot);
 		if(lua_pcall(L, 4, 0, 0))
 			script_error(L, "error: %s", lua_tostring(L, -1));
 	}
@@ -2775,6 +3420,12 @@ static int l_register_abm(lua_State *L)
 
 	infostream<<"register_abm: id="<<id<<std::endl;
 
+	// For the Lua profiler
+	lua_getfield(L, 1, "action");
+	if(lua_isfunction(L, -1))
+		set_callback_origin(L, lua_gettop(L));
+	lua_pop(L, 1);
+
 	// registered_abms[id] = spec
 	lua_pushnumber(L, id);
 	lua_pushvalue(L, 1);
@@ -3294,6 +3945,13 @@ static int l_get_inventory(lua_State *L)
 	return 1;
 }
 
+// get_current_modname() -> name of the mod being loaded or nil
+static int l_get_current_modname(lua_State *L)
+{
+	lua_getfield(L, LUA_REGISTRYINDEX, "minetest_current_modname");
+	return 1;
+}
+
 // get_modpath(modname)
 static int l_get_modpath(lua_State *L)
 {
@@ -3311,6 +3969,31 @@ static int l_get_modpath(lua_State *L)
 	return 1;
 }
 
+// get_content_id(name) -> content id
+static int l_get_content_id(lua_State *L)
+{
+	std::string name = luaL_checkstring(L, 1);
+	INodeDefManager *ndef = get_server(L)->getNodeDefManager();
+	content_t c;
+	if(!ndef->getId(name, c))
+		return luaL_error(L, "get_content_id: unknown node \"%s\"",
+				name.c_str());
+	lua_pushinteger(L, c);
+	return 1;
+}
+
+// get_name_from_content_id(content id) -> name
+static int l_get_name_from_content_id(lua_State *L)
+{
+	int c = luaL_checkint(L, 1);
+	if(c < 0 || c > MAX_CONTENT)
+		return luaL_error(L, "get_name_from_content_id: invalid content"
+				" id %d", c);
+	INodeDefManager *ndef = get_server(L)->getNodeDefManager();
+	lua_pushstring(L, ndef->get(c).name.c_str());
+	return 1;
+}
+
 static const struct luaL_Reg minetest_f [] = {
 	{"register_nodedef_defaults", l_register_nodedef_defaults},
 	{"register_entity", l_register_entity},
@@ -3328,7 +4011,10 @@ static const struct luaL_Reg minetest_f [] = {
 	{"chat_send_player", l_chat_send_player},
 	{"get_player_privs", l_get_player_privs},
 	{"get_inventory", l_get_inventory},
+	{"get_current_modname", l_get_current_modname},
 	{"get_modpath", l_get_modpath},
+	{"get_content_id", l_get_content_id},
+	{"get_name_from_content_id", l_get_name_from_content_id},
 	{NULL, NULL}
 };
 
@@ -3377,12 +4063,21 @@ void scriptapi_export(lua_State *L, Server *server)
 	lua_setfield(L, -2, "registered_craftitems");
 	lua_newtable(L);
 	lua_setfield(L, -2, "registered_abms");
+	// Mod names of registered callback functions, for the profiler
+	lua_newtable(L);
+	lua_setfield(L, -2, "callback_origins");
 	
 	lua_newtable(L);
 	lua_setfield(L, -2, "object_refs");
 	lua_newtable(L);
 	lua_setfield(L, -2, "luaentities");
 
+	g_refs.object_refs = ref_minetest_table(L, "object_refs");
+	g_refs.luaentities = ref_minetest_table(L, "luaentities");
+
+	g_script_profiler.reset();
+	g_globalsteps.reset();
+
 	// Create entity prototype
 	luaL_newmetatable(L, "minetest.entity");
 	// metatable.__index = metatable
@@ -3398,6 +4093,7 @@ void scriptapi_export(lua_State *L, Server *server)
 	NodeMetaRef::Register(L);
 	ObjectRef::Register(L);
 	EnvRef::Register(L);
+	LuaVoxelManip::Register(L);
 }
 
 bool scriptapi_loadmod(lua_State *L, const std::string &scriptpath,
@@ -3447,6 +4143,26 @@ void scriptapi_add_environment(lua_State *L, ServerEnvironment *env)
 	lua_pushlightuserdata(L, env);
 	lua_setfield(L, LUA_REGISTRYINDEX, "minetest_env");
 
+	// builtin.lua has made the callback tables by now
+	g_refs.registered_globalsteps =
+			ref_minetest_table(L, "registered_globalsteps");
+	g_refs.registered_on_placenodes =
+			ref_minetest_table(L, "registered_on_placenodes");
+	g_refs.registered_on_dignodes =
+			ref_minetest_table(L, "registered_on_dignodes");
+	g_refs.registered_on_punchnodes =
+			ref_minetest_table(L, "registered_on_punchnodes");
+	g_refs.registered_on_generateds =
+			ref_minetest_table(L, "registered_on_generateds");
+	g_refs.registered_on_chat_messages =
+			ref_minetest_table(L, "registered_on_chat_messages");
+	g_refs.registered_on_newplayers =
+			ref_minetest_table(L, "registered_on_newplayers");
+	g_refs.registered_on_dieplayers =
+			ref_minetest_table(L, "registered_on_dieplayers");
+	g_refs.registered_on_respawnplayers =
+			ref_minetest_table(L, "registered_on_respawnplayers");
+
 	/*
 		Add ActiveBlockModifiers to environment
 	*/
@@ -3505,8 +4221,16 @@ void scriptapi_add_environment(lua_State *L, ServerEnvironment *env)
 			int trigger_chance = 50;
 			getintfield(L, current_abm, "chance", trigger_chance);
 
-			LuaABM *abm = new LuaABM(L, id, trigger_contents,
-					required_neighbors, trigger_interval, trigger_chance);
+			lua_getfield(L, current_abm, "action");
+			luaL_checktype(L, -1, LUA_TFUNCTION);
+			u32 profiler_slot = g_script_profiler.getSlot(
+					get_callback_origin(L, lua_gettop(L))
+					+ " abm " + itos(id));
+			int action_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+			LuaABM *abm = new LuaABM(L, action_ref, profiler_slot,
+					trigger_contents, required_neighbors,
+					trigger_interval, trigger_chance);
 			
 			env->addActiveBlockModifier(abm);
 
@@ -3547,8 +4271,7 @@ void scriptapi_add_object_reference(lua_State *L, ServerActiveObject *cobj)
 	int object = lua_gettop(L);
 
 	// Get minetest.object_refs table
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "object_refs");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.object_refs);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int objectstable = lua_gettop(L);
 	
@@ -3566,8 +4289,7 @@ void scriptapi_rm_object_reference(lua_State *L, ServerActiveObject *cobj)
 	StackUnroller stack_unroller(L);
 
 	// Get minetest.object_refs table
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "object_refs");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.object_refs);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int objectstable = lua_gettop(L);
 	
@@ -3592,8 +4314,7 @@ bool scriptapi_on_chat_message(lua_State *L, const std::string &name,
 	StackUnroller stack_unroller(L);
 
 	// Get minetest.registered_on_chat_messages
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_chat_messages");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_chat_messages);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -3601,6 +4322,8 @@ bool scriptapi_on_chat_message(lua_State *L, const std::string &name,
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_chat_message"));
 		// Call function
 		lua_pushstring(L, name.c_str());
 		lua_pushstring(L, message.c_str());
@@ -3626,8 +4349,7 @@ void scriptapi_on_newplayer(lua_State *L, ServerActiveObject *player)
 	StackUnroller stack_unroller(L);
 
 	// Get minetest.registered_on_newplayers
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_newplayers");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_newplayers);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -3635,6 +4357,8 @@ void scriptapi_on_newplayer(lua_State *L, ServerActiveObject *player)
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_newplayer"));
 		// Call function
 		objectref_get_or_create(L, player);
 		if(lua_pcall(L, 1, 0, 0))
@@ -3650,8 +4374,7 @@ void scriptapi_on_dieplayer(lua_State *L, ServerActiveObject *player)
     StackUnroller stack_unroller(L);
     
     // Get minetest.registered_on_dieplayers
-    lua_getglobal(L, "minetest");
-    lua_getfield(L, -1, "registered_on_dieplayers");
+    lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_dieplayers);
     luaL_checktype(L, -1, LUA_TTABLE);
     int table = lua_gettop(L);
     // Foreach
@@ -3659,6 +4382,8 @@ void scriptapi_on_dieplayer(lua_State *L, ServerActiveObject *player)
     while(lua_next(L, table) != 0){
         // key at index -2 and value at index -1
        luaL_checktype(L, -1, LUA_TFUNCTION);
+        ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+                "on_dieplayer"));
         // Call function
        objectref_get_or_create(L, player);
         if(lua_pcall(L, 1, 0, 0))
@@ -3677,8 +4402,7 @@ bool scriptapi_on_respawnplayer(lua_State *L, ServerActiveObject *player)
 	bool positioning_handled_by_some = false;
 
 	// Get minetest.registered_on_respawnplayers
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_respawnplayers");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_respawnplayers);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -3686,6 +4410,8 @@ bool scriptapi_on_respawnplayer(lua_State *L, ServerActiveObject *player)
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_respawnplayer"));
 		// Call function
 		objectref_get_or_create(L, player);
 		if(lua_pcall(L, 1, 1, 0))
@@ -3806,6 +4532,8 @@ bool scriptapi_craftitem_on_drop(lua_State *L, const char *name,
 	callback_exists = get_craftitem_callback(L, name, "on_drop");
 	if(callback_exists)
 	{
+		ScriptCallbackTimer timer(get_craftitem_slot(L, lua_gettop(L),
+				name, "on_drop"));
 		// Call function
 		lua_pushstring(L, name);
 		objectref_get_or_create(L, dropper);
@@ -3830,6 +4558,8 @@ bool scriptapi_craftitem_on_place_on_ground(lua_State *L, const char *name,
 	callback_exists = get_craftitem_callback(L, name, "on_place_on_ground");
 	if(callback_exists)
 	{
+		ScriptCallbackTimer timer(get_craftitem_slot(L, lua_gettop(L),
+				name, "on_place_on_ground"));
 		// Call function
 		lua_pushstring(L, name);
 		objectref_get_or_create(L, placer);
@@ -3854,6 +4584,8 @@ bool scriptapi_craftitem_on_use(lua_State *L, const char *name,
 	callback_exists = get_craftitem_callback(L, name, "on_use");
 	if(callback_exists)
 	{
+		ScriptCallbackTimer timer(get_craftitem_slot(L, lua_gettop(L),
+				name, "on_use"));
 		// Call function
 		lua_pushstring(L, name);
 		objectref_get_or_create(L, user);
@@ -3876,22 +4608,47 @@ void scriptapi_environment_step(lua_State *L, float dtime)
 	//infostream<<"scriptapi_environment_step"<<std::endl;
 	StackUnroller stack_unroller(L);
 
+	// Move the Lua time of the previous step into g_profiler
+	g_script_profiler.flushStep();
+	float print_interval = g_settings->getFloat("lua_profiler_print_interval");
+	if(print_interval > 0 && g_script_profiler_print_interval.step(
+			dtime, print_interval))
+	{
+		std::ostringstream os(std::ios_base::binary);
+		g_script_profiler.printInterval(os, 5);
+		if(os.str() != "")
+			actionstream<<"Lua time in the last "<<print_interval<<"s: "
+					<<os.str()<<std::endl;
+	}
+
 	// Get minetest.registered_globalsteps
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_globalsteps");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_globalsteps);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
-	// Foreach
-	lua_pushnil(L);
-	while(lua_next(L, table) != 0){
-		// key at index -2 and value at index -1
+
+	// Run them in order within globalstep_time_budget
+	u32 budget_us = g_settings->getFloat("globalstep_time_budget") * 1000000;
+	u32 start_time = porting::getTimeUs();
+	g_script_profiler.forgetLastSlot();
+	g_globalsteps.beginStep(lua_objlen(L, table), dtime);
+
+	u32 i;
+	float step_dtime;
+	while(g_globalsteps.next(budget_us != 0
+			&& porting::getTimeUs() - start_time >= budget_us,
+			&i, &step_dtime))
+	{
+		lua_rawgeti(L, table, i + 1);
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"globalstep"));
 		// Call function
-		lua_pushnumber(L, dtime);
+		lua_pushnumber(L, step_dtime);
 		if(lua_pcall(L, 1, 0, 0))
 			script_error(L, "error: %s", lua_tostring(L, -1));
-		// value removed, keep key for next iteration
 	}
+	if(g_globalsteps.overran())
+		g_script_profiler.countOverrun();
 }
 
 void scriptapi_environment_on_placenode(lua_State *L, v3s16 p, MapNode newnode,
@@ -3907,8 +4664,7 @@ void scriptapi_environment_on_placenode(lua_State *L, v3s16 p, MapNode newnode,
 			get_server(L)->getWritableNodeDefManager();
 	
 	// Get minetest.registered_on_placenodes
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_placenodes");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_placenodes);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -3916,6 +4672,8 @@ void scriptapi_environment_on_placenode(lua_State *L, v3s16 p, MapNode newnode,
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_placenode"));
 		// Call function
 		push_v3s16(L, p);
 		pushnode(L, newnode, ndef);
@@ -3939,8 +4697,7 @@ void scriptapi_environment_on_dignode(lua_State *L, v3s16 p, MapNode oldnode,
 			get_server(L)->getWritableNodeDefManager();
 	
 	// Get minetest.registered_on_dignodes
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_dignodes");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_dignodes);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -3948,6 +4705,8 @@ void scriptapi_environment_on_dignode(lua_State *L, v3s16 p, MapNode oldnode,
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_dignode"));
 		// Call function
 		push_v3s16(L, p);
 		pushnode(L, oldnode, ndef);
@@ -3971,8 +4730,7 @@ void scriptapi_environment_on_punchnode(lua_State *L, v3s16 p, MapNode node,
 			get_server(L)->getWritableNodeDefManager();
 	
 	// Get minetest.registered_on_punchnodes
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_punchnodes");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_punchnodes);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -3980,6 +4738,8 @@ void scriptapi_environment_on_punchnode(lua_State *L, v3s16 p, MapNode node,
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_punchnode"));
 		// Call function
 		push_v3s16(L, p);
 		pushnode(L, node, ndef);
@@ -3998,8 +4758,7 @@ void scriptapi_environment_on_generated(lua_State *L, v3s16 minp, v3s16 maxp)
 	StackUnroller stack_unroller(L);
 
 	// Get minetest.registered_on_generateds
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "registered_on_generateds");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.registered_on_generateds);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int table = lua_gettop(L);
 	// Foreach
@@ -4007,6 +4766,8 @@ void scriptapi_environment_on_generated(lua_State *L, v3s16 minp, v3s16 maxp)
 	while(lua_next(L, table) != 0){
 		// key at index -2 and value at index -1
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_callback_slot(L, lua_gettop(L),
+				"on_generated"));
 		// Call function
 		push_v3s16(L, minp);
 		push_v3s16(L, maxp);
@@ -4061,8 +4822,7 @@ bool scriptapi_luaentity_add(lua_State *L, u16 id, const char *name,
 	lua_setfield(L, -2, "object");
 
 	// minetest.luaentities[id] = object
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "luaentities");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.luaentities);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	lua_pushnumber(L, id); // Push id
 	lua_pushvalue(L, object); // Copy object to top of stack
@@ -4073,6 +4833,8 @@ bool scriptapi_luaentity_add(lua_State *L, u16 id, const char *name,
 	lua_getfield(L, -1, "on_activate");
 	if(!lua_isnil(L, -1)){
 		luaL_checktype(L, -1, LUA_TFUNCTION);
+		ScriptCallbackTimer timer(get_luaentity_slot(L, object,
+				"on_activate"));
 		lua_pushvalue(L, object); // self
 		lua_pushlstring(L, staticdata.c_str(), staticdata.size());
 		// Call with 2 arguments, 0 results
@@ -4091,8 +4853,7 @@ void scriptapi_luaentity_rm(lua_State *L, u16 id)
 	infostream<<"scriptapi_luaentity_rm: id="<<id<<std::endl;
 
 	// Get minetest.luaentities table
-	lua_getglobal(L, "minetest");
-	lua_getfield(L, -1, "luaentities");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, g_refs.luaentities);
 	luaL_checktype(L, -1, LUA_TTABLE);
 	int objectstable = lua_gettop(L);
 	
@@ -4101,7 +4862,7 @@ void scriptapi_luaentity_rm(lua_State *L, u16 id)
 	lua_pushnil(L);
 	lua_settable(L, objectstable);
 	
-	lua_pop(L, 2); // pop luaentities, minetest
+	lua_pop(L, 1); // pop luaentities
 }
 
 std::string scriptapi_luaentity_get_staticdata(lua_State *L, u16 id)
@@ -4122,6 +4883,8 @@ std::string scriptapi_luaentity_get_staticdata(lua_State *L, u16 id)
 		return "";
 	
 	luaL_checktype(L, -1, LUA_TFUNCTION);
+	ScriptCallbackTimer timer(get_luaentity_slot(L, object,
+			"get_staticdata"));
 	lua_pushvalue(L, object); // self
 	// Call with 1 arguments, 1 results
 	if(lua_pcall(L, 1, 1, 0))
@@ -4133,6 +4896,36 @@ std::string scriptapi_luaentity_get_staticdata(lua_State *L, u16 id)
 	return std::string(s, len);
 }
 
+bool scriptapi_luaentity_has_get_staticdata(lua_State *L, u16 id)
+{
+	realitycheck(L);
+	assert(lua_checkstack(L, 20));
+	StackUnroller stack_unroller(L);
+
+	// Get minetest.luaentities[id]
+	luaentity_get(L, id);
+	int object = lua_gettop(L);
+
+	lua_getfield(L, object, "get_staticdata");
+	return !lua_isnil(L, -1);
+}
+
+/*
+	Entities without on_step are not stepped while they are at rest.
+*/
+bool scriptapi_luaentity_has_on_step(lua_State *L, u16 id)
+{
+	realitycheck(L);
+	assert(lua_checkstack(L, 20));
+	StackUnroller stack_unroller(L);
+
+	// Get minetest.luaentities[id]
+	luaentity_get(L, id);
+
+	lua_getfield(L, -1, "on_step");
+	return !lua_isnil(L, -1);
+}
+
 void scriptapi_luaentity_get_properties(lua_State *L, u16 id,
 		LuaEntityProperties *prop)
 {
@@ -4207,6 +5000,7 @@ void scriptapi_luaentity_step(lua_State *L, u16 id, float dtime)
 	if(lua_isnil(L, -1))
 		return;
 	luaL_checktype(L, -1, LUA_TFUNCTION);
+	ScriptCallbackTimer timer(get_luaentity_slot(L, object, "on_step"));
 	lua_pushvalue(L, object); // self
 	lua_pushnumber(L, dtime); // dtime
 	// Call with 2 arguments, 0 results
@@ -4232,6 +5026,7 @@ void scriptapi_luaentity_punch(lua_State *L, u16 id,
 	if(lua_isnil(L, -1))
 		return;
 	luaL_checktype(L, -1, LUA_TFUNCTION);
+	ScriptCallbackTimer timer(get_luaentity_slot(L, object, "on_punch"));
 	lua_pushvalue(L, object); // self
 	objectref_get_or_create(L, puncher); // Clicker reference
 	lua_pushnumber(L, time_from_last_punch);
@@ -4258,6 +5053,7 @@ void scriptapi_luaentity_rightclick(lua_State *L, u16 id,
 	if(lua_isnil(L, -1))
 		return;
 	luaL_checktype(L, -1, LUA_TFUNCTION);
+	ScriptCallbackTimer timer(get_luaentity_slot(L, object, "on_rightclick"));
 	lua_pushvalue(L, object); // self
 	objectref_get_or_create(L, clicker); // Clicker reference
 	// Call with 2 arguments, 0 results
@@ -4265,3 +5061,31 @@ void scriptapi_luaentity_rightclick(lua_State *L, u16 id,
 		script_error(L, "error running function 'on_rightclick': %s\n", lua_tostring(L, -1));
 }
 
+/*
+	profiling
+*/
+
+void scriptapi_print_profile(lua_State *L, std::ostream &os, u32 max_count)
+{
+	g_script_profiler.printTotals(os, max_count);
+}
+
+void scriptapi_clear_profile(lua_State *L)
+{
+	g_script_profiler.clear();
+}
+
+/*
+	time budgets
+*/
+
+void scriptapi_budget_start(lua_State *L)
+{
+	g_script_profiler.forgetLastSlot();
+}
+
+void scriptapi_budget_overrun(lua_State *L)
+{
+	g_script_profiler.countOverrun();
+}
+
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "irrlichttypes.h"
 #include <string>
+#include <iostream>
 #include "mapnode.h"
 
 class Server;
@@ -84,6 +85,8 @@ bool scriptapi_luaentity_add(lua_State *L, u16 id, const char *name,
 		const std::string &staticdata);
 void scriptapi_luaentity_rm(lua_State *L, u16 id);
 std::string scriptapi_luaentity_get_staticdata(lua_State *L, u16 id);
+bool scriptapi_luaentity_has_get_staticdata(lua_State *L, u16 id);
+bool scriptapi_luaentity_has_on_step(lua_State *L, u16 id);
 void scriptapi_luaentity_get_properties(lua_State *L, u16 id,
 		LuaEntityProperties *prop);
 void scriptapi_luaentity_step(lua_State *L, u16 id, float dtime);
@@ -92,5 +95,16 @@ void scriptapi_luaentity_punch(lua_State *L, u16 id,
 void scriptapi_luaentity_rightclick(lua_State *L, u16 id,
 		ServerActiveObject *clicker);
 
+/* profiling */
+// Prints the Lua callbacks that have taken the most time since clearing
+void scriptapi_print_profile(lua_State *L, std::ostream &os, u32 max_count);
+void scriptapi_clear_profile(lua_State *L);
+
+/* time budgets */
+// Call when starting to spend a time budget
+void scriptapi_budget_start(lua_State *L);
+// Counts an overrun of the budget for the Lua callback that finished last
+void scriptapi_budget_overrun(lua_State *L);
+
 #endif
 
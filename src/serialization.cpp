@@ -52,13 +52,31 @@ void zerr(int ret)
     }
 }
 
-void compressZlib(SharedBuffer<u8> data, std::ostream &os)
+static CompressionCodec g_compression_codec = COMPRESSION_ZLIB;
+static int g_zlib_level = -1;
+
+void setCompressionParams(CompressionCodec codec, int zlib_level)
+{
+	g_compression_codec = codec;
+	g_zlib_level = zlib_level;
+}
+
+bool parseCompressionCodec(const std::string &name, CompressionCodec &codec)
+{
+	if(name == "zlib")
+		codec = COMPRESSION_ZLIB;
+	else if(name == "lz")
+		codec = COMPRESSION_LZ;
+	else if(name == "none")
+		codec = COMPRESSION_NONE;
+	else
+		return false;
+	return true;
+}
+
+void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level)
 {
 	z_stream z;
-	const s32 bufsize = 16384;
-	//char input_buffer[bufsize];
-	char output_buffer[bufsize];
-	int input_i = 0;
 	int status = 0;
 	int ret;
 
@@ -66,49 +84,38 @@ void compressZlib(SharedBuffer<u8> data, std::ostream &os)
 	z.zfree = Z_NULL;
 	z.opaque = Z_NULL;
 
-	ret = deflateInit(&z, -1);
+	ret = deflateInit(&z, level);
 	if(ret != Z_OK)
 		throw SerializationError("compressZlib: deflateInit failed");
 	
-	z.avail_in = 0;
-	
-	for(;;)
+	/*
+		Compress everything in one step into a buffer that is large
+		enough for the worst case
+	*/
+	uLong bound = deflateBound(&z, data.getSize());
+	Buffer<u8> output_buffer(bound);
+
+	z.next_in = (Bytef*)*data;
+	z.avail_in = data.getSize();
+	z.next_out = (Bytef*)*output_buffer;
+	z.avail_out = bound;
+
+	status = deflate(&z, Z_FINISH);
+	if(status != Z_STREAM_END)
 	{
-		int flush = Z_NO_FLUSH;
-		z.next_out = (Bytef*)output_buffer;
-		z.avail_out = bufsize;
-
-		if(z.avail_in == 0)
-		{
-			//z.next_in = (char*)&data[input_i];
-			z.next_in = (Bytef*)&data[input_i];
-			z.avail_in = data.getSize() - input_i;
-			input_i += z.avail_in;
-			if(input_i == (int)data.getSize())
-				flush = Z_FINISH;
-		}
-		if(z.avail_in == 0)
-			break;
-		status = deflate(&z, flush);
-		if(status == Z_NEED_DICT || status == Z_DATA_ERROR
-				|| status == Z_MEM_ERROR)
-		{
-			zerr(status);
-			throw SerializationError("compressZlib: deflate failed");
-		}
-		int count = bufsize - z.avail_out;
-		if(count)
-			os.write(output_buffer, count);
+		zerr(status);
+		deflateEnd(&z);
+		throw SerializationError("compressZlib: deflate failed");
 	}
+	os.write((char*)*output_buffer, bound - z.avail_out);
 
 	deflateEnd(&z);
-
 }
 
-void compressZlib(const std::string &data, std::ostream &os)
+void compressZlib(const std::string &data, std::ostream &os, int level)
 {
 	SharedBuffer<u8> databuf((u8*)data.c_str(), data.size());
-	compressZlib(databuf, os);
+	compressZlib(databuf, os, level);
 }
 
 void decompressZlib(std::istream &is, std::ostream &os)
@@ -193,8 +200,237 @@ void decompressZlib(std::istream &is, std::ostream &os)
 	inflateEnd(&z);
 }
 
+/*
+	Number of bytes left in the stream, or 0xffffffff if it can't be told.
+	Used for checking sizes read from the stream before allocating.
+*/
+static u32 get_remaining_input(std::istream &is)
+{
+	std::streampos pos = is.tellg();
+	if(pos == std::streampos(-1))
+		return 0xffffffff;
+	is.seekg(0, std::ios::end);
+	std::streampos end = is.tellg();
+	is.seekg(pos);
+	if(end == std::streampos(-1) || end < pos)
+		return 0xffffffff;
+	return end - pos;
+}
+
+/*
+	LZ codec
+
+	Format:
+	u32 uncompressed size
+	u32 compressed size
+	compressed data: a sequence of
+		u8 token: literal count in the high 4 bits, match length - 4
+		          in the low 4 bits; 15 means more length bytes follow
+		[literal count continuation bytes: 255, 255, ..., <255]
+		literals
+		u16 match offset (absent after the last literals)
+		[match length continuation bytes]
+*/
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+/*
+	Largest accepted uncompressed size. A block's node data is at most
+	3*4096 bytes plus its palette; node metadata of a block full of
+	chests stays well below this.
+*/
+#define LZ_MAX_SIZE (16*1024*1024)
+
+static inline u32 lz_hash(const u8 *p)
+{
+	u32 v = p[0] | (p[1]<<8) | (p[2]<<16) | ((u32)p[3]<<24);
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static void lz_write_length(std::string &out, u32 len)
+{
+	while(len >= 255)
+	{
+		out += (char)255;
+		len -= 255;
+	}
+	out += (char)len;
+}
+
+static void lz_write_sequence(std::string &out, const u8 *literals,
+		u32 literal_count, u16 offset, u32 match_len)
+{
+	u32 ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+	u8 token = ((literal_count < 15 ? literal_count : 15) << 4)
+			| (ml < 15 ? ml : 15);
+	out += (char)token;
+	if(literal_count >= 15)
+		lz_write_length(out, literal_count - 15);
+	out.append((const char*)literals, literal_count);
+	if(match_len == 0)
+		return;
+	u8 tmp[2];
+	writeU16(tmp, offset);
+	out.append((char*)tmp, 2);
+	if(ml >= 15)
+		lz_write_length(out, ml - 15);
+}
+
+void compressLZ(SharedBuffer<u8> data, std::ostream &os)
+{
+	const u8 *src = *data;
+	u32 size = data.getSize();
+	std::string out;
+	out.reserve(size / 2 + 16);
+
+	// Last position of each hashed 4-byte sequence
+	s32 table[1<<LZ_HASH_BITS];
+	for(u32 k=0; k<(1<<LZ_HASH_BITS); k++)
+		table[k] = -1;
+
+	u32 anchor = 0;
+	u32 i = 0;
+	while(i + LZ_MIN_MATCH <= size)
+	{
+		u32 h = lz_hash(&src[i]);
+		s32 candidate = table[h];
+		table[h] = i;
+		if(candidate < 0 || i - candidate > LZ_MAX_OFFSET
+				|| memcmp(&src[candidate], &src[i], LZ_MIN_MATCH) != 0)
+		{
+			i++;
+			continue;
+		}
+		u32 len = LZ_MIN_MATCH;
+		while(i + len < size && src[candidate + len] == src[i + len])
+			len++;
+		lz_write_sequence(out, &src[anchor], i - anchor, i - candidate, len);
+		i += len;
+		anchor = i;
+	}
+	// The rest are literals
+	lz_write_sequence(out, &src[anchor], size - anchor, 0, 0);
+
+	u8 tmp[8];
+	writeU32(&tmp[0], size);
+	writeU32(&tmp[4], out.size());
+	os.write((char*)tmp, 8);
+	os.write(out.c_str(), out.size());
+}
+
+static u32 lz_read_length(const u8 *&p, const u8 *end, u32 len)
+{
+	if(len != 15)
+		return len;
+	for(;;)
+	{
+		if(p == end)
+			throw SerializationError("decompressLZ: truncated length");
+		u8 b = *p++;
+		len += b;
+		if(b != 255)
+			return len;
+	}
+}
+
+void decompressLZ(std::istream &is, std::ostream &os)
+{
+	u8 tmp[8];
+	is.read((char*)tmp, 8);
+	if(is.gcount() != 8)
+		throw SerializationError("decompressLZ: no enough input data");
+	u32 size = readU32(&tmp[0]);
+	u32 packed_size = readU32(&tmp[4]);
+
+	// Check the sizes before allocating anything
+	if(size > LZ_MAX_SIZE)
+		throw SerializationError("decompressLZ: too large data");
+	if(packed_size > get_remaining_input(is))
+		throw SerializationError("decompressLZ: no enough input data");
+
+	std::string packed(packed_size, '\0');
+	if(packed_size != 0)
+		is.read(&packed[0], packed_size);
+	if(packed_size != 0 && (u32)is.gcount() != packed_size)
+		throw SerializationError("decompressLZ: no enough input data");
+
+	std::string out(size, '\0');
+	u8 *dst = (u8*)&out[0];
+	u32 o = 0;
+	const u8 *p = (const u8*)packed.c_str();
+	const u8 *end = p + packed_size;
+	while(p < end)
+	{
+		u8 token = *p++;
+		u32 literal_count = lz_read_length(p, end, token >> 4);
+		if(literal_count > (u32)(end - p) || literal_count > size - o)
+			throw SerializationError("decompressLZ: invalid literals");
+		memcpy(&dst[o], p, literal_count);
+		p += literal_count;
+		o += literal_count;
+		if(p == end)
+			break;
+
+		if(end - p < 2)
+			throw SerializationError("decompressLZ: truncated offset");
+		u16 offset = readU16((u8*)p);
+		p += 2;
+		u32 len = lz_read_length(p, end, token & 0x0f) + LZ_MIN_MATCH;
+		if(offset == 0 || offset > o || len > size - o)
+			throw SerializationError("decompressLZ: invalid match");
+		// Byte by byte; the source may overlap the destination
+		const u8 *m = &dst[o - offset];
+		for(u32 k=0; k<len; k++)
+			dst[o + k] = m[k];
+		o += len;
+	}
+	if(o != size)
+		throw SerializationError("decompressLZ: size mismatch");
+
+	os.write(out.c_str(), out.size());
+}
+
+void compressNone(SharedBuffer<u8> data, std::ostream &os)
+{
+	u8 tmp[4];
+	writeU32(tmp, data.getSize());
+	os.write((char*)tmp, 4);
+	os.write((char*)*data, data.getSize());
+}
+
+void decompressNone(std::istream &is, std::ostream &os)
+{
+	u8 tmp[4];
+	is.read((char*)tmp, 4);
+	if(is.gcount() != 4)
+		throw SerializationError("decompressNone: no enough input data");
+	u32 size = readU32(tmp);
+	if(size > get_remaining_input(is))
+		throw SerializationError("decompressNone: no enough input data");
+	std::string data(size, '\0');
+	if(size != 0)
+		is.read(&data[0], size);
+	if(size != 0 && (u32)is.gcount() != size)
+		throw SerializationError("decompressNone: no enough input data");
+	os.write(data.c_str(), size);
+}
+
 void compress(SharedBuffer<u8> data, std::ostream &os, u8 version)
 {
+	if(version >= 24)
+	{
+		u8 codec = g_compression_codec;
+		os.write((char*)&codec, 1);
+		if(codec == COMPRESSION_LZ)
+			compressLZ(data, os);
+		else if(codec == COMPRESSION_NONE)
+			compressNone(data, os);
+		else
+			compressZlib(data, os, g_zlib_level);
+		return;
+	}
+
 	if(version >= 11)
 	{
 		compressZlib(data, os);
@@ -238,6 +474,23 @@ void compress(SharedBuffer<u8> data, std::ostream &os, u8 version)
 
 void decompress(std::istream &is, std::ostream &os, u8 version)
 {
+	if(version >= 24)
+	{
+		u8 codec = 0;
+		is.read((char*)&codec, 1);
+		if(is.gcount() != 1)
+			throw SerializationError("decompress: no enough input data");
+		if(codec == COMPRESSION_ZLIB)
+			decompressZlib(is, os);
+		else if(codec == COMPRESSION_LZ)
+			decompressLZ(is, os);
+		else if(codec == COMPRESSION_NONE)
+			decompressNone(is, os);
+		else
+			throw SerializationError("decompress: unknown codec");
+		return;
+	}
+
 	if(version >= 11)
 	{
 		decompressZlib(is, os);
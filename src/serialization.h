@@ -57,11 +57,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	19: new content type handling
 	20: many existing content types translated to extended ones
 	21: dynamic content type allocation
+	22: uniform blocks stored as a single node (flag 0x10)
+	23: content types stored as a per-block palette and packed indices
+	24: compressed payloads are prefixed with a codec id
 */
 // This represents an uninitialized or invalid format
 #define SER_FMT_VER_INVALID 255
 // Highest supported serialization version
-#define SER_FMT_VER_HIGHEST 21
+#define SER_FMT_VER_HIGHEST 24
 // Lowest supported serialization version
 #define SER_FMT_VER_LOWEST 0
 
@@ -71,10 +74,36 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	Misc. serialization functions
 */
 
-void compressZlib(SharedBuffer<u8> data, std::ostream &os);
-void compressZlib(const std::string &data, std::ostream &os);
+/*
+	Codecs of compressed payloads in serialization version >= 24.
+	The id is written in front of each payload.
+*/
+enum CompressionCodec
+{
+	COMPRESSION_ZLIB = 0,
+	// LZ77 byte codec; larger output than zlib but many times faster
+	COMPRESSION_LZ = 1,
+	// Stored as-is, for data that is small enough already
+	COMPRESSION_NONE = 2,
+};
+
+// Sets the codec and zlib level compress() uses for version >= 24.
+// Defaults are zlib and level -1 (zlib's default).
+void setCompressionParams(CompressionCodec codec, int zlib_level);
+// Parses "zlib", "lz" or "none"; returns false if the name is unknown
+bool parseCompressionCodec(const std::string &name, CompressionCodec &codec);
+
+void compressZlib(SharedBuffer<u8> data, std::ostream &os, int level=-1);
+void compressZlib(const std::string &data, std::ostream &os, int level=-1);
 void decompressZlib(std::istream &is, std::ostream &os);
 
+void compressLZ(SharedBuffer<u8> data, std::ostream &os);
+void decompressLZ(std::istream &is, std::ostream &os);
+
+// u32 size followed by the data
+void compressNone(SharedBuffer<u8> data, std::ostream &os);
+void decompressNone(std::istream &is, std::ostream &os);
+
 // These choose between zlib and a self-made one according to version
 void compress(SharedBuffer<u8> data, std::ostream &os, u8 version);
 //void compress(const std::string &data, std::ostream &os, u8 version);
@@ -882,6 +882,14 @@ Server::Server(
 	JMutexAutoLock envlock(m_env_mutex);
 	JMutexAutoLock conlock(m_con_mutex);
 
+	// Block payload compression
+	CompressionCodec codec = COMPRESSION_ZLIB;
+	if(!parseCompressionCodec(g_settings->get("compression_codec"), codec))
+		errorstream<<"Unknown compression_codec \""
+				<<g_settings->get("compression_codec")
+				<<"\", using zlib"<<std::endl;
+	setCompressionParams(codec, g_settings->getS32("zlib_compression_level"));
+
 	// Path to builtin.lua
 	std::string builtinpath = porting::path_data + DIR_DELIM + "builtin.lua";
 
@@ -930,6 +938,9 @@ Server::Server(
 			throw ModError("Failed to load and run "+scriptpath);
 		}
 	}
+
+	// All nodes are registered now
+	m_nodedef->updateLiquidAlternatives();
 	
 	// Read Textures and calculate sha1 sums
 	PrepareTextures();
@@ -1307,6 +1318,14 @@ void Server::AsyncRunStep()
 
 		core::map<v3s16, MapBlock*> modified_blocks;
 		m_env->getMap().transformLiquids(modified_blocks);
+
+		// Flowing liquids don't dispatch map edit events
+		for(core::map<v3s16, MapBlock*>::Iterator
+				i = modified_blocks.getIterator();
+				i.atEnd() == false; i++)
+		{
+			m_env->wakeObjectsInBlock(i.getNode()->getKey());
+		}
 #if 0		
 		/*
 			Update lighting
@@ -1812,6 +1831,25 @@ void Server::AsyncRunStep()
 			m_env->saveMeta(m_mapsavedir);
 		}
 	}
+
+	/*
+		Collect Lua garbage now that the step is done, so that less
+		of it is left to be done in the middle of the next steps
+	*/
+	{
+		JMutexAutoLock lock(m_env_mutex);
+		{
+			ScopeProfiler sp(g_profiler, "Server: Lua GC idle step");
+			script_gc_idle_step(m_lua,
+					g_settings->getFloat("lua_gc_idle_step_time") * 1000000);
+		}
+		size_t used_bytes = 0;
+		size_t reserved_bytes = 0;
+		script_get_memory_usage(m_lua, &used_bytes, &reserved_bytes);
+		g_profiler->avg("Server: Lua memory (KiB)", used_bytes / 1024);
+		g_profiler->avg("Server: Lua allocator memory (KiB)",
+				reserved_bytes / 1024);
+	}
 }
 
 void Server::Receive()
@@ -3201,6 +3239,13 @@ void Server::ProcessData(u8 *data, u32 datasize, u16 peer_id)
 
 				m_env->getMap().removeNodeAndUpdate(p_under, modified_blocks);
 			}
+			// The ignored map edit event would have woken up objects
+			for(core::map<v3s16, MapBlock*>::Iterator
+					i = modified_blocks.getIterator();
+					i.atEnd() == false; i++)
+			{
+				m_env->wakeObjectsInBlock(i.getNode()->getKey());
+			}
 			/*
 				Set blocks not sent to far players
 			*/
@@ -3345,6 +3390,13 @@ void Server::ProcessData(u8 *data, u32 datasize, u16 peer_id)
 						std::string p_name = std::string(player->getName());
 						m_env->getMap().addNodeAndUpdate(p_above, n, modified_blocks, p_name);
 					}
+					// The ignored map edit event would have woken up objects
+					for(core::map<v3s16, MapBlock*>::Iterator
+							i = modified_blocks.getIterator();
+							i.atEnd() == false; i++)
+					{
+						m_env->wakeObjectsInBlock(i.getNode()->getKey());
+					}
 					/*
 						Set blocks not sent to far players
 					*/
@@ -20,6 +20,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "utility.h"
 #include "settings.h"
 #include "main.h" // For g_settings
+#include "scriptapi.h"
 
 #define PP(x) "("<<(x).X<<","<<(x).Y<<","<<(x).Z<<")"
 
@@ -362,6 +363,30 @@ void cmd_clearobjects(std::wostringstream &os,
 	ctx->flags |= SEND_TO_OTHERS;
 }
 
+void cmd_luaprofile(std::wostringstream &os,
+	ServerCommandContext *ctx)
+{
+	if((ctx->privs & PRIV_SERVER) ==0)
+	{
+		os<<L"-!- You don't have permission to do that";
+		return;
+	}
+
+	if(ctx->parms.size() >= 2 && ctx->parms[1] == L"clear")
+	{
+		scriptapi_clear_profile(ctx->server->getLua());
+		os<<L"-!- Lua profile cleared";
+		return;
+	}
+
+	std::ostringstream profile(std::ios_base::binary);
+	scriptapi_print_profile(ctx->server->getLua(), profile, 8);
+	if(profile.str() == "")
+		os<<L"-!- No Lua time recorded";
+	else
+		os<<L"-!- Lua time: "<<narrow_to_wide(profile.str());
+}
+
 
 std::wstring processServerCommand(ServerCommandContext *ctx)
 {
@@ -376,7 +401,7 @@ std::wstring processServerCommand(ServerCommandContext *ctx)
 		os<<L"-!- Available commands: ";
 		os<<L"me status privs";
 		if(privs & PRIV_SERVER)
-			os<<L" shutdown setting clearobjects";
+			os<<L" shutdown setting clearobjects luaprofile";
 		if(privs & PRIV_SETTIME)
 			os<<L" time";
 		if(privs & PRIV_TELEPORT)
@@ -410,6 +435,8 @@ std::wstring processServerCommand(ServerCommandContext *ctx)
 		cmd_me(os, ctx);
 	else if(ctx->parms[0] == L"clearobjects")
 		cmd_clearobjects(os, ctx);
+	else if(ctx->parms[0] == L"luaprofile")
+		cmd_luaprofile(os, ctx);
 	else
 		os<<L"-!- Invalid command: " + ctx->parms[0];
 	
@@ -60,6 +60,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "player.h"
 #include "main.h"
 #include "test.h"
+#include "benchmark.h"
 #include "environment.h"
 #include "server.h"
 #include "serialization.h"
@@ -212,6 +213,10 @@ int main(int argc, char *argv[])
 	allowed_options.insert("enable-unittests", ValueSpec(VALUETYPE_FLAG));
 	allowed_options.insert("map-dir", ValueSpec(VALUETYPE_STRING));
 	allowed_options.insert("info-on-stderr", ValueSpec(VALUETYPE_FLAG));
+	allowed_options.insert("benchmark-compression", ValueSpec(VALUETYPE_STRING,
+			"Compare block compression codecs on a map.sqlite and exit"));
+	allowed_options.insert("benchmark-luaentities", ValueSpec(VALUETYPE_STRING,
+			"Time stepping the given number of Lua entities and exit"));
 
 	Settings cmd_args;
 	
@@ -314,6 +319,18 @@ int main(int argc, char *argv[])
 		run_tests();
 	}
 
+	if(cmd_args.exists("benchmark-compression"))
+	{
+		run_compression_benchmark(cmd_args.get("benchmark-compression"));
+		return 0;
+	}
+
+	if(cmd_args.exists("benchmark-luaentities"))
+	{
+		run_luaentity_benchmark(cmd_args.getU16("benchmark-luaentities"));
+		return 0;
+	}
+
 	/*
 		Check parameters
 	*/
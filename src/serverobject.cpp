@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <fstream>
 #include "inventory.h"
 #include "tooldef.h"
+#include "mapblock.h"
 
 ServerActiveObject::ServerActiveObject(ServerEnvironment *env, v3f pos):
 	ActiveObject(0),
@@ -30,7 +31,8 @@ ServerActiveObject::ServerActiveObject(ServerEnvironment *env, v3f pos):
 	m_static_exists(false),
 	m_static_block(1337,1337,1337),
 	m_env(env),
-	m_base_position(pos)
+	m_base_position(pos),
+	m_sleeping(false)
 {
 }
 
@@ -38,6 +40,17 @@ ServerActiveObject::~ServerActiveObject()
 {
 }
 
+void ServerActiveObject::wakeUpIfInBlocks(core::map<v3s16, bool> &blocks)
+{
+	if(!m_sleeping)
+		return;
+	v3f pos = getBasePosition();
+	v3f below = pos - v3f(0, BS, 0);
+	if(blocks.find(getNodeBlockPos(floatToInt(pos, BS))) ||
+			blocks.find(getNodeBlockPos(floatToInt(below, BS))))
+		wakeUp();
+}
+
 ServerActiveObject* ServerActiveObject::create(u8 type,
 		ServerEnvironment *env, u16 id, v3f pos,
 		const std::string &data)
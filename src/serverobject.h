@@ -84,10 +84,10 @@ class ServerActiveObject : public ActiveObject
 	*/
 	
 	virtual void setPos(v3f pos)
-		{ setBasePosition(pos); }
+		{ setBasePosition(pos); wakeUp(); }
 	// continuous: if true, object does not stop immediately at pos
 	virtual void moveTo(v3f pos, bool continuous)
-		{ setBasePosition(pos); }
+		{ setBasePosition(pos); wakeUp(); }
 	// If object has moved less than this and data has not changed,
 	// saving to disk may be omitted
 	virtual float getMinimumSavedMovement()
@@ -108,6 +108,17 @@ class ServerActiveObject : public ActiveObject
 			packet.
 	*/
 	virtual void step(float dtime, bool send_recommended){}
+
+	/*
+		A sleeping object is not stepped. Objects put themselves to
+		sleep in step() when they are at rest, and are woken up by
+		anything that could move them: changes to the nodes around
+		them, being punched or having their properties set.
+	*/
+	bool isSleeping(){ return m_sleeping; }
+	void wakeUp(){ m_sleeping = false; }
+	// Wakes up if in or resting on a node of one of the blocks
+	void wakeUpIfInBlocks(core::map<v3s16, bool> &blocks);
 	
 	/*
 		The return value of this is passed to the client-side object
@@ -131,6 +142,13 @@ class ServerActiveObject : public ActiveObject
 	*/
 	virtual bool isStaticAllowed() const
 	{return true;}
+	/*
+		Return true in here if getStaticData() returns the same thing
+		over the whole life of the object. The environment then reuses
+		the stored copy instead of calling getStaticData() again.
+	*/
+	virtual bool hasConstantStaticData()
+	{return false;}
 	
 	// time_from_last_punch is used for lessening damage if punching fast
 	virtual void punch(ServerActiveObject *puncher,
@@ -202,8 +220,11 @@ class ServerActiveObject : public ActiveObject
 			const std::string &data);
 	static void registerType(u16 type, Factory f);
 
+	void goToSleep(){ m_sleeping = true; }
+
 	ServerEnvironment *m_env;
 	v3f m_base_position;
+	bool m_sleeping;
 
 private:
 	// Used for creating objects based on type
@@ -33,8 +33,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "content_mapnode.h"
 #include "nodedef.h"
 #include "mapsector.h"
+#include "mapblock.h"
 #include "settings.h"
 #include "log.h"
+#include "occlusion.h"
+#include "script.h"
+#include "activeobject.h"
+#include "serverobject.h"
+#include "collision.h"
+#include "gamedef.h"
 
 /*
 	Asserts that the exception occurs
@@ -212,6 +219,66 @@ struct TestCompress
 		}
 
 		}
+
+		{ // LZ codec and uncompressed
+
+		// Empty, short, runs (overlapping matches), repeated blocks
+		// and noise
+		u32 sizes[] = {0, 3, 300, 40000, 40000};
+		CompressionCodec codecs[] = {COMPRESSION_LZ, COMPRESSION_NONE};
+		for(u32 c=0; c<2; c++)
+		for(u32 t=0; t<sizeof(sizes)/sizeof(sizes[0]); t++)
+		{
+			SharedBuffer<u8> fromdata(sizes[t]);
+			for(u32 i=0; i<sizes[t]; i++)
+			{
+				if(t == 2)
+					fromdata[i] = (i < 200) ? 7 : i;
+				else if(t == 3)
+					fromdata[i] = (i % 4096) / 3;
+				else
+					fromdata[i] = myrand();
+			}
+
+			setCompressionParams(codecs[c], -1);
+			std::ostringstream os(std::ios_base::binary);
+			compress(fromdata, os, SER_FMT_VER_HIGHEST);
+			setCompressionParams(COMPRESSION_ZLIB, -1);
+			// Data after the payload must be left in the stream
+			os<<"end";
+
+			std::istringstream is(os.str(), std::ios_base::binary);
+			std::ostringstream os2(std::ios_base::binary);
+			decompress(is, os2, SER_FMT_VER_HIGHEST);
+			std::string str_out2 = os2.str();
+			assert(str_out2.size() == fromdata.getSize());
+			for(u32 i=0; i<str_out2.size(); i++)
+				assert((u8)str_out2[i] == fromdata[i]);
+			std::string rest;
+			is>>rest;
+			assert(rest == "end");
+			if(t == 3 && codecs[c] == COMPRESSION_LZ)
+				assert(os.str().size() < sizes[t] / 10);
+		}
+
+		// Sizes in the header that can't be right are rejected
+		// before anything is allocated
+		u32 headers[][2] = {{0xffffffff, 4}, {100, 0xffffff00}};
+		for(u32 t=0; t<2; t++)
+		{
+			u8 buf[13];
+			buf[0] = COMPRESSION_LZ;
+			writeU32(&buf[1], headers[t][0]);
+			writeU32(&buf[5], headers[t][1]);
+			writeU32(&buf[9], 0);
+			std::istringstream is(std::string((char*)buf, 13),
+					std::ios_base::binary);
+			std::ostringstream os2(std::ios_base::binary);
+			EXCEPTION_CHECK(SerializationError,
+					decompress(is, os2, SER_FMT_VER_HIGHEST));
+		}
+
+		}
 	}
 };
 
@@ -231,6 +298,16 @@ struct TestMapNode
 		assert(nodedef->get(n).light_propagates == true);
 		n.setContent(LEGN(nodedef, "CONTENT_STONE"));
 		assert(nodedef->get(n).light_propagates == false);
+
+		// Fast lookup tables agree with the definitions
+		for(u16 c=0; c<=MAX_CONTENT; c++){
+			const ContentFeatures &f = nodedef->get(c);
+			assert(nodedef->lightPropagates(c) == f.light_propagates);
+			assert(nodedef->sunlightPropagates(c) == f.sunlight_propagates);
+			assert(nodedef->walkable(c) == f.walkable);
+			assert(nodedef->liquidType(c) == f.liquid_type);
+			assert(nodedef->lightSource(c) == f.light_source);
+		}
 	}
 };
 
@@ -303,6 +380,23 @@ struct TestVoxelManipulator
 
 		assert(v.getNode(v3s16(-1,0,-1)).getContent() == 2);
 		EXCEPTION_CHECK(InvalidPositionException, v.getNode(v3s16(0,1,1)));
+
+		/*
+			Exception-free access
+		*/
+
+		bool is_valid_position = false;
+		MapNode n = v.getNodeNoEx(v3s16(-1,0,-1), &is_valid_position);
+		assert(is_valid_position);
+		assert(n.getContent() == 2);
+
+		n = v.getNodeNoEx(v3s16(0,1,1), &is_valid_position);
+		assert(!is_valid_position);
+		assert(n.getContent() == CONTENT_IGNORE);
+
+		n = v.getNodeNoExNoEmerge(v3s16(100,100,100), &is_valid_position);
+		assert(!is_valid_position);
+		assert(n.getContent() == CONTENT_IGNORE);
 	}
 };
 
@@ -637,6 +731,513 @@ struct TestMapSector
 };
 #endif
 
+struct TestMapBlockSerialization
+{
+	void fill(MapBlock &b, INodeDefManager *nodedef)
+	{
+		for(s16 z=0; z<MAP_BLOCKSIZE; z++)
+		for(s16 y=0; y<MAP_BLOCKSIZE; y++)
+		for(s16 x=0; x<MAP_BLOCKSIZE; x++)
+		{
+			MapNode n(CONTENT_AIR, (x+y)&0xff, z);
+			if(y < 5)
+				n.setContent(LEGN(nodedef, "CONTENT_STONE"));
+			else if(y == 5)
+				n.setContent(0x800 + x); // Extended content type
+			b.setNode(x, y, z, n);
+		}
+	}
+	void check(MapBlock &b, INodeDefManager *nodedef)
+	{
+		MapBlock ref(NULL, v3s16(0,0,0), NULL);
+		fill(ref, nodedef);
+		for(s16 z=0; z<MAP_BLOCKSIZE; z++)
+		for(s16 y=0; y<MAP_BLOCKSIZE; y++)
+		for(s16 x=0; x<MAP_BLOCKSIZE; x++)
+		{
+			MapNode n1 = b.getNode(x, y, z);
+			MapNode n2 = ref.getNode(x, y, z);
+			assert(n1.getContent() == n2.getContent());
+			assert(n1.getParam1() == n2.getParam1());
+			assert(n1.getParam2() == n2.getParam2());
+		}
+	}
+	void Run(INodeDefManager *nodedef)
+	{
+		u8 versions[] = {SER_FMT_VER_HIGHEST, 22, 19};
+		for(u32 i=0; i<sizeof(versions)/sizeof(versions[0]); i++)
+		{
+			MapBlock b(NULL, v3s16(0,0,0), NULL);
+			fill(b, nodedef);
+			check(b, nodedef);
+
+			std::ostringstream os(std::ios_base::binary);
+			b.serialize(os, versions[i]);
+
+			MapBlock b2(NULL, v3s16(0,0,0), NULL);
+			std::istringstream is(os.str(), std::ios_base::binary);
+			b2.deSerialize(is, versions[i]);
+			check(b2, nodedef);
+		}
+
+		/*
+			Uniform blocks
+		*/
+		for(u32 i=0; i<sizeof(versions)/sizeof(versions[0]); i++)
+		{
+			MapNode stone(LEGN(nodedef, "CONTENT_STONE"), 0x0f, 3);
+			MapBlock b(NULL, v3s16(0,0,0), NULL);
+			assert(b.isUniform());
+			assert(b.getNode(1,2,3).getContent() == CONTENT_IGNORE);
+			b.fill(stone);
+			// Writing the same node keeps the block compact
+			b.setNode(1, 2, 3, stone);
+			assert(b.isUniform());
+
+			std::ostringstream os(std::ios_base::binary);
+			b.serialize(os, versions[i]);
+
+			MapBlock b2(NULL, v3s16(0,0,0), NULL);
+			std::istringstream is(os.str(), std::ios_base::binary);
+			b2.deSerialize(is, versions[i]);
+			assert(b2.isUniform());
+			MapNode n = b2.getNode(15, 0, 7);
+			assert(n.getContent() == stone.getContent());
+			assert(n.getParam1() == 0x0f);
+			assert(n.getParam2() == 3);
+
+			// Writing a different node materializes it
+			MapNode air(CONTENT_AIR);
+			b2.setNode(0, 0, 0, air);
+			assert(!b2.isUniform());
+			assert(b2.getNode(0,0,0).getContent() == CONTENT_AIR);
+			assert(b2.getNode(1,0,0).getContent() == stone.getContent());
+			b2.setNode(0, 0, 0, stone);
+			assert(b2.compactIfUniform());
+		}
+
+		/*
+			Small palettes pack several indices per byte
+		*/
+		{
+			MapBlock b(NULL, v3s16(0,0,0), NULL);
+			content_t contents[3] = {CONTENT_AIR,
+					LEGN(nodedef, "CONTENT_STONE"), 0x801};
+			for(s16 z=0; z<MAP_BLOCKSIZE; z++)
+			for(s16 y=0; y<MAP_BLOCKSIZE; y++)
+			for(s16 x=0; x<MAP_BLOCKSIZE; x++)
+			{
+				MapNode n(contents[(x+y*3+z)%3], x, z);
+				b.setNode(x, y, z, n);
+			}
+			std::vector<content_t> palette;
+			b.getContentPalette(palette);
+			assert(palette.size() == 3);
+			assert(palette[0] == CONTENT_AIR);
+
+			std::ostringstream os(std::ios_base::binary);
+			b.serialize(os, SER_FMT_VER_HIGHEST);
+			MapBlock b2(NULL, v3s16(0,0,0), NULL);
+			std::istringstream is(os.str(), std::ios_base::binary);
+			b2.deSerialize(is, SER_FMT_VER_HIGHEST);
+			for(s16 z=0; z<MAP_BLOCKSIZE; z++)
+			for(s16 y=0; y<MAP_BLOCKSIZE; y++)
+			for(s16 x=0; x<MAP_BLOCKSIZE; x++)
+			{
+				MapNode n = b2.getNode(x, y, z);
+				assert(n.getContent() == contents[(x+y*3+z)%3]);
+				assert(n.getParam1() == x);
+				assert(n.getParam2() == b.getNode(x, y, z).getParam2());
+			}
+		}
+	}
+};
+
+struct TestMapBlockSnapshot
+{
+	void Run()
+	{
+		MapBlock b(NULL, v3s16(0,0,0), NULL);
+		MapNode air(CONTENT_AIR);
+		b.fill(air);
+
+		// Unchanged blocks share one snapshot
+		MapBlockSnapshot *s1 = b.getSnapshot();
+		MapBlockSnapshot *s2 = b.getSnapshot();
+		assert(s1 == s2);
+		assert(s1->getNodeNoCheck(v3s16(3,4,5)).getContent() == CONTENT_AIR);
+
+		// Writing makes a new one and leaves the old one as it was
+		MapNode n(CONTENT_AIR, 0x0f, 0x80);
+		b.setNode(v3s16(3,4,5), n);
+		MapBlockSnapshot *s3 = b.getSnapshot();
+		assert(s3 != s1);
+		assert(s1->getNodeNoCheck(v3s16(3,4,5)).getParam1() == 0);
+		assert(s3->getNodeNoCheck(v3s16(3,4,5)).getParam1() == 0x0f);
+		assert(s3->getNodeNoCheck(v3s16(3,4,5)).getParam2() == 0x80);
+		assert(s3->getNodeNoCheck(v3s16(0,0,0)).getParam1() == 0);
+
+		// Snapshots outlive the block
+		s1->drop();
+		s2->drop();
+		MapBlock *b2 = new MapBlock(NULL, v3s16(0,0,0), NULL);
+		b2->fill(n);
+		MapBlockSnapshot *s4 = b2->getSnapshot();
+		delete b2;
+		assert(s4->getNodeNoCheck(v3s16(15,15,15)).getParam1() == 0x0f);
+		s4->drop();
+		s3->drop();
+
+		// Dummy blocks have no snapshot
+		MapBlock dummy(NULL, v3s16(0,0,0), NULL, true);
+		assert(dummy.getSnapshot() == NULL);
+	}
+};
+
+struct TestOcclusion
+{
+	void Run(INodeDefManager *nodedef)
+	{
+		MapNode air(CONTENT_AIR);
+		MapNode stone(LEGN(nodedef, "CONTENT_STONE"));
+
+		/*
+			Face connectivity
+		*/
+
+		MapBlock b(NULL, v3s16(0,0,0), NULL);
+		b.fill(air);
+		MapBlockSnapshot *s = b.getSnapshot();
+		FaceConnectivity c_air = getFaceConnectivity(s, nodedef);
+		s->drop();
+		assert(c_air.connects(0, 3));
+		assert(c_air.connects(2, 4));
+
+		b.fill(stone);
+		s = b.getSnapshot();
+		FaceConnectivity c_stone = getFaceConnectivity(s, nodedef);
+		s->drop();
+		for(u8 i=0; i<6; i++)
+			assert(c_stone.connects(i, (i+3)%6) == false);
+
+		// A tunnel going from left to right
+		for(s16 x=0; x<MAP_BLOCKSIZE; x++)
+			b.setNode(v3s16(x,5,5), air);
+		s = b.getSnapshot();
+		FaceConnectivity c_tunnel = getFaceConnectivity(s, nodedef);
+		s->drop();
+		assert(c_tunnel.connects(2, 5));
+		assert(c_tunnel.connects(0, 3) == false);
+		assert(c_tunnel.connects(1, 5) == false);
+
+		/*
+			Visibility search along the X axis:
+			camera, tunnel, air, stone, air
+		*/
+
+		OcclusionGrid grid;
+		grid.setBlock(v3s16(0,0,0), c_air);
+		grid.setBlock(v3s16(1,0,0), c_tunnel);
+		grid.setBlock(v3s16(2,0,0), c_air);
+		grid.setBlock(v3s16(3,0,0), c_stone);
+		grid.setBlock(v3s16(4,0,0), c_air);
+		// Next to the tunnel and its end
+		grid.setBlock(v3s16(1,0,1), c_stone);
+		grid.setBlock(v3s16(2,0,1), c_air);
+		assert(grid.setBlock(v3s16(2,0,1), c_air) == false);
+
+		core::map<v3s16, bool> visible;
+		grid.findVisibleBlocks(v3s16(0,0,0), v3s16(-10,-10,-10),
+				v3s16(10,10,10), visible);
+		assert(visible.find(v3s16(1,0,0)) != NULL);
+		assert(visible.find(v3s16(2,0,0)) != NULL);
+		assert(visible.find(v3s16(3,0,0)) != NULL);
+		assert(visible.find(v3s16(4,0,0)) == NULL);
+		// Seen from the end of the tunnel
+		assert(visible.find(v3s16(2,0,1)) != NULL);
+		// Next to the tunnel, would need turning back towards the camera
+		assert(visible.find(v3s16(1,0,1)) == NULL);
+
+		// Opening the stone block makes the last one visible
+		grid.setBlock(v3s16(3,0,0), c_tunnel);
+		visible.clear();
+		grid.findVisibleBlocks(v3s16(0,0,0), v3s16(-10,-10,-10),
+				v3s16(10,10,10), visible);
+		assert(visible.find(v3s16(4,0,0)) != NULL);
+
+		// The range limits the search
+		visible.clear();
+		grid.findVisibleBlocks(v3s16(0,0,0), v3s16(-10,-10,-10),
+				v3s16(2,10,10), visible);
+		assert(visible.find(v3s16(2,0,0)) != NULL);
+		assert(visible.find(v3s16(3,0,0)) == NULL);
+	}
+};
+
+struct TestScriptAllocator
+{
+	void Run()
+	{
+		ScriptAllocator a;
+		const u32 count = 1000;
+		u8 *blocks[count];
+		size_t sizes[count];
+
+		// Small and big blocks, filled with a pattern
+		for(u32 i=0; i<count; i++)
+		{
+			sizes[i] = 1 + (i * 37) % 400;
+			blocks[i] = (u8*)a.reallocate(NULL, 0, sizes[i]);
+			assert(blocks[i] != NULL);
+			memset(blocks[i], i & 0xff, sizes[i]);
+		}
+		assert(a.getUsedBytes() > 0);
+		assert(a.getReservedBytes() >= a.getUsedBytes());
+
+		// Resize inside a class, between classes and to big blocks
+		for(u32 i=0; i<count; i+=3)
+		{
+			size_t nsize = 1 + (i * 53) % 600;
+			blocks[i] = (u8*)a.reallocate(blocks[i], sizes[i], nsize);
+			assert(blocks[i] != NULL);
+			size_t kept = sizes[i] < nsize ? sizes[i] : nsize;
+			for(size_t j=0; j<kept; j++)
+				assert(blocks[i][j] == (i & 0xff));
+			memset(blocks[i], i & 0xff, nsize);
+			sizes[i] = nsize;
+		}
+
+		// Nothing was overwritten by other blocks
+		for(u32 i=0; i<count; i++)
+		{
+			for(size_t j=0; j<sizes[i]; j++)
+				assert(blocks[i][j] == (i & 0xff));
+		}
+
+		for(u32 i=0; i<count; i++)
+			assert(a.reallocate(blocks[i], sizes[i], 0) == NULL);
+		assert(a.getUsedBytes() == 0);
+
+		// Freed small blocks are used again
+		size_t reserved = a.getReservedBytes();
+		for(u32 i=0; i<100; i++)
+			blocks[i] = (u8*)a.reallocate(NULL, 0, 24);
+		assert(a.getReservedBytes() == reserved);
+		for(u32 i=0; i<100; i++)
+			a.reallocate(blocks[i], 24, 0);
+	}
+};
+
+struct TestGlobalstepScheduler
+{
+	// Runs a step, going over the budget after budget_count globalsteps
+	std::string step(GlobalstepScheduler &s, u32 count, u32 budget_count,
+			float *dtimes)
+	{
+		std::string order;
+		s.beginStep(count, 0.1);
+		u32 i;
+		float dtime;
+		while(s.next(order.size() >= budget_count, &i, &dtime))
+		{
+			order += '0' + i;
+			dtimes[i] = dtime;
+		}
+		return order;
+	}
+
+	void Run()
+	{
+		GlobalstepScheduler s;
+		float dtimes[5];
+
+		assert(step(s, 5, 5, dtimes) == "01234");
+		assert(s.overran() == false);
+
+		// Out of time: the rest of the pass runs on the next step and
+		// the pass after that is in registration order again
+		assert(step(s, 5, 3, dtimes) == "012");
+		assert(s.overran());
+		assert(step(s, 5, 5, dtimes) == "34");
+		assert(s.overran() == false);
+		assert(fabs(dtimes[3] - 0.2) < 0.001);
+		assert(step(s, 5, 5, dtimes) == "01234");
+		assert(fabs(dtimes[0] - 0.2) < 0.001);
+		assert(fabs(dtimes[4] - 0.1) < 0.001);
+
+		// At least one is run on every step
+		assert(step(s, 5, 0, dtimes) == "0");
+		assert(step(s, 5, 0, dtimes) == "1");
+		assert(step(s, 5, 5, dtimes) == "234");
+
+		// Globalsteps removed in the middle of a pass
+		assert(step(s, 5, 4, dtimes) == "0123");
+		assert(step(s, 3, 5, dtimes) == "012");
+	}
+};
+
+struct TestActiveObjectMap
+{
+	void Run()
+	{
+		ActiveObjectMap<int> m;
+		int objects[10];
+
+		for(u32 i=0; i<10; i++)
+		{
+			u16 id = m.getFreeId();
+			assert(id == i + 1);
+			assert(m.insert(id, &objects[i]));
+		}
+		assert(m.size() == 10);
+		assert(m.get(0) == NULL);
+		assert(m.get(5) == &objects[4]);
+		assert(m.get(11) == NULL);
+		assert(m.insert(5, &objects[0]) == false);
+
+		// Removing keeps the others found and iterable
+		u16 generation = m.getGeneration(3);
+		m.remove(3);
+		m.remove(7);
+		assert(m.size() == 8);
+		assert(m.get(3) == NULL);
+		assert(m.get(3, generation) == NULL);
+		for(u32 i=0; i<m.size(); i++)
+			assert(m.get(m.getIdAt(i)) == m.getAt(i));
+
+		// Removed ids are reused in order, with a new generation
+		u16 id = m.getFreeId();
+		assert(id == 3);
+		assert(m.insert(id, &objects[2]));
+		assert(m.get(3, generation) == NULL);
+		assert(m.get(3, m.getGeneration(3)) == &objects[2]);
+
+		// A supplied id is not handed out again
+		assert(m.insert(7, &objects[6]));
+		assert(m.getFreeId() == 11);
+	}
+};
+
+struct TestAddNodes
+{
+	class EventCollector : public MapEventReceiver
+	{
+	public:
+		EventCollector():
+			event_count(0)
+		{}
+		void onMapEditEvent(MapEditEvent *event)
+		{
+			assert(event->type == MEET_OTHER);
+			event_count++;
+			for(core::map<v3s16, bool>::Iterator
+					i = event->modified_blocks.getIterator();
+					i.atEnd() == false; i++)
+			{
+				modified_blocks.insert(i.getNode()->getKey(), true);
+			}
+		}
+		u32 event_count;
+		core::map<v3s16, bool> modified_blocks;
+	};
+
+	void Run(IWritableNodeDefManager *nodedef)
+	{
+		TestGameDef gamedef(nodedef);
+		TestMap map(&gamedef);
+		map.createBlocks(v3s16(-1,-1,-1), v3s16(1,1,1));
+		EventCollector collector;
+		map.addEventReceiver(&collector);
+
+		// Across the borders of the blocks (-1,0,0), (0,0,0) and
+		// (1,0,0), and one in a block that is not loaded
+		content_t stone = LEGN(nodedef, "CONTENT_STONE");
+		core::map<v3s16, MapNode> nodes;
+		nodes.insert(v3s16(-1,5,3), MapNode(stone));
+		nodes.insert(v3s16(0,5,3), MapNode(stone));
+		nodes.insert(v3s16(15,5,3), MapNode(stone));
+		nodes.insert(v3s16(16,5,3), MapNode(stone));
+		nodes.insert(v3s16(100,5,3), MapNode(stone));
+		assert(map.addNodesWithEvent(nodes) == 4);
+
+		assert(map.getNode(v3s16(-1,5,3)).getContent() == stone);
+		assert(map.getNode(v3s16(0,5,3)).getContent() == stone);
+		assert(map.getNode(v3s16(15,5,3)).getContent() == stone);
+		assert(map.getNode(v3s16(16,5,3)).getContent() == stone);
+		assert(map.getNode(v3s16(1,5,3)).getContent() == CONTENT_AIR);
+		// The stone casts a shadow
+		assert(map.getNode(v3s16(0,4,3)).getLight(LIGHTBANK_DAY, nodedef)
+				!= LIGHT_SUN);
+
+		// One event with every written block, and only loaded ones
+		assert(collector.event_count == 1);
+		assert(collector.modified_blocks.find(v3s16(-1,0,0)));
+		assert(collector.modified_blocks.find(v3s16(0,0,0)));
+		assert(collector.modified_blocks.find(v3s16(1,0,0)));
+		for(core::map<v3s16, bool>::Iterator
+				i = collector.modified_blocks.getIterator();
+				i.atEnd() == false; i++)
+		{
+			assert(map.getBlockNoCreateNoEx(i.getNode()->getKey()));
+		}
+
+		map.removeEventReceiver(&collector);
+	}
+};
+
+struct TestObjectWaking
+{
+	class TestObject : public ServerActiveObject
+	{
+	public:
+		TestObject(v3f pos):
+			ServerActiveObject(NULL, pos)
+		{}
+		u8 getType() const
+			{ return ACTIVEOBJECT_TYPE_INVALID; }
+		void sleep()
+			{ goToSleep(); }
+	};
+
+	void Run(IWritableNodeDefManager *nodedef)
+	{
+		TestGameDef gamedef(nodedef);
+		TestMap map(&gamedef);
+		map.createBlocks(v3s16(-1,-1,-1), v3s16(1,1,1));
+
+		// Resting on the node (5,-1,5) and far away from it
+		TestObject resting(v3f(5*BS, -0.4*BS, 5*BS));
+		TestObject far(v3f(-12*BS, 12*BS, -12*BS));
+		resting.sleep();
+		far.sleep();
+
+		core::map<v3s16, bool> wake_blocks;
+		resting.wakeUpIfInBlocks(wake_blocks);
+		assert(resting.isSleeping());
+
+		// Dig the node below the object like the server does
+		core::map<v3s16, MapBlock*> modified_blocks;
+		map.removeNodeAndUpdate(v3s16(5,-1,5), modified_blocks);
+		assert(map.getNode(v3s16(5,-1,5)).getContent() == CONTENT_AIR);
+		for(core::map<v3s16, MapBlock*>::Iterator
+				i = modified_blocks.getIterator();
+				i.atEnd() == false; i++)
+		{
+			wake_blocks.insert(i.getNode()->getKey(), true);
+		}
+		resting.wakeUpIfInBlocks(wake_blocks);
+		far.wakeUpIfInBlocks(wake_blocks);
+		assert(!resting.isSleeping());
+		assert(far.isSleeping());
+
+		// Objects don't sleep on unloaded nodes, which collide too
+		core::aabbox3d<f32> box(-BS/3.,0.0,-BS/3., BS/3.,BS*2./3.,BS/3.);
+		assert(isGroundLoaded(&map, box, v3f(5*BS, -0.4*BS, 5*BS)));
+		assert(!isGroundLoaded(&map, box, v3f(5*BS, -16.4*BS, 5*BS)));
+		assert(!isGroundLoaded(&map, box, v3f(31.5*BS, -0.4*BS, 5*BS)));
+	}
+};
+
 struct TestSocket
 {
 	void Run()
@@ -1096,6 +1697,14 @@ void run_tests()
 	TEST(TestCompress);
 	TESTPARAMS(TestMapNode, nodedef);
 	TESTPARAMS(TestVoxelManipulator, nodedef);
+	TESTPARAMS(TestMapBlockSerialization, nodedef);
+	TEST(TestMapBlockSnapshot);
+	TESTPARAMS(TestOcclusion, nodedef);
+	TEST(TestScriptAllocator);
+	TEST(TestGlobalstepScheduler);
+	TEST(TestActiveObjectMap);
+	TESTPARAMS(TestAddNodes, nodedef);
+	TESTPARAMS(TestObjectWaking, nodedef);
 	//TEST(TestMapBlock);
 	//TEST(TestMapSector);
 	if(INTERNET_SIMULATOR == false){
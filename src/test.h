@@ -20,7 +20,87 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #ifndef TEST_HEADER
 #define TEST_HEADER
 
+#include "common_irrlicht.h"
+#include "debug.h"
+#include "gamedef.h"
+#include "nodedef.h"
+#include "map.h"
+#include "mapsector.h"
+#include "mapblock.h"
+#include "content_mapnode.h"
+
 void run_tests();
 
-#endif
+/*
+	Game definitions and an in-memory map for the tests and benchmarks
+	that work on a Map without a Server or Client
+*/
+class TestGameDef : public IGameDef
+{
+public:
+	TestGameDef(IWritableNodeDefManager *ndef, ITextureSource *tsrc=NULL):
+		m_ndef(ndef),
+		m_tsrc(tsrc)
+	{}
+	virtual IToolDefManager* getToolDefManager()
+		{ return NULL; }
+	virtual INodeDefManager* getNodeDefManager()
+		{ return m_ndef; }
+	virtual ICraftDefManager* getCraftDefManager()
+		{ return NULL; }
+	virtual ICraftItemDefManager* getCraftItemDefManager()
+		{ return NULL; }
+	virtual ITextureSource* getTextureSource()
+		{ return m_tsrc; }
+	virtual u16 allocateUnknownNodeId(const std::string &name)
+		{ return m_ndef->allocateDummy(name); }
+private:
+	IWritableNodeDefManager *m_ndef;
+	ITextureSource *m_tsrc;
+};
+
+class TestMap : public Map
+{
+public:
+	TestMap(IGameDef *gamedef):
+		Map(dstream, gamedef)
+	{}
+	// Adds a block created outside, eg. loaded from a database
+	void insertBlock(MapBlock *block)
+	{
+		v3s16 p = block->getPos();
+		getOrCreateSector(v2s16(p.X, p.Z))->insertBlock(block);
+	}
+	// Creates the blocks from blockpos0 to blockpos1, stone below y=0
+	// and air above
+	void createBlocks(v3s16 blockpos0, v3s16 blockpos1)
+	{
+		content_t stone = LEGN(m_gamedef->ndef(), "CONTENT_STONE");
+		for(s16 z=blockpos0.Z; z<=blockpos1.Z; z++)
+		for(s16 x=blockpos0.X; x<=blockpos1.X; x++)
+		{
+			MapSector *sector = getOrCreateSector(v2s16(x, z));
+			for(s16 y=blockpos0.Y; y<=blockpos1.Y; y++)
+			{
+				MapBlock *block = sector->createBlankBlock(y);
+				if(y < 0)
+					block->fill(MapNode(stone));
+				else
+					block->fill(MapNode(CONTENT_AIR, LIGHT_SUN));
+			}
+		}
+	}
+private:
+	MapSector * getOrCreateSector(v2s16 p2d)
+	{
+		MapSector *sector = getSectorNoGenerateNoEx(p2d);
+		if(sector == NULL)
+		{
+			sector = new ServerMapSector(this, p2d, m_gamedef);
+			m_sectors.insert(p2d, sector);
+		}
+		return sector;
+	}
+};
 
+#endif
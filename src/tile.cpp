@@ -25,11 +25,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "mesh.h"
 #include <ICameraSceneNode.h>
+#include <iomanip>
+#include <cstdio> // For remove()
 #include "log.h"
 #include "mapnode.h" // For texture atlas making
 #include "mineral.h" // For texture atlas making
 #include "nodedef.h" // For texture atlas making
 #include "gamedef.h"
+#include "sha1.h" // For the texture atlas cache
 
 /*
 	A cache from texture name to texture path
@@ -176,6 +179,20 @@ struct SourceAtlasPointer
 	}
 };
 
+/*
+	Where a texture is in the main atlas.
+
+	A list of these is stored in the atlas cache along with the atlas
+	image.
+*/
+struct AtlasCacheEntry
+{
+	std::string name;
+	v2s32 pos;
+	core::dimension2d<u32> dim;
+	u16 tiled;
+};
+
 /*
 	SourceImageCache: A cache used for storing source images.
 */
@@ -337,6 +354,12 @@ class TextureSource : public IWritableTextureSource
 		return ap.atlas;
 	}
 
+	/*
+		Returns the average color of the opaque pixels of a texture.
+		The alpha is 0 if the texture has no image or is transparent.
+	*/
+	video::SColor getTextureAverageColor(u32 id);
+
 	// Update new texture pointer and texture coordinates to an
 	// AtlasPointer based on it's texture id
 	void updateAP(AtlasPointer &ap);
@@ -356,8 +379,19 @@ class TextureSource : public IWritableTextureSource
 	// Build the main texture atlas which contains most of the
 	// textures.
 	void buildMainAtlas(class IGameDef *gamedef);
+
+	// Makes buildMainAtlas() store the atlas in dir and reuse it
+	// when the set of textures in it is the same.
+	// textures_digest has to change when any source image changes.
+	void setAtlasCache(const std::string &dir,
+			const std::string &textures_digest);
 	
 private:
+	// Adds an AtlasPointer to a texture in the main atlas.
+	// m_atlaspointer_cache_mutex has to be locked.
+	void addMainAtlasPointer(const AtlasCacheEntry &e,
+			video::IImage *atlas_img);
+	
 	
 	// The id of the thread that is allowed to use irrlicht directly
 	threadid_t m_main_thread;
@@ -382,6 +416,10 @@ class TextureSource : public IWritableTextureSource
 
 	// Queued texture fetches (to be processed by the main thread)
 	RequestQueue<std::string, u32, u8, u8> m_get_texture_queue;
+
+	// Main texture atlas cache; not used if empty
+	std::string m_atlas_cache_dir;
+	std::string m_atlas_cache_digest;
 };
 
 IWritableTextureSource* createTextureSource(IrrlichtDevice *device)
@@ -688,6 +726,35 @@ std::string TextureSource::getTextureName(u32 id)
 	return m_atlaspointer_cache[id].name;
 }
 
+video::SColor TextureSource::getTextureAverageColor(u32 id)
+{
+	JMutexAutoLock lock(m_atlaspointer_cache_mutex);
+
+	if(id >= m_atlaspointer_cache.size())
+		return video::SColor(0,0,0,0);
+	
+	SourceAtlasPointer &sap = m_atlaspointer_cache[id];
+	if(sap.atlas_img == NULL)
+		return video::SColor(0,0,0,0);
+
+	u32 r = 0, g = 0, b = 0, count = 0;
+	for(u32 y=0; y<sap.intsize.Y; y++)
+	for(u32 x=0; x<sap.intsize.X; x++)
+	{
+		video::SColor c = sap.atlas_img->getPixel(
+				sap.intpos.X + x, sap.intpos.Y + y);
+		// Leave out the holes of things like leaves
+		if(c.getAlpha() < 128)
+			continue;
+		r += c.getRed();
+		g += c.getGreen();
+		b += c.getBlue();
+		count++;
+	}
+	if(count == 0)
+		return video::SColor(0,0,0,0);
+	return video::SColor(255, r / count, g / count, b / count);
+}
 
 AtlasPointer TextureSource::getTexture(u32 id)
 {
@@ -778,6 +845,259 @@ void TextureSource::rebuildImagesAndTextures()
 	}
 }
 
+void TextureSource::setAtlasCache(const std::string &dir,
+		const std::string &textures_digest)
+{
+	m_atlas_cache_dir = dir;
+	m_atlas_cache_digest = textures_digest;
+}
+
+void TextureSource::addMainAtlasPointer(const AtlasCacheEntry &e,
+		video::IImage *atlas_img)
+{
+	core::dimension2d<u32> atlas_dim = atlas_img->getDimension();
+
+	bool reuse_old_id = false;
+	u32 id = m_atlaspointer_cache.size();
+	// Check old id without fetching a texture
+	core::map<std::string, u32>::Node *n;
+	n = m_name_to_id.find(e.name);
+	// If it exists, we will replace the old definition
+	if(n){
+		id = n->getValue();
+		reuse_old_id = true;
+		/*infostream<<"TextureSource::buildMainAtlas(): "
+				<<"Replacing old AtlasPointer"<<std::endl;*/
+	}
+
+	// Create AtlasPointer
+	AtlasPointer ap(id);
+	ap.atlas = NULL; // Set on the second pass
+	ap.pos = v2f((float)e.pos.X/(float)atlas_dim.Width,
+			(float)e.pos.Y/(float)atlas_dim.Height);
+	ap.size = v2f((float)e.dim.Width/(float)atlas_dim.Width,
+			(float)e.dim.Width/(float)atlas_dim.Height);
+	ap.tiled = e.tiled;
+
+	// Create SourceAtlasPointer and add to containers
+	SourceAtlasPointer nap(e.name, ap, atlas_img, e.pos, e.dim);
+	if(reuse_old_id)
+		m_atlaspointer_cache[id] = nap;
+	else
+		m_atlaspointer_cache.push_back(nap);
+	m_name_to_id[e.name] = id;
+}
+
+/*
+	Texture atlas cache.
+
+	<name>.png is the atlas image and <name>.atlas tells where the
+	textures are in it:
+		u8 version (1)
+		u32 number of textures
+		for each texture:
+			u16 length of name
+			string name
+			s32 x, s32 y, u32 width, u32 height
+			u16 x-wise tiling count
+*/
+static bool readAtlasCache(const std::string &cache_name,
+		video::IVideoDriver *driver, core::dimension2d<u32> atlas_dim,
+		video::IImage **img, core::list<AtlasCacheEntry> &entries)
+{
+	std::ifstream is((cache_name + ".atlas").c_str(), std::ios_base::binary);
+	if(is.good() == false)
+		return false;
+
+	core::list<AtlasCacheEntry> read_entries;
+	try
+	{
+		u8 version = readU8(is);
+		if(version != 1)
+			return false;
+		u32 count = readU32(is);
+		for(u32 i=0; i<count; i++)
+		{
+			AtlasCacheEntry e;
+			e.name = deSerializeString(is);
+			e.pos.X = readS32(is);
+			e.pos.Y = readS32(is);
+			e.dim.Width = readU32(is);
+			e.dim.Height = readU32(is);
+			e.tiled = readU16(is);
+			if(is.fail())
+				return false;
+			// The texture and its tiled copies must be in the atlas
+			if(e.pos.X < 0 || e.pos.Y < 0
+					|| e.dim.Width == 0 || e.dim.Height == 0
+					|| (u64)e.pos.X + (u64)MYMAX(e.tiled, 1) * e.dim.Width
+						> atlas_dim.Width
+					|| (u64)e.pos.Y + e.dim.Height > atlas_dim.Height)
+				return false;
+			read_entries.push_back(e);
+		}
+	}
+	catch(SerializationError &e)
+	{
+		return false;
+	}
+	if(is.fail())
+		return false;
+
+	video::IImage *img2 = driver->createImageFromFile(
+			(cache_name + ".png").c_str());
+	if(img2 == NULL)
+		return false;
+	if(img2->getDimension() != atlas_dim
+			|| img2->getColorFormat() != video::ECF_A8R8G8B8)
+	{
+		img2->drop();
+		return false;
+	}
+
+	*img = img2;
+	entries.clear();
+	for(core::list<AtlasCacheEntry>::Iterator i = read_entries.begin();
+			i != read_entries.end(); i++)
+		entries.push_back(*i);
+	return true;
+}
+
+static void writeAtlasCache(const std::string &cache_name,
+		video::IVideoDriver *driver, video::IImage *img,
+		core::list<AtlasCacheEntry> &entries)
+{
+	if(driver->writeImageToFile(img, (cache_name + ".png").c_str()) == false)
+	{
+		errorstream<<"TextureSource::buildMainAtlas(): Failed to write "
+				<<"cached atlas \""<<cache_name<<".png\""<<std::endl;
+		return;
+	}
+
+	std::ostringstream os(std::ios_base::binary);
+	writeU8(os, 1);
+	writeU32(os, entries.size());
+	for(core::list<AtlasCacheEntry>::Iterator i = entries.begin();
+			i != entries.end(); i++)
+	{
+		os<<serializeString(i->name);
+		writeS32(os, i->pos.X);
+		writeS32(os, i->pos.Y);
+		writeU32(os, i->dim.Width);
+		writeU32(os, i->dim.Height);
+		writeU16(os, i->tiled);
+	}
+
+	// The image is only used if this is complete
+	std::ofstream of((cache_name + ".atlas").c_str(),
+			std::ios_base::binary | std::ios_base::trunc);
+	of<<os.str();
+}
+
+/*
+	Adds the local files a texture is made of to the atlas cache key, so
+	that files changed in texture_path or the data directory are noticed.
+	Any part of the name between the delimiters of texture modifiers can
+	be a file name.
+*/
+static void addTextureFilesToDigest(SHA1 &sha1,
+		core::map<std::string, bool> &sourcelist)
+{
+	core::map<std::string, bool> paths;
+	for(core::map<std::string, bool>::Iterator
+			i = sourcelist.getIterator();
+			i.atEnd() == false; i++)
+	{
+		std::string name = i.getNode()->getKey();
+		std::string part;
+		for(u32 j=0; j<=name.size(); j++)
+		{
+			if(j < name.size() && name[j] != '^' && name[j] != '['
+					&& name[j] != ':' && name[j] != '='
+					&& name[j] != ',')
+			{
+				part += name[j];
+				continue;
+			}
+			if(part != "")
+			{
+				std::string path = getTexturePath(part);
+				if(path != "")
+					paths[path] = true;
+			}
+			part = "";
+		}
+	}
+
+	for(core::map<std::string, bool>::Iterator
+			i = paths.getIterator();
+			i.atEnd() == false; i++)
+	{
+		std::string path = i.getNode()->getKey();
+		std::ifstream is(path.c_str(), std::ios_base::binary);
+		std::ostringstream os(std::ios_base::binary);
+		os<<path<<"\n";
+		if(is.good())
+			os<<is.rdbuf();
+		std::string s = os.str();
+		sha1.addBytes(s.c_str(), s.size());
+	}
+}
+
+/*
+	The atlas cache keeps the ATLAS_CACHE_KEEP most recently used
+	atlases. Their names are listed in <dir>/index, most recent first;
+	the files of other atlases are deleted.
+*/
+#define ATLAS_CACHE_KEEP 8
+
+static void useAtlasCache(const std::string &dir, const std::string &id)
+{
+	core::list<std::string> ids;
+	ids.push_back(id);
+	{
+		std::ifstream is((dir + DIR_DELIM + "index").c_str());
+		std::string line;
+		while(std::getline(is, line) && ids.size() < ATLAS_CACHE_KEEP)
+		{
+			if(line != "" && line != id)
+				ids.push_back(line);
+		}
+	}
+	{
+		std::ofstream of((dir + DIR_DELIM + "index").c_str(),
+				std::ios_base::trunc);
+		for(core::list<std::string>::Iterator i = ids.begin();
+				i != ids.end(); i++)
+			of<<*i<<"\n";
+	}
+
+	std::vector<fs::DirListNode> list = fs::GetDirListing(dir);
+	for(u32 i=0; i<list.size(); i++)
+	{
+		const std::string &name = list[i].name;
+		if(list[i].dir || name == "index")
+			continue;
+		std::string file_id = name.substr(0, name.find('.'));
+		bool keep = false;
+		for(core::list<std::string>::Iterator j = ids.begin();
+				j != ids.end(); j++)
+		{
+			if(*j == file_id)
+			{
+				keep = true;
+				break;
+			}
+		}
+		if(keep == false)
+		{
+			infostream<<"Removing old cached atlas file \""
+					<<name<<"\""<<std::endl;
+			remove((dir + DIR_DELIM + name).c_str());
+		}
+	}
+}
+
 void TextureSource::buildMainAtlas(class IGameDef *gamedef) 
 {
 	assert(gamedef->tsrc() == this);
@@ -843,142 +1163,178 @@ void TextureSource::buildMainAtlas(class IGameDef *gamedef)
 	}
 	infostream<<std::endl;
 
-	// Padding to disallow texture bleeding
-	s32 padding = 16;
-
-	s32 column_width = 256;
-	s32 column_padding = 16;
-
 	/*
-		First pass: generate almost everything
+		The atlas is cached by the source images, both the announced ones
+		and the local files, and the names of the textures in it
 	*/
-	core::position2d<s32> pos_in_atlas(0,0);
-	
-	pos_in_atlas.Y = padding;
-
-	for(core::map<std::string, bool>::Iterator
-			i = sourcelist.getIterator();
-			i.atEnd() == false; i++)
+	std::string cache_id;
+	std::string cache_name;
+	if(m_atlas_cache_dir != "" && m_atlas_cache_digest != "")
 	{
-		std::string name = i.getNode()->getKey();
-
-		// Generate image by name
-		video::IImage *img2 = generate_image_from_scratch(name, m_device,
-				&m_sourcecache);
-		if(img2 == NULL)
+		SHA1 sha1;
+		std::string s = std::string("atlas1\n") + m_atlas_cache_digest + "\n";
+		sha1.addBytes(s.c_str(), s.size());
+		for(core::map<std::string, bool>::Iterator
+				i = sourcelist.getIterator();
+				i.atEnd() == false; i++)
 		{
-			errorstream<<"TextureSource::buildMainAtlas(): "
-					<<"Couldn't generate image \""<<name<<"\""<<std::endl;
-			continue;
+			std::string name = i.getNode()->getKey() + "\n";
+			sha1.addBytes(name.c_str(), name.size());
 		}
+		addTextureFilesToDigest(sha1, sourcelist);
+		unsigned char *digest = sha1.getDigest();
+		std::ostringstream os;
+		for(u32 i=0; i<20; i++)
+			os<<std::hex<<std::setw(2)<<std::setfill('0')<<(int)digest[i];
+		free(digest);
+		cache_id = os.str();
+		cache_name = m_atlas_cache_dir + DIR_DELIM + cache_id;
+	}
 
-		core::dimension2d<u32> dim = img2->getDimension();
-
-		// Don't add to atlas if image is large
-		core::dimension2d<u32> max_size_in_atlas(32,32);
-		if(dim.Width > max_size_in_atlas.Width
-		|| dim.Height > max_size_in_atlas.Height)
+	core::list<AtlasCacheEntry> entries;
+	bool loaded_from_cache = false;
+	if(cache_name != "")
+	{
+		video::IImage *cached_img = NULL;
+		if(readAtlasCache(cache_name, driver, atlas_dim, &cached_img,
+				entries))
 		{
-			infostream<<"TextureSource::buildMainAtlas(): Not adding "
-					<<"\""<<name<<"\" because image is large"<<std::endl;
-			continue;
+			infostream<<"TextureSource::buildMainAtlas(): Using cached "
+					<<"atlas \""<<cache_name<<"\""<<std::endl;
+			atlas_img->drop();
+			atlas_img = cached_img;
+			for(core::list<AtlasCacheEntry>::Iterator i = entries.begin();
+					i != entries.end(); i++)
+				addMainAtlasPointer(*i, atlas_img);
+			loaded_from_cache = true;
 		}
+	}
+
+	if(loaded_from_cache == false)
+	{
+		// Padding to disallow texture bleeding
+		s32 padding = 16;
 
-		// Wrap columns and stop making atlas if atlas is full
-		if(pos_in_atlas.Y + dim.Height > atlas_dim.Height)
+		s32 column_width = 256;
+		s32 column_padding = 16;
+
+		/*
+			First pass: generate almost everything
+		*/
+		core::position2d<s32> pos_in_atlas(0,0);
+		
+		pos_in_atlas.Y = padding;
+
+		for(core::map<std::string, bool>::Iterator
+				i = sourcelist.getIterator();
+				i.atEnd() == false; i++)
 		{
-			if(pos_in_atlas.X > (s32)atlas_dim.Width - 256 - padding){
+			std::string name = i.getNode()->getKey();
+
+			// Generate image by name
+			video::IImage *img2 = generate_image_from_scratch(name, m_device,
+					&m_sourcecache);
+			if(img2 == NULL)
+			{
 				errorstream<<"TextureSource::buildMainAtlas(): "
-						<<"Atlas is full, not adding more textures."
-						<<std::endl;
-				break;
+						<<"Couldn't generate image \""<<name<<"\""<<std::endl;
+				continue;
 			}
-			pos_in_atlas.Y = padding;
-			pos_in_atlas.X += column_width + column_padding;
-		}
-		
-		/*infostream<<"TextureSource::buildMainAtlas(): Adding \""<<name
-				<<"\" to texture atlas"<<std::endl;*/
-
-		// Tile it a few times in the X direction
-		u16 xwise_tiling = column_width / dim.Width;
-		if(xwise_tiling > 16) // Limit to 16 (more gives no benefit)
-			xwise_tiling = 16;
-		for(u32 j=0; j<xwise_tiling; j++)
-		{
-			// Copy the copy to the atlas
-			/*img2->copyToWithAlpha(atlas_img,
-					pos_in_atlas + v2s32(j*dim.Width,0),
-					core::rect<s32>(v2s32(0,0), dim),
-					video::SColor(255,255,255,255),
-					NULL);*/
-			img2->copyTo(atlas_img,
-					pos_in_atlas + v2s32(j*dim.Width,0),
-					core::rect<s32>(v2s32(0,0), dim),
-					NULL);
-		}
 
-		// Copy the borders a few times to disallow texture bleeding
-		for(u32 side=0; side<2; side++) // top and bottom
-		for(s32 y0=0; y0<padding; y0++)
-		for(s32 x0=0; x0<(s32)xwise_tiling*(s32)dim.Width; x0++)
-		{
-			s32 dst_y;
-			s32 src_y;
-			if(side==0)
+			core::dimension2d<u32> dim = img2->getDimension();
+
+			// Don't add to atlas if image is large
+			core::dimension2d<u32> max_size_in_atlas(32,32);
+			if(dim.Width > max_size_in_atlas.Width
+			|| dim.Height > max_size_in_atlas.Height)
 			{
-				dst_y = y0 + pos_in_atlas.Y + dim.Height;
-				src_y = pos_in_atlas.Y + dim.Height - 1;
+				infostream<<"TextureSource::buildMainAtlas(): Not adding "
+						<<"\""<<name<<"\" because image is large"<<std::endl;
+				continue;
 			}
-			else
+
+			// Wrap columns and stop making atlas if atlas is full
+			if(pos_in_atlas.Y + dim.Height > atlas_dim.Height)
 			{
-				dst_y = -y0 + pos_in_atlas.Y-1;
-				src_y = pos_in_atlas.Y;
+				if(pos_in_atlas.X > (s32)atlas_dim.Width - 256 - padding){
+					errorstream<<"TextureSource::buildMainAtlas(): "
+							<<"Atlas is full, not adding more textures."
+							<<std::endl;
+					break;
+				}
+				pos_in_atlas.Y = padding;
+				pos_in_atlas.X += column_width + column_padding;
+			}
+			
+			/*infostream<<"TextureSource::buildMainAtlas(): Adding \""<<name
+					<<"\" to texture atlas"<<std::endl;*/
+
+			// Tile it a few times in the X direction
+			u16 xwise_tiling = column_width / dim.Width;
+			if(xwise_tiling > 16) // Limit to 16 (more gives no benefit)
+				xwise_tiling = 16;
+			for(u32 j=0; j<xwise_tiling; j++)
+			{
+				// Copy the copy to the atlas
+				/*img2->copyToWithAlpha(atlas_img,
+						pos_in_atlas + v2s32(j*dim.Width,0),
+						core::rect<s32>(v2s32(0,0), dim),
+						video::SColor(255,255,255,255),
+						NULL);*/
+				img2->copyTo(atlas_img,
+						pos_in_atlas + v2s32(j*dim.Width,0),
+						core::rect<s32>(v2s32(0,0), dim),
+						NULL);
 			}
-			s32 x = x0 + pos_in_atlas.X;
-			video::SColor c = atlas_img->getPixel(x, src_y);
-			atlas_img->setPixel(x,dst_y,c);
-		}
 
-		img2->drop();
+			// Copy the borders a few times to disallow texture bleeding
+			for(u32 side=0; side<2; side++) // top and bottom
+			for(s32 y0=0; y0<padding; y0++)
+			for(s32 x0=0; x0<(s32)xwise_tiling*(s32)dim.Width; x0++)
+			{
+				s32 dst_y;
+				s32 src_y;
+				if(side==0)
+				{
+					dst_y = y0 + pos_in_atlas.Y + dim.Height;
+					src_y = pos_in_atlas.Y + dim.Height - 1;
+				}
+				else
+				{
+					dst_y = -y0 + pos_in_atlas.Y-1;
+					src_y = pos_in_atlas.Y;
+				}
+				s32 x = x0 + pos_in_atlas.X;
+				video::SColor c = atlas_img->getPixel(x, src_y);
+				atlas_img->setPixel(x,dst_y,c);
+			}
 
-		/*
-			Add texture to caches
-		*/
-		
-		bool reuse_old_id = false;
-		u32 id = m_atlaspointer_cache.size();
-		// Check old id without fetching a texture
-		core::map<std::string, u32>::Node *n;
-		n = m_name_to_id.find(name);
-		// If it exists, we will replace the old definition
-		if(n){
-			id = n->getValue();
-			reuse_old_id = true;
-			/*infostream<<"TextureSource::buildMainAtlas(): "
-					<<"Replacing old AtlasPointer"<<std::endl;*/
-		}
+			img2->drop();
 
-		// Create AtlasPointer
-		AtlasPointer ap(id);
-		ap.atlas = NULL; // Set on the second pass
-		ap.pos = v2f((float)pos_in_atlas.X/(float)atlas_dim.Width,
-				(float)pos_in_atlas.Y/(float)atlas_dim.Height);
-		ap.size = v2f((float)dim.Width/(float)atlas_dim.Width,
-				(float)dim.Width/(float)atlas_dim.Height);
-		ap.tiled = xwise_tiling;
-
-		// Create SourceAtlasPointer and add to containers
-		SourceAtlasPointer nap(name, ap, atlas_img, pos_in_atlas, dim);
-		if(reuse_old_id)
-			m_atlaspointer_cache[id] = nap;
-		else
-			m_atlaspointer_cache.push_back(nap);
-		m_name_to_id[name] = id;
+			/*
+				Add texture to caches
+			*/
 			
-		// Increment position
-		pos_in_atlas.Y += dim.Height + padding * 2;
+			AtlasCacheEntry e;
+			e.name = name;
+			e.pos = pos_in_atlas;
+			e.dim = dim;
+			e.tiled = xwise_tiling;
+			addMainAtlasPointer(e, atlas_img);
+			entries.push_back(e);
+			
+			// Increment position
+			pos_in_atlas.Y += dim.Height + padding * 2;
+		}
+
+		if(cache_name != "")
+		{
+			fs::CreateAllDirs(m_atlas_cache_dir);
+			writeAtlasCache(cache_name, driver, atlas_img, entries);
+		}
 	}
+	if(cache_name != "")
+		useAtlasCache(m_atlas_cache_dir, cache_id);
 
 	/*
 		Make texture
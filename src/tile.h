@@ -110,6 +110,8 @@ class ITextureSource
 		{return AtlasPointer(0);}
 	virtual video::ITexture* getTextureRaw(const std::string &name)
 		{return NULL;}
+	virtual video::SColor getTextureAverageColor(u32 id)
+		{return video::SColor(0,0,0,0);}
 	virtual void updateAP(AtlasPointer &ap){};
 };
 
@@ -126,12 +128,16 @@ class IWritableTextureSource : public ITextureSource
 		{return AtlasPointer(0);}
 	virtual video::ITexture* getTextureRaw(const std::string &name)
 		{return NULL;}
+	virtual video::SColor getTextureAverageColor(u32 id)
+		{return video::SColor(0,0,0,0);}
 	virtual void updateAP(AtlasPointer &ap){};
 
 	virtual void processQueue()=0;
 	virtual void insertSourceImage(const std::string &name, video::IImage *img)=0;
 	virtual void rebuildImagesAndTextures()=0;
 	virtual void buildMainAtlas(class IGameDef *gamedef)=0;
+	virtual void setAtlasCache(const std::string &dir,
+			const std::string &textures_digest)=0;
 };
 
 IWritableTextureSource* createTextureSource(IrrlichtDevice *device);
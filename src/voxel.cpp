@@ -232,6 +232,58 @@ void VoxelManipulator::copyTo(MapNode *dst, VoxelArea dst_area,
 	}
 }
 
+void VoxelManipulator::copyFromPlanes(const u8 *src_param0,
+		const u8 *src_param1, const u8 *src_param2, VoxelArea src_area,
+		v3s16 from_pos, v3s16 to_pos, v3s16 size)
+{
+	for(s16 z=0; z<size.Z; z++)
+	for(s16 y=0; y<size.Y; y++)
+	{
+		s32 i_src = src_area.index(from_pos.X, from_pos.Y+y, from_pos.Z+z);
+		s32 i_local = m_area.index(to_pos.X, to_pos.Y+y, to_pos.Z+z);
+		for(s16 x=0; x<size.X; x++)
+		{
+			MapNode &n = m_data[i_local+x];
+			n.param0 = src_param0[i_src+x];
+			n.param1 = src_param1[i_src+x];
+			n.param2 = src_param2[i_src+x];
+		}
+		memset(&m_flags[i_local], 0, size.X);
+	}
+}
+
+void VoxelManipulator::copyToPlanes(u8 *dst_param0, u8 *dst_param1,
+		u8 *dst_param2, VoxelArea dst_area,
+		v3s16 dst_pos, v3s16 from_pos, v3s16 size)
+{
+	for(s16 z=0; z<size.Z; z++)
+	for(s16 y=0; y<size.Y; y++)
+	{
+		s32 i_dst = dst_area.index(dst_pos.X, dst_pos.Y+y, dst_pos.Z+z);
+		s32 i_local = m_area.index(from_pos.X, from_pos.Y+y, from_pos.Z+z);
+		for(s16 x=0; x<size.X; x++)
+		{
+			const MapNode &n = m_data[i_local+x];
+			dst_param0[i_dst+x] = n.param0;
+			dst_param1[i_dst+x] = n.param1;
+			dst_param2[i_dst+x] = n.param2;
+		}
+	}
+}
+
+void VoxelManipulator::copyFromUniform(const MapNode &n, v3s16 to_pos,
+		v3s16 size)
+{
+	for(s16 z=0; z<size.Z; z++)
+	for(s16 y=0; y<size.Y; y++)
+	{
+		s32 i_local = m_area.index(to_pos.X, to_pos.Y+y, to_pos.Z+z);
+		for(s16 x=0; x<size.X; x++)
+			m_data[i_local+x] = n;
+		memset(&m_flags[i_local], 0, size.X);
+	}
+}
+
 /*
 	Algorithms
 	-----------------------------------------------------
@@ -316,7 +368,7 @@ void VoxelManipulator::unspreadLight(enum LightBank bank, v3s16 p, u8 oldlight,
 			/*
 				And the neighbor is transparent and it has some light
 			*/
-			if(nodemgr->get(n2).light_propagates && light2 != 0)
+			if(nodemgr->lightPropagates(n2.getContent()) && light2 != 0)
 			{
 				/*
 					Set light to 0 and add to queue
@@ -454,7 +506,7 @@ void VoxelManipulator::unspreadLight(enum LightBank bank,
 				/*
 					And the neighbor is transparent and it has some light
 				*/
-				if(nodemgr->get(n2).light_propagates && n2.getLight(bank, nodemgr) != 0)
+				if(nodemgr->lightPropagates(n2.getContent()) && n2.getLight(bank, nodemgr) != 0)
 				{
 					/*
 						Set light to 0 and add to queue
@@ -545,7 +597,7 @@ void VoxelManipulator::spreadLight(enum LightBank bank, v3s16 p,
 		*/
 		if(light2 < newlight)
 		{
-			if(nodemgr->get(n2).light_propagates)
+			if(nodemgr->lightPropagates(n2.getContent()))
 			{
 				n2.setLight(bank, newlight, nodemgr);
 				spreadLight(bank, n2pos, nodemgr);
@@ -652,7 +704,7 @@ void VoxelManipulator::spreadLight(enum LightBank bank,
 				*/
 				if(light2 < newlight)
 				{
-					if(nodemgr->get(n2).light_propagates)
+					if(nodemgr->lightPropagates(n2.getContent()))
 					{
 						n2.setLight(bank, newlight, nodemgr);
 						lighted_nodes.insert(n2pos, true);
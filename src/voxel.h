@@ -375,22 +375,30 @@ class VoxelManipulator /*: public NodeContainer*/
 
 		return m_data[m_area.index(p)];
 	}
-	MapNode getNodeNoEx(v3s16 p)
+	/*
+		These return CONTENT_IGNORE for inexistent nodes. If
+		is_valid_position is not NULL, it is set to whether the node
+		exists.
+	*/
+	MapNode getNodeNoEx(v3s16 p, bool *is_valid_position=NULL)
 	{
 		emerge(p);
 
-		if(m_flags[m_area.index(p)] & VOXELFLAG_INEXISTENT)
-		{
+		bool valid = !(m_flags[m_area.index(p)] & VOXELFLAG_INEXISTENT);
+		if(is_valid_position)
+			*is_valid_position = valid;
+		if(valid == false)
 			return MapNode(CONTENT_IGNORE);
-		}
 
 		return m_data[m_area.index(p)];
 	}
-	MapNode getNodeNoExNoEmerge(v3s16 p)
+	MapNode getNodeNoExNoEmerge(v3s16 p, bool *is_valid_position=NULL)
 	{
-		if(m_area.contains(p) == false)
-			return MapNode(CONTENT_IGNORE);
-		if(m_flags[m_area.index(p)] & VOXELFLAG_INEXISTENT)
+		bool valid = m_area.contains(p)
+				&& !(m_flags[m_area.index(p)] & VOXELFLAG_INEXISTENT);
+		if(is_valid_position)
+			*is_valid_position = valid;
+		if(valid == false)
 			return MapNode(CONTENT_IGNORE);
 		return m_data[m_area.index(p)];
 	}
@@ -493,6 +501,18 @@ class VoxelManipulator /*: public NodeContainer*/
 	void copyTo(MapNode *dst, VoxelArea dst_area,
 			v3s16 dst_pos, v3s16 from_pos, v3s16 size);
 
+	/*
+		Same as above, but for storage that keeps param0, param1
+		and param2 in separate planes (like MapBlock)
+	*/
+	void copyFromPlanes(const u8 *src_param0, const u8 *src_param1,
+			const u8 *src_param2, VoxelArea src_area,
+			v3s16 from_pos, v3s16 to_pos, v3s16 size);
+	void copyToPlanes(u8 *dst_param0, u8 *dst_param1, u8 *dst_param2,
+			VoxelArea dst_area, v3s16 dst_pos, v3s16 from_pos, v3s16 size);
+	// Set an area to a single node and set flags to 0
+	void copyFromUniform(const MapNode &n, v3s16 to_pos, v3s16 size);
+
 	/*
 		Algorithms
 	*/